@@ -0,0 +1,201 @@
+/****************************************************************************
+ * location_logger/host/bench/ahrs_bench.c
+ *
+ * Accuracy and cost of the Mahony filter in imu_ahrs.c with the IMU
+ * thread's gains, on synthetic 200 Hz samples with white noise and a
+ * residual gyro bias:
+ *
+ *   start    level, 2 s, from a single sample
+ *   rest     level, 3 s
+ *   tilt     roll to 30 degree at 30 degree/s, hold, roll back
+ *   turn     level, 10 degree/s for 18 s at 10 m/s, 1.7 m/s^2 sideways
+ *   brake    level, -4 m/s^2 for 3 s
+ *
+ * The largest roll/pitch error of each phase must stay within its limit;
+ * the turn and the braking pull the gravity reference unless the rate and
+ * |acc| gates hold it off.  The linear acceleration and the yaw
+ * drift are reported.  Every update is timed in ns and with cycles.h.
+ *
+ *   ahrs_bench [-s seed]
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "imu_ahrs.h"
+#include "cycles.h"
+#include "bench_common.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define RATE_HZ IMU_SAMPLE_RATE_HZ
+#define ACC_NOISE 0.03f // m/s^2 per sample
+#define GYR_NOISE 0.05f // degree/s per sample
+#define GYR_BIAS 0.05f // degree/s, left after bias and tempco
+
+#define SPEED 10.0f // m/s in the turn
+#define TURN_RATE 10.0f // degree/s
+#define BRAKE (-4.0f) // m/s^2
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct
+{
+  const char *name;
+  float seconds;
+  float roll_rate; // degree/s, true
+  float yaw_rate;
+  float forward; // m/s^2, true acceleration
+  float limit; // degree, roll/pitch error
+} phase_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const phase_t g_phases[] =
+{
+  { "start", 2.0f,   0.0f,      0.0f,  0.0f,  2.0f },
+  { "rest",  3.0f,   0.0f,      0.0f,  0.0f,  0.5f },
+  { "tilt",  1.0f,  30.0f,      0.0f,  0.0f,  1.0f },
+  { "hold",  5.0f,   0.0f,      0.0f,  0.0f,  0.5f },
+  { "tilt",  1.0f, -30.0f,      0.0f,  0.0f,  1.0f },
+  { "rest",  3.0f,   0.0f,      0.0f,  0.0f,  0.5f },
+  { "turn", 18.0f,   0.0f, TURN_RATE,  0.0f,  5.0f },
+  { "rest",  5.0f,   0.0f,      0.0f,  0.0f,  5.0f },
+  { "brake", 3.0f,   0.0f,      0.0f, BRAKE,  5.0f },
+  { "rest",  5.0f,   0.0f,      0.0f,  0.0f,  5.0f },
+};
+
+static imu_ahrs_t g_ahrs;
+static uint64_t g_update_ns[60 * RATE_HZ];
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, FAR char *argv[])
+{
+  const phase_t *ph;
+  const float dt = 1.0f / RATE_HZ;
+  int opt;
+  int p;
+  int k;
+  int steps;
+  int updates = 0;
+  int failures = 0;
+  float roll = 0.0f; // true, degree
+  float yaw = 0.0f;
+  float r;
+  float err;
+  float worst;
+  float lin_err;
+  float lin_worst;
+  float yaw_err;
+  uint64_t t0;
+  uint32_t start;
+  cycles_stats_t cycles = {0};
+  IMUAttitude att;
+  IMUData data;
+
+  while ((opt = getopt(argc, argv, "s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      bench_srand(strtoul(optarg, NULL, 0));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  cycles_init();
+  imu_ahrs_init(&g_ahrs, IMU_AHRS_KP, IMU_AHRS_KI, IMU_AHRS_ACC_TOL,
+                IMU_AHRS_RATE_MAX);
+  memset(&data, 0, sizeof(data));
+
+  printf("%-6s %6s %12s %8s %14s\n", "phase", "s", "tilt err max",
+         "limit", "lin err max");
+  for (p = 0; p < sizeof(g_phases) / sizeof(g_phases[0]); p++)
+  {
+    ph = &g_phases[p];
+    steps = (int)(ph->seconds * RATE_HZ + 0.5f);
+    worst = 0.0f;
+    lin_worst = 0.0f;
+    for (k = 0; k < steps; k++)
+    {
+      roll += ph->roll_rate * dt;
+      yaw += ph->yaw_rate * dt;
+      r = roll * (float)M_PI / 180.0f;
+
+      /* level apart from roll; IMUData axes are x forward, y left, z up,
+       * the turn is to the right, so the centripetal force is to -y
+       */
+
+      data.ax = ph->forward + ACC_NOISE * bench_gauss();
+      data.ay = CONST_G * sinf(r) -
+                SPEED * ph->yaw_rate * (float)M_PI / 180.0f +
+                ACC_NOISE * bench_gauss();
+      data.az = CONST_G * cosf(r) + ACC_NOISE * bench_gauss();
+      data.roll = ph->roll_rate + GYR_BIAS + GYR_NOISE * bench_gauss();
+      data.pitch = GYR_BIAS + GYR_NOISE * bench_gauss();
+      data.yaw = -ph->yaw_rate + GYR_BIAS + GYR_NOISE * bench_gauss();
+      data.timestamp_ns += 1000000000ull / RATE_HZ;
+
+      t0 = host_now_ns();
+      start = cycles_now();
+      imu_ahrs_update(&g_ahrs, &data, dt);
+      cycles_add(&cycles, start);
+      if (updates < sizeof(g_update_ns) / sizeof(g_update_ns[0]))
+      {
+        g_update_ns[updates++] = host_now_ns() - t0;
+      }
+
+      imu_ahrs_get(&g_ahrs, &data, &att);
+      err = fmaxf(fabsf(att.roll - roll), fabsf(att.pitch));
+      worst = fmaxf(worst, err);
+
+      /* true linear acceleration: forward, and the turn's centripetal
+       * to the right
+       */
+
+      lin_err = fabsf(att.lin_body[0] - ph->forward) +
+                fabsf(att.lin_body[1] -
+                      SPEED * ph->yaw_rate * (float)M_PI / 180.0f);
+      lin_worst = fmaxf(lin_worst, lin_err);
+    }
+
+    printf("%-6s %6.1f %12.2f %8.1f %14.2f%s\n", ph->name, ph->seconds,
+           worst, ph->limit, lin_worst, worst > ph->limit ? "  FAILED" : "");
+    failures += worst > ph->limit;
+  }
+
+  yaw_err = att.yaw - fmodf(yaw, 360.0f);
+  printf("yaw %.1f degree, true %.1f, drift %.2f degree "
+         "(%.2f degree/s bias, no heading reference)\n",
+         att.yaw, fmodf(yaw, 360.0f), yaw_err, GYR_BIAS);
+  printf("%u of %u samples gyro only\n", g_ahrs.gyro_only, g_ahrs.updates);
+
+  bench_report_ns("imu_ahrs_update", g_update_ns, updates);
+  printf("imu_ahrs_update %lu %s avg, %lu max\n",
+         (unsigned long)(cycles.total / cycles.count), CYCLES_UNIT,
+         (unsigned long)cycles.max);
+  printf("%s\n", failures ? "FAILED" : "ok");
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/****************************************************************************
+ * location_logger/host/bench/bench_common.c
+ *
+ * Timing and noise helpers shared by the host benchmarks.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_common.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static uint32_t g_bench_rand = 1;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int bench_cmp_u64(FAR const void *a, FAR const void *b)
+{
+  uint64_t x = *(FAR const uint64_t *)a;
+  uint64_t y = *(FAR const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_report_ns(FAR const char *label, FAR uint64_t *samples, int n)
+{
+  uint64_t sum = 0;
+  int i;
+
+  if (n <= 0)
+  {
+    printf("%-24s no samples\n", label);
+    return;
+  }
+
+  qsort(samples, n, sizeof(samples[0]), bench_cmp_u64);
+  for (i = 0; i < n; i++)
+  {
+    sum += samples[i];
+  }
+
+  printf("%-24s n=%-6d min %8llu  avg %8llu  p50 %8llu  p99 %8llu  "
+         "max %8llu ns\n",
+         label, n,
+         (unsigned long long)samples[0],
+         (unsigned long long)(sum / n),
+         (unsigned long long)samples[n / 2],
+         (unsigned long long)samples[(n * 99) / 100],
+         (unsigned long long)samples[n - 1]);
+}
+
+void bench_srand(uint32_t seed)
+{
+  /* xorshift32 sticks at zero */
+
+  g_bench_rand = seed | 1;
+}
+
+float bench_uniform(void)
+{
+  g_bench_rand ^= g_bench_rand << 13;
+  g_bench_rand ^= g_bench_rand >> 17;
+  g_bench_rand ^= g_bench_rand << 5;
+  return (g_bench_rand >> 8) * (1.0f / 16777216.0f) + 0.5f / 16777216.0f;
+}
+
+float bench_gauss(void)
+{
+  return sqrtf(-2.0f * logf(bench_uniform())) *
+         cosf(2.0f * (float)M_PI * bench_uniform());
+}
@@ -0,0 +1,45 @@
+/****************************************************************************
+ * location_logger/host/bench/bench_common.h
+ *
+ * Timing and noise helpers shared by the host benchmarks.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_BENCH_BENCH_COMMON_H
+#define __HOST_BENCH_BENCH_COMMON_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+
+#include "host_dev.h"
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+/* Sorts samples[] in place and prints min/avg/p50/p99/max in ns */
+
+void bench_report_ns(FAR const char *label, FAR uint64_t *samples, int n);
+
+/* Reproducible noise: xorshift32 seeded with bench_srand() (1 when never
+ * called), uniform in (0, 1) and standard normal by Box-Muller
+ */
+
+void bench_srand(uint32_t seed);
+float bench_uniform(void);
+float bench_gauss(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __HOST_BENCH_BENCH_COMMON_H */
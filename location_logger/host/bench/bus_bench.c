@@ -0,0 +1,300 @@
+/****************************************************************************
+ * location_logger/host/bench/bus_bench.c
+ *
+ * IMU FIFO drain latency on an I2C bus shared with other readers.  The
+ * virtual BMI270 holds the bus for the estimated SCL time of every
+ * transfer.  The IMU drains its FIFO with exec_dequeue_fifo() every
+ * 20 ms while low priority threads keep reading other registers back to
+ * back: first each on its own descriptor, as separate open() calls did,
+ * then all through one i2c_bus_t with the IMU at I2C_BUS_PRIO_IMU.  The
+ * drain time includes the wait for the bus; the "idle" row has no
+ * readers.
+ *
+ *   bus_bench [-s seconds]   run time per case, default 2 s
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "bmi270lib/i2c_bmi270.h"
+#include "bmi270lib/i2c_bus.h"
+#include "bmi270_sim.h"
+#include "bench_common.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define DRAIN_INTERVAL_NS (20 * 1000000ull)
+#define POLLERS (3)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct poller_s
+{
+  FAR const char *name;
+  uint8_t reg;
+  int len;
+  pthread_t thread;
+  i2c_ctrl_t i2c;
+  uint32_t reads;
+  uint32_t errors;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct poller_s g_pollers[POLLERS] =
+{
+  { "temperature", 0x22, 2 },
+  { "status",      0x03, 1 },
+  { "data",        0x0c, 12 },
+};
+
+static volatile bool g_running;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static FAR void *poller_main(FAR void *arg)
+{
+  FAR struct poller_s *p = arg;
+  uint8_t buf[16];
+
+  while (g_running)
+  {
+    if (i2c_reg_read(&p->i2c, p->reg, buf, p->len) < 0)
+    {
+      p->errors++;
+    }
+    else
+    {
+      p->reads++;
+    }
+  }
+
+  return NULL;
+}
+
+static void sleep_until(uint64_t deadline_ns)
+{
+  uint64_t now = host_now_ns();
+  struct timespec ts;
+
+  if (deadline_ns > now)
+  {
+    ts.tv_sec = (deadline_ns - now) / 1000000000ull;
+    ts.tv_nsec = (deadline_ns - now) % 1000000000ull;
+    nanosleep(&ts, NULL);
+  }
+}
+
+/* bus == NULL: every thread on its own descriptor */
+
+static int run_case(FAR const char *label, FAR i2c_bmi270_t *bmi270,
+                    FAR i2c_bus_t *bus, int pollers, int seconds)
+{
+  int drains = seconds * 1000000000ull / DRAIN_INTERVAL_NS;
+  int fd = bmi270->i2c.fd;
+  int i;
+  int n;
+  uint64_t t0;
+  uint64_t next;
+  FAR uint64_t *lat;
+  FAR struct poller_s *p;
+  bmi270_batch_t batch;
+  i2c_bus_stats_t bs;
+  i2c_bus_stats_t bs0;
+
+  lat = malloc(drains * sizeof(uint64_t));
+  if (lat == NULL)
+  {
+    return -1;
+  }
+
+  if (bus != NULL)
+  {
+    i2c_bus_attach(bus, &bmi270->i2c, I2C_BUS_PRIO_IMU);
+    i2c_bus_get_stats(bus, &bs0);
+  }
+
+  g_running = true;
+  for (i = 0; i < pollers; i++)
+  {
+    p = &g_pollers[i];
+    memset(&p->i2c, 0, sizeof(p->i2c));
+    p->i2c.i2c_addr = BMI270_I2C_ADDRESS;
+    p->i2c.speed = I2C_SPEED;
+    if (bus != NULL)
+    {
+      i2c_bus_attach(bus, &p->i2c, I2C_BUS_PRIO_LOW);
+    }
+    else
+    {
+      p->i2c.fd = open(I2C_DEVNAME_FOR_BMI270, O_WRONLY);
+    }
+
+    p->reads = 0;
+    p->errors = 0;
+    pthread_create(&p->thread, NULL, poller_main, p);
+  }
+
+  exec_dequeue_fifo(bmi270);
+  get_fifo_batch(&batch, bmi270);
+  next = host_now_ns();
+  for (n = 0; n < drains; n++)
+  {
+    next += DRAIN_INTERVAL_NS;
+    sleep_until(next);
+
+    t0 = host_now_ns();
+    if (exec_dequeue_fifo(bmi270) < 0)
+    {
+      printf("ERROR: Failed to Dequeue\n");
+      break;
+    }
+
+    lat[n] = host_now_ns() - t0;
+    get_fifo_batch(&batch, bmi270);
+  }
+
+  g_running = false;
+  for (i = 0; i < pollers; i++)
+  {
+    p = &g_pollers[i];
+    pthread_join(p->thread, NULL);
+    if (bus == NULL)
+    {
+      close(p->i2c.fd);
+    }
+  }
+
+  printf("%s\n", label);
+  bench_report_ns("  drain", lat, n);
+  for (i = 0; i < pollers; i++)
+  {
+    p = &g_pollers[i];
+    printf("  %-12s %3d bytes %8.0f reads/s %u errors\n", p->name, p->len,
+           (double)p->reads / seconds, p->errors);
+  }
+
+  if (bus != NULL)
+  {
+    i2c_bus_get_stats(bus, &bs);
+    printf("  bus: %u requests in %u transfers, %u split\n",
+           bs.requests - bs0.requests, bs.transfers - bs0.transfers,
+           bs.split - bs0.split);
+    for (i = I2C_BUS_PRIORITIES - 1; i >= 0; i--)
+    {
+      n = bs.prio[i].requests - bs0.prio[i].requests;
+      if (n == 0)
+      {
+        continue;
+      }
+
+      printf("  prio %d: %7d requests, %6.1f%% batched, "
+             "wait avg %6.1f us max %6u us\n", i, n,
+             100.0 * (bs.prio[i].batched - bs0.prio[i].batched) / n,
+             (double)(bs.prio[i].wait_us - bs0.prio[i].wait_us) / n,
+             bs.prio[i].max_wait_us);
+    }
+
+    bmi270->i2c.bus = NULL;
+    bmi270->i2c.fd = fd;
+  }
+
+  free(lat);
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, FAR char *argv[])
+{
+  int fd;
+  int opt;
+  int seconds = 2;
+  i2c_bmi270_t bmi270 = {0};
+  i2c_bus_t *bus;
+  struct bmi270_sim_config_s config = {0};
+
+  while ((opt = getopt(argc, argv, "s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      seconds = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seconds]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* Real time sensor, bus time only once initialised */
+
+  config.time_scale = 1.0f;
+  config.acc_noise_g = 0.002f;
+  config.gyr_noise_dps = 0.05f;
+  config.temperature_c = 25.0f;
+  config.seed = 1;
+  bmi270_sim_configure(&config);
+
+  bmi270.i2c.i2c_addr = BMI270_I2C_ADDRESS;
+  bmi270.i2c.speed = I2C_SPEED;
+  fd = open(I2C_DEVNAME_FOR_BMI270, O_WRONLY);
+  if (fd < 0)
+  {
+    printf("ERROR: Failed to open %s\n", I2C_DEVNAME_FOR_BMI270);
+    return EXIT_FAILURE;
+  }
+
+  bmi270.i2c.fd = fd;
+  if (init_bmi270(&bmi270) < 0)
+  {
+    printf("ERROR: Failed to initialize\n");
+    fini_bmi270(&bmi270);
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  config.bus_realtime = true;
+  bmi270_sim_configure(&config);
+
+  bus = i2c_bus_open(I2C_DEVNAME_FOR_BMI270);
+  if (bus == NULL)
+  {
+    printf("ERROR: Failed to open the shared bus\n");
+    fini_bmi270(&bmi270);
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  printf("I2C %d kHz, IMU drain every %llu ms, %d s per case\n",
+         I2C_SPEED / 1000, DRAIN_INTERVAL_NS / 1000000ull, seconds);
+  run_case("idle", &bmi270, NULL, 0, seconds);
+  run_case("own descriptors, 3 readers", &bmi270, NULL, POLLERS, seconds);
+  run_case("shared bus, 3 readers", &bmi270, bus, POLLERS, seconds);
+
+  i2c_bus_close(bus);
+  fini_bmi270(&bmi270);
+  close(fd);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/****************************************************************************
+ * location_logger/host/bench/convert_bench.c
+ *
+ * Microbenchmark of bmi270_convert() on a typical 50 ms drain and on a
+ * full FIFO worth of samples.  First every int16 value is converted with
+ * the scale of every ACC and GYR range, and each result must be bit
+ * identical to the float product of the value and the scale, so a kernel
+ * that rounds differently fails the run.
+ *
+ *   convert_bench [-t ms]   time budget per case, default 50 ms
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bmi270lib/i2c_bmi270.h"
+#include "bmi270lib/bmi270_convert.h"
+#include "bench_common.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SWEEP_SAMPLES (65536 / 3 + 1)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const int g_counts[] =
+{
+  10, 20, BMI270_STORE_TABLE_LENGTH
+};
+
+static axis_t g_src[SWEEP_SAMPLES];
+static float g_dst[SWEEP_SAMPLES * 3];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/**
+ * @brief convert all int16 values with one scale
+ *
+ * @return int 0, or 1 when a result differs from raw * scale
+ */
+
+static int check_scale(FAR const char *name, float scale)
+{
+  int i;
+  float expect;
+
+  for (i = 0; i < SWEEP_SAMPLES * 3; i++)
+  {
+    (&g_src[0].x)[i] = (int16_t)(i - 32768);
+  }
+
+  memset(g_dst, 0xff, sizeof(g_dst));
+  bmi270_convert(g_dst, g_src, SWEEP_SAMPLES, scale);
+  for (i = 0; i < SWEEP_SAMPLES * 3; i++)
+  {
+    expect = (float)(&g_src[0].x)[i] * scale;
+    if (memcmp(&g_dst[i], &expect, sizeof(float)) != 0)
+    {
+      printf("%-16s raw %6d: %.9g != %.9g MISMATCH\n", name,
+             (&g_src[0].x)[i], g_dst[i], expect);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static uint64_t time_convert(int n, int budget_ms, FAR uint64_t *iters)
+{
+  uint64_t t0;
+  uint64_t elapsed;
+  int b;
+
+  *iters = 0;
+  t0 = host_now_ns();
+  do
+  {
+    for (b = 0; b < 256; b++)
+    {
+      bmi270_convert(g_dst, g_src, n, 0.0023928f);
+    }
+
+    *iters += 256;
+    elapsed = host_now_ns() - t0;
+  }
+  while (elapsed < budget_ms * 1000000ull);
+
+  return elapsed;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, FAR char *argv[])
+{
+  int budget_ms = 50;
+  int failures = 0;
+  int opt;
+  int r;
+  int ranges = 0;
+  int c;
+  uint64_t iters;
+  uint64_t elapsed;
+  char name[16];
+  bmi270_config_t config;
+
+  while ((opt = getopt(argc, argv, "t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      budget_ms = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t ms]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  bmi270_default_config(&config);
+  for (r = BMI270_ACC_RANGE_2G; r <= BMI270_ACC_RANGE_16G; r++)
+  {
+    config.acc_range = r;
+    snprintf(name, sizeof(name), "acc range %d", r);
+    failures += check_scale(name, bmi270_acc_scale(&config));
+    ranges++;
+  }
+
+  for (r = BMI270_GYR_RANGE_2000DPS; r <= BMI270_GYR_RANGE_125DPS; r++)
+  {
+    config.gyr_range = r;
+    snprintf(name, sizeof(name), "gyr range %d", r);
+    failures += check_scale(name, bmi270_gyr_scale(&config));
+    ranges++;
+  }
+
+  printf("all int16 values, %d ranges: %s\n", ranges,
+         failures ? "MISMATCH" : "bit identical");
+
+  printf("%7s %10s %10s\n", "samples", "ns/sample", "Msample/s");
+  for (c = 0; c < sizeof(g_counts) / sizeof(g_counts[0]); c++)
+  {
+    elapsed = time_convert(g_counts[c], budget_ms, &iters);
+    printf("%7d %10.2f %10.1f\n", g_counts[c],
+           (double)elapsed / (iters * g_counts[c]),
+           (double)iters * g_counts[c] * 1e3 / elapsed);
+  }
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
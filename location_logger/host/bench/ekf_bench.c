@@ -0,0 +1,315 @@
+/****************************************************************************
+ * location_logger/host/bench/ekf_bench.c
+ *
+ * Accuracy and cost of the GNSS/INS filter in ins_ekf.c on a synthetic
+ * drive: straight, a 100 m radius circle, straight again, at 10 m/s.  The
+ * IMU samples carry a constant bias and white noise, the 1 Hz fixes white
+ * noise.  Errors against the true trajectory are taken just before each
+ * fix, i.e. after a second of dead reckoning, once the filter settled;
+ * the run fails when they exceed sane limits.  Every predict and update
+ * is timed in ns and with cycles.h.
+ *
+ *   ekf_bench [-r hz] [-s seed]   IMU rate, default 200 Hz
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "ins_ekf.h"
+#include "cycles.h"
+#include "bench_common.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SPEED 10.0f // m/s
+#define RADIUS 100.0f // m
+#define STRAIGHT_S 30 // before and after the circle
+#define CIRCLE_S 120
+#define DURATION_S (STRAIGHT_S + CIRCLE_S + STRAIGHT_S)
+#define SETTLE_S 60 // errors counted from here
+
+#define LAT0 35.681236
+#define LON0 139.767125
+#define ALT0 40.0
+
+#define ACC_NOISE 0.03f // m/s^2 per sample
+#define GYR_NOISE 0.05f // degree/s per sample
+#define POS_NOISE 1.5f // m
+#define ALT_NOISE 3.0f
+#define VEL_NOISE 0.1f // m/s
+
+#define LIMIT_POS 4.0f // m rms
+#define LIMIT_VEL 0.3f // m/s rms
+#define LIMIT_TILT 1.0f // degree rms
+#define LIMIT_YAW 3.0f
+#define LIMIT_GYR_BIAS 0.05f // degree/s, z at the end
+#define LIMIT_ACC_BIAS 0.05f // m/s^2, horizontal at the end
+
+#define WGS84_A 6378137.0
+#define WGS84_E2 6.69437999014e-3
+#define DEG_TO_RAD (M_PI / 180.0)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const float g_acc_bias[3] = { 0.08f, -0.05f, 0.1f }; // IMUData axes
+static const float g_gyr_bias[3] = { 0.3f, -0.2f, 0.25f }; // degree/s
+
+static ins_ekf_t g_ekf;
+static uint64_t g_predict_ns[DURATION_S * 400];
+static uint64_t g_update_ns[DURATION_S];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static float wrap_deg(float a)
+{
+  while (a > 180.0f)
+  {
+    a -= 360.0f;
+  }
+
+  while (a < -180.0f)
+  {
+    a += 360.0f;
+  }
+
+  return a;
+}
+
+/**
+ * @brief noisy fix at north, east (m from the start) and true velocity
+ */
+
+static void make_fix(ins_ekf_fix_t *fix, double n, double e, float vn,
+                     float ve)
+{
+  double s = sin(LAT0 * DEG_TO_RAD);
+  double d = 1.0 - WGS84_E2 * s * s;
+  double m_per_rad_n = WGS84_A * (1.0 - WGS84_E2) / (d * sqrt(d)) + ALT0;
+  double m_per_rad_e = (WGS84_A / sqrt(d) + ALT0) * cos(LAT0 * DEG_TO_RAD);
+
+  fix->latitude = LAT0 + (n + POS_NOISE * bench_gauss()) / m_per_rad_n /
+                  DEG_TO_RAD;
+  fix->longitude = LON0 + (e + POS_NOISE * bench_gauss()) / m_per_rad_e /
+                   DEG_TO_RAD;
+  fix->altitude = ALT0 + ALT_NOISE * bench_gauss();
+  fix->vn = vn + VEL_NOISE * bench_gauss();
+  fix->ve = ve + VEL_NOISE * bench_gauss();
+  fix->altitude_valid = true;
+}
+
+/**
+ * @brief true position as north, east (m) of a fused latitude, longitude
+ */
+
+static void to_ned(const ins_ekf_state_t *state, double *n, double *e)
+{
+  double s = sin(LAT0 * DEG_TO_RAD);
+  double d = 1.0 - WGS84_E2 * s * s;
+
+  *n = (state->latitude - LAT0) * DEG_TO_RAD *
+       (WGS84_A * (1.0 - WGS84_E2) / (d * sqrt(d)) + ALT0);
+  *e = (state->longitude - LON0) * DEG_TO_RAD *
+       (WGS84_A / sqrt(d) + ALT0) * cos(LAT0 * DEG_TO_RAD);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, FAR char *argv[])
+{
+  int rate = 200;
+  int opt;
+  int steps;
+  int step;
+  int predicts = 0;
+  int updates = 0;
+  int scored = 0;
+  int failures = 0;
+  float dt;
+  float t;
+  float w;
+  float psi = 0.0f;
+  float vn;
+  float ve;
+  double n = 0.0;
+  double e = 0.0;
+  double fn;
+  double fe;
+  double err_pos = 0.0;
+  double err_vel = 0.0;
+  double err_tilt = 0.0;
+  double err_yaw = 0.0;
+  float gyr_bias_err;
+  float acc_bias_err;
+  uint64_t t0;
+  uint32_t start;
+  cycles_stats_t predict_cycles = {0};
+  cycles_stats_t update_cycles = {0};
+  ins_ekf_config_t config;
+  ins_ekf_state_t state;
+  ins_ekf_fix_t fix;
+  IMUData data;
+
+  while ((opt = getopt(argc, argv, "r:s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 's':
+      bench_srand(strtoul(optarg, NULL, 0));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r hz] [-s seed]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (rate < 1 || rate > 400)
+  {
+    fprintf(stderr, "rate 1 .. 400 Hz\n");
+    return EXIT_FAILURE;
+  }
+
+  cycles_init();
+  ins_ekf_default_config(&config);
+  ins_ekf_init(&g_ekf, &config);
+
+  dt = 1.0f / rate;
+  steps = DURATION_S * rate;
+  for (step = 0; step <= steps; step++)
+  {
+    t = step * dt;
+
+    /* fix at every whole second, for the state of the last sample */
+
+    if (step % rate == 0)
+    {
+      make_fix(&fix, n, e, SPEED * cosf(psi), SPEED * sinf(psi));
+      if (!g_ekf.started)
+      {
+        /* level on the first sample, heading from the course */
+
+        memset(&data, 0, sizeof(data));
+        data.az = CONST_G;
+        ins_ekf_start(&g_ekf, &fix, &data, atan2f(fix.ve, fix.vn),
+                      0.1f);
+      }
+      else
+      {
+        if (t >= SETTLE_S)
+        {
+          ins_ekf_get(&g_ekf, &state);
+          to_ned(&state, &fn, &fe);
+          vn = SPEED * cosf(psi);
+          ve = SPEED * sinf(psi);
+          err_pos += (fn - n) * (fn - n) + (fe - e) * (fe - e);
+          err_vel += (state.v[0] - vn) * (state.v[0] - vn) +
+                     (state.v[1] - ve) * (state.v[1] - ve);
+          err_tilt += (state.roll * state.roll + state.pitch * state.pitch) /
+                      (DEG_TO_RAD * DEG_TO_RAD);
+          err_yaw += pow(wrap_deg((state.yaw - psi) / DEG_TO_RAD), 2);
+          scored++;
+        }
+
+        t0 = host_now_ns();
+        start = cycles_now();
+        ins_ekf_update(&g_ekf, &fix);
+        cycles_add(&update_cycles, start);
+        g_update_ns[updates++] = host_now_ns() - t0;
+      }
+    }
+
+    if (step == steps)
+    {
+      break;
+    }
+
+    /* true motion over the next sample period */
+
+    w = t >= STRAIGHT_S && t < STRAIGHT_S + CIRCLE_S ? SPEED / RADIUS : 0.0f;
+    n += SPEED * cosf(psi + 0.5f * w * dt) * dt;
+    e += SPEED * sinf(psi + 0.5f * w * dt) * dt;
+    psi += w * dt;
+
+    /* level, so the IMU sees the centripetal acceleration to the right
+     * (y negative) and the turn around z down (yaw negative)
+     */
+
+    data.ax = g_acc_bias[0] + ACC_NOISE * bench_gauss();
+    data.ay = -SPEED * w + g_acc_bias[1] + ACC_NOISE * bench_gauss();
+    data.az = CONST_G + g_acc_bias[2] + ACC_NOISE * bench_gauss();
+    data.roll = g_gyr_bias[0] + GYR_NOISE * bench_gauss();
+    data.pitch = g_gyr_bias[1] + GYR_NOISE * bench_gauss();
+    data.yaw = -w / DEG_TO_RAD + g_gyr_bias[2] + GYR_NOISE * bench_gauss();
+    data.timestamp_ns = (uint64_t)(step + 1) * 1000000000ull / rate;
+
+    t0 = host_now_ns();
+    start = cycles_now();
+    ins_ekf_predict(&g_ekf, &data, dt);
+    cycles_add(&predict_cycles, start);
+    g_predict_ns[predicts++] = host_now_ns() - t0;
+  }
+
+  err_pos = sqrt(err_pos / scored);
+  err_vel = sqrt(err_vel / scored);
+  err_tilt = sqrt(err_tilt / scored);
+  err_yaw = sqrt(err_yaw / scored);
+  ins_ekf_get(&g_ekf, &state);
+
+  /* the filter estimates the bias in the body frame: z down */
+
+  gyr_bias_err = fabsf(-state.gyr_bias[2] / (float)DEG_TO_RAD -
+                       g_gyr_bias[2]);
+  acc_bias_err = hypotf(state.acc_bias[0] - g_acc_bias[0],
+                        -state.acc_bias[1] - g_acc_bias[1]);
+
+  printf("%d s at %d Hz, %d fixes (%u rejected, %u resets), "
+         "errors before the fix after %d s:\n",
+         DURATION_S, rate, updates, g_ekf.rejects, g_ekf.resets, SETTLE_S);
+  printf("  position %.2f m rms, velocity %.3f m/s rms\n", err_pos,
+         err_vel);
+  printf("  roll/pitch %.2f, yaw %.2f degree rms\n", err_tilt, err_yaw);
+  printf("  gyro z bias %.3f degree/s off, accel bias %.3f %.3f %.3f m/s^2"
+         " (true %.3f %.3f %.3f), %.3f m/s^2 off horizontally\n",
+         gyr_bias_err, state.acc_bias[0], -state.acc_bias[1],
+         -state.acc_bias[2], g_acc_bias[0], g_acc_bias[1], g_acc_bias[2],
+         acc_bias_err);
+
+  failures += err_pos > LIMIT_POS;
+  failures += err_vel > LIMIT_VEL;
+  failures += err_tilt > LIMIT_TILT;
+  failures += err_yaw > LIMIT_YAW;
+  failures += gyr_bias_err > LIMIT_GYR_BIAS;
+  failures += acc_bias_err > LIMIT_ACC_BIAS;
+
+  bench_report_ns("ins_ekf_predict", g_predict_ns, predicts);
+  bench_report_ns("ins_ekf_update", g_update_ns, updates);
+  printf("ins_ekf_predict %lu %s avg, %lu max\n",
+         (unsigned long)(predict_cycles.total / predict_cycles.count),
+         CYCLES_UNIT, (unsigned long)predict_cycles.max);
+  printf("ins_ekf_update %lu %s avg, %lu max\n",
+         (unsigned long)(update_cycles.total / update_cycles.count),
+         CYCLES_UNIT, (unsigned long)update_cycles.max);
+  printf("ins_ekf_t %zu bytes\n", sizeof(g_ekf));
+  printf("%s\n", failures ? "FAILED" : "ok");
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,348 @@
+/****************************************************************************
+ * location_logger/host/bench/fifo_bench.c
+ *
+ * Microbenchmark of bmi270_fifo_decoder() on synthetic header-mode FIFOs
+ * of several frame mixes and depths up to BMI270_FIFO_MAX_LENGTH, and of
+ * bmi270_fifo_decoder_headerless() on the same depths; compare its rows
+ * with "acc+gyr", which carries the same samples with headers.  The
+ * decoded sample counts are checked against the generated ones, so a
+ * decoder regression fails the run.
+ *
+ *   fifo_bench [-t ms]   time budget per case, default 50 ms
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bmi270lib/i2c_bmi270.h"
+#include "bench_common.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define FRAME_ACC     (0)
+#define FRAME_GYR     (1)
+#define FRAME_ACC_GYR (2)
+#define FRAME_SKIP    (3)
+#define FRAME_CFG     (4)
+#define FRAME_END     (-1)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct fifo_mix_s
+{
+  FAR const char *name;
+  int pattern[8];       /* Repeated until the depth is reached */
+  int sensortime;       /* Terminate with a sensortime frame */
+};
+
+typedef void (*decoder_t)(FAR i2c_bmi270_t *pctrl);
+
+struct fifo_case_s
+{
+  int depth;
+  int frames;
+  int acc;
+  int gyr;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const struct fifo_mix_s g_mixes[] =
+{
+  { "acc+gyr",         { FRAME_ACC_GYR, FRAME_END }, 0 },
+  { "gyr200/acc100",   { FRAME_ACC_GYR, FRAME_GYR, FRAME_END }, 0 },
+  { "acc only",        { FRAME_ACC, FRAME_END }, 0 },
+  { "gyr only",        { FRAME_GYR, FRAME_END }, 0 },
+  { "ctrl-heavy",      { FRAME_ACC_GYR, FRAME_SKIP, FRAME_GYR, FRAME_CFG,
+                         FRAME_END }, 1 },
+};
+
+static const int g_depths[] =
+{
+  256, 1024, BMI270_FIFO_MAX_LENGTH
+};
+
+static uint8_t g_fifo[BMI270_FIFO_MAX_LENGTH];
+static axis_t g_acc_table[BMI270_STORE_TABLE_LENGTH];
+static axis_t g_gyr_table[BMI270_STORE_TABLE_LENGTH];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int put_axis(FAR uint8_t *p, int seed)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+  {
+    int16_t v = (int16_t)(seed * 31 + i * 1000);
+
+    p[i * 2] = v & 0xff;
+    p[i * 2 + 1] = (v >> 8) & 0xff;
+  }
+
+  return 6;
+}
+
+static int frame_size(int kind)
+{
+  switch (kind)
+  {
+  case FRAME_ACC:
+  case FRAME_GYR:
+    return 7;
+  case FRAME_ACC_GYR:
+    return 13;
+  case FRAME_SKIP:
+    return 2;
+  default:
+    return 5;
+  }
+}
+
+/**
+ * @brief fill g_fifo with whole frames of a mix up to max_depth bytes
+ */
+
+static void build_fifo(FAR const struct fifo_mix_s *mix, int max_depth,
+                       FAR struct fifo_case_s *c)
+{
+  int limit = max_depth - (mix->sensortime ? 4 : 0);
+  int pos = 0;
+  int k = 0;
+  int kind;
+
+  memset(c, 0, sizeof(*c));
+
+  while (1)
+  {
+    kind = mix->pattern[k];
+    if (kind == FRAME_END)
+    {
+      k = 0;
+      kind = mix->pattern[0];
+    }
+
+    if (pos + frame_size(kind) > limit)
+    {
+      break;
+    }
+
+    switch (kind)
+    {
+    case FRAME_ACC:
+      g_fifo[pos++] = 0x84;
+      pos += put_axis(&g_fifo[pos], c->frames);
+      c->acc++;
+      break;
+    case FRAME_GYR:
+      g_fifo[pos++] = 0x88;
+      pos += put_axis(&g_fifo[pos], c->frames);
+      c->gyr++;
+      break;
+    case FRAME_ACC_GYR:
+      g_fifo[pos++] = 0x8c;
+      pos += put_axis(&g_fifo[pos], c->frames);
+      pos += put_axis(&g_fifo[pos], c->frames + 1);
+      c->acc++;
+      c->gyr++;
+      break;
+    case FRAME_SKIP:
+      g_fifo[pos++] = 0x40;
+      g_fifo[pos++] = 0x01;
+      break;
+    case FRAME_CFG:
+      g_fifo[pos++] = 0x48;
+      g_fifo[pos++] = 0xa8;
+      g_fifo[pos++] = 0x02;
+      g_fifo[pos++] = 0xa9;
+      g_fifo[pos++] = 0x02;
+      break;
+    }
+
+    c->frames++;
+    k++;
+  }
+
+  if (mix->sensortime)
+  {
+    g_fifo[pos++] = 0x44;
+    g_fifo[pos++] = 0x12;
+    g_fifo[pos++] = 0x34;
+    g_fifo[pos++] = 0x00;
+    c->frames++;
+  }
+
+  c->depth = pos;
+}
+
+/**
+ * @brief fill g_fifo with header-less GYR+ACC frames up to max_depth bytes
+ */
+
+static void build_fifo_headerless(int max_depth, FAR struct fifo_case_s *c)
+{
+  int pos = 0;
+
+  memset(c, 0, sizeof(*c));
+
+  while (pos + BMI270_FIFO_HEADERLESS_FRAME_LENGTH <= max_depth)
+  {
+    pos += put_axis(&g_fifo[pos], c->frames);
+    pos += put_axis(&g_fifo[pos], c->frames + 1);
+    c->frames++;
+    c->acc++;
+    c->gyr++;
+  }
+
+  c->depth = pos;
+}
+
+/**
+ * @brief decode ctrl->fifo repeatedly for budget_ms
+ *
+ * @param iters decodes done [output]
+ * @return uint64_t elapsed ns
+ */
+
+static uint64_t time_decoder(decoder_t decoder, FAR i2c_bmi270_t *ctrl,
+                             int budget_ms, FAR uint64_t *iters)
+{
+  uint64_t t0;
+  uint64_t elapsed;
+  int b;
+
+  /* Batches keep the clock reads out of the measurement */
+
+  *iters = 0;
+  t0 = host_now_ns();
+  do
+  {
+    for (b = 0; b < 64; b++)
+    {
+      ctrl->acc_table_pos = 0;
+      ctrl->gyr_table_pos = 0;
+      decoder(ctrl);
+    }
+
+    *iters += 64;
+    elapsed = host_now_ns() - t0;
+  }
+  while (elapsed < budget_ms * 1000000ull);
+
+  return elapsed;
+}
+
+/**
+ * @brief check the decoded counts once, then time the decoder
+ *
+ * @return int 0, or 1 on a count mismatch
+ */
+
+static int run_case(FAR const char *name, decoder_t decoder,
+                    FAR i2c_bmi270_t *ctrl,
+                    FAR const struct fifo_case_s *c, int budget_ms)
+{
+  uint64_t iters;
+  uint64_t elapsed;
+
+  ctrl->fifo_depth = c->depth;
+  ctrl->acc_table_pos = 0;
+  ctrl->gyr_table_pos = 0;
+  decoder(ctrl);
+  if (ctrl->acc_table_pos != c->acc || ctrl->gyr_table_pos != c->gyr)
+  {
+    printf("%-16s %6d decoded acc %d/%d gyr %d/%d: MISMATCH\n",
+           name, c->depth, ctrl->acc_table_pos, c->acc,
+           ctrl->gyr_table_pos, c->gyr);
+    return 1;
+  }
+
+  elapsed = time_decoder(decoder, ctrl, budget_ms, &iters);
+  printf("%-16s %6d %7d %10.2f %10.1f\n",
+         name, c->depth, c->frames,
+         (double)elapsed / (iters * c->frames),
+         (double)c->depth * iters * 1e3 / elapsed);
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, FAR char *argv[])
+{
+  int budget_ms = 50;
+  int failures = 0;
+  int opt;
+  int m;
+  int d;
+  i2c_bmi270_t ctrl = {0};
+  struct fifo_case_s c;
+
+  while ((opt = getopt(argc, argv, "t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      budget_ms = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t ms]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  ctrl.fifo = g_fifo;
+  ctrl.acc_table = g_acc_table;
+  ctrl.gyr_table = g_gyr_table;
+
+  printf("%-16s %6s %7s %10s %10s\n",
+         "mix", "depth", "frames", "ns/frame", "MB/s");
+
+  for (m = 0; m < sizeof(g_mixes) / sizeof(g_mixes[0]); m++)
+  {
+    for (d = 0; d < sizeof(g_depths) / sizeof(g_depths[0]); d++)
+    {
+      build_fifo(&g_mixes[m], g_depths[d], &c);
+      if (run_case(g_mixes[m].name, bmi270_fifo_decoder, &ctrl, &c,
+                   budget_ms) != 0)
+      {
+        failures++;
+        continue;
+      }
+
+      if (g_mixes[m].sensortime &&
+          (!ctrl.fifo_time_valid || ctrl.fifo_time != 0x003412))
+      {
+        printf("%-16s %6d sensortime not decoded: MISMATCH\n",
+               g_mixes[m].name, c.depth);
+        failures++;
+      }
+    }
+  }
+
+  for (d = 0; d < sizeof(g_depths) / sizeof(g_depths[0]); d++)
+  {
+    build_fifo_headerless(g_depths[d], &c);
+    failures += run_case("headerless", bmi270_fifo_decoder_headerless,
+                         &ctrl, &c, budget_ms);
+  }
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
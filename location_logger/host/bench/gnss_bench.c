@@ -0,0 +1,146 @@
+/****************************************************************************
+ * location_logger/host/bench/gnss_bench.c
+ *
+ * Per-fix latency of gnss_get() against the replayed receiver.
+ *
+ *   gnss_bench [-r] [-l loops] [recording.csv]
+ *
+ *   -r        pace frames like the receiver instead of as fast as possible
+ *   -l loops  number of passes over the recording
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "gnss.h"
+#include "gnss_replay.h"
+#include "bench_common.h"
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, FAR char *argv[])
+{
+  int fd;
+  int ret;
+  int opt;
+  int loops = 1;
+  bool realtime = false;
+  int nfix = 0;
+  int nnofix = 0;
+  int capacity = 1024;
+  uint64_t t_start;
+  uint64_t t_call;
+  uint64_t t_done;
+  uint64_t elapsed;
+  FAR uint64_t *latency;
+  FAR uint64_t *duration;
+  sigset_t mask;
+  struct gnss_positiondata_s position_data;
+  struct gnss_replay_stats_s stats;
+
+  while ((opt = getopt(argc, argv, "rl:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      realtime = true;
+      break;
+    case 'l':
+      loops = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r] [-l loops] [recording.csv]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  gnss_replay_configure(optind < argc ? argv[optind] : NULL,
+                        realtime, loops);
+  gnss_replay_exit_at_end(false);
+
+  latency = malloc(capacity * sizeof(uint64_t));
+  duration = malloc(capacity * sizeof(uint64_t));
+  if (latency == NULL || duration == NULL)
+  {
+    return EXIT_FAILURE;
+  }
+
+  fd = gnss_initialize(&mask);
+  if (fd < 0)
+  {
+    printf("gnss_initialize failed. %d\n", fd);
+    return EXIT_FAILURE;
+  }
+
+  t_start = host_now_ns();
+  ret = gnss_first_contact(fd, &mask);
+  if (ret != OK)
+  {
+    printf("gnss_first_contact failed. %d\n", ret);
+    gnss_finalize(fd, &mask);
+    return EXIT_FAILURE;
+  }
+
+  printf("first fix after %llu us\n",
+         (unsigned long long)((host_now_ns() - t_start) / 1000));
+
+  t_start = host_now_ns();
+  while (1)
+  {
+    t_call = host_now_ns();
+    ret = gnss_get(fd, &mask, &position_data);
+    t_done = host_now_ns();
+    if (ret < 0)
+    {
+      break;
+    }
+
+    if (ret != OK)
+    {
+      nnofix++;
+      continue;
+    }
+
+    if (nfix == capacity)
+    {
+      capacity *= 2;
+      latency = realloc(latency, capacity * sizeof(uint64_t));
+      duration = realloc(duration, capacity * sizeof(uint64_t));
+      if (latency == NULL || duration == NULL)
+      {
+        return EXIT_FAILURE;
+      }
+    }
+
+    latency[nfix] = t_done - gnss_replay_release_ns();
+    duration[nfix] = t_done - t_call;
+    nfix++;
+  }
+
+  elapsed = host_now_ns() - t_start;
+  gnss_replay_get_stats(&stats);
+
+  printf("mode %s, %d fixes, %d without fix, %u dropped, %.1f fixes/s\n",
+         realtime ? "realtime" : "fast", nfix, nnofix, stats.dropped,
+         elapsed ? nfix * 1e9 / elapsed : 0.0);
+  bench_report_ns("gnss_get release->ret", latency, nfix);
+  bench_report_ns("gnss_get call", duration, nfix);
+
+  gnss_stop(fd);
+  gnss_finalize(fd, &mask);
+  free(latency);
+  free(duration);
+  return EXIT_SUCCESS;
+}
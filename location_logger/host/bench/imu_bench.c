@@ -0,0 +1,406 @@
+/****************************************************************************
+ * location_logger/host/bench/imu_bench.c
+ *
+ * IMU throughput and I2C bus use against the virtual BMI270.  The chip is
+ * initialised with init_bmi270(), cold and then warm, and its FIFO drained
+ * with exec_dequeue_fifo() at several poll intervals over simulated time,
+ * then on the INT1 FIFO watermark interrupt with time advanced in 1 ms
+ * steps, and finally at other rates and FIFO modes set with
+ * reconfigure_bmi270().  The warm init and the reconfigurations show
+ * the writes the register shadow skips.  Recovery from a stuck bus and
+ * from a power loss is timed as the IMU thread does it, and the I2C
+ * layer statistics of the whole run are printed last.
+ *
+ *   imu_bench [-s seconds]
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bmi270lib/i2c_bmi270.h"
+#include "bmi270_ctrl.h"
+#include "bmi270_sim.h"
+#include "bench_common.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const int g_intervals_ms[] =
+{
+  10, 20, 50, 100
+};
+
+static const struct
+{
+  FAR const char *label;
+  uint8_t acc_odr;
+  uint8_t gyr_odr;
+  bool headerless;
+} g_rates[] =
+{
+  { "50/50 Hz poll 50 ms",    BMI270_ODR_50HZ,  BMI270_ODR_50HZ,  false },
+  { "200/200 Hz poll 50 ms",  BMI270_ODR_200HZ, BMI270_ODR_200HZ, false },
+  { "400/400 Hz poll 50 ms",  BMI270_ODR_400HZ, BMI270_ODR_400HZ, false },
+  { "headerless 200 Hz",      BMI270_ODR_200HZ, BMI270_ODR_200HZ, true },
+};
+
+static volatile bool g_int1_fired;
+static i2c_stats_t g_i2c_stats;
+static char g_telemetry[I2C_STATS_FORMAT_SIZE];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int int1_handler(int irq, FAR void *context, FAR void *arg)
+{
+  board_gpio_int(BMI270_INT1_PIN, false);
+  g_int1_fired = true;
+  return 0;
+}
+
+static void print_samples(FAR const struct bmi270_sim_stats_s *st,
+                          uint64_t acc_samples, uint64_t gyr_samples,
+                          int seconds, int empty)
+{
+  printf("%-24s acc %llu/s  gyr %llu/s  %.2f B/sample  "
+         "%u frames dropped  %d empty drains\n", "",
+         (unsigned long long)(acc_samples / seconds),
+         (unsigned long long)(gyr_samples / seconds),
+         (acc_samples + gyr_samples) ?
+         (double)st->bytes_read / (acc_samples + gyr_samples) : 0.0,
+         st->frames_dropped, empty);
+}
+
+static void print_bus(FAR const char *label,
+                      FAR const struct bmi270_sim_stats_s *st,
+                      double seconds)
+{
+  printf("%-24s %6u xfers  %8llu B wr  %8llu B rd  bus %8llu us",
+         label, st->transfers,
+         (unsigned long long)st->bytes_written,
+         (unsigned long long)st->bytes_read,
+         (unsigned long long)(st->bus_ns / 1000));
+  if (seconds > 0.0)
+  {
+    printf("  (%.2f%% of bus)", st->bus_ns / (seconds * 1e7));
+  }
+
+  printf("\n");
+}
+
+static void print_txn(FAR const i2c_txn_stats_t *ts)
+{
+  printf("%-24s %u ops in %u batched xfers: %u ioctls, %llu us bus saved\n",
+         "", ts->ops, ts->transfers, ts->ioctls_saved,
+         (unsigned long long)(ts->bus_ns_saved / 1000));
+}
+
+static void print_shadow(FAR i2c_bmi270_t *bmi270)
+{
+  printf("%-24s %u writes skipped, %u reads cached by the shadow\n", "",
+         bmi270->shadow.writes_skipped, bmi270->shadow.reads_cached);
+  bmi270->shadow.writes_skipped = 0;
+  bmi270->shadow.reads_cached = 0;
+}
+
+static void print_init(FAR i2c_bmi270_t *bmi270,
+                       FAR const struct bmi270_sim_stats_s *st)
+{
+  char label[32];
+
+  snprintf(label, sizeof(label), "init %s", bmi270->init_stats.warm ?
+           "warm" : "cold");
+  print_bus(label, st, 0.0);
+  printf("%-24s %u us total, %u us config upload, %u uploads\n", "",
+         bmi270->init_stats.total_us, bmi270->init_stats.upload_us,
+         st->init_uploads);
+  print_txn(&bmi270->i2c.txn_stats);
+  print_shadow(bmi270);
+}
+
+/**
+ * @brief drain the FIFO every interval_ms of sensor time for seconds
+ */
+
+static void run_poll(FAR i2c_bmi270_t *bmi270, FAR const char *label,
+                     int interval_ms, int seconds)
+{
+  int drains = seconds * 1000 / interval_ms;
+  int empty = 0;
+  int ret;
+  int n;
+  uint64_t t0;
+  uint64_t acc_samples = 0;
+  uint64_t gyr_samples = 0;
+  FAR uint64_t *cpu;
+  bmi270_batch_t batch;
+  struct bmi270_sim_stats_s st;
+
+  cpu = malloc(drains * sizeof(uint64_t));
+  if (cpu == NULL)
+  {
+    return;
+  }
+
+  bmi270_sim_reset_stats();
+  memset(&bmi270->i2c.txn_stats, 0, sizeof(bmi270->i2c.txn_stats));
+
+  for (n = 0; n < drains; n++)
+  {
+    bmi270_sim_advance(interval_ms * 1000000ull);
+
+    t0 = host_now_ns();
+    ret = exec_dequeue_fifo(bmi270);
+    cpu[n] = host_now_ns() - t0;
+    if (ret < 0)
+    {
+      printf("ERROR: Failed to Dequeue: %d\n", ret);
+      break;
+    }
+
+    if (get_fifo_batch(&batch, bmi270) == 0)
+    {
+      empty++;
+    }
+
+    acc_samples += batch.acc_count;
+    gyr_samples += batch.gyr_count;
+  }
+
+  bmi270_sim_get_stats(&st);
+  print_bus(label, &st, seconds);
+  print_samples(&st, acc_samples, gyr_samples, seconds, empty);
+  if (bmi270->i2c.txn_stats.ioctls_saved > 0)
+  {
+    print_txn(&bmi270->i2c.txn_stats);
+  }
+
+  bench_report_ns("  exec_dequeue_fifo", cpu, n);
+  free(cpu);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, FAR char *argv[])
+{
+  int fd;
+  int ret;
+  int opt;
+  int seconds = 10;
+  int drains;
+  int empty;
+  int i;
+  int n;
+  uint64_t acc_samples;
+  uint64_t gyr_samples;
+  FAR uint64_t *cpu;
+  char label[32];
+  i2c_bmi270_t bmi270 = {0};
+  bmi270_config_t bmi270_config;
+  bmi270_batch_t batch;
+  struct bmi270_sim_config_s config = {0};
+  struct bmi270_sim_stats_s st;
+
+  while ((opt = getopt(argc, argv, "s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      seconds = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seconds]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* Manual sensor time, default noise */
+
+  config.time_scale = 0.0f;
+  config.acc_noise_g = 0.002f;
+  config.gyr_noise_dps = 0.05f;
+  config.temperature_c = 25.0f;
+  config.seed = 1;
+  bmi270_sim_configure(&config);
+
+  bmi270.i2c.fd = -1;
+  bmi270.i2c.i2c_addr = BMI270_I2C_ADDRESS;
+  bmi270.i2c.speed = I2C_SPEED;
+
+  fd = open(I2C_DEVNAME_FOR_BMI270, O_WRONLY);
+  if (fd < 0)
+  {
+    printf("ERROR: Failed to open %s\n", I2C_DEVNAME_FOR_BMI270);
+    return EXIT_FAILURE;
+  }
+
+  bmi270.i2c.fd = fd;
+  i2c_stats_attach(&bmi270.i2c, &g_i2c_stats);
+
+  bmi270_sim_reset_stats();
+  memset(&bmi270.i2c.txn_stats, 0, sizeof(bmi270.i2c.txn_stats));
+  ret = init_bmi270(&bmi270);
+  if (ret < 0)
+  {
+    printf("ERROR: Failed to initialize: %d\n", ret);
+    fini_bmi270(&bmi270);
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  bmi270_sim_get_stats(&st);
+  print_init(&bmi270, &st);
+
+  /* Again on the initialised chip */
+
+  fini_bmi270(&bmi270);
+  bmi270_sim_reset_stats();
+  memset(&bmi270.i2c.txn_stats, 0, sizeof(bmi270.i2c.txn_stats));
+  ret = init_bmi270(&bmi270);
+  if (ret < 0)
+  {
+    printf("ERROR: Failed to initialize: %d\n", ret);
+    fini_bmi270(&bmi270);
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  bmi270_sim_get_stats(&st);
+  print_init(&bmi270, &st);
+
+  for (i = 0; i < sizeof(g_intervals_ms) / sizeof(g_intervals_ms[0]); i++)
+  {
+    snprintf(label, sizeof(label), "poll %3d ms", g_intervals_ms[i]);
+    run_poll(&bmi270, label, g_intervals_ms[i], seconds);
+  }
+
+  /* Watermark interrupt: drain only when INT1 rises.  The latency is the
+   * age of the oldest sample when the drain starts.
+   */
+
+  ret = enable_fifo_watermark_bmi270(&bmi270, IMU_FIFO_WATERMARK_BYTES);
+  exec_dequeue_fifo(&bmi270);
+  get_fifo_batch(&batch, &bmi270);
+  board_gpio_intconfig(BMI270_INT1_PIN, INT_HIGH_LEVEL, true, int1_handler);
+  board_gpio_int(BMI270_INT1_PIN, true);
+
+  cpu = malloc(seconds * 1000 * sizeof(uint64_t));
+  if (ret == 0 && cpu != NULL)
+  {
+    uint64_t last_ms = 0;
+
+    acc_samples = 0;
+    gyr_samples = 0;
+    empty = 0;
+    drains = 0;
+    bmi270_sim_reset_stats();
+
+    for (n = 1; n <= seconds * 1000; n++)
+    {
+      bmi270_sim_advance(1000000ull);
+      if (!g_int1_fired)
+      {
+        continue;
+      }
+
+      g_int1_fired = false;
+      ret = exec_dequeue_fifo(&bmi270);
+      if (ret < 0)
+      {
+        printf("ERROR: Failed to Dequeue: %d\n", ret);
+        break;
+      }
+
+      if (get_fifo_batch(&batch, &bmi270) == 0)
+      {
+        empty++;
+      }
+
+      acc_samples += batch.acc_count;
+      gyr_samples += batch.gyr_count;
+      cpu[drains++] = (n - last_ms) * 1000000ull;
+      last_ms = n;
+      board_gpio_int(BMI270_INT1_PIN, true);
+    }
+
+    bmi270_sim_get_stats(&st);
+    snprintf(label, sizeof(label), "watermark %3d B", IMU_FIFO_WATERMARK_BYTES);
+    print_bus(label, &st, seconds);
+    print_samples(&st, acc_samples, gyr_samples, seconds, empty);
+    bench_report_ns("  drain interval", cpu, drains);
+  }
+
+  free(cpu);
+  board_gpio_int(BMI270_INT1_PIN, false);
+
+  /* Sample rate against bus load, switched with reconfigure_bmi270() */
+
+  for (i = 0; i < sizeof(g_rates) / sizeof(g_rates[0]); i++)
+  {
+    bmi270_default_config(&bmi270_config);
+    bmi270_config.acc_odr = g_rates[i].acc_odr;
+    bmi270_config.gyr_odr = g_rates[i].gyr_odr;
+    bmi270_config.fifo_headerless = g_rates[i].headerless;
+    bmi270_sim_reset_stats();
+    if (reconfigure_bmi270(&bmi270, &bmi270_config) < 0)
+    {
+      printf("ERROR: Failed to reconfigure %s\n", g_rates[i].label);
+      continue;
+    }
+
+    bmi270_sim_get_stats(&st);
+    print_bus("reconfigure", &st, 0.0);
+    print_shadow(&bmi270);
+
+    run_poll(&bmi270, g_rates[i].label, 50, seconds);
+  }
+
+  /* I2C error recovery as the IMU thread does it, after a stuck bus and
+   * after a power loss
+   */
+
+  for (i = 0; i < 2; i++)
+  {
+    if (i == 1)
+    {
+      bmi270_sim_power_cycle();
+    }
+
+    bmi270_sim_inject_fault(0, true);
+    bmi270_sim_reset_stats();
+    if (exec_dequeue_fifo(&bmi270) == 0 ||
+        i2c_bus_reset(&bmi270.i2c) < 0 ||
+        recover_bmi270(&bmi270) < 0 ||
+        enable_fifo_watermark_bmi270(&bmi270, IMU_FIFO_WATERMARK_BYTES) < 0)
+    {
+      printf("ERROR: Failed to recover\n");
+      continue;
+    }
+
+    bmi270_sim_get_stats(&st);
+    print_bus(i == 0 ? "recover stuck bus" : "recover power loss", &st, 0.0);
+    print_shadow(&bmi270);
+  }
+
+  /* Every transfer above, as the IMU thread reports it */
+
+  i2c_stats_format(&g_i2c_stats, g_telemetry, sizeof(g_telemetry));
+  printf("i2c stats %s\n", g_telemetry);
+
+  fini_bmi270(&bmi270);
+  close(fd);
+  return EXIT_SUCCESS;
+}
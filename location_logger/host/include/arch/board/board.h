@@ -0,0 +1,64 @@
+/****************************************************************************
+ * location_logger/host/include/arch/board/board.h
+ *
+ * Host stand-in for the Spresense board header.  The GPIO interrupt calls
+ * are served by host/shim/host_gpio.c, where simulated devices drive the
+ * input pins.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_ARCH_BOARD_BOARD_H
+#define __HOST_INCLUDE_ARCH_BOARD_BOARD_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* GPIO interrupt modes (cxd56_gpioint.h) */
+
+#define INT_HIGH_LEVEL   2
+#define INT_LOW_LEVEL    3
+#define INT_RISING_EDGE  4
+#define INT_FALLING_EDGE 5
+#define INT_BOTH_EDGE    7
+
+/* Pull modes (cxd56_gpio.h) */
+
+#define PIN_FLOAT     0
+#define PIN_PULLUP    1
+#define PIN_PULLDOWN  2
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef int (*xcpt_t)(int irq, FAR void *context, FAR void *arg);
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+int board_gpio_config(uint32_t pin, int mode, bool input, bool drive,
+                      int pull);
+int board_gpio_intconfig(uint32_t pin, int mode, bool filter, xcpt_t isr);
+int board_gpio_int(uint32_t pin, bool enable);
+int board_gpio_read(uint32_t pin);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __HOST_INCLUDE_ARCH_BOARD_BOARD_H */
@@ -0,0 +1,131 @@
+/****************************************************************************
+ * location_logger/host/include/arch/chip/gnss.h
+ *
+ * Host stand-in for the CXD56xx GNSS driver interface.  Only the ioctls,
+ * constants and the part of cxd56_gnss_positiondata_s that the
+ * location_logger modules use are provided.  They are served by the PVT
+ * replay device in host/shim/gnss_replay.c.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_ARCH_CHIP_GNSS_H
+#define __HOST_INCLUDE_ARCH_CHIP_GNSS_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* ioctl commands */
+
+#define CXD56_GNSS_IOCTL_START                   1
+#define CXD56_GNSS_IOCTL_STOP                    2
+#define CXD56_GNSS_IOCTL_SELECT_SATELLITE_SYSTEM 3
+#define CXD56_GNSS_IOCTL_GET_SATELLITE_SYSTEM    4
+#define CXD56_GNSS_IOCTL_SET_OPE_MODE            7
+#define CXD56_GNSS_IOCTL_GET_OPE_MODE            8
+#define CXD56_GNSS_IOCTL_SIGNAL_SET              47
+
+/* Start modes */
+
+#define CXD56_GNSS_STMOD_COLD 0
+#define CXD56_GNSS_STMOD_WARM 1
+#define CXD56_GNSS_STMOD_HOT  3
+
+/* Satellite systems */
+
+#define CXD56_GNSS_SAT_GPS     (1U << 0)
+#define CXD56_GNSS_SAT_GLONASS (1U << 1)
+#define CXD56_GNSS_SAT_SBAS    (1U << 2)
+#define CXD56_GNSS_SAT_QZ_L1CA (1U << 3)
+
+/* Signal types */
+
+#define CXD56_GNSS_SIG_GNSS 0
+
+/* Position fix modes */
+
+#define CXD56_GNSS_PVT_POSFIX_INVALID 1
+#define CXD56_GNSS_PVT_POSFIX_2D      2
+#define CXD56_GNSS_PVT_POSFIX_3D      3
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct cxd56_gnss_date_s
+{
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+};
+
+struct cxd56_gnss_time_s
+{
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t sec;
+  uint32_t usec;
+};
+
+struct cxd56_gnss_receiver_s
+{
+  uint8_t type;
+  uint8_t dgps;
+  uint8_t pos_fixmode;
+  uint8_t vel_fixmode;
+  uint8_t numsv;
+  uint8_t numsv_tracking;
+  uint8_t numsv_calcpos;
+  uint8_t numsv_calcvel;
+  uint8_t assist;
+  uint8_t pos_dataexist;
+  uint16_t svtype;
+  uint16_t pos_svtype;
+  uint16_t vel_svtype;
+  double latitude;
+  double longitude;
+  double altitude;
+  double geoid;
+  float velocity;
+  float direction;
+  struct cxd56_gnss_date_s date;
+  struct cxd56_gnss_time_s time;
+  struct cxd56_gnss_date_s gpsdate;
+  struct cxd56_gnss_time_s gpstime;
+  struct cxd56_gnss_time_s receivetime;
+  uint32_t priv;
+};
+
+struct cxd56_gnss_positiondata_s
+{
+  uint64_t data_timestamp;
+  uint32_t status;
+  uint32_t svcount;
+  struct cxd56_gnss_receiver_s receiver;
+};
+
+struct cxd56_gnss_ope_mode_param_s
+{
+  uint32_t mode;
+  uint32_t cycle;
+};
+
+struct cxd56_gnss_signal_setting_s
+{
+  int fd;
+  uint8_t enable;
+  uint8_t gnsssig;
+  int signo;
+  void *data;
+};
+
+#endif /* __HOST_INCLUDE_ARCH_CHIP_GNSS_H */
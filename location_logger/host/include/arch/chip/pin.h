@@ -0,0 +1,21 @@
+/****************************************************************************
+ * location_logger/host/include/arch/chip/pin.h
+ *
+ * Host stand-in for the CXD56xx pin definitions.  Only the pins the
+ * location_logger modules use are listed.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_ARCH_CHIP_PIN_H
+#define __HOST_INCLUDE_ARCH_CHIP_PIN_H
+
+#include <nuttx/config.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define PIN_EMMC_DATA2 (70)
+#define PIN_EMMC_DATA3 (71)
+
+#endif /* __HOST_INCLUDE_ARCH_CHIP_PIN_H */
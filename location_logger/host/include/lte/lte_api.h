@@ -0,0 +1,107 @@
+/****************************************************************************
+ * location_logger/host/include/lte/lte_api.h
+ *
+ * Host stand-in for the Spresense LTE library.  The calls complete
+ * synchronously and successfully; see host/shim/lte_stub.c.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_LTE_LTE_API_H
+#define __HOST_INCLUDE_LTE_LTE_API_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define LTE_IPTYPE_V4         0
+#define LTE_IPTYPE_V6         1
+#define LTE_IPTYPE_V4V6       2
+
+#define LTE_APN_AUTHTYPE_NONE 0
+#define LTE_APN_AUTHTYPE_PAP  1
+#define LTE_APN_AUTHTYPE_CHAP 2
+
+#define LTE_APN_TYPE_DEFAULT  (1 << 1)
+#define LTE_APN_TYPE_IA       (1 << 8)
+
+#define LTE_RAT_CATM          2
+
+#define LTE_VER_BB_PRODUCT_LEN 32
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef struct lte_errinfo
+{
+  uint8_t err_indicator;
+  int32_t err_result_code;
+  int32_t err_no;
+} lte_errinfo_t;
+
+typedef struct lte_version
+{
+  char bb_product[LTE_VER_BB_PRODUCT_LEN];
+} lte_version_t;
+
+typedef struct lte_netinfo
+{
+  uint8_t nw_stat;
+  uint8_t pdn_num;
+} lte_netinfo_t;
+
+typedef struct lte_quality
+{
+  bool valid;
+  int16_t rsrp;
+  int16_t rsrq;
+  int16_t sinr;
+  int16_t rssi;
+} lte_quality_t;
+
+typedef struct lte_apn_setting
+{
+  char *apn;
+  uint8_t ip_type;
+  uint8_t auth_type;
+  uint32_t apn_type;
+  char *user_name;
+  char *password;
+} lte_apn_setting_t;
+
+typedef struct lte_pdn
+{
+  uint8_t session_id;
+  uint8_t active;
+  uint32_t apn_type;
+} lte_pdn_t;
+
+typedef void (*restart_report_cb_t)(uint32_t reason);
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int lte_initialize(void);
+int lte_finalize(void);
+int lte_set_report_restart(restart_report_cb_t restart_callback);
+int lte_power_on(void);
+int lte_power_off(void);
+int lte_radio_on_sync(void);
+int lte_radio_off_sync(void);
+int lte_activate_pdn_sync(lte_apn_setting_t *apn, lte_pdn_t *pdn);
+int lte_deactivate_pdn_sync(uint8_t session_id);
+int lte_get_imsi_sync(char *imsi, size_t len);
+int lte_get_errinfo(lte_errinfo_t *info);
+
+#endif /* __HOST_INCLUDE_LTE_LTE_API_H */
@@ -0,0 +1,32 @@
+/****************************************************************************
+ * location_logger/host/include/netutils/webclient.h
+ *
+ * Host stand-in for the NuttX webclient.  Posts are counted and dropped;
+ * see host/shim/lte_stub.c.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_NETUTILS_WEBCLIENT_H
+#define __HOST_INCLUDE_NETUTILS_WEBCLIENT_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef void (*wget_callback_t)(FAR char **buffer, int offset,
+                                int datend, FAR int *buflen, FAR void *arg);
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int wget_post(FAR const char *url, FAR const char *posts, FAR char *buffer,
+              int buflen, wget_callback_t callback, FAR void *arg);
+
+#endif /* __HOST_INCLUDE_NETUTILS_WEBCLIENT_H */
@@ -0,0 +1,13 @@
+/****************************************************************************
+ * location_logger/host/include/nuttx/arch.h
+ *
+ * Host stand-in for <nuttx/arch.h>.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_NUTTX_ARCH_H
+#define __HOST_INCLUDE_NUTTX_ARCH_H
+
+#include <nuttx/config.h>
+
+#endif /* __HOST_INCLUDE_NUTTX_ARCH_H */
@@ -0,0 +1,36 @@
+/****************************************************************************
+ * location_logger/host/include/nuttx/config.h
+ *
+ * Host stand-in for the generated NuttX configuration header.  Only the
+ * definitions the location_logger modules rely on are provided here.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_NUTTX_CONFIG_H
+#define __HOST_INCLUDE_NUTTX_CONFIG_H
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define CONFIG_HOST_SHIM 1
+
+#define CONFIG_CXD56_GNSS 1
+#define CONFIG_CXD56_I2C0 1
+#define CONFIG_CXD56_GPIO_IRQ 1
+
+/* NuttX <sys/types.h> and <nuttx/compiler.h> definitions */
+
+#ifndef FAR
+#  define FAR
+#endif
+
+#ifndef OK
+#  define OK 0
+#endif
+
+#ifndef ERROR
+#  define ERROR -1
+#endif
+
+#endif /* __HOST_INCLUDE_NUTTX_CONFIG_H */
@@ -0,0 +1,52 @@
+/****************************************************************************
+ * location_logger/host/include/nuttx/i2c/i2c_master.h
+ *
+ * Host stand-in for the NuttX I2C character driver interface.  The message
+ * and transfer layouts follow <nuttx/i2c/i2c_master.h>.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_INCLUDE_NUTTX_I2C_I2C_MASTER_H
+#define __HOST_INCLUDE_NUTTX_I2C_I2C_MASTER_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define I2C_M_READ    0x0001 /* Read data, from slave to master */
+#define I2C_M_TEN     0x0002 /* Ten bit address */
+#define I2C_M_NOSTOP  0x0040 /* Message should not end with a STOP */
+#define I2C_M_NOSTART 0x0080 /* Message should not begin with a START */
+
+#define I2CIOC_TRANSFER 0x2101
+#define I2CIOC_RESET    0x2102
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct i2c_msg_s
+{
+  uint32_t frequency; /* I2C frequency */
+  uint16_t addr;      /* Slave address (7- or 10-bit) */
+  uint16_t flags;     /* See I2C_M_* definitions */
+  uint8_t *buffer;    /* Buffer to be transferred */
+  ssize_t length;     /* Length of the buffer in bytes */
+};
+
+struct i2c_transfer_s
+{
+  struct i2c_msg_s *msgv; /* Array of I2C messages for the transfer */
+  size_t msgc;            /* Number of messages in the array. */
+};
+
+#endif /* __HOST_INCLUDE_NUTTX_I2C_I2C_MASTER_H */
@@ -0,0 +1,1578 @@
+/****************************************************************************
+ * location_logger/host/shim/bmi270_sim.c
+ *
+ * Virtual BMI270 register model on the host I2C bus.  See bmi270_sim.h.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <nuttx/i2c/i2c_master.h>
+
+#include "host_dev.h"
+#include "bmi270_sim.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SIM_I2C_ADDRESS (0x69)
+#define SIM_CHIP_ID (0x24)
+#define SIM_CONFIG_SIZE (8192)
+
+/* Register MAP (subset modelled) */
+
+#define REG_CHIPID (0x00)
+#define REG_ERR_REG (0x02)
+#define REG_STATUS (0x03)
+#define REG_DATA_AUX (0x04)
+#define REG_DATA_ACC (0x0c)
+#define REG_DATA_GYR (0x12)
+#define REG_SENSORTIME0 (0x18)
+#define REG_SENSORTIME1 (0x19)
+#define REG_SENSORTIME2 (0x1a)
+#define REG_INT_STATUS0 (0x1c)
+#define REG_INT_STATUS1 (0x1d)
+#define REG_INTERNAL_STATUS (0x21)
+#define REG_TEMPERATURE_0 (0x22)
+#define REG_TEMPERATURE_1 (0x23)
+#define REG_FIFO_LENGTH_0 (0x24)
+#define REG_FIFO_LENGTH_1 (0x25)
+#define REG_FIFO_DATA (0x26)
+#define REG_FEAT_PAGE (0x2f)
+#define REG_FEATURES (0x30)
+#define REG_ACC_CONF (0x40)
+#define REG_ACC_RANGE (0x41)
+#define REG_GYR_CONF (0x42)
+#define REG_GYR_RANGE (0x43)
+#define REG_AUX_CONF (0x44)
+#define REG_FIFO_DOWNS (0x45)
+#define REG_FIFO_WTM_0 (0x46)
+#define REG_FIFO_WTM_1 (0x47)
+#define REG_FIFO_CONFIG_0 (0x48)
+#define REG_FIFO_CONFIG_1 (0x49)
+#define REG_SATURATION (0x4a)
+#define REG_AUX_DEV_ID (0x4b)
+#define REG_AUX_IF_CONF (0x4c)
+#define REG_AUX_RD_ADDR (0x4d)
+#define REG_AUX_WR_ADDR (0x4e)
+#define REG_AUX_WR_DATA (0x4f)
+#define REG_INT1_IO_CTRL (0x53)
+#define REG_INT_LATCH (0x55)
+#define REG_INT1_MAP_FEAT (0x56)
+#define REG_INT_MAP_DATA (0x58)
+#define REG_INIT_CTRL (0x59)
+#define REG_INIT_ADDR_0 (0x5b)
+#define REG_INIT_ADDR_1 (0x5c)
+#define REG_INIT_DATA (0x5e)
+#define REG_IF_CONF (0x6b)
+#define REG_PWR_CONF (0x7c)
+#define REG_PWR_CTRL (0x7d)
+#define REG_CMD (0x7e)
+
+#define PWR_CTRL_AUX_EN (0x01)
+#define PWR_CTRL_GYR_EN (0x02)
+#define PWR_CTRL_ACC_EN (0x04)
+#define PWR_CONF_ADV_POWER_SAVE (0x01)
+#define FIFO_CONFIG_0_STOP_ON_FULL (0x01)
+#define FIFO_CONFIG_0_TIME_EN (0x02)
+#define FIFO_CONFIG_1_HEADER_EN (0x10)
+#define FIFO_CONFIG_1_AUX_EN (0x20)
+#define FIFO_CONFIG_1_ACC_EN (0x40)
+#define FIFO_CONFIG_1_GYR_EN (0x80)
+
+#define FIFO_HEADER_SKIP (0x40)
+#define FIFO_HEADER_TIME (0x44)
+#define FIFO_HEADER_CFG (0x48)
+#define FIFO_HEADER_REGULAR (0x80)
+#define FIFO_HEADER_ACC (0x04)
+#define FIFO_HEADER_GYR (0x08)
+#define FIFO_HEADER_AUX (0x10)
+#define IF_CONF_AUX_EN (0x20)
+#define AUX_IF_CONF_MANUAL (0x80)
+#define AUX_FRAME_LENGTH (8)
+
+#define INT1_IO_CTRL_LVL (0x02)
+#define INT1_IO_CTRL_OUTPUT_EN (0x08)
+#define INT_STATUS1_FFULL (0x01)
+#define INT_STATUS1_FWM (0x02)
+#define INT_STATUS0_NO_MOTION (0x20)
+#define INT_STATUS0_ANY_MOTION (0x40)
+
+/* Feature engine: 8 pages of 16 bytes, any-motion at page 1 offset 0x0c
+ * and no-motion at page 2 offset 0, evaluated every 20 ms (512 ticks).
+ */
+
+#define FEAT_PAGES (8)
+#define FEAT_PAGE_SIZE (16)
+#define FEAT_PERIOD_TICKS (512)
+#define FEAT_MOTION_EN (0x8000)
+
+/* BMM150 on the AUX bus.  The data registers follow the field set with
+ * bmi270_sim_set_mag() whenever the power bit is set; the operating mode
+ * and repetitions are stored but not modelled.
+ */
+
+#define MAG_I2C_ADDRESS (0x10)
+#define MAG_CHIP_ID (0x32)
+#define MAG_REG_FIRST (0x40)
+#define MAG_REG_CHIP_ID (0x40)
+#define MAG_REG_DATA_X (0x42)
+#define MAG_REG_RHALL (0x48)
+#define MAG_REG_POWER (0x4b)
+#define MAG_REG_TRIM (0x5d)
+#define MAG_REGS (0x40)
+#define MAG_TRIM_X1 (2)
+#define MAG_TRIM_X2 (-6)
+#define MAG_TRIM_Y1 (-1)
+#define MAG_TRIM_Y2 (-8)
+#define MAG_TRIM_Z1 (24000)
+#define MAG_TRIM_Z2 (700)
+#define MAG_TRIM_XYZ1 (6500)
+
+#define CMD_FIFO_FLUSH (0xb0)
+#define CMD_SOFTRESET (0xb6)
+
+/* INT1 is re-evaluated every millisecond when sensor time runs freely */
+
+#define SIM_TICK_NS (1000 * 1000)
+
+/* Sensor time runs at 25.6 kHz, one tick is 39062.5 ns */
+
+#define NS_TO_TICKS(ns) (((ns) * 2) / 78125)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct bmi270_sim_dev_s
+{
+  pthread_mutex_t bus_lock;   /* Held for a whole transfer */
+  pthread_mutex_t lock;
+  struct bmi270_sim_config_s config;
+  struct bmi270_sim_stats_s stats;
+
+  uint8_t regs[128];
+  uint8_t config_mem[SIM_CONFIG_SIZE];
+  bool config_loading;
+  int init_pos;           /* INIT_DATA byte address */
+
+  /* Time */
+
+  uint64_t t0_ns;         /* Host time at power-on */
+  uint64_t vt_ns;         /* Sensor time in ns since power-on */
+  uint64_t acc_next;      /* Next FIFO sample, sensor ticks */
+  uint64_t gyr_next;
+  uint64_t aux_next;
+
+  /* FIFO contents, always starting on a frame boundary */
+
+  uint8_t fifo[BMI270_SIM_FIFO_SIZE];
+  int fifo_len;
+
+  /* Signal */
+
+  float acc_g[3];
+  float gyr_dps[3];
+  float mag_ut[3];
+  uint32_t rng;
+
+  /* BMM150 register file from MAG_REG_FIRST */
+
+  uint8_t mag[MAG_REGS];
+
+  /* Feature engine */
+
+  uint8_t feat[FEAT_PAGES][FEAT_PAGE_SIZE];
+  uint64_t feat_next;     /* Next evaluation, sensor ticks */
+  float motion_ref[3];    /* Acceleration at the last any-motion, g */
+  uint32_t any_count;     /* Periods above the any-motion threshold */
+  uint32_t still_count;   /* Periods below the no-motion threshold */
+
+  /* INT1 output */
+
+  uint32_t int1_pin;
+  int opens;              /* Open descriptors */
+  bool ticking;           /* sim_tick_main() started */
+
+  /* Injected bus faults */
+
+  uint32_t fail_transfers;  /* next transfers to fail */
+  bool stuck;               /* fail every transfer until I2CIOC_RESET */
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static int bmi270_sim_open(FAR void *priv);
+static int bmi270_sim_close(FAR void *priv);
+static int bmi270_sim_ioctl(FAR void *priv, int cmd, unsigned long arg);
+
+/* Config file the driver uploads, see bmi270.c */
+
+int get_bmi270_config_file_size(void);
+const uint8_t *get_bmi270_config_file_addr(void);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const struct host_file_operations_s g_bmi270_sim_fops =
+{
+  bmi270_sim_open,
+  bmi270_sim_close,
+  NULL,
+  bmi270_sim_ioctl
+};
+
+static struct bmi270_sim_dev_s g_bmi270_sim =
+{
+  .bus_lock = PTHREAD_MUTEX_INITIALIZER,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .config =
+  {
+    .time_scale = 1.0f,
+    .acc_noise_g = 0.002f,
+    .gyr_noise_dps = 0.05f,
+    .temperature_c = 25.0f,
+    .seed = 1,
+  },
+  .acc_g = { 0.0f, 0.0f, 1.0f },
+  .mag_ut = { 20.0f, 0.0f, -40.0f },
+};
+
+/* BMM150 trim registers 0x5d .. 0x71, see MAG_TRIM_* */
+
+static const uint8_t g_mag_trim[] =
+{
+  MAG_TRIM_X1, (uint8_t)MAG_TRIM_Y1, 0, 0, 0, 0, 0, (uint8_t)MAG_TRIM_X2,
+  (uint8_t)MAG_TRIM_Y2, 0, 0, MAG_TRIM_Z2 & 0xff, MAG_TRIM_Z2 >> 8,
+  MAG_TRIM_Z1 & 0xff, MAG_TRIM_Z1 >> 8, MAG_TRIM_XYZ1 & 0xff,
+  MAG_TRIM_XYZ1 >> 8, 0, 0, 0xfd /* xy2 -3 */, 0x1d /* xy1 29 */,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static float sim_gauss(FAR struct bmi270_sim_dev_s *dev)
+{
+  float u1;
+  float u2;
+
+  /* xorshift32 + Box-Muller */
+
+  do
+  {
+    dev->rng ^= dev->rng << 13;
+    dev->rng ^= dev->rng >> 17;
+    dev->rng ^= dev->rng << 5;
+    u1 = (dev->rng >> 8) * (1.0f / 16777216.0f);
+  }
+  while (u1 <= 0.0f);
+
+  dev->rng ^= dev->rng << 13;
+  dev->rng ^= dev->rng >> 17;
+  dev->rng ^= dev->rng << 5;
+  u2 = (dev->rng >> 8) * (1.0f / 16777216.0f);
+
+  return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+static uint64_t sim_ticks(FAR struct bmi270_sim_dev_s *dev)
+{
+  return NS_TO_TICKS(dev->vt_ns);
+}
+
+/* Sample period in sensor ticks for an ODR field, 100 Hz is 256 ticks */
+
+static uint64_t sim_period(uint8_t conf, int downs)
+{
+  int odr = conf & 0x0f;
+
+  if (odr < 1)
+  {
+    odr = 1;
+  }
+
+  if (odr > 13)
+  {
+    odr = 13;
+  }
+
+  return (odr <= 8 ? (256ull << (8 - odr)) : (256ull >> (odr - 8))) << downs;
+}
+
+static bool sim_initialized(FAR struct bmi270_sim_dev_s *dev)
+{
+  return (dev->regs[REG_INTERNAL_STATUS] & 0x0f) == 0x01;
+}
+
+static bool sim_acc_on(FAR struct bmi270_sim_dev_s *dev)
+{
+  return sim_initialized(dev) &&
+         (dev->regs[REG_PWR_CTRL] & PWR_CTRL_ACC_EN) &&
+         (dev->regs[REG_FIFO_CONFIG_1] & FIFO_CONFIG_1_ACC_EN);
+}
+
+static bool sim_gyr_on(FAR struct bmi270_sim_dev_s *dev)
+{
+  return sim_initialized(dev) &&
+         (dev->regs[REG_PWR_CTRL] & PWR_CTRL_GYR_EN) &&
+         (dev->regs[REG_FIFO_CONFIG_1] & FIFO_CONFIG_1_GYR_EN);
+}
+
+static bool sim_header_mode(FAR struct bmi270_sim_dev_s *dev)
+{
+  return (dev->regs[REG_FIFO_CONFIG_1] & FIFO_CONFIG_1_HEADER_EN) != 0;
+}
+
+/* AUX interface powered and enabled, manual or data mode */
+
+static bool sim_aux_powered(FAR struct bmi270_sim_dev_s *dev)
+{
+  return sim_initialized(dev) &&
+         (dev->regs[REG_PWR_CTRL] & PWR_CTRL_AUX_EN) &&
+         (dev->regs[REG_IF_CONF] & IF_CONF_AUX_EN);
+}
+
+/* AUX data mode samples into the FIFO, header mode only */
+
+static bool sim_aux_on(FAR struct bmi270_sim_dev_s *dev)
+{
+  return sim_aux_powered(dev) && sim_header_mode(dev) &&
+         !(dev->regs[REG_AUX_IF_CONF] & AUX_IF_CONF_MANUAL) &&
+         (dev->regs[REG_FIFO_CONFIG_1] & FIFO_CONFIG_1_AUX_EN);
+}
+
+static uint64_t sim_acc_period(FAR struct bmi270_sim_dev_s *dev)
+{
+  return sim_period(dev->regs[REG_ACC_CONF],
+                    (dev->regs[REG_FIFO_DOWNS] >> 4) & 0x07);
+}
+
+static uint64_t sim_gyr_period(FAR struct bmi270_sim_dev_s *dev)
+{
+  return sim_period(dev->regs[REG_GYR_CONF],
+                    dev->regs[REG_FIFO_DOWNS] & 0x07);
+}
+
+static uint64_t sim_aux_period(FAR struct bmi270_sim_dev_s *dev)
+{
+  return sim_period(dev->regs[REG_AUX_CONF], 0);
+}
+
+/* Restart the sample schedule on the next period boundary */
+
+static void sim_reschedule(FAR struct bmi270_sim_dev_s *dev)
+{
+  uint64_t now = sim_ticks(dev);
+  uint64_t p;
+
+  p = sim_acc_period(dev);
+  dev->acc_next = (now / p + 1) * p;
+  p = sim_gyr_period(dev);
+  dev->gyr_next = (now / p + 1) * p;
+  p = sim_aux_period(dev);
+  dev->aux_next = (now / p + 1) * p;
+}
+
+/* Size of the frame at the head of the FIFO */
+
+static int sim_frame_size(FAR struct bmi270_sim_dev_s *dev, int pos)
+{
+  uint8_t h;
+  int n;
+
+  if (!sim_header_mode(dev))
+  {
+    n = ((dev->regs[REG_FIFO_CONFIG_1] & FIFO_CONFIG_1_ACC_EN) ? 6 : 0) +
+        ((dev->regs[REG_FIFO_CONFIG_1] & FIFO_CONFIG_1_GYR_EN) ? 6 : 0);
+    return n ? n : 1;
+  }
+
+  h = dev->fifo[pos];
+  switch (h & 0xfc)
+  {
+  case FIFO_HEADER_SKIP:
+    return 2;
+  case FIFO_HEADER_TIME:
+    return 4;
+  case FIFO_HEADER_CFG:
+    return 5;
+  default:
+    n = 1;
+    if (h & FIFO_HEADER_ACC)
+    {
+      n += 6;
+    }
+
+    if (h & FIFO_HEADER_GYR)
+    {
+      n += 6;
+    }
+
+    if (h & FIFO_HEADER_AUX)
+    {
+      n += AUX_FRAME_LENGTH;
+    }
+
+    return n;
+  }
+}
+
+static void sim_fifo_consume(FAR struct bmi270_sim_dev_s *dev, int len)
+{
+  memmove(dev->fifo, dev->fifo + len, dev->fifo_len - len);
+  dev->fifo_len -= len;
+}
+
+static void sim_fifo_push(FAR struct bmi270_sim_dev_s *dev,
+                          FAR const uint8_t *frame, int len)
+{
+  int size;
+
+  while (dev->fifo_len + len > BMI270_SIM_FIFO_SIZE)
+  {
+    if (dev->regs[REG_FIFO_CONFIG_0] & FIFO_CONFIG_0_STOP_ON_FULL)
+    {
+      dev->stats.frames_dropped++;
+      return;
+    }
+
+    /* Overwrite the oldest frame and account for it in a skip frame */
+
+    size = sim_frame_size(dev, 0);
+    if (sim_header_mode(dev) && dev->fifo[0] == FIFO_HEADER_SKIP)
+    {
+      size = sim_frame_size(dev, 2);
+      memmove(dev->fifo + 2, dev->fifo + 2 + size,
+              dev->fifo_len - 2 - size);
+      dev->fifo_len -= size;
+      if (dev->fifo[1] < 0xff)
+      {
+        dev->fifo[1]++;
+      }
+    }
+    else if (sim_header_mode(dev))
+    {
+      sim_fifo_consume(dev, size);
+      memmove(dev->fifo + 2, dev->fifo, dev->fifo_len);
+      dev->fifo[0] = FIFO_HEADER_SKIP;
+      dev->fifo[1] = 1;
+      dev->fifo_len += 2;
+    }
+    else
+    {
+      sim_fifo_consume(dev, size);
+    }
+
+    dev->stats.frames_dropped++;
+  }
+
+  memcpy(dev->fifo + dev->fifo_len, frame, len);
+  dev->fifo_len += len;
+  dev->stats.frames++;
+}
+
+static int16_t sim_raw(FAR struct bmi270_sim_dev_s *dev, float value,
+                       float range, int satbit)
+{
+  float raw = value / range * 32768.0f;
+
+  if (raw > 32767.0f)
+  {
+    dev->regs[REG_SATURATION] |= 1 << satbit;
+    return 32767;
+  }
+
+  if (raw < -32768.0f)
+  {
+    dev->regs[REG_SATURATION] |= 1 << satbit;
+    return -32768;
+  }
+
+  return (int16_t)lrintf(raw);
+}
+
+static int sim_sample_acc(FAR struct bmi270_sim_dev_s *dev, FAR uint8_t *p)
+{
+  float range = (float)(2 << (dev->regs[REG_ACC_RANGE] & 0x03));
+  int16_t v;
+  int i;
+
+  for (i = 0; i < 3; i++)
+  {
+    v = sim_raw(dev, dev->acc_g[i] + dev->config.acc_bias_g[i] +
+                dev->config.acc_noise_g * sim_gauss(dev), range, i);
+    p[i * 2] = v & 0xff;
+    p[i * 2 + 1] = (v >> 8) & 0xff;
+  }
+
+  memcpy(&dev->regs[REG_DATA_ACC], p, 6);
+  return 6;
+}
+
+static int sim_sample_gyr(FAR struct bmi270_sim_dev_s *dev, FAR uint8_t *p)
+{
+  int code = dev->regs[REG_GYR_RANGE] & 0x07;
+  float range = (float)(2000 >> (code > 4 ? 4 : code));
+  int16_t v;
+  int i;
+
+  for (i = 0; i < 3; i++)
+  {
+    v = sim_raw(dev, dev->gyr_dps[i] + dev->config.gyr_bias_dps[i] +
+                dev->config.gyr_tempco_dps[i] *
+                (dev->config.temperature_c - 23.0f) +
+                dev->config.gyr_noise_dps * sim_gauss(dev), range, 3 + i);
+    p[i * 2] = v & 0xff;
+    p[i * 2 + 1] = (v >> 8) & 0xff;
+  }
+
+  memcpy(&dev->regs[REG_DATA_GYR], p, 6);
+  return 6;
+}
+
+/* One 13 bit X/Y value of the BMM150, inverse of the Bosch compensation
+ * at RHALL == XYZ1
+ */
+
+static int16_t sim_mag_xy(float ut, int t1, int t2)
+{
+  float raw = (ut * 16.0f - t1 * 8.0f) * 32.0f / (t2 + 160.0f);
+
+  raw = raw > 4095.0f ? 4095.0f : raw < -4095.0f ? -4095.0f : raw;
+  return (int16_t)lrintf(raw);
+}
+
+static int16_t sim_mag_z(float ut)
+{
+  float raw = ut * 64.0f * (MAG_TRIM_Z2 + MAG_TRIM_Z1 *
+                            (float)MAG_TRIM_XYZ1 / 32768.0f) / 131072.0f;
+
+  raw = raw > 16383.0f ? 16383.0f : raw < -16383.0f ? -16383.0f : raw;
+  return (int16_t)lrintf(raw);
+}
+
+/* Read a BMM150 register over the AUX bus */
+
+static uint8_t sim_mag_read(FAR struct bmi270_sim_dev_s *dev, uint8_t reg)
+{
+  bool on = (dev->mag[MAG_REG_POWER - MAG_REG_FIRST] & 0x01) != 0;
+  uint16_t v;
+
+  if (reg < MAG_REG_FIRST || reg >= MAG_REG_FIRST + MAG_REGS)
+  {
+    return 0;
+  }
+
+  if (reg == MAG_REG_CHIP_ID)
+  {
+    return on ? MAG_CHIP_ID : 0;
+  }
+
+  if (on && reg >= MAG_REG_DATA_X && reg < MAG_REG_DATA_X + 8)
+  {
+    switch ((reg - MAG_REG_DATA_X) / 2)
+    {
+    case 0:
+      v = (uint16_t)(sim_mag_xy(dev->mag_ut[0], MAG_TRIM_X1, MAG_TRIM_X2)
+                     << 3);
+      break;
+    case 1:
+      v = (uint16_t)(sim_mag_xy(dev->mag_ut[1], MAG_TRIM_Y1, MAG_TRIM_Y2)
+                     << 3);
+      break;
+    case 2:
+      v = (uint16_t)(sim_mag_z(dev->mag_ut[2]) << 1);
+      break;
+    default:
+      v = (MAG_TRIM_XYZ1 << 2) | 0x01;
+      break;
+    }
+
+    return (reg & 1) ? v >> 8 : v & 0xff;
+  }
+
+  if (reg >= MAG_REG_TRIM && reg < MAG_REG_TRIM + sizeof(g_mag_trim))
+  {
+    return g_mag_trim[reg - MAG_REG_TRIM];
+  }
+
+  return dev->mag[reg - MAG_REG_FIRST];
+}
+
+static void sim_mag_write(FAR struct bmi270_sim_dev_s *dev, uint8_t reg,
+                          uint8_t value)
+{
+  if (reg >= MAG_REG_FIRST && reg < MAG_REG_TRIM)
+  {
+    dev->mag[reg - MAG_REG_FIRST] = value;
+  }
+}
+
+/* AUX burst of burst_len bytes from the sensor into DATA_0.. and p */
+
+static int sim_sample_aux(FAR struct bmi270_sim_dev_s *dev, uint8_t reg,
+                          FAR uint8_t *p)
+{
+  static const int burst_len[4] =
+  {
+    1, 2, 6, 8
+  };
+
+  int n = burst_len[dev->regs[REG_AUX_IF_CONF] & 0x03];
+  bool present = dev->regs[REG_AUX_DEV_ID] == MAG_I2C_ADDRESS << 1;
+  int i;
+
+  memset(p, 0, AUX_FRAME_LENGTH);
+  for (i = 0; i < n && present; i++)
+  {
+    p[i] = sim_mag_read(dev, reg + i);
+  }
+
+  memcpy(&dev->regs[REG_DATA_AUX], p, AUX_FRAME_LENGTH);
+  return AUX_FRAME_LENGTH;
+}
+
+static uint8_t sim_int_status1(FAR struct bmi270_sim_dev_s *dev)
+{
+  int wtm = dev->regs[REG_FIFO_WTM_0] |
+            ((dev->regs[REG_FIFO_WTM_1] & 0x1f) << 8);
+  uint8_t status = 0;
+
+  if (wtm > 0 && dev->fifo_len >= wtm)
+  {
+    status |= INT_STATUS1_FWM;
+  }
+
+  if (dev->fifo_len > BMI270_SIM_FIFO_SIZE - 13)
+  {
+    status |= INT_STATUS1_FFULL;
+  }
+
+  return status;
+}
+
+/* Non-latched INT1 level for the current FIFO fill */
+
+static bool sim_int1_level(FAR struct bmi270_sim_dev_s *dev)
+{
+  uint8_t io = dev->regs[REG_INT1_IO_CTRL];
+  bool active;
+
+  if (!(io & INT1_IO_CTRL_OUTPUT_EN))
+  {
+    return false;
+  }
+
+  active = (sim_int_status1(dev) & dev->regs[REG_INT_MAP_DATA] & 0x03) != 0 ||
+           (dev->regs[REG_INT_STATUS0] & dev->regs[REG_INT1_MAP_FEAT]) != 0;
+  return (io & INT1_IO_CTRL_LVL) ? active : !active;
+}
+
+/**
+ * @brief generate every FIFO frame due up to the current sensor time
+ */
+
+static void sim_generate(FAR struct bmi270_sim_dev_s *dev)
+{
+  uint64_t now = sim_ticks(dev);
+  uint64_t acc_p = sim_acc_period(dev);
+  uint64_t gyr_p = sim_gyr_period(dev);
+  uint64_t aux_p = sim_aux_period(dev);
+  bool acc_on = sim_acc_on(dev);
+  bool gyr_on = sim_gyr_on(dev);
+  bool aux_on = sim_aux_on(dev);
+  bool header = sim_header_mode(dev);
+  uint8_t frame[1 + AUX_FRAME_LENGTH + 6 + 6];
+  uint64_t t;
+  bool acc;
+  bool gyr;
+  bool aux;
+  int len;
+
+  while (acc_on || gyr_on || aux_on)
+  {
+    t = UINT64_MAX;
+    if (acc_on && dev->acc_next < t)
+    {
+      t = dev->acc_next;
+    }
+
+    if (gyr_on && dev->gyr_next < t)
+    {
+      t = dev->gyr_next;
+    }
+
+    if (aux_on && dev->aux_next < t)
+    {
+      t = dev->aux_next;
+    }
+
+    if (t > now)
+    {
+      break;
+    }
+
+    acc = acc_on && dev->acc_next == t;
+    gyr = gyr_on && dev->gyr_next == t;
+    aux = aux_on && dev->aux_next == t;
+    if (acc)
+    {
+      dev->acc_next += acc_p;
+    }
+
+    if (gyr)
+    {
+      dev->gyr_next += gyr_p;
+    }
+
+    if (aux)
+    {
+      dev->aux_next += aux_p;
+    }
+
+    /* Header-less frames carry every enabled sensor; the data sheet
+     * requires equal ODRs, otherwise only the common instants are kept.
+     */
+
+    if (!header && (acc != acc_on || gyr != gyr_on))
+    {
+      continue;
+    }
+
+    len = 0;
+    if (header)
+    {
+      frame[len++] = FIFO_HEADER_REGULAR |
+                     (acc ? FIFO_HEADER_ACC : 0) |
+                     (gyr ? FIFO_HEADER_GYR : 0) |
+                     (aux ? FIFO_HEADER_AUX : 0);
+    }
+
+    if (aux)
+    {
+      len += sim_sample_aux(dev, dev->regs[REG_AUX_RD_ADDR], &frame[len]);
+    }
+
+    if (gyr)
+    {
+      len += sim_sample_gyr(dev, &frame[len]);
+    }
+
+    if (acc)
+    {
+      len += sim_sample_acc(dev, &frame[len]);
+    }
+
+    sim_fifo_push(dev, frame, len);
+  }
+}
+
+/* Duration in periods and threshold in g of a motion detector, false when
+ * it is disabled.
+ */
+
+static bool sim_motion_config(FAR const uint8_t *p, FAR uint32_t *dur,
+                              FAR float *thres)
+{
+  uint16_t w1 = p[0] | (p[1] << 8);
+  uint16_t w2 = p[2] | (p[3] << 8);
+
+  *dur = w1 & 0x1fff;
+  *thres = (w2 & 0x07ff) / 2048.0f;
+  return (w2 & FEAT_MOTION_EN) != 0 && (w1 & 0xe000) != 0;
+}
+
+/**
+ * @brief run the any-motion and no-motion detectors up to now
+ *
+ * The slope is the largest axis change of the noiseless acceleration
+ * from the reference taken at the last any-motion event.  Any-motion
+ * fires once the slope stays above its threshold for its duration;
+ * no-motion fires once per still period after its duration below.
+ */
+
+static void sim_features(FAR struct bmi270_sim_dev_s *dev)
+{
+  uint64_t now = sim_ticks(dev);
+  bool any_on;
+  bool no_on;
+  uint32_t any_dur;
+  uint32_t no_dur;
+  float any_thres;
+  float no_thres;
+  float acc[3];
+  float slope;
+  float d;
+  int i;
+
+  /* The reference starts from the signal when the accelerometer starts */
+
+  if (!sim_initialized(dev) || !(dev->regs[REG_PWR_CTRL] & PWR_CTRL_ACC_EN))
+  {
+    dev->feat_next = (now / FEAT_PERIOD_TICKS + 1) * FEAT_PERIOD_TICKS;
+    for (i = 0; i < 3; i++)
+    {
+      dev->motion_ref[i] = dev->acc_g[i] + dev->config.acc_bias_g[i];
+    }
+
+    return;
+  }
+
+  any_on = sim_motion_config(&dev->feat[1][0x0c], &any_dur, &any_thres);
+  no_on = sim_motion_config(&dev->feat[2][0x00], &no_dur, &no_thres);
+
+  for (; dev->feat_next <= now; dev->feat_next += FEAT_PERIOD_TICKS)
+  {
+    slope = 0.0f;
+    for (i = 0; i < 3; i++)
+    {
+      acc[i] = dev->acc_g[i] + dev->config.acc_bias_g[i];
+      d = fabsf(acc[i] - dev->motion_ref[i]);
+      slope = d > slope ? d : slope;
+    }
+
+    if (any_on && slope > any_thres)
+    {
+      if (++dev->any_count > any_dur)
+      {
+        dev->regs[REG_INT_STATUS0] |= INT_STATUS0_ANY_MOTION;
+        memcpy(dev->motion_ref, acc, sizeof(acc));
+        dev->any_count = 0;
+      }
+    }
+    else
+    {
+      dev->any_count = 0;
+    }
+
+    if (no_on && slope <= no_thres)
+    {
+      if (++dev->still_count == no_dur + 1)
+      {
+        dev->regs[REG_INT_STATUS0] |= INT_STATUS0_NO_MOTION;
+      }
+    }
+    else
+    {
+      dev->still_count = 0;
+    }
+  }
+}
+
+static void sim_update_time(FAR struct bmi270_sim_dev_s *dev)
+{
+  if (dev->config.time_scale > 0.0f)
+  {
+    dev->vt_ns = (uint64_t)((host_now_ns() - dev->t0_ns) *
+                            (double)dev->config.time_scale);
+  }
+
+  sim_generate(dev);
+  sim_features(dev);
+}
+
+static void sim_config_frame(FAR struct bmi270_sim_dev_s *dev)
+{
+  uint8_t frame[5];
+
+  if (!sim_header_mode(dev) || !(sim_acc_on(dev) || sim_gyr_on(dev)))
+  {
+    return;
+  }
+
+  frame[0] = FIFO_HEADER_CFG;
+  frame[1] = dev->regs[REG_ACC_CONF];
+  frame[2] = dev->regs[REG_ACC_RANGE];
+  frame[3] = dev->regs[REG_GYR_CONF];
+  frame[4] = dev->regs[REG_GYR_RANGE];
+  sim_fifo_push(dev, frame, sizeof(frame));
+}
+
+static void sim_reset(FAR struct bmi270_sim_dev_s *dev)
+{
+  memset(dev->regs, 0, sizeof(dev->regs));
+  dev->regs[REG_CHIPID] = SIM_CHIP_ID;
+  dev->regs[REG_STATUS] = 0x10;
+  dev->regs[REG_ACC_CONF] = 0xa8;
+  dev->regs[REG_ACC_RANGE] = 0x02;
+  dev->regs[REG_GYR_CONF] = 0xa9;
+  dev->regs[REG_AUX_CONF] = 0x46;
+  dev->regs[REG_FIFO_DOWNS] = 0x88;
+  dev->regs[REG_FIFO_WTM_1] = 0x02;
+  dev->regs[REG_FIFO_CONFIG_0] = 0x02;
+  dev->regs[REG_FIFO_CONFIG_1] = 0x10;
+  dev->regs[REG_AUX_DEV_ID] = MAG_I2C_ADDRESS << 1;
+  dev->regs[REG_AUX_IF_CONF] = 0x83;
+  dev->regs[REG_AUX_RD_ADDR] = MAG_REG_DATA_X;
+  dev->regs[REG_AUX_WR_ADDR] = MAG_REG_POWER;
+  dev->regs[REG_PWR_CONF] = 0x03;
+  memset(dev->config_mem, 0, sizeof(dev->config_mem));
+  dev->config_loading = false;
+  dev->init_pos = 0;
+  dev->fifo_len = 0;
+  memset(dev->feat, 0, sizeof(dev->feat));
+  dev->any_count = 0;
+  dev->still_count = 0;
+  sim_reschedule(dev);
+}
+
+static void sim_reg_write(FAR struct bmi270_sim_dev_s *dev, uint8_t reg,
+                          uint8_t value)
+{
+  FAR const uint8_t *blob;
+  int size;
+
+  switch (reg)
+  {
+  case REG_CHIPID:
+  case REG_ERR_REG:
+  case REG_STATUS:
+  case REG_SENSORTIME0:
+  case REG_SENSORTIME1:
+  case REG_SENSORTIME2:
+  case REG_INT_STATUS0:
+  case REG_INT_STATUS1:
+  case REG_INTERNAL_STATUS:
+  case REG_TEMPERATURE_0:
+  case REG_TEMPERATURE_1:
+  case REG_FIFO_LENGTH_0:
+  case REG_FIFO_LENGTH_1:
+  case REG_SATURATION:
+    break;
+
+  case REG_CMD:
+    if (value == CMD_SOFTRESET)
+    {
+      sim_reset(dev);
+    }
+    else if (value == CMD_FIFO_FLUSH)
+    {
+      dev->fifo_len = 0;
+    }
+
+    break;
+
+  case REG_INIT_CTRL:
+    dev->regs[reg] = value;
+    if (value == 0x00)
+    {
+      dev->config_loading = true;
+      dev->regs[REG_INTERNAL_STATUS] = 0x00;
+    }
+    else if (value == 0x01 && dev->config_loading)
+    {
+      blob = get_bmi270_config_file_addr();
+      size = get_bmi270_config_file_size();
+      if (size > SIM_CONFIG_SIZE)
+      {
+        size = SIM_CONFIG_SIZE;
+      }
+
+      dev->config_loading = false;
+      if (memcmp(dev->config_mem, blob, size) == 0)
+      {
+        dev->regs[REG_INTERNAL_STATUS] = 0x01;
+        dev->stats.init_uploads++;
+        sim_reschedule(dev);
+      }
+      else
+      {
+        dev->regs[REG_INTERNAL_STATUS] = 0x02;
+      }
+    }
+
+    break;
+
+  case REG_ACC_CONF:
+  case REG_ACC_RANGE:
+  case REG_GYR_CONF:
+  case REG_GYR_RANGE:
+  case REG_AUX_CONF:
+  case REG_FIFO_DOWNS:
+    if (dev->regs[reg] != value)
+    {
+      dev->regs[reg] = value;
+      sim_reschedule(dev);
+      sim_config_frame(dev);
+    }
+
+    break;
+
+  case REG_INIT_ADDR_0:
+  case REG_INIT_ADDR_1:
+    dev->regs[reg] = value;
+    dev->init_pos = ((dev->regs[REG_INIT_ADDR_0] & 0x0f) |
+                     (dev->regs[REG_INIT_ADDR_1] << 4)) * 2;
+    break;
+
+  case REG_PWR_CTRL:
+  case REG_FIFO_CONFIG_1:
+  case REG_IF_CONF:
+  case REG_AUX_IF_CONF:
+    dev->regs[reg] = value;
+    sim_reschedule(dev);
+    break;
+
+  /* Manual mode accesses, done by the time the next transfer polls
+   * STATUS.aux_busy
+   */
+
+  case REG_AUX_RD_ADDR:
+    dev->regs[reg] = value;
+    if (sim_aux_powered(dev) &&
+        (dev->regs[REG_AUX_IF_CONF] & AUX_IF_CONF_MANUAL))
+    {
+      uint8_t data[AUX_FRAME_LENGTH];
+
+      sim_sample_aux(dev, value, data);
+    }
+
+    break;
+
+  case REG_AUX_WR_ADDR:
+    dev->regs[reg] = value;
+    if (sim_aux_powered(dev) &&
+        (dev->regs[REG_AUX_IF_CONF] & AUX_IF_CONF_MANUAL) &&
+        dev->regs[REG_AUX_DEV_ID] == MAG_I2C_ADDRESS << 1)
+    {
+      sim_mag_write(dev, value, dev->regs[REG_AUX_WR_DATA]);
+    }
+
+    break;
+
+  case REG_FEAT_PAGE:
+    dev->regs[reg] = value & (FEAT_PAGES - 1);
+    break;
+
+  default:
+    if (reg >= REG_FEATURES && reg < REG_FEATURES + FEAT_PAGE_SIZE)
+    {
+      dev->feat[dev->regs[REG_FEAT_PAGE]][reg - REG_FEATURES] = value;
+      break;
+    }
+
+    dev->regs[reg] = value;
+    break;
+  }
+}
+
+static uint8_t sim_reg_read(FAR struct bmi270_sim_dev_s *dev, uint8_t reg)
+{
+  uint64_t ticks;
+  int16_t temp;
+  uint8_t value;
+
+  switch (reg)
+  {
+  case REG_STATUS:
+    value = 0x10;
+    if (sim_initialized(dev) && (dev->regs[REG_PWR_CTRL] & PWR_CTRL_ACC_EN))
+    {
+      value |= 0x80;
+    }
+
+    if (sim_initialized(dev) && (dev->regs[REG_PWR_CTRL] & PWR_CTRL_GYR_EN))
+    {
+      value |= 0x40;
+    }
+
+    return value;
+
+  case REG_SENSORTIME0:
+  case REG_SENSORTIME1:
+  case REG_SENSORTIME2:
+    ticks = sim_ticks(dev) & 0xffffff;
+    return (ticks >> (8 * (reg - REG_SENSORTIME0))) & 0xff;
+
+  case REG_TEMPERATURE_0:
+  case REG_TEMPERATURE_1:
+    temp = (int16_t)lrintf((dev->config.temperature_c - 23.0f) * 512.0f);
+    return reg == REG_TEMPERATURE_0 ? temp & 0xff : (temp >> 8) & 0xff;
+
+  case REG_FIFO_LENGTH_0:
+    return dev->fifo_len & 0xff;
+
+  case REG_FIFO_LENGTH_1:
+    return (dev->fifo_len >> 8) & 0x3f;
+
+  case REG_SATURATION:
+    value = dev->regs[reg];
+    dev->regs[reg] = 0;
+    return value;
+
+  case REG_INT_STATUS0:
+    value = dev->regs[reg];
+    dev->regs[reg] = 0;
+    return value;
+
+  case REG_INT_STATUS1:
+    return sim_int_status1(dev);
+
+  default:
+    if (reg >= REG_FEATURES && reg < REG_FEATURES + FEAT_PAGE_SIZE)
+    {
+      return dev->feat[dev->regs[REG_FEAT_PAGE]][reg - REG_FEATURES];
+    }
+
+    return dev->regs[reg];
+  }
+}
+
+/**
+ * @brief stream FIFO_DATA into a read message
+ *
+ * Whole frames are removed from the FIFO; a frame cut off by the end of
+ * the read is delivered again on the next read.  Once the FIFO is empty a
+ * sensortime frame follows if enabled, then over-read filler.
+ */
+
+static void sim_fifo_read(FAR struct bmi270_sim_dev_s *dev,
+                          FAR uint8_t *buf, int len)
+{
+  bool header = sim_header_mode(dev);
+  uint64_t ticks;
+  int copied = 0;
+  int size;
+
+  while (copied < len && dev->fifo_len > 0)
+  {
+    size = sim_frame_size(dev, 0);
+    if (size > len - copied)
+    {
+      memcpy(buf + copied, dev->fifo, len - copied);
+      copied = len;
+      break;
+    }
+
+    memcpy(buf + copied, dev->fifo, size);
+    sim_fifo_consume(dev, size);
+    copied += size;
+  }
+
+  dev->stats.fifo_bytes_read += copied;
+
+  if (copied < len && dev->fifo_len == 0 && header &&
+      (dev->regs[REG_FIFO_CONFIG_0] & FIFO_CONFIG_0_TIME_EN) &&
+      len - copied >= 4)
+  {
+    ticks = sim_ticks(dev) & 0xffffff;
+    buf[copied++] = FIFO_HEADER_TIME;
+    buf[copied++] = ticks & 0xff;
+    buf[copied++] = (ticks >> 8) & 0xff;
+    buf[copied++] = (ticks >> 16) & 0xff;
+  }
+
+  while (copied < len)
+  {
+    buf[copied] = header ? FIFO_HEADER_REGULAR : ((copied & 1) ? 0x80 : 0);
+    copied++;
+  }
+}
+
+static int sim_transfer(FAR struct bmi270_sim_dev_s *dev,
+                        FAR struct i2c_transfer_s *xfer)
+{
+  FAR struct i2c_msg_s *msg;
+  bool expect_reg = true;
+  bool addr_only = false;
+  uint8_t reg = 0;
+  ssize_t i;
+  size_t m;
+  int cont;
+
+  for (m = 0; m < xfer->msgc; m++)
+  {
+    if (xfer->msgv[m].addr != SIM_I2C_ADDRESS)
+    {
+      dev->stats.nacks++;
+      return -ENXIO;
+    }
+  }
+
+  sim_update_time(dev);
+  dev->stats.transfers++;
+
+  if (dev->stuck || dev->fail_transfers > 0)
+  {
+    if (dev->fail_transfers > 0)
+    {
+      dev->fail_transfers--;
+    }
+
+    dev->stats.faults++;
+    return -EIO;
+  }
+
+  /* STOP and bus free time before the next START, about one SCL period */
+
+  if (xfer->msgc > 0 && xfer->msgv[0].frequency > 0)
+  {
+    dev->stats.bus_ns += 1000000000ull / xfer->msgv[0].frequency;
+  }
+
+  for (m = 0; m < xfer->msgc; m++)
+  {
+    msg = &xfer->msgv[m];
+    dev->stats.messages++;
+
+    /* A write right after one that only carried the register address,
+     * as from i2c_reg_write_burst(), or one flagged I2C_M_NOSTART, as from
+     * i2c_txn_write_burst(), continues the data phase of that write.  Any
+     * other message starts with a repeated START and an address.
+     */
+
+    cont = !(msg->flags & I2C_M_READ) &&
+           ((msg->flags & I2C_M_NOSTART) || addr_only);
+    addr_only = false;
+    if (msg->frequency > 0)
+    {
+      dev->stats.bus_ns += (uint64_t)(1 - cont + msg->length) * 9 *
+                           1000000000ull / msg->frequency;
+    }
+
+    if (msg->flags & I2C_M_READ)
+    {
+      dev->stats.bytes_read += msg->length;
+      if (reg == REG_FIFO_DATA)
+      {
+        sim_fifo_read(dev, msg->buffer, msg->length);
+      }
+      else
+      {
+        for (i = 0; i < msg->length; i++)
+        {
+          msg->buffer[i] = sim_reg_read(dev, reg);
+          reg = (reg + 1) & 0x7f;
+        }
+      }
+
+      expect_reg = true;
+      continue;
+    }
+
+    dev->stats.bytes_written += msg->length;
+    i = 0;
+    if ((expect_reg || !cont) && msg->length > 0)
+    {
+      reg = msg->buffer[0] & 0x7f;
+      i = 1;
+      expect_reg = false;
+      addr_only = msg->length == 1;
+    }
+
+    for (; i < msg->length; i++)
+    {
+      if (reg == REG_INIT_DATA)
+      {
+        /* Burst writes are rejected in advanced power save */
+
+        if (!(dev->regs[REG_PWR_CONF] & PWR_CONF_ADV_POWER_SAVE) &&
+            dev->init_pos < SIM_CONFIG_SIZE)
+        {
+          dev->config_mem[dev->init_pos] = msg->buffer[i];
+        }
+
+        dev->init_pos++;
+        dev->regs[REG_INIT_ADDR_0] = (dev->init_pos / 2) & 0x0f;
+        dev->regs[REG_INIT_ADDR_1] = (dev->init_pos / 2 >> 4) & 0xff;
+        continue;
+      }
+
+      sim_reg_write(dev, reg, msg->buffer[i]);
+      if (reg != REG_FIFO_DATA)
+      {
+        reg = (reg + 1) & 0x7f;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Without transfers nothing advances a free running sensor time, so a
+ * thread does it while INT1 is in use.
+ */
+
+static FAR void *sim_tick_main(FAR void *arg)
+{
+  FAR struct bmi270_sim_dev_s *dev = arg;
+  struct timespec ts = { 0, SIM_TICK_NS };
+  bool level;
+
+  while (1)
+  {
+    nanosleep(&ts, NULL);
+    pthread_mutex_lock(&dev->lock);
+    sim_update_time(dev);
+    level = sim_int1_level(dev);
+    pthread_mutex_unlock(&dev->lock);
+    host_gpio_set_level(dev->int1_pin, level);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief INT1 level after a state change, called with the lock held
+ *
+ * The level is applied to the pin by the caller once the lock is
+ * released, since the pin may run an interrupt handler that talks to
+ * the chip.
+ */
+
+static bool sim_int1_sync(FAR struct bmi270_sim_dev_s *dev)
+{
+  pthread_t thread;
+
+  if (!dev->ticking && dev->config.time_scale > 0.0f &&
+      (dev->regs[REG_INT1_IO_CTRL] & INT1_IO_CTRL_OUTPUT_EN))
+  {
+    if (pthread_create(&thread, NULL, sim_tick_main, dev) == 0)
+    {
+      pthread_detach(thread);
+      dev->ticking = true;
+    }
+  }
+
+  return sim_int1_level(dev);
+}
+
+static int bmi270_sim_open(FAR void *priv)
+{
+  FAR struct bmi270_sim_dev_s *dev = priv;
+
+  pthread_mutex_lock(&dev->lock);
+  dev->opens++;
+  pthread_mutex_unlock(&dev->lock);
+  return 0;
+}
+
+static int bmi270_sim_close(FAR void *priv)
+{
+  FAR struct bmi270_sim_dev_s *dev = priv;
+  FAR struct bmi270_sim_stats_s *st = &dev->stats;
+
+  /* Statistics once the last descriptor is closed */
+
+  pthread_mutex_lock(&dev->lock);
+  if (--dev->opens > 0)
+  {
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+  }
+
+  printf("bmi270_sim: %u transfers, %u msgs, %llu B written, "
+         "%llu B read (%llu B FIFO), bus %llu us\n",
+         st->transfers, st->messages,
+         (unsigned long long)st->bytes_written,
+         (unsigned long long)st->bytes_read,
+         (unsigned long long)st->fifo_bytes_read,
+         (unsigned long long)(st->bus_ns / 1000));
+  printf("bmi270_sim: %u frames, %u dropped\n",
+         st->frames, st->frames_dropped);
+  pthread_mutex_unlock(&dev->lock);
+  return 0;
+}
+
+static int bmi270_sim_ioctl(FAR void *priv, int cmd, unsigned long arg)
+{
+  FAR struct bmi270_sim_dev_s *dev = priv;
+  bool level;
+  bool realtime;
+  int ret;
+  uint64_t bus_ns;
+  struct timespec ts;
+
+  if (cmd == I2CIOC_RESET)
+  {
+    pthread_mutex_lock(&dev->lock);
+    dev->stats.bus_resets++;
+    dev->stuck = false;
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+  }
+
+  if (cmd != I2CIOC_TRANSFER)
+  {
+    return -ENOTTY;
+  }
+
+  pthread_mutex_lock(&dev->bus_lock);
+  pthread_mutex_lock(&dev->lock);
+  bus_ns = dev->stats.bus_ns;
+  ret = sim_transfer(dev, (FAR struct i2c_transfer_s *)(uintptr_t)arg);
+  bus_ns = dev->stats.bus_ns - bus_ns;
+  realtime = dev->config.bus_realtime;
+  level = sim_int1_sync(dev);
+  pthread_mutex_unlock(&dev->lock);
+  host_gpio_set_level(dev->int1_pin, level);
+
+  if (realtime && bus_ns > 0)
+  {
+    ts.tv_sec = bus_ns / 1000000000ull;
+    ts.tv_nsec = bus_ns % 1000000000ull;
+    nanosleep(&ts, NULL);
+  }
+
+  pthread_mutex_unlock(&dev->bus_lock);
+  return ret;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**
+ * @brief power on the virtual BMI270 and register its bus
+ *
+ * @param devpath I2C bus device path, normally I2C_DEVNAME_FOR_BMI270
+ * @param int1_pin GPIO driven by the INT1 output, see host_gpio.c
+ * @return int success == 0
+ */
+
+int bmi270_sim_register(FAR const char *devpath, uint32_t int1_pin)
+{
+  FAR struct bmi270_sim_dev_s *dev = &g_bmi270_sim;
+  FAR const char *env;
+
+  dev->int1_pin = int1_pin;
+
+  env = getenv("BMI270_SIM_TIME_SCALE");
+  if (env != NULL)
+  {
+    dev->config.time_scale = strtof(env, NULL);
+  }
+
+  dev->rng = dev->config.seed ? dev->config.seed : 1;
+  dev->t0_ns = host_now_ns();
+  dev->vt_ns = 0;
+  sim_reset(dev);
+  return host_register_driver(devpath, &g_bmi270_sim_fops, dev);
+}
+
+void bmi270_sim_configure(FAR const struct bmi270_sim_config_s *config)
+{
+  FAR struct bmi270_sim_dev_s *dev = &g_bmi270_sim;
+
+  pthread_mutex_lock(&dev->lock);
+  dev->config = *config;
+  dev->rng = config->seed ? config->seed : 1;
+  dev->t0_ns = host_now_ns() -
+               (config->time_scale > 0.0f ?
+                (uint64_t)(dev->vt_ns / config->time_scale) : 0);
+  pthread_mutex_unlock(&dev->lock);
+}
+
+/**
+ * @brief advance sensor time in manual mode (time_scale == 0)
+ *
+ * @param ns sensor time to add
+ */
+
+void bmi270_sim_advance(uint64_t ns)
+{
+  FAR struct bmi270_sim_dev_s *dev = &g_bmi270_sim;
+  bool level;
+
+  pthread_mutex_lock(&dev->lock);
+  dev->vt_ns += ns;
+  sim_generate(dev);
+  sim_features(dev);
+  level = sim_int1_sync(dev);
+  pthread_mutex_unlock(&dev->lock);
+  host_gpio_set_level(dev->int1_pin, level);
+}
+
+/**
+ * @brief set the true specific force and rotation rate seen by the chip
+ *
+ * @param acc_g acceleration in g, body frame
+ * @param gyr_dps rotation rate in degree/s, body frame
+ */
+
+void bmi270_sim_set_motion(FAR const float acc_g[3],
+                           FAR const float gyr_dps[3])
+{
+  FAR struct bmi270_sim_dev_s *dev = &g_bmi270_sim;
+
+  pthread_mutex_lock(&dev->lock);
+  memcpy(dev->acc_g, acc_g, sizeof(dev->acc_g));
+  memcpy(dev->gyr_dps, gyr_dps, sizeof(dev->gyr_dps));
+  pthread_mutex_unlock(&dev->lock);
+}
+
+/**
+ * @brief set the field seen by the BMM150 on the AUX bus
+ *
+ * @param ut magnetic field in uT, body frame
+ */
+
+void bmi270_sim_set_mag(FAR const float ut[3])
+{
+  FAR struct bmi270_sim_dev_s *dev = &g_bmi270_sim;
+
+  pthread_mutex_lock(&dev->lock);
+  memcpy(dev->mag_ut, ut, sizeof(dev->mag_ut));
+  pthread_mutex_unlock(&dev->lock);
+}
+
+void bmi270_sim_get_stats(FAR struct bmi270_sim_stats_s *stats)
+{
+  pthread_mutex_lock(&g_bmi270_sim.lock);
+  *stats = g_bmi270_sim.stats;
+  pthread_mutex_unlock(&g_bmi270_sim.lock);
+}
+
+void bmi270_sim_reset_stats(void)
+{
+  pthread_mutex_lock(&g_bmi270_sim.lock);
+  memset(&g_bmi270_sim.stats, 0, sizeof(g_bmi270_sim.stats));
+  pthread_mutex_unlock(&g_bmi270_sim.lock);
+}
+
+/**
+ * @brief make transfers fail with -EIO
+ *
+ * @param transfers number of transfers to fail
+ * @param stuck fail all of them until I2CIOC_RESET, as with SDA held low
+ */
+
+void bmi270_sim_inject_fault(uint32_t transfers, bool stuck)
+{
+  pthread_mutex_lock(&g_bmi270_sim.lock);
+  g_bmi270_sim.fail_transfers = transfers;
+  g_bmi270_sim.stuck = stuck;
+  pthread_mutex_unlock(&g_bmi270_sim.lock);
+}
+
+/**
+ * @brief power the chip off and on, losing its registers and config
+ */
+
+void bmi270_sim_power_cycle(void)
+{
+  FAR struct bmi270_sim_dev_s *dev = &g_bmi270_sim;
+  bool level;
+
+  pthread_mutex_lock(&dev->lock);
+  sim_reset(dev);
+  memset(dev->mag, 0, sizeof(dev->mag));
+  level = sim_int1_level(dev);
+  pthread_mutex_unlock(&dev->lock);
+  host_gpio_set_level(dev->int1_pin, level);
+}
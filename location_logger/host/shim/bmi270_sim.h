@@ -0,0 +1,110 @@
+/****************************************************************************
+ * location_logger/host/shim/bmi270_sim.h
+ *
+ * Virtual BMI270 behind the host I2C bus (/dev/i2c0).  I2CIOC_TRANSFER
+ * requests addressed to BMI270_I2C_ADDRESS are served from a register
+ * model covering the map used by i2c_bmi270.c: CHIPID, CMD (soft reset,
+ * FIFO flush), PWR_CONF/PWR_CTRL, INIT_CTRL/INIT_ADDR/INIT_DATA config
+ * upload, ACC/GYR_CONF and RANGE, FIFO_CONFIG, FIFO_DOWNS, FIFO_WTM,
+ * FIFO_LENGTH/FIFO_DATA, DATA, SENSORTIME, TEMPERATURE, STATUS and
+ * SATURATION.  INT1_IO_CTRL, INT_LATCH, INT_MAP_DATA and INT_STATUS_1
+ * model the non-latched FIFO watermark/full interrupt, which drives the
+ * GPIO given to bmi270_sim_register() through host_gpio.c.  FEAT_PAGE and
+ * FEATURES hold the feature engine settings; the any-motion and no-motion
+ * detectors run on the noiseless signal and report in the clear on read
+ * INT_STATUS_0, mapped to INT1 by INT1_MAP_FEAT.  The AUX interface
+ * (PWR_CTRL.aux_en, IF_CONF, AUX_DEV_ID, AUX_IF_CONF, AUX_RD_ADDR,
+ * AUX_WR_ADDR, AUX_WR_DATA, AUX_CONF) leads to a BMM150 magnetometer,
+ * read into DATA_0..7 in manual mode and into header mode FIFO frames at
+ * the AUX_CONF rate in data mode.
+ *
+ * Every message of a transfer starts with a repeated START and a
+ * register address unless it carries I2C_M_NOSTART or is a write right
+ * after one carrying only the address.  The bus time counts 9 SCL
+ * periods per byte plus one per transfer for STOP and bus free.
+ * Transfers are serialised like on a real bus and, with bus_realtime,
+ * each one keeps the bus for that time.  Bus faults and power loss can be
+ * injected; I2CIOC_RESET clears a stuck bus.
+ *
+ * The FIFO is filled at the configured ODRs with a stationary signal
+ * (1 g on +Z) plus bias and white noise.  Sample time follows
+ * CLOCK_MONOTONIC scaled by time_scale, or is advanced explicitly with
+ * bmi270_sim_advance() when time_scale is zero.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_SHIM_BMI270_SIM_H
+#define __HOST_SHIM_BMI270_SIM_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BMI270_SIM_FIFO_SIZE (6144)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct bmi270_sim_config_s
+{
+  float time_scale;       /* Sensor time per host time, 0: manual */
+  float acc_noise_g;      /* Accelerometer white noise, 1 sigma */
+  float gyr_noise_dps;    /* Gyroscope white noise, 1 sigma */
+  float acc_bias_g[3];
+  float gyr_bias_dps[3];
+  float temperature_c;
+  uint32_t seed;
+  bool bus_realtime;      /* Hold the bus for the estimated SCL time */
+  float gyr_tempco_dps[3];  /* Gyro bias change per K from 23 degC */
+};
+
+struct bmi270_sim_stats_s
+{
+  uint32_t transfers;     /* I2CIOC_TRANSFER ioctls addressed to the chip */
+  uint32_t messages;      /* i2c_msg_s processed */
+  uint32_t nacks;         /* Messages to other addresses */
+  uint64_t bytes_written; /* Including register address bytes */
+  uint64_t bytes_read;
+  uint64_t fifo_bytes_read;
+  uint64_t bus_ns;        /* Estimated SCL time, 9 bits per byte */
+  uint32_t frames;        /* Frames pushed into the FIFO */
+  uint32_t frames_dropped;
+  uint32_t init_uploads;  /* Successful INIT_CTRL 0->1 sequences */
+  uint32_t faults;        /* Transfers failed by bmi270_sim_inject_fault() */
+  uint32_t bus_resets;    /* I2CIOC_RESET ioctls */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+int bmi270_sim_register(FAR const char *devpath, uint32_t int1_pin);
+void bmi270_sim_configure(FAR const struct bmi270_sim_config_s *config);
+void bmi270_sim_advance(uint64_t ns);
+void bmi270_sim_set_motion(FAR const float acc_g[3],
+                           FAR const float gyr_dps[3]);
+void bmi270_sim_set_mag(FAR const float ut[3]);
+void bmi270_sim_get_stats(FAR struct bmi270_sim_stats_s *stats);
+void bmi270_sim_reset_stats(void);
+void bmi270_sim_inject_fault(uint32_t transfers, bool stuck);
+void bmi270_sim_power_cycle(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __HOST_SHIM_BMI270_SIM_H */
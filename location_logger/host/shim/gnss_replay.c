@@ -0,0 +1,732 @@
+/****************************************************************************
+ * location_logger/host/shim/gnss_replay.c
+ *
+ * PVT frame replay behind /dev/gps2.  See gnss_replay.h for the recording
+ * format and the knobs.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arch/chip/gnss.h>
+
+#include "host_dev.h"
+#include "gnss_replay.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef GNSS_REPLAY_DEFAULT_FILE
+#  define GNSS_REPLAY_DEFAULT_FILE "data/sample_drive.csv"
+#endif
+
+#define GNSS_REPLAY_PATH_MAX 256
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct gnss_replay_frame_s
+{
+  uint32_t t_ms;
+  uint8_t fixmode;
+  double latitude;
+  double longitude;
+  double altitude;
+  float velocity;
+  float direction;
+};
+
+struct gnss_replay_dev_s
+{
+  pthread_mutex_t lock;
+
+  /* Configuration */
+
+  char file[GNSS_REPLAY_PATH_MAX];
+  bool realtime;
+  int loops;
+  bool exit_at_end;     /* exit() instead of failing with ENODATA */
+
+  /* Recording */
+
+  FAR struct gnss_replay_frame_s *frames;
+  int nframes;
+  uint32_t span_ms;     /* Length of one pass including one cycle */
+
+  /* Receiver state */
+
+  bool opened;
+  bool started;
+  uint32_t cycle_ms;
+  struct cxd56_gnss_signal_setting_s sig;
+  int next;
+  int pass;
+  uint64_t start_ns;
+  uint64_t release_ns;  /* Release time of the frame last handed out */
+  uint64_t wait_ns;     /* Time of the previous sigwaitinfo() */
+  bool fresh;           /* Handed-out frame not read yet */
+  struct cxd56_gnss_positiondata_s posdat;
+
+  struct gnss_replay_stats_s stats;
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+int __real_sigwaitinfo(FAR const sigset_t *set, FAR siginfo_t *info);
+int __real_sigtimedwait(FAR const sigset_t *set, FAR siginfo_t *info,
+                        FAR const struct timespec *timeout);
+unsigned int __real_sleep(unsigned int seconds);
+
+static int gnss_replay_open(FAR void *priv);
+static int gnss_replay_close(FAR void *priv);
+static ssize_t gnss_replay_read(FAR void *priv, FAR void *buffer,
+                                size_t buflen);
+static int gnss_replay_ioctl(FAR void *priv, int cmd, unsigned long arg);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const struct host_file_operations_s g_gnss_replay_fops =
+{
+  gnss_replay_open,
+  gnss_replay_close,
+  gnss_replay_read,
+  gnss_replay_ioctl
+};
+
+static struct gnss_replay_dev_s g_gnss_replay =
+{
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .file = GNSS_REPLAY_DEFAULT_FILE,
+  .loops = 1,
+  .exit_at_end = true,
+  .cycle_ms = 1000,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/**
+ * @brief load the recording into memory
+ *
+ * @param dev replay device
+ * @return int success == 0
+ */
+
+static int gnss_replay_load(FAR struct gnss_replay_dev_s *dev)
+{
+  FAR FILE *fp;
+  char line[256];
+  int capacity = 0;
+  struct gnss_replay_frame_s frame;
+  unsigned int fixmode;
+
+  fp = fopen(dev->file, "r");
+  if (fp == NULL)
+  {
+    printf("gnss_replay: cannot open %s: %d\n", dev->file, errno);
+    return -ENOENT;
+  }
+
+  dev->nframes = 0;
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    if (line[0] == '#' || line[0] == '\n')
+    {
+      continue;
+    }
+
+    if (sscanf(line, "%u,%u,%lf,%lf,%lf,%f,%f",
+               &frame.t_ms, &fixmode, &frame.latitude, &frame.longitude,
+               &frame.altitude, &frame.velocity, &frame.direction) != 7)
+    {
+      printf("gnss_replay: bad line: %s", line);
+      continue;
+    }
+
+    frame.fixmode = (uint8_t)fixmode;
+
+    if (dev->nframes == capacity)
+    {
+      FAR struct gnss_replay_frame_s *frames;
+
+      capacity = capacity ? capacity * 2 : 256;
+      frames = realloc(dev->frames, capacity * sizeof(*frames));
+      if (frames == NULL)
+      {
+        fclose(fp);
+        return -ENOMEM;
+      }
+
+      dev->frames = frames;
+    }
+
+    dev->frames[dev->nframes++] = frame;
+  }
+
+  fclose(fp);
+
+  if (dev->nframes == 0)
+  {
+    printf("gnss_replay: %s has no frames\n", dev->file);
+    return -ENODATA;
+  }
+
+  dev->span_ms = dev->frames[dev->nframes - 1].t_ms - dev->frames[0].t_ms;
+  dev->span_ms += dev->cycle_ms;
+  return 0;
+}
+
+static uint64_t gnss_replay_frame_release(FAR struct gnss_replay_dev_s *dev,
+                                          int pass, int idx)
+{
+  uint64_t offset_ms = (uint64_t)pass * dev->span_ms +
+                       (dev->frames[idx].t_ms - dev->frames[0].t_ms);
+
+  return dev->start_ns + offset_ms * 1000000ull;
+}
+
+/**
+ * @brief release time of the frame gnss_replay_wait() hands out next
+ *
+ * @param dev replay device
+ * @param release CLOCK_MONOTONIC time in ns [out]
+ * @return int success == 0, -ENODATA at the end of the recording
+ */
+
+static int gnss_replay_next_release(FAR struct gnss_replay_dev_s *dev,
+                                    FAR uint64_t *release)
+{
+  int n = dev->next;
+  int p = dev->pass;
+
+  if (n >= dev->nframes)
+  {
+    if (p + 1 >= dev->loops)
+    {
+      return -ENODATA;
+    }
+
+    n = 0;
+    p++;
+  }
+
+  *release = gnss_replay_frame_release(dev, p, n);
+  return 0;
+}
+
+static void gnss_replay_fill(FAR struct gnss_replay_dev_s *dev, int pass,
+                             int idx)
+{
+  FAR const struct gnss_replay_frame_s *frame = &dev->frames[idx];
+  FAR struct cxd56_gnss_receiver_s *rcv = &dev->posdat.receiver;
+  uint32_t t_ms = frame->t_ms + (uint32_t)pass * dev->span_ms;
+
+  memset(&dev->posdat, 0, sizeof(dev->posdat));
+  dev->posdat.data_timestamp = t_ms;
+  rcv->pos_fixmode = frame->fixmode;
+  rcv->vel_fixmode = frame->fixmode;
+  rcv->pos_dataexist = frame->fixmode != CXD56_GNSS_PVT_POSFIX_INVALID;
+  rcv->latitude = frame->latitude;
+  rcv->longitude = frame->longitude;
+  rcv->altitude = frame->altitude;
+  rcv->velocity = frame->velocity;
+  rcv->direction = frame->direction;
+  rcv->time.hour = (t_ms / 3600000) % 24;
+  rcv->time.minute = (t_ms / 60000) % 60;
+  rcv->time.sec = (t_ms / 1000) % 60;
+  rcv->time.usec = (t_ms % 1000) * 1000;
+}
+
+/**
+ * @brief wait for the next position notification
+ *
+ * In realtime mode the caller sleeps until the frame is due.  If the
+ * caller fell behind, frames the receiver would already have overwritten
+ * are skipped and counted as dropped.  In fast mode frames are released
+ * as soon as they are waited for.
+ *
+ * @param dev replay device
+ * @return int success == 0, -ENODATA at the end of the recording
+ */
+
+static int gnss_replay_wait(FAR struct gnss_replay_dev_s *dev)
+{
+  uint64_t now = host_now_ns();
+  uint64_t release;
+  struct timespec ts;
+
+  if (dev->wait_ns != 0)
+  {
+    uint64_t loop = now - dev->wait_ns;
+
+    dev->stats.loop_sum += loop;
+    if (loop > dev->stats.loop_max)
+    {
+      dev->stats.loop_max = loop;
+    }
+  }
+
+  dev->wait_ns = now;
+
+  if (dev->next >= dev->nframes)
+  {
+    if (dev->pass + 1 >= dev->loops)
+    {
+      return -ENODATA;
+    }
+
+    dev->pass++;
+    dev->next = 0;
+  }
+
+  if (!dev->realtime)
+  {
+    gnss_replay_fill(dev, dev->pass, dev->next++);
+    dev->release_ns = now;
+    dev->fresh = true;
+    dev->stats.served++;
+    return 0;
+  }
+
+  /* Skip frames that were already superseded */
+
+  while (1)
+  {
+    int n = dev->next + 1;
+    int p = dev->pass;
+
+    if (n >= dev->nframes)
+    {
+      if (p + 1 >= dev->loops)
+      {
+        break;
+      }
+
+      n = 0;
+      p++;
+    }
+
+    if (gnss_replay_frame_release(dev, p, n) > now)
+    {
+      break;
+    }
+
+    dev->next = n;
+    dev->pass = p;
+    dev->stats.dropped++;
+  }
+
+  release = gnss_replay_frame_release(dev, dev->pass, dev->next);
+  if (release > now)
+  {
+    ts.tv_sec = release / 1000000000ull;
+    ts.tv_nsec = release % 1000000000ull;
+
+    pthread_mutex_unlock(&dev->lock);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+           == EINTR);
+    pthread_mutex_lock(&dev->lock);
+  }
+
+  gnss_replay_fill(dev, dev->pass, dev->next++);
+  dev->release_ns = release;
+  dev->fresh = true;
+  dev->stats.served++;
+  return 0;
+}
+
+/**
+ * @brief print the replay statistics
+ *
+ * @param dev replay device, locked
+ */
+
+static void gnss_replay_report(FAR struct gnss_replay_dev_s *dev)
+{
+  FAR struct gnss_replay_stats_s *st = &dev->stats;
+
+  printf("gnss_replay: %u frames served, %u dropped, %u reads\n",
+         st->served, st->dropped, st->reads);
+  if (st->reads > 0)
+  {
+    printf("gnss_replay: release->read latency "
+           "avg %llu ns, min %llu ns, max %llu ns\n",
+           (unsigned long long)(st->latency_sum / st->reads),
+           (unsigned long long)st->latency_min,
+           (unsigned long long)st->latency_max);
+  }
+
+  if (st->served > 1)
+  {
+    printf("gnss_replay: loop period avg %llu ns, max %llu ns\n",
+           (unsigned long long)(st->loop_sum / (st->served - 1)),
+           (unsigned long long)st->loop_max);
+  }
+}
+
+static int gnss_replay_open(FAR void *priv)
+{
+  FAR struct gnss_replay_dev_s *dev = priv;
+  int ret = 0;
+
+  pthread_mutex_lock(&dev->lock);
+  if (dev->opened)
+  {
+    ret = -EBUSY;
+    goto errout;
+  }
+
+  ret = gnss_replay_load(dev);
+  if (ret < 0)
+  {
+    goto errout;
+  }
+
+  dev->opened = true;
+  dev->started = false;
+  dev->sig.enable = 0;
+  dev->next = 0;
+  dev->pass = 0;
+  dev->wait_ns = 0;
+  dev->fresh = false;
+  memset(&dev->posdat, 0, sizeof(dev->posdat));
+  memset(&dev->stats, 0, sizeof(dev->stats));
+  dev->stats.latency_min = UINT64_MAX;
+
+errout:
+  pthread_mutex_unlock(&dev->lock);
+  return ret;
+}
+
+static int gnss_replay_close(FAR void *priv)
+{
+  FAR struct gnss_replay_dev_s *dev = priv;
+
+  pthread_mutex_lock(&dev->lock);
+  dev->opened = false;
+  dev->started = false;
+
+  gnss_replay_report(dev);
+
+  free(dev->frames);
+  dev->frames = NULL;
+  dev->nframes = 0;
+  pthread_mutex_unlock(&dev->lock);
+  return 0;
+}
+
+static ssize_t gnss_replay_read(FAR void *priv, FAR void *buffer,
+                                size_t buflen)
+{
+  FAR struct gnss_replay_dev_s *dev = priv;
+  uint64_t latency;
+
+  if (buflen < sizeof(dev->posdat))
+  {
+    return -EINVAL;
+  }
+
+  pthread_mutex_lock(&dev->lock);
+  memcpy(buffer, &dev->posdat, sizeof(dev->posdat));
+
+  if (dev->fresh)
+  {
+    latency = host_now_ns() - dev->release_ns;
+    dev->stats.latency_sum += latency;
+    if (latency < dev->stats.latency_min)
+    {
+      dev->stats.latency_min = latency;
+    }
+
+    if (latency > dev->stats.latency_max)
+    {
+      dev->stats.latency_max = latency;
+    }
+
+    dev->stats.reads++;
+    dev->fresh = false;
+  }
+
+  pthread_mutex_unlock(&dev->lock);
+  return sizeof(dev->posdat);
+}
+
+static int gnss_replay_ioctl(FAR void *priv, int cmd, unsigned long arg)
+{
+  FAR struct gnss_replay_dev_s *dev = priv;
+  FAR struct cxd56_gnss_ope_mode_param_s *opemode;
+  uint64_t release;
+  uint64_t offset;
+  int ret = 0;
+
+  pthread_mutex_lock(&dev->lock);
+  switch (cmd)
+  {
+  case CXD56_GNSS_IOCTL_START:
+    dev->started = true;
+    dev->start_ns = host_now_ns();
+
+    /* After a stop the recording goes on one cycle from now */
+
+    if ((dev->next > 0 || dev->pass > 0) &&
+        gnss_replay_next_release(dev, &release) == 0)
+    {
+      offset = release - dev->start_ns;
+      dev->start_ns += dev->cycle_ms * 1000000ull - offset;
+    }
+    break;
+
+  case CXD56_GNSS_IOCTL_STOP:
+    dev->started = false;
+    break;
+
+  case CXD56_GNSS_IOCTL_SELECT_SATELLITE_SYSTEM:
+    break;
+
+  case CXD56_GNSS_IOCTL_SET_OPE_MODE:
+    opemode = (FAR struct cxd56_gnss_ope_mode_param_s *)(uintptr_t)arg;
+    dev->cycle_ms = opemode->cycle;
+    break;
+
+  case CXD56_GNSS_IOCTL_SIGNAL_SET:
+    memcpy(&dev->sig, (FAR void *)(uintptr_t)arg, sizeof(dev->sig));
+    break;
+
+  default:
+    ret = -ENOTTY;
+    break;
+  }
+
+  pthread_mutex_unlock(&dev->lock);
+  return ret;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**
+ * @brief register the replay device
+ *
+ * @param devpath device path, normally CONFIG_GNSS_ADDON_DEVNAME
+ * @return int success == 0
+ */
+
+int gnss_replay_register(FAR const char *devpath)
+{
+  FAR struct gnss_replay_dev_s *dev = &g_gnss_replay;
+  FAR const char *env;
+
+  env = getenv("GNSS_REPLAY_FILE");
+  if (env != NULL)
+  {
+    snprintf(dev->file, sizeof(dev->file), "%s", env);
+  }
+
+  env = getenv("GNSS_REPLAY_MODE");
+  dev->realtime = env != NULL && strcmp(env, "realtime") == 0;
+
+  env = getenv("GNSS_REPLAY_LOOPS");
+  if (env != NULL && atoi(env) > 0)
+  {
+    dev->loops = atoi(env);
+  }
+
+  return host_register_driver(devpath, &g_gnss_replay_fops, dev);
+}
+
+/**
+ * @brief override the replay settings; takes effect on the next open()
+ *
+ * @param file recording, NULL keeps the current one
+ * @param realtime pace frames like the receiver
+ * @param loops number of passes over the recording
+ */
+
+void gnss_replay_configure(FAR const char *file, bool realtime, int loops)
+{
+  FAR struct gnss_replay_dev_s *dev = &g_gnss_replay;
+
+  pthread_mutex_lock(&dev->lock);
+  if (file != NULL)
+  {
+    snprintf(dev->file, sizeof(dev->file), "%s", file);
+  }
+
+  dev->realtime = realtime;
+  dev->loops = loops > 0 ? loops : 1;
+  pthread_mutex_unlock(&dev->lock);
+}
+
+/**
+ * @brief choose what the end of the recording does
+ *
+ * @param enable true: print the statistics and exit(); false: sigwaitinfo()
+ *        fails with ENODATA
+ */
+
+void gnss_replay_exit_at_end(bool enable)
+{
+  pthread_mutex_lock(&g_gnss_replay.lock);
+  g_gnss_replay.exit_at_end = enable;
+  pthread_mutex_unlock(&g_gnss_replay.lock);
+}
+
+bool gnss_replay_is_realtime(void)
+{
+  return g_gnss_replay.realtime;
+}
+
+/**
+ * @brief release time of the frame last handed out by sigwaitinfo()
+ *
+ * @return uint64_t CLOCK_MONOTONIC time in ns
+ */
+
+uint64_t gnss_replay_release_ns(void)
+{
+  uint64_t ns;
+
+  pthread_mutex_lock(&g_gnss_replay.lock);
+  ns = g_gnss_replay.release_ns;
+  pthread_mutex_unlock(&g_gnss_replay.lock);
+  return ns;
+}
+
+void gnss_replay_get_stats(FAR struct gnss_replay_stats_s *stats)
+{
+  pthread_mutex_lock(&g_gnss_replay.lock);
+  *stats = g_gnss_replay.stats;
+  pthread_mutex_unlock(&g_gnss_replay.lock);
+}
+
+/**
+ * @brief sigwaitinfo() that also delivers the replayed GNSS notification
+ */
+
+int __wrap_sigwaitinfo(FAR const sigset_t *set, FAR siginfo_t *info)
+{
+  FAR struct gnss_replay_dev_s *dev = &g_gnss_replay;
+  int signo;
+  int ret;
+
+  pthread_mutex_lock(&dev->lock);
+  signo = dev->sig.signo;
+  if (!dev->opened || !dev->started || !dev->sig.enable ||
+      sigismember(set, signo) != 1)
+  {
+    pthread_mutex_unlock(&dev->lock);
+    return __real_sigwaitinfo(set, info);
+  }
+
+  ret = gnss_replay_wait(dev);
+  if (ret == -ENODATA && dev->exit_at_end)
+  {
+    /* The application loops forever like on the target */
+
+    gnss_replay_report(dev);
+    fflush(stdout);
+    pthread_mutex_unlock(&dev->lock);
+    exit(EXIT_SUCCESS);
+  }
+
+  pthread_mutex_unlock(&dev->lock);
+
+  if (ret < 0)
+  {
+    errno = -ret;
+    return -1;
+  }
+
+  if (info != NULL)
+  {
+    memset(info, 0, sizeof(*info));
+    info->si_signo = signo;
+  }
+
+  return signo;
+}
+
+/**
+ * @brief sigtimedwait() that also delivers the replayed GNSS notification
+ *
+ * In realtime mode it fails with EAGAIN when no frame is due before the
+ * timeout, after sleeping until then; in fast mode frames are released on
+ * demand, so only a zero timeout fails, none being pending.
+ */
+
+int __wrap_sigtimedwait(FAR const sigset_t *set, FAR siginfo_t *info,
+                        FAR const struct timespec *timeout)
+{
+  FAR struct gnss_replay_dev_s *dev = &g_gnss_replay;
+  uint64_t deadline;
+  uint64_t release;
+  struct timespec ts;
+  int signo;
+  int ret;
+
+  pthread_mutex_lock(&dev->lock);
+  signo = dev->sig.signo;
+  if (!dev->opened || !dev->started || !dev->sig.enable ||
+      sigismember(set, signo) != 1 || timeout == NULL)
+  {
+    pthread_mutex_unlock(&dev->lock);
+    return __real_sigtimedwait(set, info, timeout);
+  }
+
+  deadline = host_now_ns() + timeout->tv_sec * 1000000000ull +
+             timeout->tv_nsec;
+  ret = gnss_replay_next_release(dev, &release);
+  if (ret == 0 &&
+      (dev->realtime ? release > deadline :
+       timeout->tv_sec == 0 && timeout->tv_nsec == 0))
+  {
+    pthread_mutex_unlock(&dev->lock);
+    if (dev->realtime)
+    {
+      ts.tv_sec = deadline / 1000000000ull;
+      ts.tv_nsec = deadline % 1000000000ull;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+             == EINTR);
+    }
+
+    errno = EAGAIN;
+    return -1;
+  }
+
+  pthread_mutex_unlock(&dev->lock);
+  return __wrap_sigwaitinfo(set, info);
+}
+
+/**
+ * @brief sleep() that is skipped in fast replay so that the application
+ * loop runs at the rate frames can be consumed
+ */
+
+unsigned int __wrap_sleep(unsigned int seconds)
+{
+  if (!g_gnss_replay.realtime)
+  {
+    return 0;
+  }
+
+  return __real_sleep(seconds);
+}
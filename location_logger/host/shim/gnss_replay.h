@@ -0,0 +1,76 @@
+/****************************************************************************
+ * location_logger/host/shim/gnss_replay.h
+ *
+ * Replaying stand-in for the CXD56 GNSS device.  Recorded PVT frames are
+ * read from a CSV file and served through open()/ioctl()/read() and
+ * sigwaitinfo() or sigtimedwait() on MY_GNSS_SIG, either paced like the
+ * receiver (realtime) or as fast as the application consumes them.
+ *
+ * Recording format, one frame per line ('#' starts a comment):
+ *
+ *   t_ms,fixmode,latitude,longitude,altitude,velocity,direction
+ *
+ * t_ms is the UTC time of day in milliseconds and fixmode uses the
+ * CXD56_GNSS_PVT_POSFIX_* values.
+ *
+ * The defaults can be overridden with environment variables:
+ *
+ *   GNSS_REPLAY_FILE   recording to replay
+ *   GNSS_REPLAY_MODE   "realtime" or "fast" (default)
+ *   GNSS_REPLAY_LOOPS  number of passes over the recording (default 1)
+ *
+ * At the end of the recording the statistics are printed and the process
+ * exits, since the application never leaves its loop; a bench that wants
+ * sigwaitinfo() to fail with ENODATA instead calls
+ * gnss_replay_exit_at_end(false).
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_SHIM_GNSS_REPLAY_H
+#define __HOST_SHIM_GNSS_REPLAY_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct gnss_replay_stats_s
+{
+  uint32_t served;       /* Frames handed out by sigwaitinfo() */
+  uint32_t dropped;      /* Frames overwritten before they were waited for */
+  uint32_t reads;        /* Successful read() of position data */
+  uint64_t latency_sum;  /* Release to read() latency in ns */
+  uint64_t latency_min;
+  uint64_t latency_max;
+  uint64_t loop_sum;     /* Time between consecutive sigwaitinfo() in ns */
+  uint64_t loop_max;
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+int gnss_replay_register(FAR const char *devpath);
+void gnss_replay_configure(FAR const char *file, bool realtime, int loops);
+void gnss_replay_exit_at_end(bool enable);
+bool gnss_replay_is_realtime(void);
+uint64_t gnss_replay_release_ns(void);
+void gnss_replay_get_stats(FAR struct gnss_replay_stats_s *stats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __HOST_SHIM_GNSS_REPLAY_H */
@@ -0,0 +1,45 @@
+/****************************************************************************
+ * location_logger/host/shim/host_board.c
+ *
+ * Host counterpart of the board bring-up: registers the simulated devices
+ * under the paths the location_logger modules expect.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <signal.h>
+
+#include "gnss.h"
+#include "bmi270lib/i2c_bmi270.h"
+#include "bmi270_ctrl.h"
+#include "host_dev.h"
+#include "gnss_replay.h"
+#include "bmi270_sim.h"
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void host_board_initialize(void)
+{
+  int ret;
+
+  ret = gnss_replay_register(CONFIG_GNSS_ADDON_DEVNAME);
+  if (ret < 0)
+  {
+    printf("host: failed to register %s: %d\n",
+           CONFIG_GNSS_ADDON_DEVNAME, ret);
+  }
+
+  ret = bmi270_sim_register(I2C_DEVNAME_FOR_BMI270, BMI270_INT1_PIN);
+  if (ret < 0)
+  {
+    printf("host: failed to register %s: %d\n",
+           I2C_DEVNAME_FOR_BMI270, ret);
+  }
+}
@@ -0,0 +1,250 @@
+/****************************************************************************
+ * location_logger/host/shim/host_dev.c
+ *
+ * Routes open()/close()/read()/ioctl() on registered device paths to the
+ * in-process drivers.  Every other path falls through to the C library.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host_dev.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct host_driver_s
+{
+  FAR const char *path;
+  FAR const struct host_file_operations_s *fops;
+  FAR void *priv;
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+int __real_open(FAR const char *path, int oflags, ...);
+int __real_close(int fd);
+ssize_t __real_read(int fd, FAR void *buffer, size_t buflen);
+int __real_ioctl(int fd, unsigned long req, ...);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct host_driver_s g_drivers[HOST_DEV_MAX_DRIVERS];
+static int g_ndrivers;
+
+/* Driver bound to each open descriptor, NULL if not a simulated device */
+
+static FAR struct host_driver_s *g_fdmap[HOST_DEV_MAX_FDS];
+static pthread_mutex_t g_fdlock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static FAR struct host_driver_s *host_fd_driver(int fd)
+{
+  FAR struct host_driver_s *drv = NULL;
+
+  if (fd >= 0 && fd < HOST_DEV_MAX_FDS)
+  {
+    pthread_mutex_lock(&g_fdlock);
+    drv = g_fdmap[fd];
+    pthread_mutex_unlock(&g_fdlock);
+  }
+
+  return drv;
+}
+
+static int host_set_errno(int ret)
+{
+  if (ret < 0)
+  {
+    errno = -ret;
+    return -1;
+  }
+
+  return ret;
+}
+
+static void __attribute__((constructor)) host_dev_constructor(void)
+{
+  host_board_initialize();
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**
+ * @brief register a simulated device
+ *
+ * @param path device path the application opens
+ * @param fops driver methods
+ * @param priv driver private data passed back to every method
+ * @return int success == 0
+ */
+
+int host_register_driver(FAR const char *path,
+                         FAR const struct host_file_operations_s *fops,
+                         FAR void *priv)
+{
+  if (g_ndrivers >= HOST_DEV_MAX_DRIVERS)
+  {
+    return -ENOMEM;
+  }
+
+  g_drivers[g_ndrivers].path = path;
+  g_drivers[g_ndrivers].fops = fops;
+  g_drivers[g_ndrivers].priv = priv;
+  g_ndrivers++;
+  return 0;
+}
+
+uint64_t host_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int __wrap_open(FAR const char *path, int oflags, ...)
+{
+  FAR struct host_driver_s *drv = NULL;
+  int fd;
+  int ret;
+  int i;
+
+  for (i = 0; i < g_ndrivers; i++)
+  {
+    if (strcmp(g_drivers[i].path, path) == 0)
+    {
+      drv = &g_drivers[i];
+      break;
+    }
+  }
+
+  if (drv == NULL)
+  {
+    va_list ap;
+    int mode = 0;
+
+    if (oflags & O_CREAT)
+    {
+      va_start(ap, oflags);
+      mode = va_arg(ap, int);
+      va_end(ap);
+    }
+
+    return __real_open(path, oflags, mode);
+  }
+
+  /* Reserve a real descriptor number so that it cannot collide with
+   * files the application opens itself.
+   */
+
+  fd = __real_open("/dev/null", O_RDONLY);
+  if (fd < 0)
+  {
+    return fd;
+  }
+
+  if (fd >= HOST_DEV_MAX_FDS)
+  {
+    __real_close(fd);
+    return host_set_errno(-EMFILE);
+  }
+
+  if (drv->fops->open != NULL)
+  {
+    ret = drv->fops->open(drv->priv);
+    if (ret < 0)
+    {
+      __real_close(fd);
+      return host_set_errno(ret);
+    }
+  }
+
+  pthread_mutex_lock(&g_fdlock);
+  g_fdmap[fd] = drv;
+  pthread_mutex_unlock(&g_fdlock);
+  return fd;
+}
+
+int __wrap_close(int fd)
+{
+  FAR struct host_driver_s *drv = host_fd_driver(fd);
+  int ret = 0;
+
+  if (drv != NULL)
+  {
+    pthread_mutex_lock(&g_fdlock);
+    g_fdmap[fd] = NULL;
+    pthread_mutex_unlock(&g_fdlock);
+
+    if (drv->fops->close != NULL)
+    {
+      ret = drv->fops->close(drv->priv);
+    }
+  }
+
+  __real_close(fd);
+  return host_set_errno(ret);
+}
+
+ssize_t __wrap_read(int fd, FAR void *buffer, size_t buflen)
+{
+  FAR struct host_driver_s *drv = host_fd_driver(fd);
+
+  if (drv == NULL)
+  {
+    return __real_read(fd, buffer, buflen);
+  }
+
+  if (drv->fops->read == NULL)
+  {
+    return host_set_errno(-ENOSYS);
+  }
+
+  return host_set_errno(drv->fops->read(drv->priv, buffer, buflen));
+}
+
+int __wrap_ioctl(int fd, unsigned long req, ...)
+{
+  FAR struct host_driver_s *drv = host_fd_driver(fd);
+  unsigned long arg;
+  va_list ap;
+
+  va_start(ap, req);
+  arg = va_arg(ap, unsigned long);
+  va_end(ap);
+
+  if (drv == NULL)
+  {
+    return __real_ioctl(fd, req, arg);
+  }
+
+  if (drv->fops->ioctl == NULL)
+  {
+    return host_set_errno(-ENOTTY);
+  }
+
+  return host_set_errno(drv->fops->ioctl(drv->priv, (int)req, arg));
+}
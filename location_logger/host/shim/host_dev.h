@@ -0,0 +1,80 @@
+/****************************************************************************
+ * location_logger/host/shim/host_dev.h
+ *
+ * Minimal character driver registry for the host build.  Device paths that
+ * the location_logger modules open (/dev/gps2, /dev/i2c0, ...) are served
+ * by in-process drivers instead of the NuttX VFS.  open(), close(), read()
+ * and ioctl() are routed here with the linker's --wrap option, so the
+ * modules are compiled unchanged.
+ *
+ ****************************************************************************/
+
+#ifndef __HOST_SHIM_HOST_DEV_H
+#define __HOST_SHIM_HOST_DEV_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define HOST_DEV_MAX_DRIVERS 8
+#define HOST_DEV_MAX_FDS     64
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Driver methods return zero (or a byte count) on success and a negated
+ * errno value on failure, like NuttX drivers.  The wrappers turn that into
+ * the usual -1/errno convention for the caller.
+ */
+
+struct host_file_operations_s
+{
+  int     (*open)(FAR void *priv);
+  int     (*close)(FAR void *priv);
+  ssize_t (*read)(FAR void *priv, FAR void *buffer, size_t buflen);
+  int     (*ioctl)(FAR void *priv, int cmd, unsigned long arg);
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+int host_register_driver(FAR const char *path,
+                         FAR const struct host_file_operations_s *fops,
+                         FAR void *priv);
+
+/* Board bring-up: registers every simulated device.  Runs automatically
+ * before main().
+ */
+
+void host_board_initialize(void);
+
+/* Monotonic clock helper shared by the simulated devices */
+
+uint64_t host_now_ns(void);
+
+/* Drive a GPIO input from a simulated device, see host_gpio.c */
+
+void host_gpio_set_level(uint32_t pin, bool level);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __HOST_SHIM_HOST_DEV_H */
@@ -0,0 +1,209 @@
+/****************************************************************************
+ * location_logger/host/shim/host_gpio.c
+ *
+ * GPIO interrupt emulation for the host build.  The application configures
+ * pins with the board_gpio_*() calls; simulated devices drive them with
+ * host_gpio_set_level() and the registered handler runs in the caller's
+ * context, as the interrupt would on the target.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arch/board/board.h>
+
+#include "host_dev.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define HOST_GPIO_MAX 8
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct host_gpio_s
+{
+  bool used;
+  uint32_t pin;
+  int mode;
+  xcpt_t isr;
+  bool enabled;
+  bool level;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct host_gpio_s g_gpio[HOST_GPIO_MAX];
+static pthread_mutex_t g_gpiolock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static FAR struct host_gpio_s *host_gpio_get(uint32_t pin)
+{
+  FAR struct host_gpio_s *free = NULL;
+  int i;
+
+  for (i = 0; i < HOST_GPIO_MAX; i++)
+  {
+    if (g_gpio[i].used && g_gpio[i].pin == pin)
+    {
+      return &g_gpio[i];
+    }
+
+    if (!g_gpio[i].used && free == NULL)
+    {
+      free = &g_gpio[i];
+    }
+  }
+
+  if (free != NULL)
+  {
+    free->used = true;
+    free->pin = pin;
+  }
+
+  return free;
+}
+
+/* Called with g_gpiolock held; returns with it released */
+
+static void host_gpio_dispatch(FAR struct host_gpio_s *gpio, bool edge)
+{
+  xcpt_t isr = NULL;
+  bool fire = false;
+
+  if (gpio->enabled && gpio->isr != NULL)
+  {
+    switch (gpio->mode)
+    {
+    case INT_HIGH_LEVEL:
+      fire = gpio->level;
+      break;
+    case INT_LOW_LEVEL:
+      fire = !gpio->level;
+      break;
+    case INT_RISING_EDGE:
+      fire = edge && gpio->level;
+      break;
+    case INT_FALLING_EDGE:
+      fire = edge && !gpio->level;
+      break;
+    case INT_BOTH_EDGE:
+      fire = edge;
+      break;
+    }
+  }
+
+  isr = gpio->isr;
+  pthread_mutex_unlock(&g_gpiolock);
+
+  if (fire)
+  {
+    isr((int)gpio->pin, NULL, NULL);
+  }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int board_gpio_config(uint32_t pin, int mode, bool input, bool drive,
+                      int pull)
+{
+  return 0;
+}
+
+int board_gpio_intconfig(uint32_t pin, int mode, bool filter, xcpt_t isr)
+{
+  FAR struct host_gpio_s *gpio;
+
+  pthread_mutex_lock(&g_gpiolock);
+  gpio = host_gpio_get(pin);
+  if (gpio == NULL)
+  {
+    pthread_mutex_unlock(&g_gpiolock);
+    return -ENOMEM;
+  }
+
+  gpio->mode = mode;
+  gpio->isr = isr;
+  gpio->enabled = false;
+  pthread_mutex_unlock(&g_gpiolock);
+  return (int)pin;
+}
+
+int board_gpio_int(uint32_t pin, bool enable)
+{
+  FAR struct host_gpio_s *gpio;
+
+  pthread_mutex_lock(&g_gpiolock);
+  gpio = host_gpio_get(pin);
+  if (gpio == NULL)
+  {
+    pthread_mutex_unlock(&g_gpiolock);
+    return -ENOMEM;
+  }
+
+  gpio->enabled = enable;
+
+  /* A level interrupt that is already asserted fires on enable */
+
+  host_gpio_dispatch(gpio, false);
+  return 0;
+}
+
+int board_gpio_read(uint32_t pin)
+{
+  FAR struct host_gpio_s *gpio;
+  int level;
+
+  pthread_mutex_lock(&g_gpiolock);
+  gpio = host_gpio_get(pin);
+  level = gpio != NULL && gpio->level;
+  pthread_mutex_unlock(&g_gpiolock);
+  return level;
+}
+
+/**
+ * @brief drive a simulated input pin
+ *
+ * @param pin pin number the device is wired to
+ * @param level new pin level
+ */
+
+void host_gpio_set_level(uint32_t pin, bool level)
+{
+  FAR struct host_gpio_s *gpio;
+  bool edge;
+
+  pthread_mutex_lock(&g_gpiolock);
+  gpio = host_gpio_get(pin);
+  if (gpio == NULL)
+  {
+    pthread_mutex_unlock(&g_gpiolock);
+    return;
+  }
+
+  edge = gpio->level != level;
+  gpio->level = level;
+  if (!edge && gpio->mode != INT_HIGH_LEVEL && gpio->mode != INT_LOW_LEVEL)
+  {
+    pthread_mutex_unlock(&g_gpiolock);
+    return;
+  }
+
+  host_gpio_dispatch(gpio, edge);
+}
@@ -0,0 +1,106 @@
+/****************************************************************************
+ * location_logger/host/shim/lte_stub.c
+ *
+ * LTE library and webclient stubs for the host build.  Every call
+ * succeeds immediately; posts are only counted.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <string.h>
+#include <lte/lte_api.h>
+#include <netutils/webclient.h>
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static restart_report_cb_t g_restart_cb;
+static unsigned int g_posts;
+static size_t g_post_bytes;
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int lte_initialize(void)
+{
+  return 0;
+}
+
+int lte_finalize(void)
+{
+  printf("lte_stub: %u posts, %zu bytes\n", g_posts, g_post_bytes);
+  return 0;
+}
+
+int lte_set_report_restart(restart_report_cb_t restart_callback)
+{
+  g_restart_cb = restart_callback;
+  return 0;
+}
+
+int lte_power_on(void)
+{
+  /* The modem reports its restart once it is powered */
+
+  if (g_restart_cb != NULL)
+  {
+    g_restart_cb(0);
+  }
+
+  return 0;
+}
+
+int lte_power_off(void)
+{
+  return 0;
+}
+
+int lte_radio_on_sync(void)
+{
+  return 0;
+}
+
+int lte_radio_off_sync(void)
+{
+  return 0;
+}
+
+int lte_activate_pdn_sync(lte_apn_setting_t *apn, lte_pdn_t *pdn)
+{
+  pdn->session_id = 1;
+  pdn->active = 1;
+  pdn->apn_type = apn->apn_type;
+  return 0;
+}
+
+int lte_deactivate_pdn_sync(uint8_t session_id)
+{
+  return 0;
+}
+
+int lte_get_imsi_sync(char *imsi, size_t len)
+{
+  snprintf(imsi, len, "%s", "001010000000000");
+  return 0;
+}
+
+int lte_get_errinfo(lte_errinfo_t *info)
+{
+  memset(info, 0, sizeof(*info));
+  return 0;
+}
+
+int wget_post(FAR const char *url, FAR const char *posts, FAR char *buffer,
+              int buflen, wget_callback_t callback, FAR void *arg)
+{
+  g_posts++;
+  g_post_bytes += strlen(posts);
+  return 0;
+}
@@ -1,8 +1,28 @@
 #include <nuttx/config.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "modules/connection.h"
 #include "modules/gnss.h"
-// #include "modules/bmi270_ctrl.h"
+#include "modules/bmi270_ctrl.h"
+#include "modules/fusion.h"
+
+/* While the IMU reports the asset parked, GNSS is stopped and nothing is
+ * uploaded; one fix is still sent every PARKED_HEARTBEAT_MS.
+ */
+
+#define PARKED_HEARTBEAT_MS (15 * 60 * 1000)
+
+/* Longest wait for a fresh fix after GNSS is resumed, hot start */
+
+#define GNSS_RESUME_TIMEOUT_MS (30 * 1000)
+
+/* Thread stacks, raised to the platform minimum on the host */
+
+#define THREAD_STACK_SIZE(size) \
+  ((size) < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : (size))
 
 int main(int argc, FAR char *argv[])
 {
@@ -11,14 +31,33 @@ int main(int argc, FAR char *argv[])
   char send_buffer[512];
   sigset_t mask;
   struct gnss_positiondata_s position_data;
-  // pthread_t imu_thread;
+  IMUMotionState motion;
+  IMUShockEvent shock;
+  IMUMagData mag;
+  FusionState fused;
+  FusionTrackPoint point;
+  float heading;
+  pthread_t imu_thread;
+  pthread_t fusion_thread;
+  pthread_attr_t attr;
+
+  // thread initialize, explicit stacks instead of CONFIG_PTHREAD_STACK_DEFAULT
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE(IMU_THREAD_STACK_SIZE));
+  if (pthread_create(&imu_thread, &attr, thread_imu_bmi270_main, NULL) != 0)
+  {
+    perror("IMUスレッド作成失敗");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE(FUSION_THREAD_STACK_SIZE));
+  if (pthread_create(&fusion_thread, &attr, thread_fusion_main, NULL) != 0)
+  {
+    perror("融合スレッド作成失敗");
+    exit(EXIT_FAILURE);
+  }
 
-  // thread initialize
-  // if (pthread_create(&imu_thread, NULL, thread_imu_bmi270_main, NULL) != 0)
-  // {
-  //   perror("IMUスレッド作成失敗");
-  //   exit(EXIT_FAILURE);
-  // }
+  pthread_attr_destroy(&attr);
 
   // Start GNSS
   gnss_fd = gnss_initialize(&mask);
@@ -36,12 +75,71 @@ int main(int argc, FAR char *argv[])
 
   do
   {
+    // Shock windows captured by the IMU thread: store, then report
+    while (imu_bmi270_shock(&shock) == 0)
+    {
+      sprintf(send_buffer, "{\"shock_g\":%.1f,\"t_ms\":%llu,\"samples\":%u,\"sat\":%u,\"file\":\"%s\"}",
+              shock.peak_g, (unsigned long long)(shock.trigger_ns / 1000000),
+              shock.samples, shock.saturation, shock.path);
+      printf("%s\n", send_buffer);
+
+      // send2harvest(send_buffer);
+    }
+
+    // Dead reckoned track between the fixes, FUSION_TRACK_HZ points a second
+    while (fusion_read(&point) == 0)
+    {
+      sprintf(send_buffer, "{\"t_ms\":%llu,\"lat\":%f,\"lng\":%f,\"std\":%.1f,\"dr_ms\":%u}",
+              (unsigned long long)(point.timestamp_ns / 1000000), point.latitude,
+              point.longitude, point.pos_std, point.since_fix_ms);
+      printf("%s\n", send_buffer);
+
+      // send2harvest(send_buffer);
+    }
+
+    // Parked: GNSS off until the IMU sees motion or the heartbeat is due,
+    // after the queues above were read
+    imu_bmi270_motion(&motion);
+    if (motion.parked)
+    {
+      printf("Parked, GNSS suspended\n");
+      gnss_stop(gnss_fd);
+      if (imu_bmi270_wait_moving(PARKED_HEARTBEAT_MS) == 0)
+      {
+        printf("Moving, GNSS resumed\n");
+      }
+
+      gnss_resume(gnss_fd);
+
+      // A notification left from before the stop carries the old fix
+      if (gnss_wait_fix(gnss_fd, &mask, GNSS_RESUME_TIMEOUT_MS) != 0)
+      {
+        printf("No fix after resume\n");
+      }
+    }
+
     printf("GNSS get\n");
 
     gnss_status = gnss_get(gnss_fd, &mask, &position_data);
     if (gnss_status == 0)
     {
-      sprintf(send_buffer, "{\"lat\":%f,\"lng\":%f}", position_data.latitude, position_data.longitude);
+      fusion_gnss(&position_data);
+
+      heading = position_data.direction;
+      if (position_data.velocity < FUSION_COG_MIN_VELOCITY &&
+          imu_bmi270_mag(&mag) == 0)
+      {
+        heading = mag.heading;
+      }
+
+      // GNSS/INS estimate once the filter runs, the raw fix until then
+      if (fusion_get(&fused) == 0)
+      {
+        position_data.latitude = fused.latitude;
+        position_data.longitude = fused.longitude;
+      }
+
+      sprintf(send_buffer, "{\"lat\":%f,\"lng\":%f,\"hdg\":%.0f}", position_data.latitude, position_data.longitude, heading);
       printf("%s\n", send_buffer);
 
       // send2harvest(send_buffer);
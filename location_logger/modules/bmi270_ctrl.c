@@ -9,28 +9,535 @@
 #include <sys/ioctl.h>
 #include <nuttx/i2c/i2c_master.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <math.h>
 
 #include <nuttx/arch.h>
 #include <arch/board/board.h>
 #include <arch/chip/pin.h>
 
 #include "bmi270lib/i2c_common.h"
+#include "bmi270lib/i2c_bus.h"
 #include "bmi270lib/i2c_bmi270.h"
+#include "bmi270lib/bmi270_convert.h"
+#include "bmi270lib/bmm150.h"
 
 #include "bmi270_ctrl.h"
+#include "imu_ring.h"
+#include "imu_bias.h"
+#include "imu_capture.h"
+#include "imu_tempco.h"
+#include "imu_ahrs.h"
 
-pthread_mutex_t data_mutex = PTHREAD_MUTEX_INITIALIZER;
-IMUData data_stack[IMU_DATA_STACK_SIZE];
-IMUData imu_sensor_bias;
-int data_stack_pos = 0;
+/* IMU thread -> imu_bmi270_pop(), lost samples -> imu_bmi270_report() */
+
+static IMUData data_buffer[IMU_DATA_RING_SIZE];
+static imu_ring_t data_ring;
+static imu_ring_stats_t data_ring_reported;
+
+/* Bias at rest, estimated by the IMU thread and published when a window
+ * at rest changes it
+ */
+
+static const imu_bias_limits_t bias_limits =
+{
+  IMU_BIAS_GYR_STD_MAX, IMU_BIAS_ACC_STD_MAX, IMU_BIAS_ACC_NORM_TOL,
+  IMU_BIAS_GYR_MEAN_MAX
+};
+
+static imu_bias_t bias_estimator;
+static pthread_mutex_t bias_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool imu_sensor_bias_valid;
+static IMUData imu_sensor_bias;
+static IMUData imu_sensor_noise;
+static bool bias_reported;
+static uint32_t motion_reported; // parks + wakes printed
+
+/* Gyro bias vs temperature, IMU thread -> imu_bmi270_tempco() */
+
+static imu_tempco_t tempco;
+static bool die_temp_valid;
+static float die_temp;
+static uint64_t die_temp_next_ns;
+static uint64_t tempco_save_ns;
+static float gyr_comp[IMU_TEMPCO_AXES]; // subtracted from this drain
+static pthread_mutex_t tempco_mutex = PTHREAD_MUTEX_INITIALIZER;
+static IMUTempcoState tempco_state;
+static bool tempco_state_valid;
+
+/* Parked state from the feature engine motion events, IMU thread ->
+ * imu_bmi270_motion() and imu_bmi270_wait_moving()
+ */
+
+#if IMU_MOTION_DETECT
+static const bmi270_motion_config_t motion_config =
+{
+  IMU_ANY_MOTION_THRES_MG, IMU_ANY_MOTION_DUR_MS,
+  IMU_NO_MOTION_THRES_MG, IMU_NO_MOTION_DUR_MS
+};
+#endif
+
+static pthread_mutex_t motion_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t motion_cond = PTHREAD_COND_INITIALIZER;
+static IMUMotionState motion_state;
+
+/* Shock capture, IMU thread -> imu_bmi270_shock() */
+
+#define SHOCK_PRE_SAMPLES (IMU_SHOCK_PRE_MS * IMU_SAMPLE_RATE_HZ / 1000)
+#define SHOCK_POST_SAMPLES (IMU_SHOCK_POST_MS * IMU_SAMPLE_RATE_HZ / 1000)
+
+static imu_capture_sample_t shock_buffer[SHOCK_PRE_SAMPLES +
+                                         SHOCK_POST_SAMPLES];
+static imu_capture_t shock_capture;
+
+/* Magnetometer, IMU thread -> imu_bmi270_mag() */
+
+static bmm150_trim_t mag_trim;
+static bool mag_present;
+static pthread_mutex_t mag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static IMUMagData mag_latest;
+static bool mag_valid;
+
+/* Attitude, IMU thread -> imu_bmi270_attitude() */
+
+static imu_ahrs_t ahrs;
+static cycles_stats_t ahrs_cycles;
+static pthread_mutex_t ahrs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static IMUAttitude attitude_latest;
+static bool attitude_valid;
+static cycles_stats_t ahrs_cycles_published;
+
+/* One drain in m/s^2, degree/s and uT, x y z per sample, IMU thread only */
+
+static float acc_si[BMI270_STORE_TABLE_LENGTH * 3];
+static float gyr_si[BMI270_STORE_TABLE_LENGTH * 3];
+static float mag_si[BMI270_STORE_TABLE_LENGTH * 3];
+
+/* imu_bmi270_reconfigure() -> IMU thread */
+
+static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bmi270_config_t pending_config;
+static bool config_pending;
+
+/* IMU thread I2C statistics, published after every drain so readers
+ * never see a transfer half counted.
+ */
+
+static i2c_stats_t i2c_stats;
+static i2c_stats_t i2c_stats_published;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec telemetry_last;
+
+/* I2C error recovery, counters published with the I2C statistics */
+
+static IMURecoveryStats recovery_stats;
+static IMURecoveryStats recovery_stats_published;
+static IMURecoveryStats recovery_stats_reported;
+static bool gap_open;
+static uint64_t gap_start_ns;
+static uint64_t last_sample_ns;
+
+#if IMU_USE_WATERMARK_IRQ
+static sem_t imu_fifo_sem;
+
+/* Level interrupt: mask it until the thread has drained the FIFO */
+
+static int bmi270_int1_handler(int irq, FAR void *context, FAR void *arg)
+{
+  board_gpio_int(BMI270_INT1_PIN, false);
+  sem_post(&imu_fifo_sem);
+  return 0;
+}
+
+static void wait_fifo_watermark(void)
+{
+  struct timespec deadline;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += IMU_WATERMARK_TIMEOUT_MS / 1000;
+  deadline.tv_nsec += (IMU_WATERMARK_TIMEOUT_MS % 1000) * 1000 * 1000;
+  if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000 * 1000 * 1000;
+  }
+
+  board_gpio_int(BMI270_INT1_PIN, true);
+  while (sem_timedwait(&imu_fifo_sem, &deadline) < 0 && errno == EINTR)
+  {
+  }
+
+  board_gpio_int(BMI270_INT1_PIN, false);
+}
+#endif
+
+static uint64_t monotonic_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void sleep_ms(int ms)
+{
+  struct timespec waittime;
+
+  waittime.tv_sec = ms / 1000;
+  waittime.tv_nsec = (ms % 1000) * 1000 * 1000;
+  nanosleep(&waittime, NULL);
+}
+
+/**
+ * @brief drain the FIFO, repeating the drain on I2C errors
+ *
+ * @return int success == 0
+ */
+
+static int dequeue_with_retry(i2c_bmi270_t *pctrl)
+{
+  int ret;
+  int retry;
+
+  ret = exec_dequeue_fifo(pctrl);
+  for (retry = 0; ret < 0 && retry < IMU_I2C_RETRY_MAX; retry++)
+  {
+    i2c_stats_retry(&pctrl->i2c);
+    sleep_ms(IMU_I2C_RETRY_DELAY_MS);
+    ret = exec_dequeue_fifo(pctrl);
+  }
+
+  return ret;
+}
+
+/**
+ * @brief set up the BMM150 behind the AUX interface, if there is one
+ */
+
+static void start_mag(i2c_bmi270_t *pctrl)
+{
+#if IMU_MAG_ENABLE
+  bool present = init_bmm150(pctrl, &mag_trim) == 0;
+
+  if (present != mag_present)
+  {
+    printf("IMU: magnetometer %s\n", present ? "found" : "not available");
+  }
+
+  mag_present = present;
+#endif
+}
+
+/**
+ * @brief reset the bus and re-initialise the BMI270 until it answers
+ *
+ * The thread, its buffers and the ring stay as they are.  The data gap
+ * opens at the last sample pushed and is closed by the first one after
+ * recovery, see record_sample().
+ */
+
+static void recover_imu(i2c_bmi270_t *pctrl)
+{
+  int ret;
+  int backoff_ms = IMU_RECOVERY_BACKOFF_MS;
+
+  if (!gap_open)
+  {
+    gap_open = true;
+    gap_start_ns = last_sample_ns ? last_sample_ns : monotonic_ns();
+  }
+
+  while (1)
+  {
+    recovery_stats.attempts++;
+    i2c_bus_reset(&pctrl->i2c);
+    ret = recover_bmi270(pctrl);
+#if IMU_USE_WATERMARK_IRQ
+    if (ret == 0)
+    {
+      ret = enable_fifo_watermark_bmi270(pctrl, IMU_FIFO_WATERMARK_BYTES);
+    }
+#endif
+#if IMU_MOTION_DETECT
+    if (ret == 0)
+    {
+      ret = enable_motion_bmi270(pctrl, &motion_config);
+    }
+#endif
+
+    if (ret == 0)
+    {
+      start_mag(pctrl);
+      break;
+    }
+
+    printf("IMU: recovery failed, next attempt in %d ms\n", backoff_ms);
+    sleep_ms(backoff_ms);
+    backoff_ms *= 2;
+    if (backoff_ms > IMU_RECOVERY_BACKOFF_MAX_MS)
+    {
+      backoff_ms = IMU_RECOVERY_BACKOFF_MAX_MS;
+    }
+  }
+
+  recovery_stats.recoveries++;
+  printf("IMU: recovered after I2C errors (%s init)\n",
+         pctrl->init_stats.warm ? "warm" : "cold");
+}
+
+/**
+ * @brief note the time of a pushed sample, closing an open data gap
+ */
+
+static void record_sample(uint64_t timestamp_ns)
+{
+  uint64_t gap;
+
+  last_sample_ns = timestamp_ns ? timestamp_ns : monotonic_ns();
+  if (!gap_open)
+  {
+    return;
+  }
+
+  gap = last_sample_ns > gap_start_ns ? last_sample_ns - gap_start_ns : 0;
+  gap_open = false;
+  recovery_stats.gaps++;
+  recovery_stats.last_gap_ns = gap;
+  recovery_stats.total_gap_ns += gap;
+  if (gap > recovery_stats.max_gap_ns)
+  {
+    recovery_stats.max_gap_ns = gap;
+  }
+}
+
+/**
+ * @brief feed the bias estimator, publishing a changed estimate
+ *
+ * data is uncompensated; a window at rest also becomes a point of the
+ * temperature model.
+ */
+
+static void update_bias(const IMUData *data)
+{
+  IMUData mean;
+  IMUData noise;
+
+  if (!imu_bias_update(&bias_estimator, data))
+  {
+    return;
+  }
+
+#if IMU_TEMPCO_ENABLE
+  if (die_temp_valid)
+  {
+    imu_tempco_add(&tempco, die_temp, &bias_estimator.last.mean[3]);
+  }
+#endif
+
+  if (!imu_bias_get(&bias_estimator, &mean, &noise))
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&bias_mutex);
+  imu_sensor_bias = mean;
+  imu_sensor_noise = noise;
+  imu_sensor_bias_valid = true;
+  pthread_mutex_unlock(&bias_mutex);
+}
+
+/**
+ * @brief publish the last magnetometer sample of a drain with its heading
+ *
+ * The tilt comes from acc, the last accelerometer sample of the same
+ * drain.  BMI270 axes are x forward, y left, z up, so acc reads +1 g on z
+ * when level.
+ */
+
+static void update_mag(const bmi270_batch_t *pbatch, const float acc[3])
+{
+  const float *m;
+  IMUMagData mag;
+  float roll;
+  float pitch;
+  float sr;
+  float cr;
+  float sp;
+  float cp;
+  float xh;
+  float yh;
+  int last;
+
+  if (pbatch->aux_count == 0)
+  {
+    return;
+  }
+
+  bmm150_convert(mag_si, pbatch->aux, pbatch->aux_count, &mag_trim);
+  last = pbatch->aux_count - 1;
+  m = &mag_si[3 * last];
+
+  roll = atan2f(acc[1], acc[2]);
+  sr = sinf(roll);
+  cr = cosf(roll);
+  pitch = atan2f(acc[0], acc[1] * sr + acc[2] * cr);
+  sp = sinf(pitch);
+  cp = cosf(pitch);
+
+  /* horizontal components, y and z negated into x forward, y right,
+   * z down
+   */
+
+  xh = m[0] * cp - m[1] * sp * sr - m[2] * sp * cr;
+  yh = -m[2] * sr + m[1] * cr;
+
+  mag.mx = m[0];
+  mag.my = m[1];
+  mag.mz = m[2];
+  mag.heading = atan2f(yh, xh) * (180.0f / (float)M_PI);
+  if (mag.heading < 0.0f)
+  {
+    mag.heading += 360.0f;
+  }
+
+  mag.timestamp_ns = 0;
+  if (pbatch->time_valid)
+  {
+    mag.timestamp_ns = pbatch->aux_time_ns +
+                       (uint64_t)last * pbatch->aux_period_ns;
+  }
+
+  pthread_mutex_lock(&mag_mutex);
+  mag_latest = mag;
+  mag_valid = true;
+  pthread_mutex_unlock(&mag_mutex);
+}
+
+/**
+ * @brief poll the die temperature and set the gyro bias of the next drain
+ *
+ * Also stores a changed model once IMU_TEMPCO_SAVE_INTERVAL_MS passed.
+ */
+
+static void update_tempco(i2c_bmi270_t *pctrl)
+{
+#if IMU_TEMPCO_ENABLE
+  uint64_t now = monotonic_ns();
+  float temp;
+
+  if (now >= die_temp_next_ns)
+  {
+    die_temp_next_ns = now + IMU_TEMP_INTERVAL_MS * 1000000ull;
+    if (read_temperature_bmi270(pctrl, &temp) == 0)
+    {
+      die_temp = temp;
+      die_temp_valid = true;
+    }
+  }
+
+  if (die_temp_valid)
+  {
+    imu_tempco_get(&tempco, die_temp, gyr_comp);
+  }
+
+  if (tempco.changed &&
+      now - tempco_save_ns >= IMU_TEMPCO_SAVE_INTERVAL_MS * 1000000ull)
+  {
+    tempco_save_ns = now;
+    if (imu_tempco_save(&tempco, IMU_TEMPCO_PATH) < 0)
+    {
+      printf("IMU: failed to store %s\n", IMU_TEMPCO_PATH);
+    }
+  }
+
+  pthread_mutex_lock(&tempco_mutex);
+  tempco_state.temperature_c = die_temp;
+  memcpy(tempco_state.bias, gyr_comp, sizeof(tempco_state.bias));
+  memcpy(tempco_state.slope, tempco.slope, sizeof(tempco_state.slope));
+  tempco_state.bins = tempco.bins;
+  tempco_state_valid = die_temp_valid;
+  pthread_mutex_unlock(&tempco_mutex);
+#endif
+}
+
+/**
+ * @brief apply the motion events of a drain to the parked state
+ *
+ * Any-motion wins when a drain saw both, so a wake is never lost.
+ */
+
+static void update_motion(i2c_bmi270_t *pctrl)
+{
+  uint8_t events = get_motion_bmi270(pctrl);
+  bool parked;
+
+  if (events == 0)
+  {
+    return;
+  }
+
+  parked = (events & BMI270_MOTION_ANY) == 0;
+  pthread_mutex_lock(&motion_mutex);
+  if (parked != motion_state.parked)
+  {
+    motion_state.parked = parked;
+    motion_state.since_ns = monotonic_ns();
+    if (parked)
+    {
+      motion_state.parks++;
+    }
+    else
+    {
+      motion_state.wakes++;
+      pthread_cond_broadcast(&motion_cond);
+    }
+  }
+
+  pthread_mutex_unlock(&motion_mutex);
+}
+
+/**
+ * @brief publish the attitude after a drain
+ *
+ * @param plast last sample of the drain, given to imu_ahrs_update()
+ */
+
+static void publish_attitude(const IMUData *plast)
+{
+  IMUAttitude att;
+
+  if (!imu_ahrs_get(&ahrs, plast, &att))
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&ahrs_mutex);
+  attitude_latest = att;
+  attitude_valid = true;
+  ahrs_cycles_published = ahrs_cycles;
+  pthread_mutex_unlock(&ahrs_mutex);
+}
 
 void *thread_imu_bmi270_main(void *arg)
 {
-  int fd;
+  i2c_bus_t *bus;
   int ret;
+  int i;
+  int n;
   struct timespec waittime;
-  axis_t acc_data;
-  axis_t gyr_data;
+  const float *acc_data = NULL;
+  const float *gyr_data = NULL;
+  float acc_last[3] = {0};
+  float gyr_last[3] = {0};
+  IMUData data;
+  bmi270_config_t config;
+  bool apply;
+  float dt;
+  uint32_t start;
+  bmi270_batch_t batch;
   i2c_bmi270_t bmi270 = {0};
 
   /* I2C confiuguration */
@@ -38,18 +545,52 @@ void *thread_imu_bmi270_main(void *arg)
   bmi270.i2c.fd = -1;
   bmi270.i2c.i2c_addr = BMI270_I2C_ADDRESS;
   bmi270.i2c.speed = I2C_SPEED;
+  i2c_stats_attach(&bmi270.i2c, &i2c_stats);
+  bmi270_default_config(&bmi270.config);
+#if IMU_FIFO_HEADERLESS
+  bmi270.config.fifo_headerless = true;
+  bmi270.config.acc_odr = bmi270.config.gyr_odr;
+#endif
 
-  /** open I2C bus */
+  imu_ring_init(&data_ring, data_buffer, IMU_DATA_RING_SIZE,
+                IMU_DATA_RING_POLICY);
+  imu_bias_init(&bias_estimator, IMU_BIAS_WINDOW_SAMPLES,
+                IMU_BIAS_HISTORY_SECONDS * IMU_SAMPLE_RATE_HZ, &bias_limits);
+  imu_capture_init(&shock_capture, shock_buffer, SHOCK_PRE_SAMPLES,
+                   SHOCK_POST_SAMPLES, IMU_SHOCK_THRES_G * CONST_G);
+  imu_ahrs_init(&ahrs, IMU_AHRS_KP, IMU_AHRS_KI, IMU_AHRS_ACC_TOL,
+                IMU_AHRS_RATE_MAX);
+  cycles_init();
+  bmi270.saturation_enabled = true;
+#if IMU_TEMPCO_ENABLE
+  if (imu_tempco_load(&tempco, IMU_TEMPCO_PATH) == 0)
+  {
+    printf("IMU: gyro tempco loaded, %d bins\n", tempco.bins);
+  }
 
-  fd = open(I2C_DEVNAME_FOR_BMI270, O_WRONLY);
-  if (fd < 0)
+  tempco_save_ns = monotonic_ns();
+#endif
+
+  /** open I2C bus, shared with the other sensors on it */
+
+  bus = i2c_bus_open(I2C_DEVNAME_FOR_BMI270);
+  if (bus == NULL)
   {
     printf("ERROR: Failed to open %s: %d\n",
            I2C_DEVNAME_FOR_BMI270, errno);
     return NULL;
   }
 
-  bmi270.i2c.fd = fd;
+  i2c_bus_attach(bus, &bmi270.i2c, I2C_BUS_PRIO_IMU);
+
+#if IMU_USE_WATERMARK_IRQ
+  /** BMI270 INT1 wakes the thread, see wait_fifo_watermark() */
+
+  sem_init(&imu_fifo_sem, 0, 0);
+  board_gpio_config(BMI270_INT1_PIN, 0, true, false, PIN_FLOAT);
+  board_gpio_intconfig(BMI270_INT1_PIN, INT_HIGH_LEVEL, true,
+                       bmi270_int1_handler);
+#endif
 
   /** init bmi270 */
 
@@ -60,6 +601,26 @@ void *thread_imu_bmi270_main(void *arg)
     goto error_on_using_bmi270;
   }
 
+#if IMU_USE_WATERMARK_IRQ
+  ret = enable_fifo_watermark_bmi270(&bmi270, IMU_FIFO_WATERMARK_BYTES);
+  if (ret < 0)
+  {
+    printf("ERROR: Failed to enable watermark: %d\n", ret);
+    goto error_on_using_bmi270;
+  }
+#endif
+
+#if IMU_MOTION_DETECT
+  ret = enable_motion_bmi270(&bmi270, &motion_config);
+  if (ret < 0)
+  {
+    printf("ERROR: Failed to enable motion detection: %d\n", ret);
+    goto error_on_using_bmi270;
+  }
+#endif
+
+  start_mag(&bmi270);
+
   /* -- WAIT 250ms -- */
 
   waittime.tv_sec = 0;
@@ -70,43 +631,124 @@ void *thread_imu_bmi270_main(void *arg)
 
   while (1)
   {
-    ret = exec_dequeue_fifo(&bmi270);
+    ret = dequeue_with_retry(&bmi270);
     if (ret < 0)
     {
       printf("ERROR: Failed to Dequeue: %d\n", ret);
-      goto error_on_using_bmi270;
+      recover_imu(&bmi270);
+      continue;
+    }
+
+    get_fifo_batch(&batch, &bmi270);
+    update_motion(&bmi270);
+    update_tempco(&bmi270);
+    n = batch.acc_count > batch.gyr_count ? batch.acc_count : batch.gyr_count;
+    bmi270_convert(acc_si, batch.acc, batch.acc_count, batch.acc_scale);
+    bmi270_convert(gyr_si, batch.gyr, batch.gyr_count, batch.gyr_scale);
+    acc_data = acc_last;
+    gyr_data = gyr_last;
+    dt = (batch.gyr_count == n ? batch.gyr_period_ns : batch.acc_period_ns) *
+         1e-9f;
+
+    for (i = 0; i < n; i++)
+    {
+      /* Pair the sensors by position within the drain; a sensor without
+       * new samples keeps its last value.
+       */
+
+      if (batch.acc_count > 0)
+      {
+        acc_data = &acc_si[3 * (i * batch.acc_count / n)];
+      }
+
+      if (batch.gyr_count > 0)
+      {
+        gyr_data = &gyr_si[3 * (i * batch.gyr_count / n)];
+      }
+
+      /* The sensor with n samples sets the time */
+
+      data.timestamp_ns = 0;
+      if (batch.time_valid)
+      {
+        data.timestamp_ns = batch.gyr_count == n ?
+            batch.gyr_time_ns + (uint64_t)i * batch.gyr_period_ns :
+            batch.acc_time_ns + (uint64_t)i * batch.acc_period_ns;
+      }
+
+      data.ax = acc_data[0];
+      data.ay = acc_data[1];
+      data.az = acc_data[2];
+      data.roll = gyr_data[0];
+      data.pitch = gyr_data[1];
+      data.yaw = gyr_data[2];
+      update_bias(&data);
+
+      data.roll -= gyr_comp[0];
+      data.pitch -= gyr_comp[1];
+      data.yaw -= gyr_comp[2];
+
+#if IMU_AHRS_ENABLE
+      start = cycles_now();
+      imu_ahrs_update(&ahrs, &data, dt);
+      cycles_add(&ahrs_cycles, start);
+#endif
+
+      imu_ring_push(&data_ring, &data);
+      imu_capture_push(&shock_capture, &data, batch.saturation);
+      record_sample(data.timestamp_ns);
     }
 
-    if (data_stack_pos < IMU_DATA_STACK_SIZE)
+    if (n > 0)
     {
+      memcpy(acc_last, acc_data, sizeof(acc_last));
+      memcpy(gyr_last, gyr_data, sizeof(gyr_last));
+      publish_attitude(&data);
+    }
+
+    update_mag(&batch, acc_last);
 
-      ret = get_latest_acc(&acc_data, &bmi270);
-      ret = get_latest_gyr(&gyr_data, &bmi270);
+    /* Apply a new configuration between drains */
 
-      pthread_mutex_lock(&data_mutex);
-      data_stack[data_stack_pos].ax = acc_data.x;
-      data_stack[data_stack_pos].ay = acc_data.y;
-      data_stack[data_stack_pos].az = acc_data.z;
-      data_stack[data_stack_pos].roll = gyr_data.x;
-      data_stack[data_stack_pos].pitch = gyr_data.y;
-      data_stack[data_stack_pos].yaw = gyr_data.z;
+    pthread_mutex_lock(&config_mutex);
+    apply = config_pending;
+    config = pending_config;
+    config_pending = false;
+    pthread_mutex_unlock(&config_mutex);
 
-      data_stack_pos++;
-      pthread_mutex_unlock(&data_mutex);
+    if (apply && reconfigure_bmi270(&bmi270, &config) < 0)
+    {
+      printf("ERROR: Failed to reconfigure\n");
+      recover_imu(&bmi270);
     }
 
+    pthread_mutex_lock(&stats_mutex);
+    i2c_stats_published = i2c_stats;
+    recovery_stats_published = recovery_stats;
+    pthread_mutex_unlock(&stats_mutex);
+
+#if IMU_USE_WATERMARK_IRQ
+    wait_fifo_watermark();
+#else
     /* -- WAIT 50ms -- */
 
     waittime.tv_sec = 0;
     waittime.tv_nsec = IMU_MEASUREMENT_INTERVAL_MS * 1000 * 1000;
     nanosleep(&waittime, NULL);
+#endif
   }
 
 error_on_using_bmi270:
 
+#if IMU_USE_WATERMARK_IRQ
+  board_gpio_int(BMI270_INT1_PIN, false);
+  board_gpio_intconfig(BMI270_INT1_PIN, 0, false, NULL);
+  sem_destroy(&imu_fifo_sem);
+#endif
+
   /** close I2C bus */
 
-  close(fd);
+  i2c_bus_close(bus);
 
   /** init bmi270 */
 
@@ -115,137 +757,419 @@ error_on_using_bmi270:
   return NULL;
 }
 
-int read_bmi270(void)
+/**
+ * @brief change the BMI270 setup of the running IMU thread
+ *
+ * The thread applies it after its next drain.
+ *
+ * @param pc new configuration, see reconfigure_bmi270()
+ * @return int success == 0
+ */
+
+int imu_bmi270_reconfigure(const bmi270_config_t *pc)
 {
+  pthread_mutex_lock(&config_mutex);
+  pending_config = *pc;
+  config_pending = true;
+  pthread_mutex_unlock(&config_mutex);
+
+#if IMU_USE_WATERMARK_IRQ
+  sem_post(&imu_fifo_sem);
+#endif
 
-  pthread_mutex_lock(&data_mutex);
-  for (int i = 0; i < data_stack_pos; i++)
+  return 0;
+}
+
+/**
+ * @brief I2C statistics of the IMU thread, as of its last drain
+ *
+ * @param pstats copy [out]
+ * @return int success == 0
+ */
+
+int imu_bmi270_i2c_stats(i2c_stats_t *pstats)
+{
+  pthread_mutex_lock(&stats_mutex);
+  *pstats = i2c_stats_published;
+  pthread_mutex_unlock(&stats_mutex);
+  return 0;
+}
+
+/**
+ * @brief I2C error recoveries and data gaps of the IMU thread
+ *
+ * @param pstats copy [out]
+ * @return int success == 0
+ */
+
+int imu_bmi270_recovery_stats(IMURecoveryStats *pstats)
+{
+  pthread_mutex_lock(&stats_mutex);
+  *pstats = recovery_stats_published;
+  pthread_mutex_unlock(&stats_mutex);
+  return 0;
+}
+
+/**
+ * @brief sensor means and noise at rest, never blocks
+ *
+ * Kept up to date by the IMU thread whenever the device rests for
+ * IMU_BIAS_WINDOW_SAMPLES samples.  roll, pitch and yaw are the gyro
+ * bias before temperature compensation, see imu_bmi270_tempco(); ax, ay
+ * and az include gravity.
+ *
+ * @param pbias means [out]
+ * @param pstddev standard deviations [out], may be NULL
+ * @return int success == 0, -1 until the device has been at rest once
+ */
+
+int imu_bmi270_bias(IMUData *pbias, IMUData *pstddev)
+{
+  int ret = -1;
+
+  pthread_mutex_lock(&bias_mutex);
+  if (imu_sensor_bias_valid)
   {
-    printf("IMU: ax = %.2f, ay = %.2f, az = %.2f, roll = %.2f, pitch = %.2f, yaw = %.2f\n",
-           data_stack[i].ax,
-           data_stack[i].ay,
-           data_stack[i].az,
-           data_stack[i].roll,
-           data_stack[i].pitch,
-           data_stack[i].yaw);
+    *pbias = imu_sensor_bias;
+    if (pstddev != NULL)
+    {
+      *pstddev = imu_sensor_noise;
+    }
+
+    ret = 0;
   }
 
-  data_stack_pos = 0;
-  pthread_mutex_unlock(&data_mutex);
+  pthread_mutex_unlock(&bias_mutex);
+  return ret;
+}
+
+/**
+ * @brief gyro temperature compensation in use, never blocks
+ *
+ * @param pstate copy [out]
+ * @return int success == 0, -1 before the first temperature reading
+ */
+
+int imu_bmi270_tempco(IMUTempcoState *pstate)
+{
+  int ret = -1;
+
+  pthread_mutex_lock(&tempco_mutex);
+  if (tempco_state_valid)
+  {
+    *pstate = tempco_state;
+    ret = 0;
+  }
+
+  pthread_mutex_unlock(&tempco_mutex);
+  return ret;
+}
+
+/**
+ * @brief parked state from the BMI270 motion detectors, never blocks
+ *
+ * The asset starts out moving and stays so while the IMU thread is not
+ * running, so callers that suspend work while parked fail safe.
+ *
+ * @param pstate copy [out]
+ * @return int success == 0
+ */
+
+int imu_bmi270_motion(IMUMotionState *pstate)
+{
+  pthread_mutex_lock(&motion_mutex);
+  *pstate = motion_state;
+  pthread_mutex_unlock(&motion_mutex);
   return 0;
 }
 
-int calibrate_bmi270(void)
+/**
+ * @brief block while the asset is parked
+ *
+ * @param timeout_ms longest wait, negative for none
+ * @return int 0 when moving, -1 when still parked at the timeout
+ */
+
+int imu_bmi270_wait_moving(int timeout_ms)
 {
+  struct timespec deadline;
+  int ret = 0;
 
-  while (data_stack_pos < IMU_CALIBRATION_STACK_SIZE)
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  if (timeout_ms >= 0)
   {
-    sleep(1);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000 * 1000;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000 * 1000 * 1000;
+    }
   }
 
-  pthread_mutex_lock(&data_mutex);
-  for (int i = 0; i < data_stack_pos; i++)
+  pthread_mutex_lock(&motion_mutex);
+  while (motion_state.parked && ret == 0)
   {
-    imu_sensor_bias.ax += data_stack[i].ax;
-    imu_sensor_bias.ay += data_stack[i].ay;
-    imu_sensor_bias.az += data_stack[i].az;
-    imu_sensor_bias.roll += data_stack[i].roll;
-    imu_sensor_bias.pitch += data_stack[i].pitch;
-    imu_sensor_bias.yaw += data_stack[i].yaw;
+    if (timeout_ms < 0)
+    {
+      pthread_cond_wait(&motion_cond, &motion_mutex);
+    }
+    else
+    {
+      ret = pthread_cond_timedwait(&motion_cond, &motion_mutex, &deadline);
+    }
   }
-  imu_sensor_bias.ax /= data_stack_pos;
-  imu_sensor_bias.ay /= data_stack_pos;
-  imu_sensor_bias.az /= data_stack_pos;
-  imu_sensor_bias.roll /= data_stack_pos;
-  imu_sensor_bias.pitch /= data_stack_pos;
-  imu_sensor_bias.yaw /= data_stack_pos;
 
-  data_stack_pos = 0;
-  pthread_mutex_unlock(&data_mutex);
+  ret = motion_state.parked ? -1 : 0;
+  pthread_mutex_unlock(&motion_mutex);
+  return ret;
+}
+
+/**
+ * @brief write a frozen shock window as CSV, one sample per line
+ *
+ * @return int success == 0
+ */
+
+static int write_shock(const char *path, const imu_capture_event_t *pev)
+{
+  int fd;
+  uint32_t i;
+  const imu_capture_sample_t *ps;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  dprintf(fd, "t_ns,ax,ay,az,roll,pitch,yaw,saturation\n");
+  for (i = 0; i < pev->count; i++)
+  {
+    ps = imu_capture_sample(&shock_capture, pev, i);
+    dprintf(fd, "%llu,%.4f,%.4f,%.4f,%.3f,%.3f,%.3f,%u\n",
+            (unsigned long long)ps->data.timestamp_ns,
+            ps->data.ax, ps->data.ay, ps->data.az,
+            ps->data.roll, ps->data.pitch, ps->data.yaw,
+            ps->saturation);
+  }
+
+  return close(fd) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief store a captured shock and re-arm the capture
+ *
+ * Writes the window to IMU_SHOCK_DIR/shock_<trigger ms>.csv.  Call it
+ * regularly from a thread that may block on storage; while a window
+ * waits here, new shocks are missed.  The window is released even when
+ * storing fails, with pevent->path left empty.
+ *
+ * @param pevent summary [out]
+ * @return int 0 when a shock was taken, -1 when there is none
+ */
+
+int imu_bmi270_shock(IMUShockEvent *pevent)
+{
+  imu_capture_event_t event;
+
+  if (!imu_capture_get(&shock_capture, &event))
+  {
+    return -1;
+  }
+
+  pevent->trigger_ns = event.trigger_ns;
+  pevent->peak_g = event.peak / CONST_G;
+  pevent->samples = event.count;
+  pevent->pre = event.pre;
+  pevent->saturation = event.saturation;
+  pevent->missed = atomic_load_explicit(&shock_capture.missed,
+                                        memory_order_relaxed);
+
+  snprintf(pevent->path, sizeof(pevent->path), "%s/shock_%llu.csv",
+           IMU_SHOCK_DIR, (unsigned long long)(event.trigger_ns / 1000000));
+  mkdir(IMU_SHOCK_DIR, 0777);
+  if (write_shock(pevent->path, &event) < 0)
+  {
+    printf("ERROR: Failed to store %s: %d\n", pevent->path, errno);
+    pevent->path[0] = '\0';
+  }
+
+  imu_capture_release(&shock_capture);
   return 0;
 }
 
-// int main_bmi270(void)
-// {
-//   int fd;
-//   int ret;
-//   int total = 512;
-//   struct timespec waittime;
-//   axis_t acc_data;
-//   axis_t gyr_data;
-//   i2c_bmi270_t bmi270 = {0};
+/**
+ * @brief the same as a one line JSON object, see i2c_stats_format()
+ *
+ * @param buf output [out]
+ * @param size size of buf
+ * @return int length written
+ */
+
+int imu_bmi270_i2c_telemetry(char *buf, int size)
+{
+  int n;
+
+  pthread_mutex_lock(&stats_mutex);
+  n = i2c_stats_format(&i2c_stats_published, buf, size);
+  pthread_mutex_unlock(&stats_mutex);
+  return n;
+}
+
+/**
+ * @brief take the oldest sample the IMU thread queued, never blocks
+ *
+ * The ring has a single consumer, the fusion thread.
+ *
+ * @param pdata sample [out]
+ * @return int success == 0, -1 when the ring is empty
+ */
 
-//   /* I2C confiuguration */
+int imu_bmi270_pop(IMUData *pdata)
+{
+  return imu_ring_pop(&data_ring, pdata) ? 0 : -1;
+}
 
-//   bmi270.i2c.fd = -1;
-//   bmi270.i2c.i2c_addr = BMI270_I2C_ADDRESS;
-//   bmi270.i2c.speed = I2C_SPEED;
+/**
+ * @brief print what changed in the IMU thread since the last call
+ *
+ * Samples lost from the ring, I2C recoveries, the first bias estimate,
+ * parked state changes, and the I2C telemetry every
+ * IMU_TELEMETRY_INTERVAL_MS.  Does not touch the samples themselves; the
+ * fusion thread calls it with its own report.
+ *
+ * @return int success == 0
+ */
 
-//   /** open I2C bus */
+int imu_bmi270_report(void)
+{
+  imu_ring_stats_t stats;
+  struct timespec now;
+  IMURecoveryStats recovery;
+  IMUData bias;
+  IMUMotionState motion;
+  static char telemetry[IMU_TELEMETRY_LINE_SIZE];
+
+  /* Report samples lost since the last call */
+
+  imu_ring_get_stats(&data_ring, &stats);
+  if (stats.dropped != data_ring_reported.dropped ||
+      stats.overwritten != data_ring_reported.overwritten)
+  {
+    printf("IMU: %u samples dropped, %u overwritten\n",
+           stats.dropped - data_ring_reported.dropped,
+           stats.overwritten - data_ring_reported.overwritten);
+    data_ring_reported = stats;
+  }
+
+  /* Data lost to I2C errors since the last call */
+
+  imu_bmi270_recovery_stats(&recovery);
+  if (recovery.gaps != recovery_stats_reported.gaps)
+  {
+    printf("IMU: %u I2C recoveries, last data gap %llu ms, max %llu ms\n",
+           recovery.recoveries - recovery_stats_reported.recoveries,
+           (unsigned long long)(recovery.last_gap_ns / 1000000),
+           (unsigned long long)(recovery.max_gap_ns / 1000000));
+    recovery_stats_reported = recovery;
+  }
 
-//   fd = open(I2C_DEVNAME_FOR_BMI270, O_WRONLY);
-//   if (fd < 0)
-//   {
-//     printf("ERROR: Failed to open %s: %d\n",
-//            I2C_DEVNAME_FOR_BMI270, errno);
-//     return -1;
-//   }
+  /* First bias estimate */
 
-//   bmi270.i2c.fd = fd;
+  if (!bias_reported && imu_bmi270_bias(&bias, NULL) == 0)
+  {
+    printf("IMU: gyro bias %.3f %.3f %.3f degree/s\n",
+           bias.roll, bias.pitch, bias.yaw);
+    bias_reported = true;
+  }
 
-//   /** init bmi270 */
+  /* Parked state changes */
 
-//   ret = init_bmi270(&bmi270);
-//   if (ret < 0)
-//   {
-//     printf("ERROR: Failed to initialize: %d\n", ret);
-//     goto error_on_using_bmi270;
-//   }
+  imu_bmi270_motion(&motion);
+  if (motion.parks + motion.wakes != motion_reported)
+  {
+    printf("IMU: %s, %u parks, %u wakes\n",
+           motion.parked ? "parked" : "moving", motion.parks, motion.wakes);
+    motion_reported = motion.parks + motion.wakes;
+  }
 
-//   /* -- WAIT 250ms -- */
+  /* Periodic I2C telemetry */
 
-//   waittime.tv_sec = 0;
-//   waittime.tv_nsec = 250 * 1000 * 1000;
-//   nanosleep(&waittime, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if ((now.tv_sec - telemetry_last.tv_sec) * 1000 +
+      (now.tv_nsec - telemetry_last.tv_nsec) / 1000000 >=
+      IMU_TELEMETRY_INTERVAL_MS)
+  {
+    imu_bmi270_i2c_telemetry(telemetry, sizeof(telemetry));
+    printf("IMU: i2c %s\n", telemetry);
+    telemetry_last = now;
+  }
 
-//   /** mesurement */
+  return 0;
+}
 
-//   for (int i = 0; i < total; i++)
-//   {
-//     ret = exec_dequeue_fifo(&bmi270);
-//     if (ret < 0)
-//     {
-//       printf("ERROR: Failed to Dequeue: %d\n", ret);
-//       goto error_on_using_bmi270;
-//     }
+/**
+ * @brief latest magnetometer sample and heading, never blocks
+ *
+ * Updated at the BMM150 rate, BMM150_AUX_ODR.  Meant as a heading source
+ * when the GNSS course over ground is unreliable at low speed.
+ *
+ * @param pmag copy [out]
+ * @return int success == 0, -1 until a sample arrived or without BMM150
+ */
 
-//     ret = get_latest_acc(&acc_data, &bmi270);
-//     ret = get_latest_gyr(&gyr_data, &bmi270);
-//     printf("(%3d/%3d) ACC|%6f,%6f,%6f || GYR|%6f,%6f,%6f\n",
-//            i, total - 1,
-//            (acc_data.x * ACC_RANGE_G * CONST_G) / RESOLUTION,
-//            (acc_data.y * ACC_RANGE_G * CONST_G) / RESOLUTION,
-//            (acc_data.z * ACC_RANGE_G * CONST_G) / RESOLUTION,
-//            (gyr_data.x * GYR_RANGE_DPS) / RESOLUTION,
-//            (gyr_data.y * GYR_RANGE_DPS) / RESOLUTION,
-//            (gyr_data.z * GYR_RANGE_DPS) / RESOLUTION);
+int imu_bmi270_mag(IMUMagData *pmag)
+{
+  int ret = -1;
 
-//     /* -- WAIT 50ms -- */
+  pthread_mutex_lock(&mag_mutex);
+  if (mag_valid)
+  {
+    *pmag = mag_latest;
+    ret = 0;
+  }
 
-//     waittime.tv_sec = 0;
-//     waittime.tv_nsec = 50 * 1000 * 1000;
-//     nanosleep(&waittime, NULL);
-//   }
+  pthread_mutex_unlock(&mag_mutex);
+  return ret;
+}
 
-// error_on_using_bmi270:
+/**
+ * @brief latest attitude and linear acceleration, never blocks
+ *
+ * Updated after every drain, from the last sample of it; the filter
+ * itself runs on every sample.
+ *
+ * @param patt copy [out]
+ * @return int success == 0, -1 before the first sample
+ */
 
-//   /** close I2C bus */
+int imu_bmi270_attitude(IMUAttitude *patt)
+{
+  int ret = -1;
 
-//   close(fd);
+  pthread_mutex_lock(&ahrs_mutex);
+  if (attitude_valid)
+  {
+    *patt = attitude_latest;
+    ret = 0;
+  }
 
-//   /** init bmi270 */
+  pthread_mutex_unlock(&ahrs_mutex);
+  return ret;
+}
 
-//   fini_bmi270(&bmi270);
+/**
+ * @brief cost of imu_ahrs_update() in the IMU thread, CYCLES_UNIT
+ *
+ * @param pstats copy [out]
+ * @return int success == 0
+ */
 
-//   return ret;
-// }
\ No newline at end of file
+int imu_bmi270_ahrs_stats(cycles_stats_t *pstats)
+{
+  pthread_mutex_lock(&ahrs_mutex);
+  *pstats = ahrs_cycles_published;
+  pthread_mutex_unlock(&ahrs_mutex);
+  return 0;
+}
@@ -1,18 +1,226 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+#include "bmi270lib/i2c_bmi270.h"
+#include "cycles.h"
+
 #define IMU_MEASUREMENT_INTERVAL_MS 50 // 50ms in nanoseconds
-#define IMU_MAX_SAVING_SECONDS 30
-#define IMU_DATA_STACK_SIZE (IMU_MAX_SAVING_SECONDS * 1000 / IMU_MEASUREMENT_INTERVAL_MS)
-#define IMU_CALIBRATION_SECONDS 10
-#define IMU_CALIBRATION_STACK_SIZE (IMU_CALIBRATION_SECONDS * 1000 / IMU_MEASUREMENT_INTERVAL_MS)
+#define IMU_SAMPLE_RATE_HZ 200 // GYR_CONF ODR, every sample is stored
+#define IMU_FIFO_HEADERLESS 0 // 1: 12 byte ACC+GYR frames, ACC at GYR rate
+#define IMU_DATA_RING_POLICY IMU_RING_OVERWRITE_OLDEST
+
+/* The fusion thread drains the ring every FUSION_INTERVAL_MS (20 ms), so
+ * 2.5 s at IMU_SAMPLE_RATE_HZ covers a long stall of it at 16 kB of RAM.
+ * A consumer that falls further behind loses the oldest samples, counted
+ * as overwritten and printed by imu_bmi270_report().  Power of two.
+ */
+
+#define IMU_DATA_RING_SIZE 512
+
+/* thread_imu_bmi270_main() stack: the driver context and a drain batch
+ * live on it (about 0.9 kB), start_bmi270() and the bus add 0.8 kB, and
+ * the tempco file I/O and float printf the rest.  The NuttX default of
+ * CONFIG_PTHREAD_STACK_DEFAULT (2 kB) is not enough.
+ */
+
+#define IMU_THREAD_STACK_SIZE 6144
+
+/* Bias estimation in the IMU thread: every IMU_BIAS_WINDOW_SAMPLES samples
+ * are tested for rest and, if the device did not move, merged into a
+ * running mean weighted over at most IMU_BIAS_HISTORY_SECONDS.
+ */
+
+#define IMU_BIAS_WINDOW_SAMPLES (IMU_SAMPLE_RATE_HZ / 2)
+#define IMU_BIAS_HISTORY_SECONDS 60
+#define IMU_BIAS_GYR_STD_MAX 0.3f // degree/s, rest limit per axis
+#define IMU_BIAS_ACC_STD_MAX 0.1f // m/s^2
+#define IMU_BIAS_ACC_NORM_TOL 0.5f // m/s^2, |mean acc| from 1 g
+#define IMU_BIAS_GYR_MEAN_MAX 2.0f // degree/s, larger means a steady turn
+
+/* Gyro bias temperature compensation: TEMPERATURE is read every
+ * IMU_TEMP_INTERVAL_MS and every window the bias estimator accepts adds a
+ * point to a bias-vs-temperature model, see imu_tempco.h.  The modelled
+ * bias is subtracted from every gyro sample.  The model is loaded from
+ * IMU_TEMPCO_PATH at start and stored there at most every
+ * IMU_TEMPCO_SAVE_INTERVAL_MS while it changes.
+ */
+
+#define IMU_TEMPCO_ENABLE 1
+#define IMU_TEMP_INTERVAL_MS 1000
+#define IMU_TEMPCO_PATH "/mnt/spif/gyro_tempco.bin"
+#define IMU_TEMPCO_SAVE_INTERVAL_MS (10 * 60 * 1000)
+
+/* Drain the FIFO on the BMI270 INT1 watermark interrupt instead of polling
+ * every IMU_MEASUREMENT_INTERVAL_MS.  100 bytes is about 50ms of 100Hz ACC
+ * + 200Hz GYR header frames (20 bytes per 10ms).  The wait times out after
+ * two intervals so a lost edge only delays the next drain.
+ */
+
+#define IMU_USE_WATERMARK_IRQ 1
+#define BMI270_INT1_PIN (PIN_EMMC_DATA3) // wired to BMI270 INT1
+#define IMU_FIFO_WATERMARK_BYTES 100
+#define IMU_WATERMARK_TIMEOUT_MS (2 * IMU_MEASUREMENT_INTERVAL_MS)
+
+/* Parked detection by the BMI270 feature engine.  No-motion for
+ * IMU_NO_MOTION_DUR_MS marks the asset parked and any-motion wakes it;
+ * both are mapped to INT1, so a wake costs at most one interrupt latency
+ * rather than a watermark period.  See imu_bmi270_motion().
+ */
+
+#define IMU_MOTION_DETECT 1
+#define IMU_ANY_MOTION_THRES_MG 80 // slope, per axis
+#define IMU_ANY_MOTION_DUR_MS 100
+#define IMU_NO_MOTION_THRES_MG 40
+#define IMU_NO_MOTION_DUR_MS 60000 // still this long: parked
+
+/* Shock capture: every sample goes through a pre/post-trigger buffer.
+ * The first sample above IMU_SHOCK_THRES_G freezes IMU_SHOCK_PRE_MS before
+ * and IMU_SHOCK_POST_MS from it on, flagged with the SATURATION bits of
+ * its drain, until imu_bmi270_shock() stores it under IMU_SHOCK_DIR.
+ */
+
+#define IMU_SHOCK_THRES_G 4.0f // |acc|, below the 8 g range
+#define IMU_SHOCK_PRE_MS 500
+#define IMU_SHOCK_POST_MS 1000
+#define IMU_SHOCK_DIR "/mnt/spif/shock"
+#define IMU_SHOCK_PATH_SIZE 48
+
+/* BMM150 magnetometer on the BMI270 AUX bus, read into the FIFO next to
+ * ACC and GYR.  The heading is tilt compensated with the accelerometer
+ * and magnetic, i.e. not corrected for declination or hard/soft iron; the
+ * BMM150 axes are taken as aligned with the BMI270 ones.  Without a
+ * BMM150 the thread carries on without it.  See imu_bmi270_mag().
+ */
+
+#define IMU_MAG_ENABLE 1
+
+/* Attitude by a Mahony filter (imu_ahrs.h) on every sample, published
+ * after every drain with the gravity-free acceleration of its last
+ * sample.  See imu_bmi270_attitude().
+ */
+
+#define IMU_AHRS_ENABLE 1
+#define IMU_AHRS_KP 0.3f // rad/s, tilt follows gravity in about 3s
+#define IMU_AHRS_KI 0.005f
+#define IMU_AHRS_ACC_TOL 0.03f // g, |acc| beyond 1 g +- this: gyro only
+#define IMU_AHRS_RATE_MAX 5.0f // degree/s, turning faster: gyro only
+
+/* I2C errors: a failed drain is repeated IMU_I2C_RETRY_MAX times
+ * IMU_I2C_RETRY_DELAY_MS apart, then the bus is reset and the chip
+ * re-initialised in place, attempts backing off from
+ * IMU_RECOVERY_BACKOFF_MS to IMU_RECOVERY_BACKOFF_MAX_MS.
+ */
+
+#define IMU_I2C_RETRY_MAX 3
+#define IMU_I2C_RETRY_DELAY_MS 1
+#define IMU_RECOVERY_BACKOFF_MS 10
+#define IMU_RECOVERY_BACKOFF_MAX_MS 2000
+
+/* I2C transfer statistics printed by imu_bmi270_report() at most this
+ * often
+ */
+
+#define IMU_TELEMETRY_INTERVAL_MS 10000
+#define IMU_TELEMETRY_LINE_SIZE I2C_STATS_FORMAT_SIZE
 
 typedef struct
 {
-  float ax;
+  float ax; // m/s^2
   float ay;
   float az;
-  float roll;
-  float pitch;
-  float yaw;
+  float roll; // degree/s around x, temperature compensated
+  float pitch; // around y
+  float yaw; // around z
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC from BMI270 sensortime, 0 if unknown
 } IMUData;
 
+typedef struct
+{
+  float temperature_c; // BMI270 die, last read
+  float bias[3]; // degree/s subtracted from roll, pitch, yaw
+  float slope[3]; // degree/s per K, 0 until the model spans enough
+  int bins; // temperature bins measured at rest
+} IMUTempcoState;
+
+typedef struct
+{
+  bool parked; // no-motion seen, no any-motion since
+  uint32_t parks; // moving -> parked
+  uint32_t wakes; // parked -> moving
+  uint64_t since_ns; // CLOCK_MONOTONIC of the last change, 0 if none
+} IMUMotionState;
+
+typedef struct
+{
+  uint64_t trigger_ns; // timestamp_ns of the first sample over the threshold
+  float peak_g; // largest |acc|
+  uint32_t samples; // in the window
+  uint32_t pre; // of which before the trigger
+  uint8_t saturation; // BMI270_SAT_* axes that clipped in the window
+  uint32_t missed; // triggers lost while a window waited, in total
+  char path[IMU_SHOCK_PATH_SIZE]; // CSV written, empty if storing failed
+} IMUShockEvent;
+
+typedef struct
+{
+  float mx; // uT, BMI270 axes
+  float my;
+  float mz;
+  float heading; // degree clockwise from magnetic north of +x, 0 .. 360
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC from BMI270 sensortime, 0 if unknown
+} IMUMagData;
+
+typedef struct
+{
+  float q[4]; // w x y z, body (x forward, y right, z down) to NED
+  float roll; // degree
+  float pitch;
+  float yaw; // degree clockwise, 0 .. 360, from the start, no north
+  float lin_body[3]; // m/s^2 without gravity, body axes
+  float lin_ned[3]; // m/s^2 without gravity, north east down
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC of the sample, 0 if unknown
+} IMUAttitude;
+
+/* The body frame of IMUAttitude, imu_ahrs.h and ins_ekf.h is x forward,
+ * y right, z down; IMUData has y left and z up.  f is the specific force
+ * in m/s^2 and w the rates in rad/s, both in body axes.
+ */
+
+static inline void imu_to_body(const IMUData *data, float f[3], float w[3])
+{
+  const float deg_to_rad = (float)M_PI / 180.0f;
+
+  f[0] = data->ax;
+  f[1] = -data->ay;
+  f[2] = -data->az;
+  w[0] = data->roll * deg_to_rad;
+  w[1] = -data->pitch * deg_to_rad;
+  w[2] = -data->yaw * deg_to_rad;
+}
+
+typedef struct
+{
+  uint32_t recoveries; // bus reset + re-init sequences that succeeded
+  uint32_t attempts; // including failed ones
+  uint32_t gaps; // data gaps closed by a sample after recovery
+  uint64_t last_gap_ns; // time between the samples either side of the gap
+  uint64_t max_gap_ns;
+  uint64_t total_gap_ns;
+} IMURecoveryStats;
+
 void *thread_imu_bmi270_main(void *arg);
-int read_bmi270(void);
\ No newline at end of file
+int imu_bmi270_report(void);
+int imu_bmi270_pop(IMUData *pdata);
+int imu_bmi270_reconfigure(const bmi270_config_t *pc);
+int imu_bmi270_i2c_stats(i2c_stats_t *pstats);
+int imu_bmi270_i2c_telemetry(char *buf, int size);
+int imu_bmi270_recovery_stats(IMURecoveryStats *pstats);
+int imu_bmi270_bias(IMUData *pbias, IMUData *pstddev);
+int imu_bmi270_tempco(IMUTempcoState *pstate);
+int imu_bmi270_motion(IMUMotionState *pstate);
+int imu_bmi270_wait_moving(int timeout_ms);
+int imu_bmi270_shock(IMUShockEvent *pevent);
+int imu_bmi270_mag(IMUMagData *pmag);
+int imu_bmi270_attitude(IMUAttitude *patt);
+int imu_bmi270_ahrs_stats(cycles_stats_t *pstats);
\ No newline at end of file
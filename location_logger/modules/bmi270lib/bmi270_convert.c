@@ -0,0 +1,40 @@
+/****************************************************************************
+ * location_logger/modules/bmi270lib/bmi270_convert.c
+ *
+ * axis_t tables to x, y, z float triplets times a per-LSB scale, e.g.
+ * bmi270_batch_t acc_scale or gyr_scale.  Each value is converted to
+ * float, which is exact for int16, and multiplied once, so the result is
+ * the correctly rounded product.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "bmi270_convert.h"
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**
+ * @brief raw samples to physical units
+ *
+ * @param dst 3 * n floats, x y z per sample [out]
+ * @param src n samples
+ * @param n number of samples
+ * @param scale physical value per LSB
+ */
+
+void bmi270_convert(float *dst, const axis_t *src, int n, float scale)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    dst[3 * i + 0] = (float)src[i].x * scale;
+    dst[3 * i + 1] = (float)src[i].y * scale;
+    dst[3 * i + 2] = (float)src[i].z * scale;
+  }
+}
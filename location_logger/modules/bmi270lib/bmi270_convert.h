@@ -0,0 +1,34 @@
+/****************************************************************************
+ * location_logger/modules/bmi270lib/bmi270_convert.h
+ *
+ * Raw ACC/GYR samples to physical units, a whole drain at a time.
+ *
+ ****************************************************************************/
+
+#ifndef __LOCATION_LOGGER_MODULES_BMI270LIB_BMI270_CONVERT_H
+#define __LOCATION_LOGGER_MODULES_BMI270LIB_BMI270_CONVERT_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include "i2c_bmi270.h"
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+void bmi270_convert(float *dst, const axis_t *src, int n, float scale);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __LOCATION_LOGGER_MODULES_BMI270LIB_BMI270_CONVERT_H */
@@ -0,0 +1,212 @@
+/****************************************************************************
+ * location_logger/modules/bmi270lib/bmm150.c
+ *
+ * The BMM150 sits on the BMI270 AUX bus.  init_bmm150() sets it up in
+ * manual mode, reads the trim registers and leaves the BMI270 reading the
+ * DATA_X..RHALL burst into the FIFO, so every drain carries the
+ * magnetometer next to ACC and GYR.  bmm150_convert() applies the Bosch
+ * floating point compensation to those bursts.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <time.h>
+#include "bmm150.h"
+#include "debug_printf.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BMM150_REG_CHIP_ID (0x40)
+#define BMM150_REG_DATA_X (0x42)
+#define BMM150_REG_POWER (0x4b)
+#define BMM150_REG_OP_MODE (0x4c)
+#define BMM150_REG_REP_XY (0x51)
+#define BMM150_REG_REP_Z (0x52)
+#define BMM150_REG_TRIM (0x5d)
+
+#define BMM150_CHIP_ID (0x32)
+#define BMM150_POWER_ON (0x01)
+#define BMM150_OP_MODE_NORMAL_25HZ (0x30)
+
+/* Regular preset: 9 XY and 15 Z repetitions */
+
+#define BMM150_REP_XY_REGULAR (0x04)
+#define BMM150_REP_Z_REGULAR (0x0e)
+
+/* 0x5d .. 0x71 */
+
+#define BMM150_TRIM_LENGTH (21)
+
+/* Out of range markers of the raw data */
+
+#define BMM150_OVERFLOW_XY (-4096)
+#define BMM150_OVERFLOW_Z (-16384)
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static float compensate_xy(int16_t raw, uint16_t rhall, int8_t t1,
+                           int8_t t2, const bmm150_trim_t *trim);
+static float compensate_z(int16_t raw, uint16_t rhall,
+                          const bmm150_trim_t *trim);
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static float
+compensate_xy(int16_t raw, uint16_t rhall, int8_t t1, int8_t t2,
+              const bmm150_trim_t *trim)
+{
+  float r;
+  float a;
+  float b;
+
+  if (raw == BMM150_OVERFLOW_XY || rhall == 0 || trim->xyz1 == 0)
+  {
+    return 0.0f;
+  }
+
+  r = (float)trim->xyz1 * 16384.0f / rhall - 16384.0f;
+  a = (float)trim->xy2 * (r * r / 268435456.0f);
+  b = r * (float)trim->xy1 / 16384.0f;
+  return (raw * ((a + b + 256.0f) * ((float)t2 + 160.0f)) / 8192.0f +
+          (float)t1 * 8.0f) / 16.0f;
+}
+
+static float
+compensate_z(int16_t raw, uint16_t rhall, const bmm150_trim_t *trim)
+{
+  float num;
+  float den;
+
+  if (raw == BMM150_OVERFLOW_Z || trim->z1 == 0 || trim->z2 == 0 ||
+      rhall == 0 || trim->xyz1 == 0)
+  {
+    return 0.0f;
+  }
+
+  num = ((float)raw - trim->z4) * 131072.0f -
+        (float)trim->z3 * ((float)rhall - trim->xyz1);
+  den = ((float)trim->z2 + (float)trim->z1 * rhall / 32768.0f) * 4.0f;
+  return num / den / 16.0f;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**
+ * @brief bring up the BMM150 and stream it into the BMI270 FIFO
+ *
+ * Call after init_bmi270() or recover_bmi270() on a header mode FIFO.
+ *
+ * @param pctrl control structure
+ * @param trim trim registers for bmm150_convert() [out]
+ * @return int success == 0, -1 when there is no BMM150 on the AUX bus
+ */
+
+int init_bmm150(i2c_bmi270_t *pctrl, bmm150_trim_t *trim)
+{
+  uint8_t t[BMM150_TRIM_LENGTH + 3];
+  uint8_t id;
+  int i;
+  struct timespec waittime;
+
+  if (open_aux_bmi270(pctrl, BMM150_I2C_ADDRESS) < 0 ||
+      aux_write_bmi270(pctrl, BMM150_REG_POWER, BMM150_POWER_ON) < 0)
+  {
+    return -1;
+  }
+
+  /* start-up time from suspend */
+
+  waittime.tv_sec = 0;
+  waittime.tv_nsec = 3 * 1000 * 1000;
+  nanosleep(&waittime, NULL);
+
+  if (aux_read_bmi270(pctrl, BMM150_REG_CHIP_ID, &id, 1) < 0 ||
+      id != BMM150_CHIP_ID)
+  {
+    DPRINT_ERROR("BMM150 not found");
+    return -1;
+  }
+
+  for (i = 0; i < BMM150_TRIM_LENGTH; i += BMI270_AUX_FRAME_LENGTH)
+  {
+    if (aux_read_bmi270(pctrl, BMM150_REG_TRIM + i, &t[i],
+                        BMI270_AUX_FRAME_LENGTH) < 0)
+    {
+      return -1;
+    }
+  }
+
+  trim->x1 = (int8_t)t[0x5d - BMM150_REG_TRIM];
+  trim->y1 = (int8_t)t[0x5e - BMM150_REG_TRIM];
+  trim->z4 = (int16_t)(t[0x62 - BMM150_REG_TRIM] |
+                       t[0x63 - BMM150_REG_TRIM] << 8);
+  trim->x2 = (int8_t)t[0x64 - BMM150_REG_TRIM];
+  trim->y2 = (int8_t)t[0x65 - BMM150_REG_TRIM];
+  trim->z2 = (int16_t)(t[0x68 - BMM150_REG_TRIM] |
+                       t[0x69 - BMM150_REG_TRIM] << 8);
+  trim->z1 = (uint16_t)(t[0x6a - BMM150_REG_TRIM] |
+                        t[0x6b - BMM150_REG_TRIM] << 8);
+  trim->xyz1 = (uint16_t)(t[0x6c - BMM150_REG_TRIM] |
+                          (t[0x6d - BMM150_REG_TRIM] & 0x7f) << 8);
+  trim->z3 = (int16_t)(t[0x6e - BMM150_REG_TRIM] |
+                       t[0x6f - BMM150_REG_TRIM] << 8);
+  trim->xy2 = (int8_t)t[0x70 - BMM150_REG_TRIM];
+  trim->xy1 = t[0x71 - BMM150_REG_TRIM];
+
+  if (aux_write_bmi270(pctrl, BMM150_REG_REP_XY,
+                       BMM150_REP_XY_REGULAR) < 0 ||
+      aux_write_bmi270(pctrl, BMM150_REG_REP_Z, BMM150_REP_Z_REGULAR) < 0 ||
+      aux_write_bmi270(pctrl, BMM150_REG_OP_MODE,
+                       BMM150_OP_MODE_NORMAL_25HZ) < 0)
+  {
+    return -1;
+  }
+
+  return start_aux_bmi270(pctrl, BMM150_REG_DATA_X, BMM150_AUX_ODR);
+}
+
+/**
+ * @brief AUX bursts to compensated x, y, z triplets in uT
+ *
+ * A saturated axis reads 0.
+ *
+ * @param dst 3 * n floats [out]
+ * @param src bmi270_batch_t aux
+ * @param n bmi270_batch_t aux_count
+ * @param trim from init_bmm150()
+ */
+
+void bmm150_convert(float *dst, const aux_t *src, int n,
+                    const bmm150_trim_t *trim)
+{
+  const uint8_t *d;
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  uint16_t rhall;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    d = src[i].data;
+    x = (int16_t)(d[0] | d[1] << 8) >> 3;
+    y = (int16_t)(d[2] | d[3] << 8) >> 3;
+    z = (int16_t)(d[4] | d[5] << 8) >> 1;
+    rhall = (uint16_t)(d[6] | d[7] << 8) >> 2;
+
+    dst[3 * i + 0] = compensate_xy(x, rhall, trim->x1, trim->x2, trim);
+    dst[3 * i + 1] = compensate_xy(y, rhall, trim->y1, trim->y2, trim);
+    dst[3 * i + 2] = compensate_z(z, rhall, trim);
+  }
+}
@@ -0,0 +1,69 @@
+/****************************************************************************
+ * location_logger/modules/bmi270lib/bmm150.h
+ *
+ * BMM150 magnetometer behind the BMI270 AUX interface.
+ *
+ ****************************************************************************/
+
+#ifndef __LOCATION_LOGGER_MODULES_BMI270LIB_BMM150_H
+#define __LOCATION_LOGGER_MODULES_BMI270LIB_BMM150_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include "i2c_bmi270.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BMM150_I2C_ADDRESS (0x10)
+
+/* Data rate of the FIFO AUX samples, the BMM150 runs at 25Hz in normal
+ * mode with the regular preset
+ */
+
+#define BMM150_AUX_ODR BMI270_ODR_25HZ
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Factory trim registers for the temperature / cross axis compensation */
+
+typedef struct _bmm150_trim_type
+{
+  int8_t x1;
+  int8_t y1;
+  int8_t x2;
+  int8_t y2;
+  uint16_t z1;
+  int16_t z2;
+  int16_t z3;
+  int16_t z4;
+  uint8_t xy1;
+  int8_t xy2;
+  uint16_t xyz1;
+} bmm150_trim_t;
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+int init_bmm150(i2c_bmi270_t *pctrl, bmm150_trim_t *trim);
+void bmm150_convert(float *dst, const aux_t *src, int n,
+                    const bmm150_trim_t *trim);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __LOCATION_LOGGER_MODULES_BMI270LIB_BMM150_H */
@@ -21,6 +21,8 @@
  * Included Files
  ****************************************************************************/
 
+#include <time.h>
+#include <string.h>
 #include "i2c_bmi270.h"
 
 /****************************************************************************
@@ -31,6 +33,15 @@
 
 #define CONV(a, n) (int16_t)((((uint16_t)a[n + 1]) << 8) | ((uint16_t)a[n]))
 
+/* Longest header mode frame: header + AUX + GYR + ACC */
+
+#define BMI270_FIFO_MAX_FRAME_LENGTH (1 + BMI270_AUX_FRAME_LENGTH + 6 + 6)
+
+/* Config file upload */
+
+#define BMI270_INIT_CHUNK_SIZE (256)
+#define BMI270_INIT_CHUNK_RETRY (3)
+
 /* Register MAP */
 
 #define BMI270_REG_CHIPID (0x00)
@@ -49,6 +60,12 @@
 #define BMI270_REG_INTERNAL_STATUS (0x21)
 #define BMI270_REG_TEMPERATURE_0 (0x22)
 #define BMI270_REG_TEMPERATURE_1 (0x23)
+
+/* TEMPERATURE: 1/512 K per LSB, 0 at 23 degC, 0x8000 while invalid */
+
+#define BMI270_TEMPERATURE_INVALID (-32768)
+#define BMI270_TEMPERATURE_OFFSET_C (23.0f)
+#define BMI270_TEMPERATURE_LSB_PER_K (512.0f)
 #define BMI270_REG_FIFO_LENGTH_0 (0x24)
 #define BMI270_REG_FIFO_LENGTH_1 (0x25)
 #define BMI270_REG_FIFO_DATA (0x26)
@@ -98,20 +115,98 @@
 #define BMI270_REG_PWR_CTRL (0x7d)
 #define BMI270_REG_CMD (0x7e)
 
-#define BMI270_STORE_TABLE_LENGTH (1024)
-#define BMI270_FIFO_MAX_LENGTH (2560)
+/* FIFO_CONFIG_1: ACC + GYR, with or without frame headers */
+
+#define BMI270_FIFO_CONFIG_1_HEADER (0xd0)
+#define BMI270_FIFO_CONFIG_1_HEADERLESS (0xc0)
+#define BMI270_FIFO_CONFIG_1_AUX (0x20)
+
+/* Regular FIFO frame header, fh_parm bits 4:2 */
+
+#define BMI270_FIFO_HEADER_ACC (0x04)
+#define BMI270_FIFO_HEADER_GYR (0x08)
+#define BMI270_FIFO_HEADER_AUX (0x10)
+
+/* Auxiliary interface: PWR_CTRL.aux_en, IF_CONF.aux_en, STATUS.aux_busy
+ * and AUX_IF_CONF with 8 byte bursts in both modes.  In manual mode a
+ * write to AUX_WR_ADDR sends AUX_WR_DATA to the sensor and a write to
+ * AUX_RD_ADDR reads it into DATA_0..7; in data mode the chip reads
+ * AUX_RD_ADDR on its own at the AUX_CONF rate.
+ */
+
+#define BMI270_PWR_CTRL_AUX_EN (0x01)
+#define BMI270_IF_CONF_AUX_EN (0x20)
+#define BMI270_STATUS_AUX_BUSY (0x04)
+#define BMI270_AUX_IF_CONF_MANUAL (0x80)
+#define BMI270_AUX_IF_CONF_BURST8 (0x0f)
+#define BMI270_AUX_BUSY_POLLS (10)
+
+/* INT1_IO_CTRL: output enabled, push-pull, active high */
+
+#define BMI270_INT1_IO_CTRL_VALUE (0x0a)
+
+/* INT_MAP_DATA: FIFO watermark and FIFO full on INT1 */
+
+#define BMI270_INT_MAP_DATA_FIFO_INT1 (0x03)
+
+/* Feature engine motion detectors in the paged FEATURES window: two
+ * 16 bit words each, duration and axis select, then threshold and enable.
+ * The engine runs at 50Hz; the threshold is in units of 1g / 2048.
+ */
+
+#define BMI270_FEAT_PAGE_ANY_MOTION (1)
+#define BMI270_FEAT_ANY_MOTION (0x0c)
+#define BMI270_FEAT_PAGE_NO_MOTION (2)
+#define BMI270_FEAT_NO_MOTION (0x00)
+#define BMI270_FEAT_MOTION_XYZ (0x7 << 13)
+#define BMI270_FEAT_MOTION_EN (1 << 15)
+#define BMI270_FEAT_MOTION_DUR_MAX (0x1fff)
+#define BMI270_FEAT_MOTION_THRES_MAX (0x07ff)
+#define BMI270_FEAT_PERIOD_MS (20)
 
 /****************************************************************************
  * Private Function Prototypes
  ****************************************************************************/
 
-static int enable_fifo_bmi270(i2c_ctrl_t *pi2c);
-static void bmi270_fifo_decoder(i2c_bmi270_t *pctrl);
+static int enable_fifo_bmi270(i2c_txn_t *ptxn, bool headerless, bool aux);
+static uint32_t now_us(void);
+static int load_config_bmi270(i2c_ctrl_t *pi2c, uint32_t *upload_us);
+static int validate_config(const bmi270_config_t *pc);
+static int write_config_bmi270(i2c_bmi270_t *pctrl, i2c_txn_t *ptxn,
+                               const bmi270_config_t *pc);
+static int start_bmi270(i2c_bmi270_t *pctrl);
+static uint32_t odr_period_ticks(uint8_t conf);
+static int fifo_frame_length(uint8_t header);
+static uint64_t update_sample_time(uint64_t *next, uint32_t period,
+                                   int count, bool anchor,
+                                   uint64_t anchor_ticks, bool exact);
+static void update_fifo_time(i2c_bmi270_t *pctrl, int acc_pos0,
+                             int gyr_pos0, int aux_pos0, uint64_t host_ns);
+static int wait_aux_bmi270(i2c_bmi270_t *pctrl);
+static void motion_words(uint8_t *p, uint16_t thres_mg, uint16_t dur_ms);
 
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
+/* Registers the shadow never serves: CHIPID (read as a presence check),
+ * status, data, sensortime, interrupt status, FIFO length and data, the
+ * paged FEATURES window, SATURATION, AUX_RD_ADDR/AUX_WR_ADDR/AUX_WR_DATA
+ * (a write starts an AUX access), INIT_ADDR/INIT_DATA, INTERNAL_ERROR,
+ * GYR_CRT_CONF and CMD.
+ */
+
+static const uint8_t g_bmi270_volatile_regs[I2C_SHADOW_SIZE / 8] =
+{
+  0xfd, 0xff, 0xff, 0xff, 0x7f, 0x00, 0xff, 0xff,   /* 0x00 - 0x3f */
+  0x00, 0xe4, 0x00, 0xd8, 0x00, 0x02, 0x00, 0x40,   /* 0x40 - 0x7f */
+};
+
+/* Used by init_bmi270() when the caller attached no storage */
+
+static bmi270_storage_t g_bmi270_storage;
+static i2c_bmi270_t *g_bmi270_storage_owner;
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
@@ -119,27 +214,32 @@ static void bmi270_fifo_decoder(i2c_bmi270_t *pctrl);
 /**
  * @brief start BMI270 FIFO
  *
- * @param fd file descriptor
+ * @param ptxn transaction the writes are queued to
+ * @param headerless ACC+GYR frames without headers
+ * @param aux AUX data in the header mode frames too
  * @return int success == 0
  */
 
 static int
-enable_fifo_bmi270(i2c_ctrl_t *pi2c)
+enable_fifo_bmi270(i2c_txn_t *ptxn, bool headerless, bool aux)
 {
   int ret;
-  ret = i2c_reg_write(pi2c, BMI270_REG_FIFO_CONFIG_1, 0xd0);
+  ret = i2c_txn_write(ptxn, BMI270_REG_FIFO_CONFIG_1,
+                      headerless ? BMI270_FIFO_CONFIG_1_HEADERLESS :
+                      BMI270_FIFO_CONFIG_1_HEADER |
+                      (aux ? BMI270_FIFO_CONFIG_1_AUX : 0));
   if (ret < 0)
   {
     return -1;
   }
 
-  ret = i2c_reg_write(pi2c, BMI270_REG_FIFO_CONFIG_0, 0x02);
+  ret = i2c_txn_write(ptxn, BMI270_REG_FIFO_CONFIG_0, 0x02);
   if (ret < 0)
   {
     return -1;
   }
 
-  ret = i2c_reg_write(pi2c, BMI270_REG_CMD, 0xb0);
+  ret = i2c_txn_write(ptxn, BMI270_REG_CMD, 0xb0);
   if (ret < 0)
   {
     return -1;
@@ -149,185 +249,142 @@ enable_fifo_bmi270(i2c_ctrl_t *pi2c)
 }
 
 /**
- * @brief Decoder for BMI270 FIFO
- *
- * @param fifo dequeued data
- * @param fifo_depth dequeued length
+ * @brief CLOCK_MONOTONIC in microseconds, for the init timing
  */
 
-static void
-bmi270_fifo_decoder(i2c_bmi270_t *pctrl)
+static uint32_t
+now_us(void)
 {
-  int i = 0;
-  int fifo_depth = pctrl->fifo_depth;
-  uint8_t *fifo = pctrl->fifo;
-
-  while (i < fifo_depth)
-  {
-    DPRINT_DEBUG("[%02x]", fifo[i]);
-    if (fifo[i] & 0x40)
-    {
-      uint8_t type = ((fifo[i] >> 2) & 0x0f);
-      i += 1;
-      switch (type)
-      {
-      case 0:
-        DPRINT_DEBUG(" - SKIP - %02x",
-                     fifo[i]);
-        i += 1;
-        break;
-      case 1:
-        DPRINT_DEBUG(" - TIME - %02x,%02x",
-                     fifo[i], fifo[i + 1]);
-        i += 2;
-        break;
-      case 2:
-        DPRINT_DEBUG(" - CFGF - %02x,%02x,%02x,%02x",
-                     fifo[i], fifo[i + 1], fifo[i + 2], fifo[i + 3]);
-        i += 4;
-        break;
-      }
-    }
-    else if (fifo[i] & 0x80)
-    {
-      uint8_t enable = ((fifo[i] >> 2) & 0x0f);
-      i += 1;
-      if (enable & 0x02)
-      {
-        DPRINT_DEBUG(" - GYR - %d,%d,%d",
-                     CONV(fifo, i), CONV(fifo, i + 2), CONV(fifo, i + 4));
-        if (pctrl->gyr_table_pos >= BMI270_STORE_TABLE_LENGTH)
-        {
-          printf("store overflow\n");
-        }
-        else
-        {
-          pctrl->gyr_table[pctrl->gyr_table_pos].x =
-              CONV(fifo, i);
-          pctrl->gyr_table[pctrl->gyr_table_pos].y =
-              CONV(fifo, i + 2);
-          pctrl->gyr_table[pctrl->gyr_table_pos].z =
-              CONV(fifo, i + 4);
-          pctrl->gyr_table_pos++;
-        }
-
-        i += 6;
-      }
-
-      if (enable & 0x01)
-      {
-        DPRINT_DEBUG(" - ACC - %d,%d,%d",
-                     CONV(fifo, i), CONV(fifo, i + 2), CONV(fifo, i + 4));
-        if (pctrl->acc_table_pos >= BMI270_STORE_TABLE_LENGTH)
-        {
-          printf("store overflow\n");
-        }
-        else
-        {
-          pctrl->acc_table[pctrl->acc_table_pos].x =
-              CONV(fifo, i);
-          pctrl->acc_table[pctrl->acc_table_pos].y =
-              CONV(fifo, i + 2);
-          pctrl->acc_table[pctrl->acc_table_pos].z =
-              CONV(fifo, i + 4);
-          pctrl->acc_table_pos++;
-        }
-
-        i += 6;
-      }
-    }
-  }
+  struct timespec now;
 
-  return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000000ull + now.tv_nsec / 1000);
 }
 
-/****************************************************************************
- * Public Functions
- ****************************************************************************/
-
 /**
- * @brief finialize BMI270
+ * @brief check a configuration against the register ranges
  *
- * @param pctrl control structure
+ * @param pc configuration
+ * @return int valid == 0
  */
 
-void fini_bmi270(i2c_bmi270_t *pctrl)
+static int
+validate_config(const bmi270_config_t *pc)
 {
-  if (pctrl->acc_table != NULL)
+  if (pc->acc_odr < 1 || pc->acc_odr > BMI270_ODR_1600HZ ||
+      pc->gyr_odr < BMI270_ODR_25HZ || pc->gyr_odr > BMI270_ODR_3200HZ ||
+      pc->acc_range > BMI270_ACC_RANGE_16G ||
+      pc->gyr_range > BMI270_GYR_RANGE_125DPS ||
+      pc->acc_bwp > 7 || pc->gyr_bwp > BMI270_BWP_NORMAL ||
+      pc->acc_downs > 7 || pc->gyr_downs > 7)
   {
-    free(pctrl->acc_table);
-    pctrl->acc_table = NULL;
+    return -1;
   }
 
-  if (pctrl->gyr_table != NULL)
-  {
-    free(pctrl->gyr_table);
-    pctrl->gyr_table = NULL;
-  }
+  /* header-less frames carry both sensors at one rate */
 
-  if (pctrl->fifo != NULL)
+  if (pc->fifo_headerless &&
+      pc->acc_odr - pc->acc_downs != pc->gyr_odr - pc->gyr_downs)
   {
-    free(pctrl->fifo);
-    pctrl->fifo = NULL;
+    return -1;
   }
 
-  return;
+  return 0;
 }
 
 /**
- * @brief initialization BMI270 and start mesurement
+ * @brief write ODR, filter, range and FIFO downsampling
+ *
+ * The sample schedule restarts, and the scale factors and periods follow
+ * the new configuration.
  *
  * @param pctrl control structure
+ * @param ptxn transaction the writes are queued to
+ * @param pc validated configuration
  * @return int success == 0
  */
 
-int init_bmi270(i2c_bmi270_t *pctrl)
+static int
+write_config_bmi270(i2c_bmi270_t *pctrl, i2c_txn_t *ptxn,
+                    const bmi270_config_t *pc)
 {
   int ret;
-  uint8_t chipid;
-  i2c_ctrl_t *pi2c = &pctrl->i2c;
-  struct timespec waittime;
-
-  /* alloc working memory */
+  uint8_t acc_conf = (pc->acc_perf ? 0x80 : 0x00) |
+                     (pc->acc_bwp << 4) | pc->acc_odr;
+  uint8_t gyr_conf = (pc->gyr_perf ? 0x80 : 0x00) |
+                     (pc->gyr_bwp << 4) | pc->gyr_odr;
 
-  pctrl->fifo = NULL;
-  pctrl->acc_table = NULL;
-  pctrl->gyr_table = NULL;
-
-  pctrl->fifo = (uint8_t *)malloc(BMI270_FIFO_MAX_LENGTH);
-  if (pctrl->fifo == NULL)
+  ret = i2c_txn_write(ptxn, BMI270_REG_ACC_CONF, acc_conf);
+  if (ret < 0)
   {
     return -1;
   }
 
-  /* alloc store memory for ACCEL */
-
-  pctrl->acc_table = (axis_t *)malloc(BMI270_STORE_TABLE_LENGTH);
-  if (pctrl->acc_table == NULL)
+  ret = i2c_txn_write(ptxn, BMI270_REG_GYR_CONF, gyr_conf);
+  if (ret < 0)
   {
     return -1;
   }
 
-  pctrl->acc_table_pos = 0;
-
-  /* alloc store memory for GYRO */
+  ret = i2c_txn_write(ptxn, BMI270_REG_ACC_RANGE, pc->acc_range);
+  if (ret < 0)
+  {
+    return -1;
+  }
 
-  pctrl->gyr_table = (axis_t *)malloc(BMI270_STORE_TABLE_LENGTH);
-  if (pctrl->acc_table == NULL)
+  ret = i2c_txn_write(ptxn, BMI270_REG_GYR_RANGE, pc->gyr_range);
+  if (ret < 0)
   {
     return -1;
   }
 
-  pctrl->gyr_table_pos = 0;
+  /* filtered data into the FIFO, as after reset */
 
-  ret = i2c_reg_read(pi2c, BMI270_REG_CHIPID, &chipid, 1);
-  if ((ret < 0) || (chipid != 0x24))
+  ret = i2c_txn_write(ptxn, BMI270_REG_FIFO_DOWNS,
+                      0x88 | (pc->acc_downs << 4) | pc->gyr_downs);
+  if (ret < 0)
   {
-    printf("communication:ERROR %d, chipid=0x%02x", ret, chipid);
     return -1;
   }
 
-  DPRINT_INFO("chipid = 0x%02x", chipid);
+  if (pc != &pctrl->config)
+  {
+    pctrl->config = *pc;
+  }
+
+  pctrl->acc_period = odr_period_ticks(acc_conf) << pc->acc_downs;
+  pctrl->gyr_period = odr_period_ticks(gyr_conf) << pc->gyr_downs;
+  pctrl->acc_next = 0;
+  pctrl->gyr_next = 0;
+  return 0;
+}
+
+/**
+ * @brief soft reset and upload the config file
+ *
+ * The file goes out in BMI270_INIT_CHUNK_SIZE bursts, each in one
+ * transfer with its INIT_ADDR, so no single transfer needs an 8KB buffer
+ * and a failed chunk is retried on its own.
+ *
+ * @param pi2c i2c control
+ * @param upload_us time spent in the INIT_DATA writes [output]
+ * @return int success == 0
+ */
+
+static int
+load_config_bmi270(i2c_ctrl_t *pi2c, uint32_t *upload_us)
+{
+  int ret;
+  int pos;
+  int len;
+  int retry;
+  int size = get_bmi270_config_file_size();
+  const uint8_t *config = get_bmi270_config_file_addr();
+  uint8_t init_addr[2];
+  uint8_t internal_stat;
+  uint64_t t0;
+  struct timespec waittime;
+  i2c_txn_t txn;
 
   ret = i2c_reg_write(pi2c, BMI270_REG_CMD, 0xb6);
   if (ret < 0)
@@ -335,6 +392,8 @@ int init_bmi270(i2c_bmi270_t *pctrl)
     /* NOP */
   }
 
+  i2c_shadow_invalidate(pi2c);
+
   /* -- WAIT 1ms -- */
 
   waittime.tv_sec = 0;
@@ -361,28 +420,61 @@ int init_bmi270(i2c_bmi270_t *pctrl)
     return -1;
   }
 
-  ret = i2c_reg_write_burst(pi2c, BMI270_REG_INIT_DATA,
-                            get_bmi270_config_file_addr(),
-                            get_bmi270_config_file_size());
-  if (ret < 0)
+  t0 = now_us();
+  for (pos = 0; pos < size; pos += len)
   {
-    return -1;
+    len = size - pos < BMI270_INIT_CHUNK_SIZE ?
+          size - pos : BMI270_INIT_CHUNK_SIZE;
+
+    /* INIT_ADDR counts 16 bit words, 4 bits in _0 and 8 bits in _1 */
+
+    init_addr[0] = (pos / 2) & 0x0f;
+    init_addr[1] = ((pos / 2) >> 4) & 0xff;
+    for (retry = 0; retry < BMI270_INIT_CHUNK_RETRY; retry++)
+    {
+      if (retry > 0)
+      {
+        i2c_stats_retry(pi2c);
+      }
+
+      i2c_txn_begin(&txn, pi2c);
+      i2c_txn_write_burst(&txn, BMI270_REG_INIT_ADDR_0, init_addr, 2);
+      i2c_txn_write_burst(&txn, BMI270_REG_INIT_DATA, &config[pos], len);
+      ret = i2c_txn_submit(&txn);
+      if (ret >= 0)
+      {
+        break;
+      }
+    }
+
+    if (ret < 0)
+    {
+      return -1;
+    }
   }
 
+  *upload_us = now_us() - t0;
+
   ret = i2c_reg_write(pi2c, BMI270_REG_INIT_CTRL, 0x01);
   if (ret < 0)
   {
     return -1;
   }
 
-  /* -- WAIT 20ms -- */
+  /* -- WAIT up to 20ms for the config to be checked -- */
 
   waittime.tv_sec = 0;
-  waittime.tv_nsec = 20 * 1000 * 1000;
-  nanosleep(&waittime, NULL);
+  waittime.tv_nsec = 1000 * 1000;
+  for (retry = 0; retry < 20; retry++)
+  {
+    nanosleep(&waittime, NULL);
+    ret = i2c_reg_read(pi2c, BMI270_REG_INTERNAL_STATUS, &internal_stat, 1);
+    if (ret >= 0 && (internal_stat & 0x0f) != 0x00)
+    {
+      break;
+    }
+  }
 
-  uint8_t internal_stat;
-  ret = i2c_reg_read(pi2c, BMI270_REG_INTERNAL_STATUS, &internal_stat, 1);
   if ((ret < 0) || ((internal_stat & 0x0f) != 0x01))
   {
     printf("communication:ERROR %d, "
@@ -391,51 +483,75 @@ int init_bmi270(i2c_bmi270_t *pctrl)
     return -1;
   }
 
-  /* -- Initialize success -- */
+  return 0;
+}
 
-  DPRINT_INFO("init success(0x%02x)", internal_stat);
+/**
+ * @brief probe the chip, load its config if needed and start measuring
+ *
+ * @param pctrl control structure with a valid configuration
+ * @return int success == 0
+ */
 
-  /* -- Start Mesurement ACC & GYR -- */
+static int
+start_bmi270(i2c_bmi270_t *pctrl)
+{
+  int ret;
+  uint8_t chipid;
+  uint8_t internal_stat;
+  i2c_ctrl_t *pi2c = &pctrl->i2c;
+  i2c_txn_t txn;
 
-  ret = i2c_reg_write(pi2c, BMI270_REG_PWR_CTRL, 0x0e);
-  if (ret < 0)
+  ret = i2c_reg_read(pi2c, BMI270_REG_CHIPID, &chipid, 1);
+  if ((ret < 0) || (chipid != 0x24))
   {
+    printf("communication:ERROR %d, chipid=0x%02x\n", ret, chipid);
     return -1;
   }
 
-  ret = i2c_reg_write(pi2c, BMI270_REG_ACC_CONF, 0xa8);
-  if (ret < 0)
-  {
-    return -1;
-  }
+  DPRINT_INFO("chipid = 0x%02x", chipid);
 
-  ret = i2c_reg_write(pi2c, BMI270_REG_GYR_CONF, 0xa9);
-  if (ret < 0)
-  {
-    return -1;
-  }
+  /* A chip that still runs a validated config file only needs the
+   * measurement setup below.
+   */
 
-  ret = i2c_reg_write(pi2c, BMI270_REG_PWR_CONF, 0x02);
-  if (ret < 0)
+  ret = i2c_reg_read(pi2c, BMI270_REG_INTERNAL_STATUS, &internal_stat, 1);
+  pctrl->init_stats.warm = !pctrl->init_cold && ret >= 0 &&
+                           (internal_stat & 0x0f) == 0x01;
+  pctrl->init_stats.upload_us = 0;
+  if (!pctrl->init_stats.warm)
   {
-    return -1;
+    ret = load_config_bmi270(pi2c, &pctrl->init_stats.upload_us);
+    if (ret < 0)
+    {
+      return -1;
+    }
   }
 
-  /* Set accelerometer range */
-  ret = i2c_reg_write(pi2c, BMI270_REG_ACC_RANGE, ACC_RANGE_SET_VALUE); // ±2g
-  if (ret < 0)
-  {
-    return -1;
-  }
+  /* -- Initialize success -- */
+
+  DPRINT_INFO("init success(0x%02x)", internal_stat);
 
-  /* Set gyroscope range */
-  ret = i2c_reg_write(pi2c, BMI270_REG_GYR_RANGE, GYR_RANGE_SET_VALUE); // ±2000°/s
+  /* -- Start Mesurement ACC & GYR -- */
+
+  /* Out of advanced power save first: in it, writes need 450us apart
+   * and cannot share a transfer.
+   */
+
+  ret = i2c_reg_write(pi2c, BMI270_REG_PWR_CONF, 0x02);
   if (ret < 0)
   {
     return -1;
   }
 
-  ret = enable_fifo_bmi270(pi2c);
+  /* the AUX interface is off after reset, see open_aux_bmi270() */
+
+  pctrl->aux_enabled = false;
+  i2c_txn_begin(&txn, pi2c);
+  i2c_txn_write(&txn, BMI270_REG_PWR_CTRL, 0x0e);
+  write_config_bmi270(pctrl, &txn, &pctrl->config);
+  enable_fifo_bmi270(&txn, pctrl->config.fifo_headerless, false);
+  ret = i2c_txn_submit(&txn);
   if (ret < 0)
   {
     return -1;
@@ -445,43 +561,991 @@ int init_bmi270(i2c_bmi270_t *pctrl)
 }
 
 /**
- * @brief Fetch FIFO of BMI270
+ * @brief sample period in sensortime ticks for an ACC/GYR_CONF value
  *
- * @param fd I2C descriptor
- * @return int success == 0
+ * @param conf register value, ODR in bits 3:0
+ * @return uint32_t ticks, 256 at 100Hz
  */
 
-int exec_dequeue_fifo(i2c_bmi270_t *pctrl)
+static uint32_t
+odr_period_ticks(uint8_t conf)
 {
-  int ret;
-  uint8_t fifo_len_reg[2];
-  i2c_ctrl_t *pi2c = &pctrl->i2c;
+  int odr = conf & 0x0f;
 
-  ret = i2c_reg_read(pi2c, BMI270_REG_FIFO_LENGTH_0, fifo_len_reg, 2);
-  if (ret < 0)
-  {
-    return -1;
-  }
-
-  pctrl->fifo_depth = CONV(fifo_len_reg, 0);
-  DPRINT_DEBUG("FIFO_LENGTH=%d", pctrl->fifo_depth);
-
-  ret = i2c_reg_read(pi2c, BMI270_REG_FIFO_DATA,
-                     pctrl->fifo, pctrl->fifo_depth);
-  if (ret < 0)
+  if (odr < 1)
   {
-    return -1;
+    odr = 1;
   }
 
-  bmi270_fifo_decoder(pctrl);
-  return 0;
+  return odr <= 8 ? 256u << (8 - odr) : 256u >> (odr - 8);
 }
 
 /**
- * @brief get latest accel value
+ * @brief length of a header mode FIFO frame including its header
  *
- * @param pd values[output]
- * @return int success == 0
+ * @param header frame header
+ * @return int bytes
+ */
+
+static int
+fifo_frame_length(uint8_t header)
+{
+  if (header & 0x40)
+  {
+    switch ((header >> 2) & 0x0f)
+    {
+    case 0:
+      return 2;
+    case 1:
+      return 4;
+    case 2:
+      return 5;
+    default:
+      return 1;
+    }
+  }
+
+  if (header & 0x80)
+  {
+    return 1 + ((header & BMI270_FIFO_HEADER_ACC) ? 6 : 0) +
+           ((header & BMI270_FIFO_HEADER_GYR) ? 6 : 0) +
+           ((header & BMI270_FIFO_HEADER_AUX) ? BMI270_AUX_FRAME_LENGTH : 0);
+  }
+
+  return 1;
+}
+
+/**
+ * @brief time of the first of count new samples of one sensor
+ *
+ * Samples are taken on multiples of their period in sensortime, so with
+ * a TIME frame the newest one is the last multiple before it.  Without
+ * one the samples follow on from the previous drain.  An inexact anchor,
+ * the SENSORTIME register read after FIFO_LENGTH, may already be past
+ * the next sample; it only replaces the schedule when samples were lost.
+ *
+ * @param next expected time of the next sample [in/out]
+ * @param anchor true when anchor_ticks holds the drain's sensortime
+ * @param exact anchor_ticks comes from a TIME frame
+ * @return uint64_t time of the first sample in ticks
+ */
+
+static uint64_t
+update_sample_time(uint64_t *next, uint32_t period, int count, bool anchor,
+                   uint64_t anchor_ticks, bool exact)
+{
+  uint64_t first = *next;
+  uint64_t anchored;
+
+  if (anchor && count > 0)
+  {
+    anchored = (anchor_ticks / period) * period -
+               (uint64_t)(count - 1) * period;
+    if (exact || *next == 0 || anchored > *next + period ||
+        anchored + period < *next)
+    {
+      first = anchored;
+    }
+  }
+
+  *next = first + (uint64_t)count * period;
+  return first;
+}
+
+/**
+ * @brief advance the sensortime to CLOCK_MONOTONIC mapping after a drain
+ *
+ * @param acc_pos0 acc_table_pos before the drain was decoded
+ * @param gyr_pos0 gyr_table_pos before the drain was decoded
+ * @param aux_pos0 aux_table_pos before the drain was decoded
+ * @param host_ns CLOCK_MONOTONIC at the end of the FIFO read
+ */
+
+static void
+update_fifo_time(i2c_bmi270_t *pctrl, int acc_pos0, int gyr_pos0,
+                 int aux_pos0, uint64_t host_ns)
+{
+  bool anchor = pctrl->fifo_time_valid;
+  uint64_t first;
+  int64_t offset;
+
+  if (anchor)
+  {
+    /* unwrap the 24 bit counter, it wraps every 655s */
+
+    if (!pctrl->time_synced)
+    {
+      pctrl->time_ticks = pctrl->fifo_time;
+    }
+    else
+    {
+      pctrl->time_ticks +=
+          (pctrl->fifo_time - (uint32_t)pctrl->time_ticks) & 0xffffff;
+    }
+
+    /* The read latency only ever adds to the offset, so follow it
+     * slowly and jump down to a lower one.
+     */
+
+    offset = (int64_t)host_ns -
+             (int64_t)BMI270_TICKS_TO_NS(pctrl->time_ticks);
+    if (!pctrl->time_synced || offset < pctrl->time_offset_ns)
+    {
+      pctrl->time_offset_ns = offset;
+    }
+    else
+    {
+      pctrl->time_offset_ns += (offset - pctrl->time_offset_ns) / 16;
+    }
+
+    pctrl->time_synced = true;
+  }
+
+  first = update_sample_time(&pctrl->acc_next, pctrl->acc_period,
+                             pctrl->acc_table_pos - acc_pos0,
+                             anchor, pctrl->time_ticks,
+                             !pctrl->config.fifo_headerless);
+  if (acc_pos0 == 0)
+  {
+    pctrl->acc_table_time = first;
+  }
+
+  first = update_sample_time(&pctrl->gyr_next, pctrl->gyr_period,
+                             pctrl->gyr_table_pos - gyr_pos0,
+                             anchor, pctrl->time_ticks,
+                             !pctrl->config.fifo_headerless);
+  if (gyr_pos0 == 0)
+  {
+    pctrl->gyr_table_time = first;
+  }
+
+  if (pctrl->aux_enabled)
+  {
+    first = update_sample_time(&pctrl->aux_next, pctrl->aux_period,
+                               pctrl->aux_table_pos - aux_pos0,
+                               anchor, pctrl->time_ticks, true);
+    if (aux_pos0 == 0)
+    {
+      pctrl->aux_table_time = first;
+    }
+  }
+}
+
+/**
+ * @brief wait for a manual AUX access to finish
+ *
+ * An 8 byte read at the default 400kHz AUX speed takes about 300us.
+ *
+ * @return int success == 0, -1 on I2C errors or when it stays busy
+ */
+
+static int
+wait_aux_bmi270(i2c_bmi270_t *pctrl)
+{
+  int ret;
+  int i;
+  uint8_t status;
+  struct timespec waittime;
+
+  waittime.tv_sec = 0;
+  waittime.tv_nsec = 500 * 1000;
+  for (i = 0; i < BMI270_AUX_BUSY_POLLS; i++)
+  {
+    nanosleep(&waittime, NULL);
+    ret = i2c_reg_read(&pctrl->i2c, BMI270_REG_STATUS, &status, 1);
+    if (ret < 0)
+    {
+      return -1;
+    }
+
+    if (!(status & BMI270_STATUS_AUX_BUSY))
+    {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**
+ * @brief Decoder for BMI270 FIFO
+ *
+ * Appends every ACC/GYR/AUX sample in pctrl->fifo[0..fifo_depth) to the
+ * store tables and keeps the value of a trailing TIME frame.  A frame
+ * cut off by the end of the buffer is ignored.  Frame data is in AUX,
+ * GYR, ACC order.
+ *
+ * @param pctrl control structure
+ */
+
+void bmi270_fifo_decoder(i2c_bmi270_t *pctrl)
+{
+  int i = 0;
+  int fifo_depth = pctrl->fifo_depth;
+  uint8_t *fifo = pctrl->fifo;
+
+  pctrl->fifo_time_valid = false;
+
+  while (i < fifo_depth)
+  {
+    DPRINT_DEBUG("[%02x]", fifo[i]);
+    if (fifo_depth - i < BMI270_FIFO_MAX_FRAME_LENGTH &&
+        i + fifo_frame_length(fifo[i]) > fifo_depth)
+    {
+      /* cut off by the end of the read, the chip sends it again */
+
+      break;
+    }
+
+    if (fifo[i] & 0x40)
+    {
+      uint8_t type = ((fifo[i] >> 2) & 0x0f);
+      i += 1;
+      switch (type)
+      {
+      case 0:
+        DPRINT_DEBUG(" - SKIP - %02x",
+                     fifo[i]);
+        i += 1;
+        break;
+      case 1:
+        DPRINT_DEBUG(" - TIME - %02x,%02x,%02x",
+                     fifo[i], fifo[i + 1], fifo[i + 2]);
+        pctrl->fifo_time = ((uint32_t)fifo[i + 2] << 16) |
+                           ((uint32_t)fifo[i + 1] << 8) | fifo[i];
+        pctrl->fifo_time_valid = true;
+        i += 3;
+        break;
+      case 2:
+        DPRINT_DEBUG(" - CFGF - %02x,%02x,%02x,%02x",
+                     fifo[i], fifo[i + 1], fifo[i + 2], fifo[i + 3]);
+        i += 4;
+        break;
+      }
+    }
+    else if (fifo[i] & 0x80)
+    {
+      uint8_t enable = ((fifo[i] >> 2) & 0x0f);
+      i += 1;
+      if (enable & 0x04)
+      {
+        DPRINT_DEBUG(" - AUX - %02x..%02x", fifo[i], fifo[i + 7]);
+        if (pctrl->aux_table_pos >= BMI270_STORE_TABLE_LENGTH)
+        {
+          printf("store overflow\n");
+        }
+        else
+        {
+          memcpy(pctrl->aux_table[pctrl->aux_table_pos].data, &fifo[i],
+                 BMI270_AUX_FRAME_LENGTH);
+          pctrl->aux_table_pos++;
+        }
+
+        i += BMI270_AUX_FRAME_LENGTH;
+      }
+
+      if (enable & 0x02)
+      {
+        DPRINT_DEBUG(" - GYR - %d,%d,%d",
+                     CONV(fifo, i), CONV(fifo, i + 2), CONV(fifo, i + 4));
+        if (pctrl->gyr_table_pos >= BMI270_STORE_TABLE_LENGTH)
+        {
+          printf("store overflow\n");
+        }
+        else
+        {
+          pctrl->gyr_table[pctrl->gyr_table_pos].x =
+              CONV(fifo, i);
+          pctrl->gyr_table[pctrl->gyr_table_pos].y =
+              CONV(fifo, i + 2);
+          pctrl->gyr_table[pctrl->gyr_table_pos].z =
+              CONV(fifo, i + 4);
+          pctrl->gyr_table_pos++;
+        }
+
+        i += 6;
+      }
+
+      if (enable & 0x01)
+      {
+        DPRINT_DEBUG(" - ACC - %d,%d,%d",
+                     CONV(fifo, i), CONV(fifo, i + 2), CONV(fifo, i + 4));
+        if (pctrl->acc_table_pos >= BMI270_STORE_TABLE_LENGTH)
+        {
+          printf("store overflow\n");
+        }
+        else
+        {
+          pctrl->acc_table[pctrl->acc_table_pos].x =
+              CONV(fifo, i);
+          pctrl->acc_table[pctrl->acc_table_pos].y =
+              CONV(fifo, i + 2);
+          pctrl->acc_table[pctrl->acc_table_pos].z =
+              CONV(fifo, i + 4);
+          pctrl->acc_table_pos++;
+        }
+
+        i += 6;
+      }
+    }
+    else
+    {
+      /* not a frame header, resync on the next byte */
+
+      i += 1;
+    }
+  }
+
+  return;
+}
+
+/**
+ * @brief Decoder for header-less ACC+GYR FIFO
+ *
+ * Every frame is GYR then ACC, 12 bytes, so the store tables are filled
+ * with a fixed stride.  Only whole frames in pctrl->fifo[0..fifo_depth)
+ * are decoded.
+ *
+ * @param pctrl control structure
+ */
+
+void bmi270_fifo_decoder_headerless(i2c_bmi270_t *pctrl)
+{
+  int i;
+  int n = pctrl->fifo_depth / BMI270_FIFO_HEADERLESS_FRAME_LENGTH;
+  int pos = pctrl->acc_table_pos > pctrl->gyr_table_pos ?
+            pctrl->acc_table_pos : pctrl->gyr_table_pos;
+  const uint8_t *p = pctrl->fifo;
+  axis_t *gyr = &pctrl->gyr_table[pctrl->gyr_table_pos];
+  axis_t *acc = &pctrl->acc_table[pctrl->acc_table_pos];
+
+  if (n > BMI270_STORE_TABLE_LENGTH - pos)
+  {
+    printf("store overflow\n");
+    n = BMI270_STORE_TABLE_LENGTH - pos;
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    gyr[i].x = CONV(p, 0);
+    gyr[i].y = CONV(p, 2);
+    gyr[i].z = CONV(p, 4);
+    acc[i].x = CONV(p, 6);
+    acc[i].y = CONV(p, 8);
+    acc[i].z = CONV(p, 10);
+    p += BMI270_FIFO_HEADERLESS_FRAME_LENGTH;
+  }
+
+  pctrl->gyr_table_pos += n;
+  pctrl->acc_table_pos += n;
+}
+
+/**
+ * @brief finialize BMI270
+ *
+ * @param pctrl control structure
+ */
+
+void fini_bmi270(i2c_bmi270_t *pctrl)
+{
+  /* Storage the caller attached stays attached */
+
+  if (g_bmi270_storage_owner == pctrl)
+  {
+    g_bmi270_storage_owner = NULL;
+    pctrl->fifo = NULL;
+    pctrl->acc_table = NULL;
+    pctrl->gyr_table = NULL;
+    pctrl->aux_table = NULL;
+  }
+
+  return;
+}
+
+/**
+ * @brief default configuration
+ *
+ * ACC 100Hz ±8g, GYR 200Hz ±500degree/s, normal filters in performance
+ * mode, no FIFO downsampling, header mode FIFO.
+ *
+ * @param pc configuration[output]
+ */
+
+void bmi270_default_config(bmi270_config_t *pc)
+{
+  pc->acc_odr = BMI270_ODR_100HZ;
+  pc->acc_range = BMI270_ACC_RANGE_8G;
+  pc->acc_bwp = BMI270_BWP_NORMAL;
+  pc->acc_perf = true;
+  pc->gyr_odr = BMI270_ODR_200HZ;
+  pc->gyr_range = BMI270_GYR_RANGE_500DPS;
+  pc->gyr_bwp = BMI270_BWP_NORMAL;
+  pc->gyr_perf = true;
+  pc->acc_downs = 0;
+  pc->gyr_downs = 0;
+  pc->fifo_headerless = false;
+}
+
+/**
+ * @brief acceleration per LSB for a configuration
+ *
+ * @return float m/s^2
+ */
+
+float bmi270_acc_scale(const bmi270_config_t *pc)
+{
+  return (float)(2 << pc->acc_range) * CONST_G / RESOLUTION;
+}
+
+/**
+ * @brief rotation rate per LSB for a configuration
+ *
+ * @return float degree/s
+ */
+
+float bmi270_gyr_scale(const bmi270_config_t *pc)
+{
+  return (float)(2000 >> pc->gyr_range) / RESOLUTION;
+}
+
+/**
+ * @brief give the driver its FIFO buffer and sample tables
+ *
+ * Call before init_bmi270(); without it the driver uses its own static
+ * storage, which only one i2c_bmi270_t can have at a time.
+ *
+ * @param pctrl control structure
+ * @param pstorage storage, e.g. a static bmi270_storage_t
+ */
+
+void bmi270_attach_storage(i2c_bmi270_t *pctrl, bmi270_storage_t *pstorage)
+{
+  pctrl->fifo = pstorage->fifo;
+  pctrl->acc_table = pstorage->acc_table;
+  pctrl->gyr_table = pstorage->gyr_table;
+  pctrl->aux_table = pstorage->aux_table;
+}
+
+/**
+ * @brief initialization BMI270 and start mesurement
+ *
+ * pctrl->config selects the measurement setup; a zeroed one is replaced
+ * by bmi270_default_config().  The soft reset and config file upload are
+ * skipped when INTERNAL_STATUS shows the chip already initialised, unless
+ * pctrl->init_cold is set.  pctrl->init_stats tells which path ran.
+ *
+ * @param pctrl control structure
+ * @return int success == 0
+ */
+
+int init_bmi270(i2c_bmi270_t *pctrl)
+{
+  int ret;
+  i2c_ctrl_t *pi2c = &pctrl->i2c;
+  uint64_t t0 = now_us();
+
+  /* The shadow outlives fini_bmi270(), so a warm re-init skips the
+   * writes that would not change anything.
+   */
+
+  if (pi2c->shadow != &pctrl->shadow)
+  {
+    i2c_shadow_attach(pi2c, &pctrl->shadow, g_bmi270_volatile_regs);
+  }
+
+  /* The drain keeps its own latency histograms */
+
+  i2c_stats_track(pi2c, BMI270_REG_FIFO_LENGTH_0);
+  i2c_stats_track(pi2c, BMI270_REG_FIFO_DATA);
+
+  if (pctrl->config.acc_odr == 0)
+  {
+    bmi270_default_config(&pctrl->config);
+  }
+
+  if (validate_config(&pctrl->config) < 0)
+  {
+    return -1;
+  }
+
+  /* working memory, no heap */
+
+  if (pctrl->fifo == NULL || pctrl->acc_table == NULL ||
+      pctrl->gyr_table == NULL)
+  {
+    if (g_bmi270_storage_owner != NULL && g_bmi270_storage_owner != pctrl)
+    {
+      printf("BMI270 storage in use, attach one\n");
+      return -1;
+    }
+
+    g_bmi270_storage_owner = pctrl;
+    bmi270_attach_storage(pctrl, &g_bmi270_storage);
+  }
+
+  pctrl->acc_table_pos = 0;
+  pctrl->gyr_table_pos = 0;
+  pctrl->aux_table_pos = 0;
+
+  ret = start_bmi270(pctrl);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  pctrl->time_synced = false;
+  pctrl->init_stats.total_us = now_us() - t0;
+
+  DPRINT_INFO("%s init %u us (upload %u us)",
+              pctrl->init_stats.warm ? "warm" : "cold",
+              pctrl->init_stats.total_us, pctrl->init_stats.upload_us);
+  return 0;
+}
+
+/**
+ * @brief switch ODR, range, filter, FIFO downsampling and FIFO mode
+ *
+ * Takes effect without a re-init.  The FIFO is flushed and the store
+ * tables emptied, so call it after get_fifo_batch() to keep every sample
+ * measured with the old setup.
+ *
+ * @param pctrl control structure
+ * @param pc new configuration
+ * @return int success == 0
+ */
+
+int reconfigure_bmi270(i2c_bmi270_t *pctrl, const bmi270_config_t *pc)
+{
+  int ret;
+  i2c_txn_t txn;
+
+  if (validate_config(pc) < 0)
+  {
+    return -1;
+  }
+
+  /* enable_fifo_bmi270() also flushes the FIFO */
+
+  i2c_txn_begin(&txn, &pctrl->i2c);
+  write_config_bmi270(pctrl, &txn, pc);
+  enable_fifo_bmi270(&txn, pc->fifo_headerless,
+                     pctrl->aux_enabled && !pc->fifo_headerless);
+  ret = i2c_txn_submit(&txn);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  pctrl->acc_table_pos = 0;
+  pctrl->gyr_table_pos = 0;
+  return 0;
+}
+
+/**
+ * @brief bring the chip back after I2C errors, keeping the buffers
+ *
+ * The register shadow is dropped, since failed writes leave registers
+ * unknown, and the chip goes through the init sequence again: warm when
+ * it still runs its config file, as after a bus glitch, cold after a
+ * power loss.  The FIFO is flushed, the store tables emptied and the
+ * sensortime sync restarts.  The FIFO watermark setup is the caller's to
+ * repeat.
+ *
+ * @param pctrl control structure after a successful init_bmi270()
+ * @return int success == 0
+ */
+
+int recover_bmi270(i2c_bmi270_t *pctrl)
+{
+  int ret;
+  uint64_t t0 = now_us();
+
+  i2c_shadow_invalidate(&pctrl->i2c);
+  ret = start_bmi270(pctrl);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  pctrl->acc_table_pos = 0;
+  pctrl->gyr_table_pos = 0;
+  pctrl->time_synced = false;
+  pctrl->init_stats.total_us = now_us() - t0;
+  return 0;
+}
+
+/**
+ * @brief raise INT1 while the FIFO holds at least wtm_bytes
+ *
+ * INT1 is a non-latched, active high, push-pull output mapped to the
+ * FIFO watermark and FIFO full events, so it stays asserted until the
+ * FIFO has been drained below the watermark.
+ *
+ * @param pctrl control structure
+ * @param wtm_bytes FIFO watermark in bytes
+ * @return int success == 0
+ */
+
+int enable_fifo_watermark_bmi270(i2c_bmi270_t *pctrl, int wtm_bytes)
+{
+  int ret;
+  i2c_txn_t txn;
+
+  if (wtm_bytes <= 0 || wtm_bytes > BMI270_FIFO_MAX_LENGTH)
+  {
+    return -1;
+  }
+
+  i2c_txn_begin(&txn, &pctrl->i2c);
+  i2c_txn_write(&txn, BMI270_REG_FIFO_WTM_0, wtm_bytes & 0xff);
+  i2c_txn_write(&txn, BMI270_REG_FIFO_WTM_1, (wtm_bytes >> 8) & 0x1f);
+  i2c_txn_write(&txn, BMI270_REG_INT_LATCH, 0x00);
+  i2c_txn_write(&txn, BMI270_REG_INT1_IO_CTRL, BMI270_INT1_IO_CTRL_VALUE);
+  i2c_txn_write(&txn, BMI270_REG_INT_MAP_DATA,
+                BMI270_INT_MAP_DATA_FIFO_INT1);
+  ret = i2c_txn_submit(&txn);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief pack one motion detector into its FEATURES words
+ */
+
+static void motion_words(uint8_t *p, uint16_t thres_mg, uint16_t dur_ms)
+{
+  uint32_t dur = dur_ms / BMI270_FEAT_PERIOD_MS;
+  uint32_t thres = ((uint32_t)thres_mg * 2048 + 500) / 1000;
+  uint16_t w1;
+  uint16_t w2;
+
+  dur = dur > BMI270_FEAT_MOTION_DUR_MAX ? BMI270_FEAT_MOTION_DUR_MAX : dur;
+  thres = thres > BMI270_FEAT_MOTION_THRES_MAX ?
+          BMI270_FEAT_MOTION_THRES_MAX : thres;
+  w1 = BMI270_FEAT_MOTION_XYZ | dur;
+  w2 = BMI270_FEAT_MOTION_EN | thres;
+  p[0] = w1 & 0xff;
+  p[1] = w1 >> 8;
+  p[2] = w2 & 0xff;
+  p[3] = w2 >> 8;
+}
+
+/**
+ * @brief report any-motion and no-motion on INT1 and in the drain
+ *
+ * Sets up the feature engine detectors of the uploaded config file and
+ * maps them to INT1 next to the FIFO interrupts.  From then on
+ * exec_dequeue_fifo() also reads INT_STATUS_0, see get_motion_bmi270().
+ * A soft reset or cold init clears the detectors; call again after
+ * recover_bmi270().
+ *
+ * @param pctrl control structure
+ * @param pm thresholds and durations
+ * @return int success == 0
+ */
+
+int enable_motion_bmi270(i2c_bmi270_t *pctrl, const bmi270_motion_config_t *pm)
+{
+  int ret;
+  uint8_t any[4];
+  uint8_t no[4];
+  i2c_txn_t txn;
+
+  motion_words(any, pm->any_thres_mg, pm->any_dur_ms);
+  motion_words(no, pm->no_thres_mg, pm->no_dur_ms);
+
+  i2c_txn_begin(&txn, &pctrl->i2c);
+  i2c_txn_write(&txn, BMI270_REG_FEAT_PAGE, BMI270_FEAT_PAGE_ANY_MOTION);
+  i2c_txn_write_burst(&txn, BMI270_REG_FEATURES + BMI270_FEAT_ANY_MOTION,
+                      any, sizeof(any));
+  i2c_txn_write(&txn, BMI270_REG_FEAT_PAGE, BMI270_FEAT_PAGE_NO_MOTION);
+  i2c_txn_write_burst(&txn, BMI270_REG_FEATURES + BMI270_FEAT_NO_MOTION,
+                      no, sizeof(no));
+  i2c_txn_write(&txn, BMI270_REG_INT1_MAP_FEAT,
+                BMI270_MOTION_ANY | BMI270_MOTION_NO);
+  ret = i2c_txn_submit(&txn);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  pctrl->motion_enabled = true;
+  pctrl->motion_status = 0;
+  return 0;
+}
+
+/**
+ * @brief motion events seen by the drains since the last call
+ *
+ * @param pctrl control structure
+ * @return uint8_t BMI270_MOTION_ANY and/or BMI270_MOTION_NO
+ */
+
+uint8_t get_motion_bmi270(i2c_bmi270_t *pctrl)
+{
+  uint8_t status = pctrl->motion_status;
+
+  pctrl->motion_status = 0;
+  return status;
+}
+
+/**
+ * @brief power the AUX interface and put it in manual mode
+ *
+ * Call after init_bmi270() or recover_bmi270(), then set the sensor up
+ * with aux_write_bmi270() / aux_read_bmi270() and hand it to the FIFO
+ * with start_aux_bmi270().
+ *
+ * @param pctrl control structure
+ * @param aux_addr 7 bit I2C address of the sensor on the AUX bus
+ * @return int success == 0
+ */
+
+int open_aux_bmi270(i2c_bmi270_t *pctrl, uint8_t aux_addr)
+{
+  int ret;
+  i2c_txn_t txn;
+
+  pctrl->aux_enabled = false;
+  i2c_txn_begin(&txn, &pctrl->i2c);
+  i2c_txn_write(&txn, BMI270_REG_PWR_CTRL, 0x0e | BMI270_PWR_CTRL_AUX_EN);
+  i2c_txn_write(&txn, BMI270_REG_IF_CONF, BMI270_IF_CONF_AUX_EN);
+  i2c_txn_write(&txn, BMI270_REG_AUX_DEV_ID, aux_addr << 1);
+  i2c_txn_write(&txn, BMI270_REG_AUX_IF_CONF,
+                BMI270_AUX_IF_CONF_MANUAL | BMI270_AUX_IF_CONF_BURST8);
+  ret = i2c_txn_submit(&txn);
+  return ret < 0 ? -1 : 0;
+}
+
+/**
+ * @brief write one register of the AUX sensor, manual mode
+ *
+ * @param pctrl control structure
+ * @param reg sensor register
+ * @param value write value
+ * @return int success == 0
+ */
+
+int aux_write_bmi270(i2c_bmi270_t *pctrl, uint8_t reg, uint8_t value)
+{
+  int ret;
+  i2c_txn_t txn;
+
+  i2c_txn_begin(&txn, &pctrl->i2c);
+  i2c_txn_write(&txn, BMI270_REG_AUX_WR_DATA, value);
+  i2c_txn_write(&txn, BMI270_REG_AUX_WR_ADDR, reg);
+  ret = i2c_txn_submit(&txn);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  return wait_aux_bmi270(pctrl);
+}
+
+/**
+ * @brief read registers of the AUX sensor, manual mode
+ *
+ * @param pctrl control structure
+ * @param reg first sensor register
+ * @param buf read buffer [out]
+ * @param len 1 .. BMI270_AUX_FRAME_LENGTH
+ * @return int success == 0
+ */
+
+int aux_read_bmi270(i2c_bmi270_t *pctrl, uint8_t reg, uint8_t *buf,
+                    int len)
+{
+  int ret;
+
+  if (len < 1 || len > BMI270_AUX_FRAME_LENGTH)
+  {
+    return -1;
+  }
+
+  ret = i2c_reg_write(&pctrl->i2c, BMI270_REG_AUX_RD_ADDR, reg);
+  if (ret < 0 || wait_aux_bmi270(pctrl) < 0)
+  {
+    return -1;
+  }
+
+  ret = i2c_reg_read(&pctrl->i2c, BMI270_REG_DATA(0), buf, len);
+  return ret < 0 ? -1 : 0;
+}
+
+/**
+ * @brief let the chip read the AUX sensor into the FIFO
+ *
+ * Switches to data mode: every AUX_CONF period the chip reads
+ * BMI270_AUX_FRAME_LENGTH bytes from data_reg, and header mode frames
+ * carry them ahead of GYR and ACC, so one FIFO_DATA burst delivers all
+ * three.  The samples arrive in bmi270_batch_t aux.  Not available with
+ * a header-less FIFO.
+ *
+ * @param pctrl control structure
+ * @param data_reg first data register of the sensor
+ * @param odr BMI270_ODR_*, at most the sensor's own rate
+ * @return int success == 0
+ */
+
+int start_aux_bmi270(i2c_bmi270_t *pctrl, uint8_t data_reg, uint8_t odr)
+{
+  int ret;
+  i2c_txn_t txn;
+
+  if (pctrl->config.fifo_headerless || odr < 1 || odr > BMI270_ODR_800HZ)
+  {
+    return -1;
+  }
+
+  i2c_txn_begin(&txn, &pctrl->i2c);
+  i2c_txn_write(&txn, BMI270_REG_AUX_CONF, odr);
+  i2c_txn_write(&txn, BMI270_REG_AUX_RD_ADDR, data_reg);
+  i2c_txn_write(&txn, BMI270_REG_AUX_IF_CONF, BMI270_AUX_IF_CONF_BURST8);
+  enable_fifo_bmi270(&txn, false, true);
+  ret = i2c_txn_submit(&txn);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  pctrl->aux_period = odr_period_ticks(odr);
+  pctrl->aux_next = 0;
+  pctrl->aux_table_pos = 0;
+  pctrl->aux_enabled = true;
+  return 0;
+}
+
+/**
+ * @brief Fetch FIFO of BMI270
+ *
+ * @param fd I2C descriptor
+ * @return int success == 0
+ */
+
+int exec_dequeue_fifo(i2c_bmi270_t *pctrl)
+{
+  int ret;
+  int acc_pos0 = pctrl->acc_table_pos;
+  int gyr_pos0 = pctrl->gyr_table_pos;
+  int aux_pos0 = pctrl->aux_table_pos;
+  uint8_t fifo_len_reg[2];
+  uint8_t sensortime[3];
+  uint8_t int_status0;
+  uint8_t saturation;
+  i2c_ctrl_t *pi2c = &pctrl->i2c;
+  struct timespec now;
+  i2c_txn_t txn;
+
+  /* There are no TIME frames without headers, so the counter is read
+   * along with the length, as are the motion events and the saturation
+   * flags, which clear on read.
+   */
+
+  i2c_txn_begin(&txn, pi2c);
+  i2c_txn_read(&txn, BMI270_REG_FIFO_LENGTH_0, fifo_len_reg, 2);
+  if (pctrl->config.fifo_headerless)
+  {
+    i2c_txn_read(&txn, BMI270_REG_SENSORTIME0, sensortime, 3);
+  }
+
+  if (pctrl->motion_enabled)
+  {
+    i2c_txn_read(&txn, BMI270_REG_INT_STATUS0, &int_status0, 1);
+  }
+
+  if (pctrl->saturation_enabled)
+  {
+    i2c_txn_read(&txn, BMI270_REG_SATURATION, &saturation, 1);
+  }
+
+  ret = i2c_txn_submit(&txn);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  if (pctrl->motion_enabled)
+  {
+    pctrl->motion_status |= int_status0 & (BMI270_MOTION_ANY |
+                                           BMI270_MOTION_NO);
+  }
+
+  if (pctrl->saturation_enabled)
+  {
+    pctrl->saturation |= saturation & (BMI270_SAT_ACC | BMI270_SAT_GYR);
+  }
+
+  pctrl->fifo_depth = CONV(fifo_len_reg, 0);
+  DPRINT_DEBUG("FIFO_LENGTH=%d", pctrl->fifo_depth);
+  if (pctrl->fifo_depth == 0)
+  {
+    return 0;
+  }
+
+  if (pctrl->config.fifo_headerless)
+  {
+    /* Whole frames only, a partial one is sent again next time */
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pctrl->fifo_time = ((uint32_t)sensortime[2] << 16) |
+                       ((uint32_t)sensortime[1] << 8) | sensortime[0];
+    pctrl->fifo_time_valid = true;
+
+    if (pctrl->fifo_depth > BMI270_FIFO_MAX_LENGTH)
+    {
+      pctrl->fifo_depth = BMI270_FIFO_MAX_LENGTH;
+    }
+
+    pctrl->fifo_depth -= pctrl->fifo_depth %
+                         BMI270_FIFO_HEADERLESS_FRAME_LENGTH;
+  }
+  else
+  {
+    /* Reading past the end returns the sensortime frame */
+
+    pctrl->fifo_depth += BMI270_FIFO_TIME_LENGTH;
+    if (pctrl->fifo_depth > BMI270_FIFO_MAX_LENGTH)
+    {
+      pctrl->fifo_depth = BMI270_FIFO_MAX_LENGTH;
+    }
+  }
+
+  ret = i2c_reg_read(pi2c, BMI270_REG_FIFO_DATA,
+                     pctrl->fifo, pctrl->fifo_depth);
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  if (pctrl->config.fifo_headerless)
+  {
+    bmi270_fifo_decoder_headerless(pctrl);
+  }
+  else
+  {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bmi270_fifo_decoder(pctrl);
+  }
+
+  update_fifo_time(pctrl, acc_pos0, gyr_pos0, aux_pos0,
+                   (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec);
+  return 0;
+}
+
+/**
+ * @brief get latest accel value
+ *
+ * @param pd values[output]
+ * @return int success == 0
  */
 
 int get_latest_acc(axis_t *pd, i2c_bmi270_t *pctrl)
@@ -522,3 +1586,79 @@ int get_latest_gyr(axis_t *pd, i2c_bmi270_t *pctrl)
   pctrl->gyr_table_pos = 0;
   return ret;
 }
+
+/**
+ * @brief read the die temperature
+ *
+ * The register follows the gyroscope at up to 100Hz; a slow poll is
+ * enough for bias compensation.
+ *
+ * @param pctrl control structure
+ * @param pcelsius temperature in degC [out]
+ * @return int success == 0, -1 on I2C errors or when no value is ready
+ */
+
+int read_temperature_bmi270(i2c_bmi270_t *pctrl, float *pcelsius)
+{
+  int ret;
+  uint8_t buf[2];
+  int16_t raw;
+
+  ret = i2c_reg_read(&pctrl->i2c, BMI270_REG_TEMPERATURE_0, buf,
+                     sizeof(buf));
+  if (ret < 0)
+  {
+    return -1;
+  }
+
+  raw = (int16_t)(buf[0] | (buf[1] << 8));
+  if (raw == BMI270_TEMPERATURE_INVALID)
+  {
+    return -1;
+  }
+
+  *pcelsius = BMI270_TEMPERATURE_OFFSET_C +
+              raw / BMI270_TEMPERATURE_LSB_PER_K;
+  return 0;
+}
+
+/**
+ * @brief get every sample decoded since the last call
+ *
+ * The batch points into the store tables, so no copy is made.  It stays
+ * valid until the next exec_dequeue_fifo().  Sample times are derived from
+ * the FIFO TIME frames, see bmi270_batch_t.
+ *
+ * @param pb batch[output]
+ * @return int number of ACC and GYR samples in the batch
+ */
+
+int get_fifo_batch(bmi270_batch_t *pb, i2c_bmi270_t *pctrl)
+{
+  pb->acc = pctrl->acc_table;
+  pb->aux = pctrl->aux_table;
+  pb->aux_count = pctrl->aux_table_pos;
+  pb->aux_time_ns = BMI270_TICKS_TO_NS(pctrl->aux_table_time) +
+                    pctrl->time_offset_ns;
+  pb->aux_period_ns = BMI270_TICKS_TO_NS(pctrl->aux_period);
+  pb->gyr = pctrl->gyr_table;
+  pb->acc_count = pctrl->acc_table_pos;
+  pb->gyr_count = pctrl->gyr_table_pos;
+
+  pb->time_valid = pctrl->time_synced;
+  pb->acc_time_ns = BMI270_TICKS_TO_NS(pctrl->acc_table_time) +
+                    pctrl->time_offset_ns;
+  pb->gyr_time_ns = BMI270_TICKS_TO_NS(pctrl->gyr_table_time) +
+                    pctrl->time_offset_ns;
+  pb->acc_period_ns = BMI270_TICKS_TO_NS(pctrl->acc_period);
+  pb->gyr_period_ns = BMI270_TICKS_TO_NS(pctrl->gyr_period);
+  pb->acc_scale = bmi270_acc_scale(&pctrl->config);
+  pb->gyr_scale = bmi270_gyr_scale(&pctrl->config);
+  pb->saturation = pctrl->saturation;
+
+  pctrl->acc_table_pos = 0;
+  pctrl->gyr_table_pos = 0;
+  pctrl->aux_table_pos = 0;
+  pctrl->saturation = 0;
+  return pb->acc_count + pb->gyr_count;
+}
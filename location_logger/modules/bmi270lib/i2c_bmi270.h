@@ -27,6 +27,7 @@
 #include <nuttx/config.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <nuttx/i2c/i2c_master.h>
@@ -43,13 +44,75 @@
 #define I2C_DEVNAME_FOR_BMI270 "/dev/i2c0"
 #define BMI270_I2C_ADDRESS (0x69)
 #define I2C_SPEED (400 * 1000) /* fast mode */
-#define ACC_RANGE_SET_VALUE (0x02)
-#define ACC_RANGE_G 8 // ±8g
-#define GYR_RANGE_SET_VALUE (0x02)
-#define GYR_RANGE_DPS 500 // ±500 degree/s
 #define CONST_G (9.80665f)
 #define RESOLUTION (32768.0f)
 
+/* bmi270_config_t values, register encodings */
+
+#define BMI270_ODR_25HZ (6)
+#define BMI270_ODR_50HZ (7)
+#define BMI270_ODR_100HZ (8)
+#define BMI270_ODR_200HZ (9)
+#define BMI270_ODR_400HZ (10)
+#define BMI270_ODR_800HZ (11)
+#define BMI270_ODR_1600HZ (12)
+#define BMI270_ODR_3200HZ (13) // GYR only
+
+#define BMI270_ACC_RANGE_2G (0)
+#define BMI270_ACC_RANGE_4G (1)
+#define BMI270_ACC_RANGE_8G (2)
+#define BMI270_ACC_RANGE_16G (3)
+
+#define BMI270_GYR_RANGE_2000DPS (0)
+#define BMI270_GYR_RANGE_1000DPS (1)
+#define BMI270_GYR_RANGE_500DPS (2)
+#define BMI270_GYR_RANGE_250DPS (3)
+#define BMI270_GYR_RANGE_125DPS (4)
+
+#define BMI270_BWP_OSR4 (0)
+#define BMI270_BWP_OSR2 (1)
+#define BMI270_BWP_NORMAL (2)
+
+#define BMI270_FIFO_MAX_LENGTH (2560)
+
+/* Sample table capacity in entries: the fastest ODR in use times the
+ * longest time between two drains, but no more than a full FIFO of
+ * 7 byte single sensor frames holds.  Later samples of a drain are
+ * dropped with "store overflow".
+ */
+
+#define BMI270_STORE_MAX_ODR_HZ (400)
+#define BMI270_STORE_MAX_DRAIN_MS (1000)
+#define BMI270_FIFO_MAX_SAMPLES (BMI270_FIFO_MAX_LENGTH / 7)
+#define BMI270_STORE_TABLE_LENGTH \
+  (BMI270_STORE_MAX_ODR_HZ * BMI270_STORE_MAX_DRAIN_MS / 1000 < \
+   BMI270_FIFO_MAX_SAMPLES ? \
+   BMI270_STORE_MAX_ODR_HZ * BMI270_STORE_MAX_DRAIN_MS / 1000 : \
+   BMI270_FIFO_MAX_SAMPLES)
+#define BMI270_FIFO_TIME_LENGTH (4) // sensortime frame read past FIFO_LENGTH
+#define BMI270_FIFO_HEADERLESS_FRAME_LENGTH (12) // GYR + ACC
+#define BMI270_AUX_FRAME_LENGTH (8) // AUX payload of a FIFO frame, DATA_0..7
+
+/* get_motion_bmi270() events, INT_STATUS_0 / INT1_MAP_FEAT bits */
+
+#define BMI270_MOTION_NO (0x20)
+#define BMI270_MOTION_ANY (0x40)
+
+/* bmi270_batch_t saturation, SATURATION register bits */
+
+#define BMI270_SAT_ACC_X (0x01)
+#define BMI270_SAT_ACC_Y (0x02)
+#define BMI270_SAT_ACC_Z (0x04)
+#define BMI270_SAT_GYR_X (0x08)
+#define BMI270_SAT_GYR_Y (0x10)
+#define BMI270_SAT_GYR_Z (0x20)
+#define BMI270_SAT_ACC (0x07)
+#define BMI270_SAT_GYR (0x38)
+
+/* Sensor time runs at 25.6kHz, one tick is 39062.5ns */
+
+#define BMI270_TICKS_TO_NS(t) (((uint64_t)(t) * 78125) / 2)
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -61,13 +124,121 @@ typedef struct _axis_type
   int16_t z;
 } axis_t;
 
+/* AUX_RD_ADDR burst of the auxiliary sensor, decoded by its driver */
+
+typedef struct _aux_type
+{
+  uint8_t data[BMI270_AUX_FRAME_LENGTH];
+} aux_t;
+
+typedef struct _bmi270_config_type
+{
+  /* ACC_CONF / ACC_RANGE */
+
+  uint8_t acc_odr;          /* BMI270_ODR_*, 0 selects the defaults */
+  uint8_t acc_range;        /* BMI270_ACC_RANGE_* */
+  uint8_t acc_bwp;          /* BMI270_BWP_*, averaging when !acc_perf */
+  bool acc_perf;            /* performance filter mode */
+
+  /* GYR_CONF / GYR_RANGE */
+
+  uint8_t gyr_odr;          /* BMI270_ODR_25HZ .. BMI270_ODR_3200HZ */
+  uint8_t gyr_range;        /* BMI270_GYR_RANGE_* */
+  uint8_t gyr_bwp;          /* BMI270_BWP_OSR4 .. BMI270_BWP_NORMAL */
+  bool gyr_perf;            /* performance filter mode */
+
+  /* FIFO_DOWNS, the FIFO keeps every 2^n-th sample */
+
+  uint8_t acc_downs;
+  uint8_t gyr_downs;
+
+  /* ACC+GYR frames without headers, needs equal FIFO rates */
+
+  bool fifo_headerless;
+} bmi270_config_t;
+
+typedef struct _bmi270_init_stats_type
+{
+  bool warm;                /* soft reset and config upload skipped */
+  uint32_t total_us;        /* init_bmi270() */
+  uint32_t upload_us;       /* config file INIT_DATA writes */
+} bmi270_init_stats_t;
+
+typedef struct _bmi270_batch_type
+{
+  /* samples of one drain, oldest first */
+
+  const axis_t *acc;
+  const axis_t *gyr;
+  const aux_t *aux;         /* see start_aux_bmi270() */
+  int acc_count;
+  int gyr_count;
+  int aux_count;
+
+  /* CLOCK_MONOTONIC time of acc[i] is acc_time_ns + i * acc_period_ns,
+   * likewise for gyr and aux.  Only valid once a FIFO TIME frame has
+   * been seen.
+   */
+
+  bool time_valid;
+  uint64_t acc_time_ns;
+  uint64_t gyr_time_ns;
+  uint64_t aux_time_ns;
+  uint32_t acc_period_ns;
+  uint32_t gyr_period_ns;
+  uint32_t aux_period_ns;
+
+  /* physical value per LSB for the active ranges */
+
+  float acc_scale;          /* m/s^2 */
+  float gyr_scale;          /* degree/s */
+
+  /* BMI270_SAT_* axes that clipped since the last batch, 0 unless
+   * i2c_bmi270_t.saturation_enabled
+   */
+
+  uint8_t saturation;
+} bmi270_batch_t;
+
+typedef struct _bmi270_motion_config_type
+{
+  /* any-motion: acceleration slope above any_thres_mg for any_dur_ms,
+   * no-motion: below no_thres_mg for no_dur_ms.  Durations run in 20ms
+   * steps up to 163s, thresholds up to 1g.
+   */
+
+  uint16_t any_thres_mg;
+  uint16_t any_dur_ms;
+  uint16_t no_thres_mg;
+  uint16_t no_dur_ms;
+} bmi270_motion_config_t;
+
+/* FIFO buffer and sample tables, placed by the caller, see
+ * bmi270_attach_storage()
+ */
+
+typedef struct _bmi270_storage_type
+{
+  uint8_t fifo[BMI270_FIFO_MAX_LENGTH];
+  axis_t acc_table[BMI270_STORE_TABLE_LENGTH];
+  axis_t gyr_table[BMI270_STORE_TABLE_LENGTH];
+  aux_t aux_table[BMI270_STORE_TABLE_LENGTH];
+} bmi270_storage_t;
+
 typedef struct _i2c_bmi270_type
 {
   /* i2c */
 
   i2c_ctrl_t i2c;
+  i2c_shadow_t shadow;      /* attached to i2c by init_bmi270() */
+
+  /* active configuration, set before init_bmi270() */
 
-  /* fetched fifo */
+  bmi270_config_t config;
+  bool init_cold;           /* always reset and upload the config file */
+  bmi270_init_stats_t init_stats;
+
+  /* fetched fifo, pointing into a bmi270_storage_t */
 
   uint8_t *fifo;
   int fifo_depth;
@@ -76,8 +247,41 @@ typedef struct _i2c_bmi270_type
 
   int acc_table_pos;
   int gyr_table_pos;
+  int aux_table_pos;
   axis_t *acc_table;
   axis_t *gyr_table;
+  aux_t *aux_table;
+
+  /* sensortime, in ticks unless noted */
+
+  bool fifo_time_valid;     /* TIME frame in the last drain */
+  uint32_t fifo_time;       /* its 24 bit value */
+  bool time_synced;
+  uint64_t time_ticks;      /* last TIME frame, unwrapped */
+  int64_t time_offset_ns;   /* CLOCK_MONOTONIC - sensortime */
+  uint32_t acc_period;
+  uint32_t gyr_period;
+  uint64_t acc_next;        /* expected time of the next sample */
+  uint64_t gyr_next;
+  uint64_t acc_table_time;  /* time of acc_table[0] */
+  uint64_t gyr_table_time;
+  uint32_t aux_period;
+  uint64_t aux_next;
+  uint64_t aux_table_time;
+
+  /* auxiliary sensor in the FIFO, see start_aux_bmi270() */
+
+  bool aux_enabled;
+
+  /* motion events, see enable_motion_bmi270() */
+
+  bool motion_enabled;
+  uint8_t motion_status;    /* BMI270_MOTION_* since get_motion_bmi270() */
+
+  /* set to read SATURATION with every drain, see bmi270_batch_t */
+
+  bool saturation_enabled;
+  uint8_t saturation;
 } i2c_bmi270_t;
 
 /****************************************************************************
@@ -89,16 +293,35 @@ extern "C"
 {
 #endif
 
+  void bmi270_default_config(bmi270_config_t *pc);
+  void bmi270_attach_storage(i2c_bmi270_t *pctrl, bmi270_storage_t *pstorage);
   int init_bmi270(i2c_bmi270_t *pctrl);
+  int reconfigure_bmi270(i2c_bmi270_t *pctrl, const bmi270_config_t *pc);
+  int recover_bmi270(i2c_bmi270_t *pctrl);
+  float bmi270_acc_scale(const bmi270_config_t *pc);
+  float bmi270_gyr_scale(const bmi270_config_t *pc);
   void fini_bmi270(i2c_bmi270_t *pctrl);
+  int enable_fifo_watermark_bmi270(i2c_bmi270_t *pctrl, int wtm_bytes);
+  int enable_motion_bmi270(i2c_bmi270_t *pctrl,
+    const bmi270_motion_config_t *pm);
+  uint8_t get_motion_bmi270(i2c_bmi270_t *pctrl);
+  int open_aux_bmi270(i2c_bmi270_t *pctrl, uint8_t aux_addr);
+  int aux_write_bmi270(i2c_bmi270_t *pctrl, uint8_t reg, uint8_t value);
+  int aux_read_bmi270(i2c_bmi270_t *pctrl, uint8_t reg, uint8_t *buf,
+    int len);
+  int start_aux_bmi270(i2c_bmi270_t *pctrl, uint8_t data_reg, uint8_t odr);
   int exec_dequeue_fifo(i2c_bmi270_t *pctrl);
+  void bmi270_fifo_decoder(i2c_bmi270_t *pctrl);
+  void bmi270_fifo_decoder_headerless(i2c_bmi270_t *pctrl);
   int get_latest_acc(axis_t *pd, i2c_bmi270_t *pctrl);
   int get_latest_gyr(axis_t *pd, i2c_bmi270_t *pctrl);
+  int read_temperature_bmi270(i2c_bmi270_t *pctrl, float *pcelsius);
+  int get_fifo_batch(bmi270_batch_t *pb, i2c_bmi270_t *pctrl);
 
   /* bmi270.c */
 
   int get_bmi270_config_file_size(void);
-  uint8_t *get_bmi270_config_file_addr(void);
+  const uint8_t *get_bmi270_config_file_addr(void);
 
 #if defined(__cplusplus)
 }
@@ -0,0 +1,442 @@
+/****************************************************************************
+ * location_logger/modules/bmi270lib/i2c_bus.c
+ *
+ * Shared I2C bus.  The first i2c_bus_open() of a device node opens it,
+ * later ones share the descriptor.  Drivers attach their i2c_ctrl_t with
+ * a priority and i2c_common.c sends every transfer through
+ * i2c_bus_transfer().
+ *
+ * There is no bus thread: a caller that finds the bus idle runs the
+ * highest priority request queued, which may be another caller's, and
+ * hands over when it is done.  Requests queued at one priority go out in
+ * arrival order, and a higher priority one always goes next, so the IMU
+ * drain waits for at most the transfer already on the bus.  Register
+ * reads of one priority that queued up meanwhile share an
+ * I2CIOC_TRANSFER.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "i2c_common.h"
+#include "i2c_bus.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* A queued read joins the transfer of another request of its priority
+ * when both read at most this much, so batches stay short.
+ */
+
+#define I2C_BUS_BATCH_MAX_BYTES (32)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct i2c_bus_req_s
+{
+  struct i2c_bus_req_s *next;
+  int priority;
+  int cmd;                  /* I2CIOC_TRANSFER or another bus ioctl */
+  unsigned long arg;
+  struct i2c_msg_s *msgv;
+  int msgc;
+  bool batchable;           /* register reads only, small */
+  bool done;
+  int result;
+  uint32_t queued_us;
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static uint32_t now_us(void);
+static bool req_batchable(struct i2c_msg_s *msgv, int msgc);
+static void bus_enqueue(i2c_bus_t *bus, struct i2c_bus_req_s *req);
+static int bus_ioctl(i2c_bus_t *bus, struct i2c_bus_req_s *req);
+static void bus_run(i2c_bus_t *bus);
+static int bus_request(i2c_bus_t *bus, struct i2c_bus_req_s *req);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static pthread_mutex_t g_buses_lock = PTHREAD_MUTEX_INITIALIZER;
+static i2c_bus_t g_buses[I2C_BUS_MAX];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint32_t
+now_us(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000000ull + now.tv_nsec / 1000);
+}
+
+/**
+ * @brief whether a transfer only reads registers, a little at a time
+ *
+ * Each write must be a lone register address followed by a read, so
+ * sharing a transfer changes nothing on any device.
+ */
+
+static bool
+req_batchable(struct i2c_msg_s *msgv, int msgc)
+{
+  int i;
+  int bytes = 0;
+
+  for (i = 0; i < msgc; i++)
+  {
+    if (msgv[i].flags & I2C_M_READ)
+    {
+      bytes += msgv[i].length;
+    }
+    else if (msgv[i].length != 1 || (msgv[i].flags & I2C_M_NOSTART) ||
+             i + 1 == msgc || !(msgv[i + 1].flags & I2C_M_READ))
+    {
+      return false;
+    }
+  }
+
+  return bytes > 0 && bytes <= I2C_BUS_BATCH_MAX_BYTES;
+}
+
+/**
+ * @brief queue behind every request of the same or a higher priority
+ */
+
+static void
+bus_enqueue(i2c_bus_t *bus, struct i2c_bus_req_s *req)
+{
+  struct i2c_bus_req_s **pp = &bus->pending;
+
+  while (*pp != NULL && (*pp)->priority >= req->priority)
+  {
+    pp = &(*pp)->next;
+  }
+
+  req->next = *pp;
+  *pp = req;
+}
+
+static int
+bus_ioctl(i2c_bus_t *bus, struct i2c_bus_req_s *req)
+{
+  struct i2c_transfer_s xfer;
+
+  if (req->cmd != I2CIOC_TRANSFER)
+  {
+    return ioctl(bus->fd, req->cmd, req->arg);
+  }
+
+  xfer.msgv = req->msgv;
+  xfer.msgc = req->msgc;
+  return ioctl(bus->fd, I2CIOC_TRANSFER, (unsigned long)(uintptr_t)&xfer);
+}
+
+/**
+ * @brief send the first queued request and the reads that can join it
+ *
+ * Called with the lock held and bus->busy set; the lock is dropped
+ * around the ioctl.  When a shared transfer fails its requests are sent
+ * again one by one, so an error is only reported to the request that
+ * caused it.
+ */
+
+static void
+bus_run(i2c_bus_t *bus)
+{
+  int i;
+  int n = 0;
+  int msgc = 0;
+  int ret;
+  uint32_t transfers = 0; // counted unlocked, added to stats after
+  uint32_t split = 0;
+  uint32_t now = now_us();
+  uint32_t wait;
+  struct i2c_bus_req_s *batch[I2C_BUS_MAX_MSGS];
+  struct i2c_bus_req_s **pp;
+  struct i2c_bus_req_s *req = bus->pending;
+  struct i2c_transfer_s xfer;
+  i2c_bus_prio_stats_t *ps;
+
+  bus->pending = req->next;
+  batch[n++] = req;
+  msgc = req->msgc;
+
+  pp = &bus->pending;
+  while (req->batchable && *pp != NULL)
+  {
+    if ((*pp)->batchable && (*pp)->priority == req->priority &&
+        msgc + (*pp)->msgc <= I2C_BUS_MAX_MSGS)
+    {
+      batch[n] = *pp;
+      msgc += (*pp)->msgc;
+      *pp = (*pp)->next;
+      n++;
+    }
+    else
+    {
+      pp = &(*pp)->next;
+    }
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    ps = &bus->stats.prio[batch[i]->priority];
+    wait = now - batch[i]->queued_us;
+    ps->requests++;
+    ps->batched += n > 1;
+    ps->wait_us += wait;
+    if (wait > ps->max_wait_us)
+    {
+      ps->max_wait_us = wait;
+    }
+  }
+
+  bus->stats.requests += n;
+  pthread_mutex_unlock(&bus->lock);
+
+  if (n == 1)
+  {
+    req->result = bus_ioctl(bus, req);
+    transfers++;
+  }
+  else
+  {
+    msgc = 0;
+    for (i = 0; i < n; i++)
+    {
+      memcpy(&bus->msgv[msgc], batch[i]->msgv,
+             batch[i]->msgc * sizeof(struct i2c_msg_s));
+      msgc += batch[i]->msgc;
+    }
+
+    xfer.msgv = bus->msgv;
+    xfer.msgc = msgc;
+    ret = ioctl(bus->fd, I2CIOC_TRANSFER, (unsigned long)(uintptr_t)&xfer);
+    transfers++;
+    if (ret < 0)
+    {
+      split++;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+      batch[i]->result = ret < 0 ? bus_ioctl(bus, batch[i]) : ret;
+      transfers += ret < 0;
+    }
+  }
+
+  pthread_mutex_lock(&bus->lock);
+  bus->stats.transfers += transfers;
+  bus->stats.split += split;
+  for (i = 0; i < n; i++)
+  {
+    batch[i]->done = true;
+  }
+}
+
+/**
+ * @brief queue a request and run the bus until it is done
+ */
+
+static int
+bus_request(i2c_bus_t *bus, struct i2c_bus_req_s *req)
+{
+  if (req->priority < 0 || req->priority >= I2C_BUS_PRIORITIES)
+  {
+    req->priority = I2C_BUS_PRIO_LOW;
+  }
+
+  req->done = false;
+  req->queued_us = now_us();
+
+  pthread_mutex_lock(&bus->lock);
+  bus_enqueue(bus, req);
+  while (!req->done)
+  {
+    if (!bus->busy)
+    {
+      bus->busy = true;
+      bus_run(bus);
+      bus->busy = false;
+      pthread_cond_broadcast(&bus->cond);
+    }
+    else
+    {
+      pthread_cond_wait(&bus->cond, &bus->lock);
+    }
+  }
+
+  pthread_mutex_unlock(&bus->lock);
+  return req->result;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/**
+ * @brief open a bus, or share it when it is open already
+ *
+ * @param devpath I2C device node, e.g. I2C_DEVNAME_FOR_BMI270
+ * @return i2c_bus_t* bus, NULL on error
+ */
+
+i2c_bus_t *i2c_bus_open(const char *devpath)
+{
+  int i;
+  int fd;
+  i2c_bus_t *bus = NULL;
+
+  pthread_mutex_lock(&g_buses_lock);
+  for (i = 0; i < I2C_BUS_MAX; i++)
+  {
+    if (g_buses[i].refs > 0 && strcmp(g_buses[i].devpath, devpath) == 0)
+    {
+      bus = &g_buses[i];
+      bus->refs++;
+      goto out;
+    }
+  }
+
+  for (i = 0; i < I2C_BUS_MAX && g_buses[i].refs > 0; i++)
+  {
+  }
+
+  if (i == I2C_BUS_MAX || strlen(devpath) >= sizeof(g_buses[i].devpath))
+  {
+    goto out;
+  }
+
+  fd = open(devpath, O_WRONLY);
+  if (fd < 0)
+  {
+    goto out;
+  }
+
+  bus = &g_buses[i];
+  memset(bus, 0, sizeof(*bus));
+  strcpy(bus->devpath, devpath);
+  bus->fd = fd;
+  bus->refs = 1;
+  pthread_mutex_init(&bus->lock, NULL);
+  pthread_cond_init(&bus->cond, NULL);
+
+out:
+  pthread_mutex_unlock(&g_buses_lock);
+  return bus;
+}
+
+/**
+ * @brief drop a reference, closing the device node with the last one
+ *
+ * @param bus bus from i2c_bus_open()
+ */
+
+void i2c_bus_close(i2c_bus_t *bus)
+{
+  pthread_mutex_lock(&g_buses_lock);
+  if (bus->refs > 0 && --bus->refs == 0)
+  {
+    close(bus->fd);
+    bus->fd = -1;
+    pthread_cond_destroy(&bus->cond);
+    pthread_mutex_destroy(&bus->lock);
+  }
+
+  pthread_mutex_unlock(&g_buses_lock);
+}
+
+/**
+ * @brief send a driver's transfers over a shared bus
+ *
+ * @param bus bus from i2c_bus_open()
+ * @param pi2c i2c control of the driver
+ * @param priority I2C_BUS_PRIO_*
+ */
+
+void i2c_bus_attach(i2c_bus_t *bus, i2c_ctrl_t *pi2c, int priority)
+{
+  pi2c->bus = bus;
+  pi2c->fd = bus->fd;
+  pi2c->priority = priority;
+}
+
+/**
+ * @brief one I2CIOC_TRANSFER, in turn with the other users of the bus
+ *
+ * Blocks until the transfer is done.
+ *
+ * @param bus bus from i2c_bus_open()
+ * @param priority I2C_BUS_PRIO_*
+ * @param msgv messages
+ * @param msgc number of messages
+ * @return int ioctl() result
+ */
+
+int i2c_bus_transfer(i2c_bus_t *bus, int priority,
+                     struct i2c_msg_s *msgv, int msgc)
+{
+  struct i2c_bus_req_s req;
+
+  req.priority = priority;
+  req.cmd = I2CIOC_TRANSFER;
+  req.arg = 0;
+  req.msgv = msgv;
+  req.msgc = msgc;
+  req.batchable = req_batchable(msgv, msgc);
+  return bus_request(bus, &req);
+}
+
+/**
+ * @brief another bus ioctl, such as I2CIOC_RESET, never shared
+ *
+ * @param bus bus from i2c_bus_open()
+ * @param priority I2C_BUS_PRIO_*
+ * @param cmd ioctl command
+ * @param arg ioctl argument
+ * @return int ioctl() result
+ */
+
+int i2c_bus_ioctl(i2c_bus_t *bus, int priority, int cmd, unsigned long arg)
+{
+  struct i2c_bus_req_s req;
+
+  req.priority = priority;
+  req.cmd = cmd;
+  req.arg = arg;
+  req.msgv = NULL;
+  req.msgc = 0;
+  req.batchable = false;
+  return bus_request(bus, &req);
+}
+
+/**
+ * @brief scheduling counters of a bus
+ *
+ * @param bus bus from i2c_bus_open()
+ * @param pstats copy [out]
+ */
+
+void i2c_bus_get_stats(i2c_bus_t *bus, i2c_bus_stats_t *pstats)
+{
+  pthread_mutex_lock(&bus->lock);
+  *pstats = bus->stats;
+  pthread_mutex_unlock(&bus->lock);
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+ * location_logger/modules/bmi270lib/i2c_bus.h
+ *
+ * Shared I2C bus: one open device node per bus, with the transfers of
+ * every driver on it scheduled by priority.
+ *
+ ****************************************************************************/
+
+#ifndef __LOCATION_LOGGER_MODULES_BMI270LIB_I2C_BUS_H
+#define __LOCATION_LOGGER_MODULES_BMI270LIB_I2C_BUS_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <nuttx/i2c/i2c_master.h>
+#include "i2c_common.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Request priorities, highest first when the bus frees up */
+
+#define I2C_BUS_PRIO_LOW (0)      /* housekeeping: temperature, status */
+#define I2C_BUS_PRIO_NORMAL (1)   /* barometer, magnetometer */
+#define I2C_BUS_PRIO_IMU (2)      /* BMI270 FIFO drain */
+#define I2C_BUS_PRIORITIES (3)
+
+#define I2C_BUS_MAX (2)           /* buses open at the same time */
+#define I2C_BUS_MAX_MSGS (16)     /* messages in one batched transfer */
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef struct _i2c_bus_prio_stats_type
+{
+  uint32_t requests;
+  uint32_t batched;         /* sent in a transfer with other requests */
+  uint64_t wait_us;         /* queued until the transfer started */
+  uint32_t max_wait_us;
+} i2c_bus_prio_stats_t;
+
+typedef struct _i2c_bus_stats_type
+{
+  uint32_t transfers;       /* ioctls issued */
+  uint32_t requests;
+  uint32_t split;           /* failed batches redone one by one */
+  i2c_bus_prio_stats_t prio[I2C_BUS_PRIORITIES];
+} i2c_bus_stats_t;
+
+struct i2c_bus_req_s;
+
+typedef struct _i2c_bus_type
+{
+  char devpath[32];
+  int fd;
+  int refs;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool busy;                /* a caller is running the bus */
+  struct i2c_bus_req_s *pending;  /* by priority, then arrival */
+  struct i2c_msg_s msgv[I2C_BUS_MAX_MSGS];
+  i2c_bus_stats_t stats;
+} i2c_bus_t;
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+i2c_bus_t *i2c_bus_open(const char *devpath);
+void i2c_bus_close(i2c_bus_t *bus);
+void i2c_bus_attach(i2c_bus_t *bus, i2c_ctrl_t *pi2c, int priority);
+int i2c_bus_transfer(i2c_bus_t *bus, int priority,
+  struct i2c_msg_s *msgv, int msgc);
+int i2c_bus_ioctl(i2c_bus_t *bus, int priority, int cmd, unsigned long arg);
+void i2c_bus_get_stats(i2c_bus_t *bus, i2c_bus_stats_t *pstats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __LOCATION_LOGGER_MODULES_BMI270LIB_I2C_BUS_H */
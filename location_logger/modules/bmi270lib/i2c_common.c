@@ -21,16 +21,41 @@
  * Included Files
  ****************************************************************************/
 
+#include <string.h>
+#include <time.h>
 #include "i2c_common.h"
+#include "i2c_bus.h"
 
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* A repeated START in place of STOP, bus free time and START saves about
+ * one SCL period in standard and fast mode.
+ */
+
+#define I2C_TXN_GAP_CYCLES (1)
+
 /****************************************************************************
  * Private Function Prototypes
  ****************************************************************************/
 
+static bool shadow_cacheable(i2c_shadow_t *pshadow, int reg);
+static bool shadow_lookup(i2c_shadow_t *pshadow, uint8_t reg,
+  uint8_t *value, int len);
+static void shadow_store(i2c_shadow_t *pshadow, uint8_t reg,
+  const uint8_t *value, int len);
+static void shadow_forget(i2c_shadow_t *pshadow, uint8_t reg, int len);
+static void shadow_store_transfer(i2c_txn_t *ptxn);
+static uint32_t now_us(void);
+static void stats_record(i2c_stats_t *pstats, struct i2c_msg_s *msgv,
+  int msgc, int ret, uint32_t us);
+static int i2c_transfer(i2c_ctrl_t *pi2c, struct i2c_msg_s *msgv,
+  int msgc);
+static int txn_reserve(i2c_txn_t *ptxn, int msgs, int bytes);
+static void txn_add_msg(i2c_txn_t *ptxn, uint16_t flags,
+  uint8_t *buffer, int length);
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -39,6 +64,310 @@
  * Private Functions
  ****************************************************************************/
 
+/**
+ * @brief whether the shadow may hold a register
+ *
+ * @param pshadow register shadow, or NULL
+ * @param reg register id
+ * @return bool false for volatile registers and without a shadow
+ */
+
+static bool
+shadow_cacheable(i2c_shadow_t *pshadow, int reg)
+{
+  if (pshadow == NULL || reg >= I2C_SHADOW_SIZE)
+    {
+      return false;
+    }
+
+  return pshadow->volatile_map == NULL ||
+         !(pshadow->volatile_map[reg >> 3] & (1 << (reg & 7)));
+}
+
+/**
+ * @brief copy len registers from the shadow if all of them are known
+ *
+ * @return bool true when value was filled
+ */
+
+static bool
+shadow_lookup(i2c_shadow_t *pshadow, uint8_t reg, uint8_t *value, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++)
+    {
+      if (!shadow_cacheable(pshadow, reg + i) ||
+          !(pshadow->valid[(reg + i) >> 3] & (1 << ((reg + i) & 7))))
+        {
+          return false;
+        }
+    }
+
+  memcpy(value, &pshadow->value[reg], len);
+  return true;
+}
+
+/**
+ * @brief record registers read from or written to the device
+ *
+ * A burst starting at a volatile register is a data port such as
+ * FIFO_DATA and does not advance through the map, so it is not recorded.
+ */
+
+static void
+shadow_store(i2c_shadow_t *pshadow, uint8_t reg, const uint8_t *value,
+             int len)
+{
+  int i;
+
+  if (!shadow_cacheable(pshadow, reg))
+    {
+      return;
+    }
+
+  for (i = 0; i < len; i++)
+    {
+      if (shadow_cacheable(pshadow, reg + i))
+        {
+          pshadow->value[reg + i] = value[i];
+          pshadow->valid[(reg + i) >> 3] |= 1 << ((reg + i) & 7);
+        }
+    }
+}
+
+static void
+shadow_forget(i2c_shadow_t *pshadow, uint8_t reg, int len)
+{
+  int i;
+
+  if (!shadow_cacheable(pshadow, reg))
+    {
+      return;
+    }
+
+  for (i = 0; i < len && reg + i < I2C_SHADOW_SIZE; i++)
+    {
+      pshadow->valid[(reg + i) >> 3] &= ~(1 << ((reg + i) & 7));
+    }
+}
+
+/**
+ * @brief record what a completed transaction wrote and read
+ */
+
+static void
+shadow_store_transfer(i2c_txn_t *ptxn)
+{
+  int m;
+  uint8_t reg = 0;
+  struct i2c_msg_s *msg;
+
+  for (m = 0; m < ptxn->msgc; m++)
+    {
+      msg = &ptxn->msgv[m];
+      if (msg->flags & (I2C_M_READ | I2C_M_NOSTART))
+        {
+          shadow_store(ptxn->pi2c->shadow, reg, msg->buffer, msg->length);
+        }
+      else
+        {
+          reg = msg->buffer[0];
+          shadow_store(ptxn->pi2c->shadow, reg, &msg->buffer[1],
+                       msg->length - 1);
+        }
+    }
+}
+
+/**
+ * @brief CLOCK_MONOTONIC in microseconds, for the transfer latency
+ */
+
+static uint32_t
+now_us(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000000ull + now.tv_nsec / 1000);
+}
+
+/**
+ * @brief count one transfer in the statistics
+ *
+ * @param pstats statistics
+ * @param msgv messages, the first one a write starting with the register
+ * @param msgc number of messages
+ * @param ret transfer result
+ * @param us transfer latency
+ */
+
+static void
+stats_record(i2c_stats_t *pstats, struct i2c_msg_s *msgv, int msgc,
+             int ret, uint32_t us)
+{
+  int i;
+  int slot;
+  int dir = I2C_STATS_WRITE;
+  int bucket = 0;
+  uint32_t v = us >> 4;
+  uint64_t rd = 0;
+  uint64_t wr = 0;
+  uint64_t data = 0;
+  uint8_t reg = msgv[0].buffer[0];
+  i2c_latency_t *plat;
+
+  for (i = 0; i < msgc; i++)
+    {
+      if (msgv[i].flags & I2C_M_READ)
+        {
+          dir = I2C_STATS_READ;
+          rd += msgv[i].length;
+        }
+      else
+        {
+          /* A write starts with the register address unless it carries
+           * I2C_M_NOSTART or follows a write of the bare address
+           */
+
+          wr += msgv[i].length;
+          data += msgv[i].length;
+          if (!(msgv[i].flags & I2C_M_NOSTART) &&
+              (i == 0 || (msgv[i - 1].flags & I2C_M_READ) ||
+               msgv[i - 1].length != 1))
+            {
+              data--;
+            }
+        }
+    }
+
+  for (slot = 0; slot < pstats->slots; slot++)
+    {
+      if (pstats->reg[slot] == reg)
+        {
+          break;
+        }
+    }
+
+  if (slot == pstats->slots && slot < I2C_STATS_SLOTS)
+    {
+      pstats->reg[pstats->slots++] = reg;
+    }
+
+  while (v != 0 && bucket < I2C_STATS_BUCKETS - 1)
+    {
+      v >>= 1;
+      bucket++;
+    }
+
+  plat = &pstats->latency[slot][dir];
+  plat->count++;
+  plat->total_us += us;
+  plat->hist[bucket]++;
+  if (us > plat->max_us)
+    {
+      plat->max_us = us;
+    }
+
+  pstats->transfers++;
+  if (ret < 0)
+    {
+      pstats->errors++;
+      plat->errors++;
+      return;
+    }
+
+  pstats->bytes_written += wr;
+  pstats->bytes_read += rd;
+  plat->bytes += dir == I2C_STATS_READ ? rd : data;
+}
+
+/**
+ * @brief one I2CIOC_TRANSFER, timed into pi2c->stats
+ *
+ * @param pi2c i2c control
+ * @param msgv messages
+ * @param msgc number of messages
+ * @return int success == 0
+ */
+
+static int
+i2c_transfer(i2c_ctrl_t *pi2c, struct i2c_msg_s *msgv, int msgc)
+{
+  int ret;
+  uint32_t t0 = 0;
+  struct i2c_transfer_s i2c_transfer;
+
+  i2c_transfer.msgv = msgv;
+  i2c_transfer.msgc = msgc;
+  if (pi2c->stats != NULL)
+    {
+      t0 = now_us();
+    }
+
+  if (pi2c->bus != NULL)
+    {
+      ret = i2c_bus_transfer(pi2c->bus, pi2c->priority, msgv, msgc);
+    }
+  else
+    {
+      ret = ioctl(pi2c->fd, I2CIOC_TRANSFER,
+                  (unsigned long)(uintptr_t)&i2c_transfer);
+    }
+
+  if (pi2c->stats != NULL)
+    {
+      stats_record(pi2c->stats, msgv, msgc, ret, now_us() - t0);
+    }
+
+  return ret;
+}
+
+/**
+ * @brief make room for msgs messages and bytes buffer bytes
+ *
+ * What is queued already goes out first when the new operation does not
+ * fit alongside it.
+ *
+ * @param ptxn transaction
+ * @param msgs messages needed
+ * @param bytes buffer bytes needed
+ * @return int success == 0
+ */
+
+static int
+txn_reserve(i2c_txn_t *ptxn, int msgs, int bytes)
+{
+  if (ptxn->error < 0)
+    {
+      return -1;
+    }
+
+  if (ptxn->msgc + msgs > I2C_TXN_MAX_MSGS ||
+      ptxn->used + bytes > I2C_TXN_BUFFER_SIZE)
+    {
+      if (i2c_txn_submit(ptxn) < 0)
+        {
+          ptxn->error = -1;
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+static void
+txn_add_msg(i2c_txn_t *ptxn, uint16_t flags, uint8_t *buffer, int length)
+{
+  struct i2c_msg_s *msg = &ptxn->msgv[ptxn->msgc++];
+
+  msg->addr   = ptxn->pi2c->i2c_addr;
+  msg->flags  = flags;
+  msg->buffer = buffer;
+  msg->length = length;
+  msg->frequency = ptxn->pi2c->speed;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -58,8 +387,14 @@ i2c_reg_write
 {
   int ret;
   struct i2c_msg_s i2c_msg;
-  struct i2c_transfer_s i2c_transfer;
   uint8_t txbuffer[2];
+  uint8_t cached;
+
+  if (shadow_lookup(pi2c->shadow, reg, &cached, 1) && cached == value)
+    {
+      pi2c->shadow->writes_skipped++;
+      return 0;
+    }
 
   txbuffer[0] = reg;
   txbuffer[1] = value;
@@ -69,13 +404,15 @@ i2c_reg_write
   i2c_msg.length = 2;
   i2c_msg.frequency = pi2c->speed;
 
-  i2c_transfer.msgv = &i2c_msg;
-  i2c_transfer.msgc = 1;
-  ret = ioctl(pi2c->fd, I2CIOC_TRANSFER,
-  (unsigned long)(uintptr_t)&i2c_transfer);
+  ret = i2c_transfer(pi2c, &i2c_msg, 1);
   if (ret < 0)
     {
       printf("I2C:Write Error(reg 0x%02x) %d\n", reg, ret);
+      shadow_forget(pi2c->shadow, reg, 1);
+    }
+  else
+    {
+      shadow_store(pi2c->shadow, reg, &value, 1);
     }
 
   return ret;
@@ -93,11 +430,10 @@ i2c_reg_write
 
 int
 i2c_reg_write_burst
-(i2c_ctrl_t *pi2c, uint8_t reg, uint8_t *pvalue, int len)
+(i2c_ctrl_t *pi2c, uint8_t reg, const uint8_t *pvalue, int len)
 {
   int ret;
   struct i2c_msg_s i2c_msg[2];
-  struct i2c_transfer_s i2c_transfer;
   uint8_t txbuffer[1];
 
   txbuffer[0] = reg;
@@ -109,17 +445,19 @@ i2c_reg_write_burst
 
   i2c_msg[1].addr   = pi2c->i2c_addr;
   i2c_msg[1].flags  = 0;
-  i2c_msg[1].buffer = pvalue;
+  i2c_msg[1].buffer = (uint8_t *)pvalue; /* only read for a write */
   i2c_msg[1].length = len;
   i2c_msg[1].frequency = pi2c->speed;
 
-  i2c_transfer.msgv = i2c_msg;
-  i2c_transfer.msgc = 2;
-  ret = ioctl(pi2c->fd, I2CIOC_TRANSFER,
-  (unsigned long)(uintptr_t)&i2c_transfer);
+  ret = i2c_transfer(pi2c, i2c_msg, 2);
   if (ret < 0)
     {
       printf("I2C:Write Error(reg 0x%02x) %d\n", reg, ret);
+      shadow_forget(pi2c->shadow, reg, len);
+    }
+  else
+    {
+      shadow_store(pi2c->shadow, reg, pvalue, len);
     }
 
   return ret;
@@ -141,7 +479,12 @@ i2c_reg_read
 {
   int ret;
   struct i2c_msg_s i2c_msg[2];
-  struct i2c_transfer_s i2c_transfer;
+
+  if (shadow_lookup(pi2c->shadow, reg, value, len))
+    {
+      pi2c->shadow->reads_cached++;
+      return 0;
+    }
 
   /* Write Data SEQ */
 
@@ -159,14 +502,537 @@ i2c_reg_read
   i2c_msg[1].length = len;
   i2c_msg[1].frequency = pi2c->speed;
 
-  i2c_transfer.msgv = i2c_msg;
-  i2c_transfer.msgc = 2;
-  ret = ioctl(pi2c->fd, I2CIOC_TRANSFER,
-  (unsigned long)(uintptr_t)&i2c_transfer);
+  ret = i2c_transfer(pi2c, i2c_msg, 2);
   if (ret < 0)
     {
       printf("I2C:Read Error(reg 0x%02x) %d\n", reg, ret);
     }
+  else
+    {
+      shadow_store(pi2c->shadow, reg, value, len);
+    }
+
+  return ret;
+}
+
+/**
+ * @brief I2C Device register read-modify-write
+ *
+ * With a shadow the read is normally served from it, and the write is
+ * skipped when the bits already match.
+ *
+ * @param pi2c i2c control
+ * @param reg register id
+ * @param mask bits to change
+ * @param value new bits, outside mask ignored
+ * @return int success == 0
+ */
+
+int
+i2c_reg_update
+(i2c_ctrl_t *pi2c, uint8_t reg, uint8_t mask, uint8_t value)
+{
+  int ret;
+  uint8_t current;
+
+  ret = i2c_reg_read(pi2c, reg, &current, 1);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  return i2c_reg_write(pi2c, reg, (current & ~mask) | (value & mask));
+}
+
+/**
+ * @brief recover a stuck bus
+ *
+ * The driver clocks SCL until a device holding SDA low lets go, then
+ * sends a STOP, see I2CIOC_RESET.  Needs CONFIG_I2C_RESET in the board
+ * configuration, without it the ioctl fails and nothing changes.
+ *
+ * @param pi2c i2c control
+ * @return int success == 0
+ */
+
+int
+i2c_bus_reset
+(i2c_ctrl_t *pi2c)
+{
+  int ret;
+
+  if (pi2c->bus != NULL)
+    {
+      ret = i2c_bus_ioctl(pi2c->bus, pi2c->priority, I2CIOC_RESET, 0);
+    }
+  else
+    {
+      ret = ioctl(pi2c->fd, I2CIOC_RESET, 0);
+    }
+
+  if (ret < 0)
+    {
+      printf("I2C:Reset Error %d\n", ret);
+    }
 
   return ret;
 }
+
+/**
+ * @brief keep a shadow of the device registers
+ *
+ * Writes of the value a register already holds are skipped, and reads
+ * of known registers are served from the shadow.  Registers flagged in
+ * volatile_map, those the device changes by itself or that act on a
+ * write, always go to the bus.  The shadow starts empty and is filled
+ * by the accesses made through pi2c.
+ *
+ * @param pi2c i2c control
+ * @param pshadow shadow storage, NULL to detach
+ * @param volatile_map I2C_SHADOW_SIZE bits, LSB first
+ */
+
+void
+i2c_shadow_attach
+(i2c_ctrl_t *pi2c, i2c_shadow_t *pshadow, const uint8_t *volatile_map)
+{
+  pi2c->shadow = pshadow;
+  if (pshadow != NULL)
+    {
+      memset(pshadow, 0, sizeof(*pshadow));
+      pshadow->volatile_map = volatile_map;
+    }
+}
+
+/**
+ * @brief forget every register, after a reset of the device
+ *
+ * @param pi2c i2c control
+ */
+
+void
+i2c_shadow_invalidate
+(i2c_ctrl_t *pi2c)
+{
+  if (pi2c->shadow != NULL)
+    {
+      memset(pi2c->shadow->valid, 0, sizeof(pi2c->shadow->valid));
+    }
+}
+
+/**
+ * @brief start queueing register accesses for one transfer
+ *
+ * Writes and reads queued with i2c_txn_write(), i2c_txn_write_burst()
+ * and i2c_txn_read() go out in order as one I2CIOC_TRANSFER, each
+ * access after a repeated START, when i2c_txn_submit() is called.  With
+ * a register shadow, writes of known values and reads of known
+ * registers are done at queue time and never reach the bus.  Read
+ * buffers are filled and burst data longer than the transaction buffer
+ * is sent from the caller's memory at that point, so both must stay
+ * valid until then.
+ *
+ * Accesses that need a delay between them, such as writes in advanced
+ * power save, must not share a transaction.
+ *
+ * @param ptxn transaction [out]
+ * @param pi2c i2c control
+ */
+
+void
+i2c_txn_begin
+(i2c_txn_t *ptxn, i2c_ctrl_t *pi2c)
+{
+  ptxn->pi2c = pi2c;
+  ptxn->msgc = 0;
+  ptxn->used = 0;
+  ptxn->ops = 0;
+  ptxn->error = 0;
+}
+
+/**
+ * @brief queue a register write
+ *
+ * @param ptxn transaction
+ * @param reg register id
+ * @param value write value [in]
+ * @return int success == 0
+ */
+
+int
+i2c_txn_write
+(i2c_txn_t *ptxn, uint8_t reg, uint8_t value)
+{
+  uint8_t *txbuffer;
+  uint8_t cached;
+  i2c_shadow_t *pshadow = ptxn->pi2c->shadow;
+
+  if (shadow_lookup(pshadow, reg, &cached, 1) && cached == value)
+    {
+      pshadow->writes_skipped++;
+      return 0;
+    }
+
+  if (txn_reserve(ptxn, 1, 2) < 0)
+    {
+      return -1;
+    }
+
+  /* Unknown until the transfer completes */
+
+  shadow_forget(pshadow, reg, 1);
+
+  txbuffer = &ptxn->buffer[ptxn->used];
+  txbuffer[0] = reg;
+  txbuffer[1] = value;
+  ptxn->used += 2;
+  txn_add_msg(ptxn, 0, txbuffer, 2);
+  ptxn->ops++;
+  return 0;
+}
+
+/**
+ * @brief queue a register burst write
+ *
+ * Short bursts are copied, longer ones are sent from pvalue.
+ *
+ * @param ptxn transaction
+ * @param reg register id
+ * @param pvalue write value [in]
+ * @param len burst length
+ * @return int success == 0
+ */
+
+int
+i2c_txn_write_burst
+(i2c_txn_t *ptxn, uint8_t reg, const uint8_t *pvalue, int len)
+{
+  uint8_t *txbuffer;
+
+  shadow_forget(ptxn->pi2c->shadow, reg, len);
+  if (len + 1 <= I2C_TXN_BUFFER_SIZE)
+    {
+      if (txn_reserve(ptxn, 1, len + 1) < 0)
+        {
+          return -1;
+        }
+
+      txbuffer = &ptxn->buffer[ptxn->used];
+      txbuffer[0] = reg;
+      memcpy(&txbuffer[1], pvalue, len);
+      ptxn->used += len + 1;
+      txn_add_msg(ptxn, 0, txbuffer, len + 1);
+    }
+  else
+    {
+      if (txn_reserve(ptxn, 2, 1) < 0)
+        {
+          return -1;
+        }
+
+      txbuffer = &ptxn->buffer[ptxn->used++];
+      txbuffer[0] = reg;
+      txn_add_msg(ptxn, 0, txbuffer, 1);
+      txn_add_msg(ptxn, I2C_M_NOSTART, (uint8_t *)pvalue, len);
+    }
+
+  ptxn->ops++;
+  return 0;
+}
+
+/**
+ * @brief queue a register read
+ *
+ * @param ptxn transaction
+ * @param reg register id
+ * @param value read value [out], filled by i2c_txn_submit()
+ * @param len burst length
+ * @return int success == 0
+ */
+
+int
+i2c_txn_read
+(i2c_txn_t *ptxn, uint8_t reg, uint8_t *value, int16_t len)
+{
+  uint8_t *txbuffer;
+  i2c_shadow_t *pshadow = ptxn->pi2c->shadow;
+
+  if (shadow_lookup(pshadow, reg, value, len))
+    {
+      pshadow->reads_cached++;
+      return 0;
+    }
+
+  if (txn_reserve(ptxn, 2, 1) < 0)
+    {
+      return -1;
+    }
+
+  txbuffer = &ptxn->buffer[ptxn->used++];
+  txbuffer[0] = reg;
+  txn_add_msg(ptxn, 0, txbuffer, 1);
+  txn_add_msg(ptxn, I2C_M_READ, value, len);
+  ptxn->ops++;
+  return 0;
+}
+
+/**
+ * @brief send the queued accesses as one transfer
+ *
+ * The transaction is empty afterwards and can be reused.  The ioctls and
+ * bus time saved against one transfer per access are added to
+ * pi2c->txn_stats.
+ *
+ * @param ptxn transaction
+ * @return int success == 0, or the first error since i2c_txn_begin()
+ */
+
+int
+i2c_txn_submit
+(i2c_txn_t *ptxn)
+{
+  int ret = ptxn->error;
+  i2c_ctrl_t *pi2c = ptxn->pi2c;
+
+  if (ret == 0 && ptxn->msgc > 0)
+    {
+      ret = i2c_transfer(pi2c, ptxn->msgv, ptxn->msgc);
+      if (ret < 0)
+        {
+          printf("I2C:Transfer Error(%d ops) %d\n", ptxn->ops, ret);
+          i2c_shadow_invalidate(pi2c);
+        }
+      else
+        {
+          shadow_store_transfer(ptxn);
+          pi2c->txn_stats.transfers++;
+          pi2c->txn_stats.ops += ptxn->ops;
+          pi2c->txn_stats.ioctls_saved += ptxn->ops - 1;
+          if (pi2c->speed > 0)
+            {
+              pi2c->txn_stats.bus_ns_saved += (uint64_t)(ptxn->ops - 1) *
+                I2C_TXN_GAP_CYCLES * 1000000000ull / pi2c->speed;
+            }
+        }
+    }
+
+  ptxn->msgc = 0;
+  ptxn->used = 0;
+  ptxn->ops = 0;
+  ptxn->error = 0;
+  return ret;
+}
+
+/**
+ * @brief keep transfer statistics
+ *
+ * Every transfer made through pi2c is timed around the ioctl and counted
+ * in pstats, which starts zeroed.  The latency includes the driver and
+ * any wait for the bus, so it shows when I2C holds a caller back.
+ *
+ * @param pi2c i2c control
+ * @param pstats statistics storage, NULL to stop counting
+ */
+
+void
+i2c_stats_attach
+(i2c_ctrl_t *pi2c, i2c_stats_t *pstats)
+{
+  pi2c->stats = pstats;
+  if (pstats != NULL)
+    {
+      memset(pstats, 0, sizeof(*pstats));
+    }
+}
+
+/**
+ * @brief give a register its own histograms ahead of its first transfer
+ *
+ * Slots otherwise go to registers in the order they are first used, so a
+ * driver reserves the ones that matter before its setup fills them.
+ *
+ * @param pi2c i2c control
+ * @param reg register id
+ * @return int success == 0, -1 when every slot is taken
+ */
+
+int
+i2c_stats_track
+(i2c_ctrl_t *pi2c, uint8_t reg)
+{
+  int slot;
+  i2c_stats_t *pstats = pi2c->stats;
+
+  if (pstats == NULL)
+    {
+      return 0;
+    }
+
+  for (slot = 0; slot < pstats->slots; slot++)
+    {
+      if (pstats->reg[slot] == reg)
+        {
+          return 0;
+        }
+    }
+
+  if (pstats->slots == I2C_STATS_SLOTS)
+    {
+      return -1;
+    }
+
+  pstats->reg[pstats->slots++] = reg;
+  return 0;
+}
+
+/**
+ * @brief count a transfer the caller repeats after an error
+ *
+ * @param pi2c i2c control
+ */
+
+void
+i2c_stats_retry
+(i2c_ctrl_t *pi2c)
+{
+  if (pi2c->stats != NULL)
+    {
+      pi2c->stats->retries++;
+    }
+}
+
+/**
+ * @brief upper edge of a latency bucket
+ *
+ * @param bucket 0 .. I2C_STATS_BUCKETS - 1
+ * @return uint32_t microseconds, UINT32_MAX for the last bucket
+ */
+
+uint32_t
+i2c_stats_bucket_us
+(int bucket)
+{
+  if (bucket >= I2C_STATS_BUCKETS - 1)
+    {
+      return UINT32_MAX;
+    }
+
+  return 16u << bucket;
+}
+
+/**
+ * @brief latency below which percent of the transfers completed
+ *
+ * @param plat latency histogram
+ * @param percent 1 .. 100
+ * @return uint32_t upper edge of the bucket, capped at the maximum seen
+ */
+
+uint32_t
+i2c_stats_percentile_us
+(const i2c_latency_t *plat, int percent)
+{
+  int i;
+  uint32_t seen = 0;
+  uint32_t need = (uint32_t)(((uint64_t)plat->count * percent + 99) / 100);
+
+  for (i = 0; i < I2C_STATS_BUCKETS; i++)
+    {
+      seen += plat->hist[i];
+      if (seen >= need && seen > 0)
+        {
+          break;
+        }
+    }
+
+  if (i == I2C_STATS_BUCKETS || i2c_stats_bucket_us(i) > plat->max_us)
+    {
+      return plat->max_us;
+    }
+
+  return i2c_stats_bucket_us(i);
+}
+
+/**
+ * @brief one line JSON summary for telemetry
+ *
+ * Totals, then count, errors, bytes, p50/p99/max latency in us per
+ * register and direction seen, the other registers as "reg":"*".
+ * Entries that do not fit are left out so that the line stays valid
+ * JSON; I2C_STATS_FORMAT_SIZE holds all of them.
+ *
+ * @param pstats statistics
+ * @param buf output [out]
+ * @param size size of buf
+ * @return int length written, truncated like snprintf() only when buf
+ *         cannot hold the totals
+ */
+
+int
+i2c_stats_format
+(const i2c_stats_t *pstats, char *buf, int size)
+{
+  int n;
+  int len;
+  int avail;
+  int slot;
+  int dir;
+  char reg[8];
+  const i2c_latency_t *plat;
+
+  n = snprintf(buf, size, "{\"xfers\":%u,\"err\":%u,\"retry\":%u,"
+               "\"wr\":%llu,\"rd\":%llu,\"regs\":[",
+               pstats->transfers, pstats->errors, pstats->retries,
+               (unsigned long long)pstats->bytes_written,
+               (unsigned long long)pstats->bytes_read);
+
+  for (slot = 0; slot <= I2C_STATS_SLOTS; slot++)
+    {
+      for (dir = I2C_STATS_WRITE; dir <= I2C_STATS_READ; dir++)
+        {
+          /* keep room for the closing "]}" */
+
+          plat = &pstats->latency[slot][dir];
+          avail = size - n - 2;
+          if (plat->count == 0 || avail <= 0)
+            {
+              continue;
+            }
+
+          if (slot < I2C_STATS_SLOTS)
+            {
+              snprintf(reg, sizeof(reg), "0x%02x", pstats->reg[slot]);
+            }
+          else
+            {
+              strcpy(reg, "*");
+            }
+
+          len = snprintf(&buf[n], avail,
+                        "%s{\"reg\":\"%s\",\"dir\":\"%c\",\"n\":%u,"
+                        "\"err\":%u,\"B\":%llu,\"p50\":%u,\"p99\":%u,"
+                        "\"max\":%u}",
+                        buf[n - 1] == '[' ? "" : ",", reg,
+                        dir == I2C_STATS_READ ? 'r' : 'w',
+                        plat->count, plat->errors,
+                        (unsigned long long)plat->bytes,
+                        i2c_stats_percentile_us(plat, 50),
+                        i2c_stats_percentile_us(plat, 99),
+                        plat->max_us);
+          if (len >= avail)
+            {
+              buf[n] = '\0';
+              continue;
+            }
+
+          n += len;
+        }
+    }
+
+  if (n + 2 < size)
+    {
+      n += snprintf(&buf[n], size - n, "]}");
+    }
+
+  return n;
+}
@@ -35,17 +35,111 @@
 #include <arch/chip/pin.h>
 #include "debug_printf.h"
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Transaction builder capacity: messages per transfer, and bytes for the
+ * register addresses and copied write data they point to.
+ */
+
+#define I2C_TXN_MAX_MSGS (12)
+#define I2C_TXN_BUFFER_SIZE (32)
+
+/* Register shadow: 7 bit register addresses */
+
+#define I2C_SHADOW_SIZE (128)
+
+/* Transfer statistics: registers with their own histograms, the rest
+ * share one more slot, and latency buckets of doubling width, the first
+ * below 16us and the last open ended, see i2c_stats_bucket_us().
+ */
+
+#define I2C_STATS_SLOTS (8)
+#define I2C_STATS_BUCKETS (14)
+#define I2C_STATS_WRITE (0)
+#define I2C_STATS_READ (1)
+
+/* i2c_stats_format() output with every counter at its largest value: the
+ * totals, an entry per slot and direction, "]}" and the NUL
+ */
+
+#define I2C_STATS_FORMAT_SIZE (128 + (I2C_STATS_SLOTS + 1) * 2 * 136 + 3)
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
+typedef struct _i2c_txn_stats_type
+{
+  uint32_t transfers;     /* I2CIOC_TRANSFER ioctls issued by i2c_txn_submit */
+  uint32_t ops;           /* register reads and writes queued */
+  uint32_t ioctls_saved;  /* ops - transfers */
+  uint64_t bus_ns_saved;  /* STOP, bus free time and START not spent */
+} i2c_txn_stats_t;
+
+typedef struct _i2c_shadow_type
+{
+  const uint8_t *volatile_map;  /* bit per register always on the bus */
+  uint8_t valid[I2C_SHADOW_SIZE / 8];
+  uint8_t value[I2C_SHADOW_SIZE];
+  uint32_t reads_cached;        /* reads served without a transfer */
+  uint32_t writes_skipped;      /* writes of the value already set */
+} i2c_shadow_t;
+
+typedef struct _i2c_latency_type
+{
+  uint32_t count;               /* transfers */
+  uint32_t errors;
+  uint64_t bytes;               /* data bytes, without register addresses */
+  uint64_t total_us;
+  uint32_t max_us;
+  uint32_t hist[I2C_STATS_BUCKETS];
+} i2c_latency_t;
+
+typedef struct _i2c_stats_type
+{
+  uint32_t transfers;
+  uint32_t errors;
+  uint32_t retries;             /* reported by callers, i2c_stats_retry() */
+  uint64_t bytes_written;       /* including register addresses */
+  uint64_t bytes_read;
+  int slots;                    /* entries of reg in use */
+  uint8_t reg[I2C_STATS_SLOTS];
+
+  /* [slot][I2C_STATS_WRITE / I2C_STATS_READ], slot I2C_STATS_SLOTS
+   * for every other register.  A transfer counts once, under its first
+   * register, as a read if it reads anything.
+   */
+
+  i2c_latency_t latency[I2C_STATS_SLOTS + 1][2];
+} i2c_stats_t;
+
+struct _i2c_bus_type;
+
 typedef struct _i2c_ctrl_type
 {
   int fd;
   int i2c_addr;
   int speed;
+  i2c_txn_stats_t txn_stats;
+  i2c_shadow_t *shadow;         /* NULL: every access goes to the bus */
+  i2c_stats_t *stats;           /* NULL: no transfer statistics */
+  struct _i2c_bus_type *bus;    /* NULL: fd is not shared */
+  int priority;                 /* I2C_BUS_PRIO_* on a shared bus */
 } i2c_ctrl_t;
 
+typedef struct _i2c_txn_type
+{
+  i2c_ctrl_t *pi2c;
+  struct i2c_msg_s msgv[I2C_TXN_MAX_MSGS];
+  uint8_t buffer[I2C_TXN_BUFFER_SIZE];
+  int msgc;
+  int used;
+  int ops;
+  int error;
+} i2c_txn_t;
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -57,9 +151,31 @@ extern "C"
 
 int i2c_reg_write(i2c_ctrl_t *pi2c, uint8_t reg, uint8_t value);
 int i2c_reg_write_burst(i2c_ctrl_t *pi2c,
-  uint8_t reg, uint8_t *pvalue, int len);
+  uint8_t reg, const uint8_t *pvalue, int len);
 int i2c_reg_read(i2c_ctrl_t *pi2c,
   uint8_t reg, uint8_t *value, int16_t len);
+int i2c_reg_update(i2c_ctrl_t *pi2c,
+  uint8_t reg, uint8_t mask, uint8_t value);
+int i2c_bus_reset(i2c_ctrl_t *pi2c);
+
+void i2c_shadow_attach(i2c_ctrl_t *pi2c, i2c_shadow_t *pshadow,
+  const uint8_t *volatile_map);
+void i2c_shadow_invalidate(i2c_ctrl_t *pi2c);
+
+void i2c_stats_attach(i2c_ctrl_t *pi2c, i2c_stats_t *pstats);
+int i2c_stats_track(i2c_ctrl_t *pi2c, uint8_t reg);
+void i2c_stats_retry(i2c_ctrl_t *pi2c);
+uint32_t i2c_stats_bucket_us(int bucket);
+uint32_t i2c_stats_percentile_us(const i2c_latency_t *plat, int percent);
+int i2c_stats_format(const i2c_stats_t *pstats, char *buf, int size);
+
+void i2c_txn_begin(i2c_txn_t *ptxn, i2c_ctrl_t *pi2c);
+int i2c_txn_write(i2c_txn_t *ptxn, uint8_t reg, uint8_t value);
+int i2c_txn_write_burst(i2c_txn_t *ptxn,
+  uint8_t reg, const uint8_t *pvalue, int len);
+int i2c_txn_read(i2c_txn_t *ptxn,
+  uint8_t reg, uint8_t *value, int16_t len);
+int i2c_txn_submit(i2c_txn_t *ptxn);
 
 #if defined(__cplusplus)
 }
@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+
+/* Free running cycle counter for profiling: the DWT cycle counter on
+ * Cortex-M4 (Spresense runs a flat build, so the application can enable
+ * it), the time stamp counter on x86 hosts, else CLOCK_MONOTONIC in ns.
+ * 32 bits wrap after about 27s at 156MHz; only differences are meaningful.
+ */
+
+#if defined(__ARM_ARCH_7EM__)
+
+#define CYCLES_DEMCR (*(volatile uint32_t *)0xe000edfc)
+#define CYCLES_DWT_CTRL (*(volatile uint32_t *)0xe0001000)
+#define CYCLES_DWT_CYCCNT (*(volatile uint32_t *)0xe0001004)
+#define CYCLES_DEMCR_TRCENA (1u << 24)
+#define CYCLES_DWT_CYCCNTENA (1u << 0)
+#define CYCLES_UNIT "cycles"
+
+static inline void cycles_init(void)
+{
+  CYCLES_DEMCR |= CYCLES_DEMCR_TRCENA;
+  CYCLES_DWT_CTRL |= CYCLES_DWT_CYCCNTENA;
+}
+
+static inline uint32_t cycles_now(void)
+{
+  return CYCLES_DWT_CYCCNT;
+}
+
+#elif defined(__x86_64__) || defined(__i386__)
+
+#include <x86intrin.h>
+
+#define CYCLES_UNIT "TSC ticks"
+
+static inline void cycles_init(void)
+{
+}
+
+static inline uint32_t cycles_now(void)
+{
+  return (uint32_t)__rdtsc();
+}
+
+#else
+
+#include <time.h>
+
+#define CYCLES_UNIT "ns"
+
+static inline void cycles_init(void)
+{
+}
+
+static inline uint32_t cycles_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000000000ull + now.tv_nsec);
+}
+
+#endif
+
+/* Running count, mean and maximum of a measured section */
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t last;
+  uint32_t max;
+  uint64_t total;
+} cycles_stats_t;
+
+static inline void cycles_add(cycles_stats_t *stats, uint32_t start)
+{
+  uint32_t n = cycles_now() - start;
+
+  stats->count++;
+  stats->last = n;
+  stats->total += n;
+  stats->max = n > stats->max ? n : stats->max;
+}
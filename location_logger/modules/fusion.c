@@ -0,0 +1,450 @@
+#include <nuttx/config.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+
+#include <arch/chip/gnss.h>
+
+#include "bmi270_ctrl.h"
+#include "ins_ekf.h"
+#include "fusion.h"
+
+#define RAD_TO_DEG (180.0f / (float)M_PI)
+#define EARTH_RADIUS_M 6371000.0 // enough to move a point by a sample period
+
+/* Filter, fusion thread only */
+
+static ins_ekf_t ekf;
+static ins_ekf_config_t ekf_config;
+static FusionStats stats;
+static uint64_t fix_applied_ns; // IMU time of the last fix taken
+
+/* fusion_gnss() -> fusion thread */
+
+static pthread_mutex_t fix_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool fix_pending;
+static ins_ekf_fix_t pending_fix;
+static uint64_t pending_fix_ns;
+
+/* fusion thread -> fusion_get() and fusion_stats() */
+
+static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FusionState state_published;
+static bool state_valid;
+static FusionStats stats_published;
+
+/* fusion thread -> fusion_read(), oldest point dropped when full */
+
+static pthread_mutex_t track_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FusionTrackPoint track_queue[FUSION_TRACK_QUEUE];
+static int track_head;
+static int track_count;
+static uint64_t track_period_ns = 1000000000ull / FUSION_TRACK_HZ;
+
+static uint64_t monotonic_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void sleep_ms(int ms)
+{
+  struct timespec waittime;
+
+  waittime.tv_sec = ms / 1000;
+  waittime.tv_nsec = (ms % 1000) * 1000 * 1000;
+  nanosleep(&waittime, NULL);
+}
+
+/**
+ * @brief start the filter at a fix, or correct it
+ *
+ * @param last latest IMU sample, levels the filter at the start
+ */
+
+static void apply_fix(const ins_ekf_fix_t *fix, const IMUData *last)
+{
+  IMUMagData mag;
+  float speed;
+  float yaw = 0.0f;
+  float yaw_std = (float)M_PI;
+  uint32_t start;
+
+  if (ekf.started)
+  {
+    start = cycles_now();
+    if (ins_ekf_update(&ekf, fix) == 0)
+    {
+      fix_applied_ns = last->timestamp_ns;
+    }
+
+    cycles_add(&stats.update, start);
+    return;
+  }
+
+  speed = sqrtf(fix->vn * fix->vn + fix->ve * fix->ve);
+  if (speed >= FUSION_COG_MIN_VELOCITY)
+  {
+    yaw = atan2f(fix->ve, fix->vn);
+    yaw_std = FUSION_COG_YAW_STD;
+  }
+  else if (imu_bmi270_mag(&mag) == 0)
+  {
+    yaw = mag.heading / RAD_TO_DEG;
+    yaw_std = FUSION_MAG_YAW_STD;
+  }
+
+  if (ins_ekf_start(&ekf, fix, last, yaw, yaw_std) == 0)
+  {
+    fix_applied_ns = last->timestamp_ns;
+    printf("FUSION: started, heading %.0f +- %.0f degree\n",
+           yaw * RAD_TO_DEG, yaw_std * RAD_TO_DEG);
+  }
+}
+
+/**
+ * @brief publish the estimate for fusion_get()
+ */
+
+static void publish(uint64_t timestamp_ns)
+{
+  ins_ekf_state_t s;
+  FusionState out;
+
+  if (!ekf.started)
+  {
+    return;
+  }
+
+  ins_ekf_get(&ekf, &s);
+  out.latitude = s.latitude;
+  out.longitude = s.longitude;
+  out.altitude = s.altitude;
+  out.vn = s.v[0];
+  out.ve = s.v[1];
+  out.vd = s.v[2];
+  out.roll = s.roll * RAD_TO_DEG;
+  out.pitch = s.pitch * RAD_TO_DEG;
+  out.yaw = s.yaw * RAD_TO_DEG;
+  if (out.yaw < 0.0f)
+  {
+    out.yaw += 360.0f;
+  }
+
+  out.pos_std = s.pos_std;
+  out.timestamp_ns = timestamp_ns;
+  out.fixes = ekf.updates;
+  out.rejected = ekf.rejects;
+
+  pthread_mutex_lock(&state_mutex);
+  state_published = out;
+  state_valid = true;
+  stats_published = stats;
+  pthread_mutex_unlock(&state_mutex);
+}
+
+/**
+ * @brief queue a track point when the sample crossed the next grid time
+ *
+ * The point is moved back along the velocity from the sample to the grid
+ * time, so points are evenly spaced whatever the IMU rate.
+ *
+ * @param timestamp_ns of the sample just predicted
+ * @param pnext_ns next grid time, 0 to align to the grid [in/out]
+ */
+
+static void track(uint64_t timestamp_ns, uint64_t *pnext_ns)
+{
+  ins_ekf_state_t s;
+  FusionTrackPoint point;
+  uint64_t period_ns;
+  float back;
+  int tail;
+
+  pthread_mutex_lock(&track_mutex);
+  period_ns = track_period_ns;
+  pthread_mutex_unlock(&track_mutex);
+
+  if (*pnext_ns == 0)
+  {
+    *pnext_ns = (timestamp_ns / period_ns + 1) * period_ns;
+  }
+
+  if (timestamp_ns < *pnext_ns)
+  {
+    return;
+  }
+
+  ins_ekf_get(&ekf, &s);
+  back = (timestamp_ns - *pnext_ns) * 1e-9f;
+  point.latitude = s.latitude -
+                   s.v[0] * back / EARTH_RADIUS_M * RAD_TO_DEG;
+  point.longitude = s.longitude -
+                    s.v[1] * back / (EARTH_RADIUS_M *
+                    cos(s.latitude / RAD_TO_DEG)) * RAD_TO_DEG;
+  point.altitude = s.altitude + s.v[2] * back;
+  point.vn = s.v[0];
+  point.ve = s.v[1];
+  point.yaw = s.yaw * RAD_TO_DEG;
+  if (point.yaw < 0.0f)
+  {
+    point.yaw += 360.0f;
+  }
+
+  point.pos_std = s.pos_std;
+  point.since_fix_ms = (*pnext_ns - fix_applied_ns) / 1000000ull;
+  point.timestamp_ns = *pnext_ns;
+
+  /* next grid time after this sample; skips the grid times of a gap */
+
+  *pnext_ns = (timestamp_ns / period_ns + 1) * period_ns;
+
+  pthread_mutex_lock(&track_mutex);
+  if (track_count == FUSION_TRACK_QUEUE)
+  {
+    track_head = (track_head + 1) % FUSION_TRACK_QUEUE;
+    track_count--;
+    stats.track_dropped++;
+  }
+
+  tail = (track_head + track_count) % FUSION_TRACK_QUEUE;
+  track_queue[tail] = point;
+  track_count++;
+  pthread_mutex_unlock(&track_mutex);
+}
+
+void *thread_fusion_main(void *arg)
+{
+  IMUData data;
+  IMUData last = {0};
+  IMUMotionState motion;
+  ins_ekf_fix_t fix;
+  bool have_fix = false;
+  uint64_t fix_ns = 0;
+  uint64_t track_ns = 0;
+  uint64_t now;
+  uint64_t report_ns;
+  uint32_t start;
+  float dt;
+
+  ins_ekf_default_config(&ekf_config);
+  ins_ekf_init(&ekf, &ekf_config);
+  cycles_init();
+  report_ns = monotonic_ns() + FUSION_REPORT_INTERVAL_MS * 1000000ull;
+
+  while (1)
+  {
+    pthread_mutex_lock(&fix_mutex);
+    if (fix_pending)
+    {
+      fix = pending_fix;
+      fix_ns = pending_fix_ns;
+      have_fix = true;
+      fix_pending = false;
+    }
+
+    pthread_mutex_unlock(&fix_mutex);
+
+    /* parked: GNSS is off and main does not read the track */
+
+    imu_bmi270_motion(&motion);
+
+    while (imu_bmi270_pop(&data) == 0)
+    {
+      /* no sensortime yet */
+
+      if (data.timestamp_ns == 0)
+      {
+        continue;
+      }
+
+      /* the state at the last sample before the fix arrived is the one
+       * the fix corrects
+       */
+
+      if (have_fix && data.timestamp_ns > fix_ns && last.timestamp_ns != 0)
+      {
+        apply_fix(&fix, &last);
+        have_fix = false;
+      }
+
+      if (ekf.started && last.timestamp_ns != 0)
+      {
+        if (data.timestamp_ns <= last.timestamp_ns ||
+            data.timestamp_ns - last.timestamp_ns >
+            FUSION_MAX_GAP_MS * 1000000ull)
+        {
+          printf("FUSION: IMU gap, restarting at the next fix\n");
+          ins_ekf_init(&ekf, &ekf_config);
+          track_ns = 0;
+        }
+        else
+        {
+          dt = (data.timestamp_ns - last.timestamp_ns) * 1e-9f;
+          start = cycles_now();
+          ins_ekf_predict(&ekf, &data, dt);
+          cycles_add(&stats.predict, start);
+          if (motion.parked)
+          {
+            track_ns = 0;
+          }
+          else
+          {
+            track(data.timestamp_ns, &track_ns);
+          }
+        }
+      }
+
+      last = data;
+    }
+
+    /* IMU stalled: correct the state as it is */
+
+    now = monotonic_ns();
+    if (have_fix && last.timestamp_ns != 0 &&
+        now - fix_ns > FUSION_FIX_WAIT_MS * 1000000ull)
+    {
+      apply_fix(&fix, &last);
+      have_fix = false;
+    }
+
+    publish(last.timestamp_ns);
+
+    if (now >= report_ns)
+    {
+      if (stats.predict.count > 0)
+      {
+        printf("FUSION: predict %lu %s avg %lu max, update %lu avg %lu max"
+               " (%lu fixes)\n",
+               (unsigned long)(stats.predict.total / stats.predict.count),
+               CYCLES_UNIT, (unsigned long)stats.predict.max,
+               (unsigned long)(stats.update.count ?
+                               stats.update.total / stats.update.count : 0),
+               (unsigned long)stats.update.max,
+               (unsigned long)stats.update.count);
+      }
+
+      imu_bmi270_report();
+      report_ns = now + FUSION_REPORT_INTERVAL_MS * 1000000ull;
+    }
+
+    sleep_ms(FUSION_INTERVAL_MS);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief hand a fix from gnss_get() to the fusion thread
+ *
+ * pos->timestamp_ns, when gnss_get() saw the notification, stands for
+ * the time of the fix, so a fix handed over late still lines up with the
+ * IMU samples of its epoch.
+ *
+ * @param pos fix
+ * @return int success == 0
+ */
+
+int fusion_gnss(const struct gnss_positiondata_s *pos)
+{
+  float dir = pos->direction / RAD_TO_DEG;
+
+  pthread_mutex_lock(&fix_mutex);
+  pending_fix.latitude = pos->latitude;
+  pending_fix.longitude = pos->longitude;
+  pending_fix.altitude = pos->altitude;
+  pending_fix.vn = pos->velocity * cosf(dir);
+  pending_fix.ve = pos->velocity * sinf(dir);
+  pending_fix.altitude_valid = pos->fixmode == CXD56_GNSS_PVT_POSFIX_3D;
+  pending_fix_ns = pos->timestamp_ns;
+  fix_pending = true;
+  pthread_mutex_unlock(&fix_mutex);
+  return 0;
+}
+
+/**
+ * @brief latest fused estimate, never blocks
+ *
+ * @param pstate copy [out]
+ * @return int success == 0, -1 before the filter started
+ */
+
+int fusion_get(FusionState *pstate)
+{
+  int ret = -1;
+
+  pthread_mutex_lock(&state_mutex);
+  if (state_valid)
+  {
+    *pstate = state_published;
+    ret = 0;
+  }
+
+  pthread_mutex_unlock(&state_mutex);
+  return ret;
+}
+
+/**
+ * @brief cost of the filter steps so far
+ *
+ * @param pstats copy [out]
+ * @return int success == 0
+ */
+
+int fusion_stats(FusionStats *pstats)
+{
+  pthread_mutex_lock(&state_mutex);
+  *pstats = stats_published;
+  pthread_mutex_unlock(&state_mutex);
+  return 0;
+}
+
+/**
+ * @brief set the rate of the dead reckoned track
+ *
+ * @param hz FUSION_TRACK_HZ_MIN .. FUSION_TRACK_HZ_MAX
+ * @return int success == 0, -1 out of range
+ */
+
+int fusion_set_rate(int hz)
+{
+  if (hz < FUSION_TRACK_HZ_MIN || hz > FUSION_TRACK_HZ_MAX)
+  {
+    return -1;
+  }
+
+  pthread_mutex_lock(&track_mutex);
+  track_period_ns = 1000000000ull / hz;
+  pthread_mutex_unlock(&track_mutex);
+  return 0;
+}
+
+/**
+ * @brief oldest queued track point, never blocks
+ *
+ * @param ppoint copy [out]
+ * @return int success == 0, -1 when the queue is empty
+ */
+
+int fusion_read(FusionTrackPoint *ppoint)
+{
+  int ret = -1;
+
+  pthread_mutex_lock(&track_mutex);
+  if (track_count > 0)
+  {
+    *ppoint = track_queue[track_head];
+    track_head = (track_head + 1) % FUSION_TRACK_QUEUE;
+    track_count--;
+    ret = 0;
+  }
+
+  pthread_mutex_unlock(&track_mutex);
+  return ret;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+
+#include "gnss.h"
+#include "cycles.h"
+
+/* GNSS/INS fusion thread: every IMU sample from the IMU ring propagates
+ * an error-state Kalman filter (ins_ekf.h) and every fix handed over with
+ * fusion_gnss() corrects it.  The fix is applied once the samples up to
+ * its notification time have been propagated, or after FUSION_FIX_WAIT_MS without
+ * IMU data.  The filter starts at the first fix, heading along the
+ * course over ground when moving faster than FUSION_COG_MIN_VELOCITY,
+ * else along the magnetometer; it restarts after an IMU gap longer than
+ * FUSION_MAX_GAP_MS.  The fusion thread is the only consumer of the IMU
+ * ring; every FUSION_REPORT_INTERVAL_MS it prints its cost and the IMU
+ * thread's report, imu_bmi270_report().
+ *
+ * Between fixes the filter dead-reckons on the IMU; the thread samples
+ * that track every 1/rate s of IMU time into a queue read with
+ * fusion_read(), so a smooth track does not need a faster GNSS cycle.
+ * Nothing is queued while the IMU reports the asset parked.
+ */
+
+#define FUSION_INTERVAL_MS 20 // IMU ring drained this often
+#define FUSION_FIX_WAIT_MS 200
+#define FUSION_MAX_GAP_MS 1000
+#define FUSION_COG_MIN_VELOCITY 1.5f // m/s, slower the course is noise
+#define FUSION_COG_YAW_STD 0.1f // rad, start heading from the course
+#define FUSION_MAG_YAW_STD 0.35f // rad, from the uncalibrated magnetometer
+#define FUSION_REPORT_INTERVAL_MS 10000 // predict/update cost, IMU report
+#define FUSION_THREAD_STACK_SIZE 6144 // ins_ekf_update() alone about 1 kB, float printf
+
+#define FUSION_TRACK_HZ 10 // default track rate
+#define FUSION_TRACK_HZ_MIN 1
+#define FUSION_TRACK_HZ_MAX 50 // at most the IMU rate
+#define FUSION_TRACK_QUEUE 512 // points, 10s at the maximum rate, main reads every ~6s
+
+typedef struct
+{
+  double latitude; // degree
+  double longitude;
+  double altitude; // m
+  float vn; // m/s
+  float ve;
+  float vd;
+  float roll; // degree, body x forward, y right, z down
+  float pitch;
+  float yaw; // clockwise from north, 0 .. 360
+  float pos_std; // m, horizontal 1 sigma
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC of the last IMU sample
+  uint32_t fixes; // applied
+  uint32_t rejected; // gated out
+} FusionState;
+
+typedef struct
+{
+  double latitude; // degree
+  double longitude;
+  float altitude; // m
+  float vn; // m/s
+  float ve;
+  float yaw; // degree, clockwise from north, 0 .. 360
+  float pos_std; // m, horizontal 1 sigma, grows while dead reckoning
+  uint32_t since_fix_ms; // dead reckoned this long since the last fix
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC, on the 1/rate grid
+} FusionTrackPoint;
+
+typedef struct
+{
+  cycles_stats_t predict; // CYCLES_UNIT per ins_ekf_predict()
+  cycles_stats_t update; // per ins_ekf_update()
+  uint32_t track_dropped; // points overwritten before fusion_read()
+} FusionStats;
+
+void *thread_fusion_main(void *arg);
+int fusion_gnss(const struct gnss_positiondata_s *pos);
+int fusion_get(FusionState *pstate);
+int fusion_stats(FusionStats *pstats);
+int fusion_set_rate(int hz);
+int fusion_read(FusionTrackPoint *ppoint);
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <time.h>
 #include <arch/chip/gnss.h>
 #include "gnss.h"
 
@@ -178,7 +179,7 @@ int gnss_setparams(int fd)
   set_opemode.mode = 1;     /* Operation mode:Normal(default). */
   set_opemode.cycle = 1000; /* Position notify cycle(msec step). */
 
-  ret = ioctl(fd, CXD56_GNSS_IOCTL_SET_OPE_MODE, (uint32_t)&set_opemode);
+  ret = ioctl(fd, CXD56_GNSS_IOCTL_SET_OPE_MODE, (unsigned long)&set_opemode);
   if (ret < 0)
   {
     printf("ioctl(CXD56_GNSS_IOCTL_SET_OPE_MODE) NG!!\n");
@@ -319,8 +320,16 @@ int gnss_initialize(sigset_t *mask)
 int gnss_get(int fd, sigset_t *mask, struct gnss_positiondata_s *position_data)
 {
   int ret;
+  struct timespec now;
+
+  /* A notification that waited while the caller was busy is up to a cycle
+   * old; take the next one so that its arrival is the time of the fix.
+   */
+
+  gnss_flush(mask);
 
   ret = sigwaitinfo(mask, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &now);
   if (ret != MY_GNSS_SIG)
   {
     printf("sigwaitinfo error %d\n", ret);
@@ -348,6 +357,9 @@ int gnss_get(int fd, sigset_t *mask, struct gnss_positiondata_s *position_data)
     position_data->altitude = posdat.receiver.altitude;
     position_data->velocity = posdat.receiver.velocity;
     position_data->direction = posdat.receiver.direction;
+    position_data->fixmode = posdat.receiver.pos_fixmode;
+    position_data->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ull +
+                                  now.tv_nsec;
 
     return OK;
   }
@@ -376,6 +388,36 @@ int gnss_stop(int fd)
   return ret;
 }
 
+/****************************************************************************
+ * Name: gnss_resume()
+ *
+ * Description:
+ *  Restart GNSS stopped by gnss_stop(), hot start from the last fix.
+ *
+ * Input Parameters:
+ *  fd      - File descriptor.
+ *
+ * Returned Value:
+ *  Zero (OK) on success; Negative value on error.
+ ****************************************************************************/
+
+int gnss_resume(int fd)
+{
+  int ret;
+
+  ret = ioctl(fd, CXD56_GNSS_IOCTL_START, CXD56_GNSS_STMOD_HOT);
+  if (ret < 0)
+  {
+    printf("start GNSS ERROR %d\n", errno);
+  }
+  else
+  {
+    printf("start GNSS OK\n");
+  }
+
+  return ret;
+}
+
 int gnss_first_contact(int fd, sigset_t *mask)
 {
   int ret;
@@ -407,4 +449,102 @@ int gnss_first_contact(int fd, sigset_t *mask)
   } while (posdat.receiver.pos_fixmode == CXD56_GNSS_PVT_POSFIX_INVALID);
 
   return OK;
-}
\ No newline at end of file
+}
+
+/****************************************************************************
+ * Name: gnss_flush()
+ *
+ * Description:
+ *  Discard position notifications that are already pending, e.g. one
+ *  raised before gnss_stop() or while the caller was busy.
+ *
+ * Input Parameters:
+ *  mask    - Signal mask.
+ *
+ * Returned Value:
+ *  Number of notifications discarded.
+ ****************************************************************************/
+
+int gnss_flush(sigset_t *mask)
+{
+  struct timespec zero = {0, 0};
+  int n = 0;
+
+  while (sigtimedwait(mask, NULL, &zero) == MY_GNSS_SIG)
+  {
+    n++;
+  }
+
+  return n;
+}
+
+/****************************************************************************
+ * Name: gnss_wait_fix()
+ *
+ * Description:
+ *  Wait for a valid fix notified after the call, like gnss_first_contact()
+ *  but bounded; pending notifications are discarded first.
+ *
+ * Input Parameters:
+ *  fd         - File descriptor.
+ *  mask       - Signal mask.
+ *  timeout_ms - Longest wait.
+ *
+ * Returned Value:
+ *  Zero (OK) on a valid fix; -ETIMEDOUT; other negative value on error.
+ ****************************************************************************/
+
+int gnss_wait_fix(int fd, sigset_t *mask, int timeout_ms)
+{
+  int ret;
+  int64_t left_ns;
+  struct timespec now;
+  struct timespec deadline;
+  struct timespec left;
+
+  gnss_flush(mask);
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+
+  do
+  {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    left_ns = (int64_t)(deadline.tv_sec - now.tv_sec) * 1000000000 +
+              (deadline.tv_nsec - now.tv_nsec);
+    if (left_ns <= 0)
+    {
+      return -ETIMEDOUT;
+    }
+
+    left.tv_sec = left_ns / 1000000000;
+    left.tv_nsec = left_ns % 1000000000;
+    ret = sigtimedwait(mask, NULL, &left);
+    if (ret < 0 && errno == EAGAIN)
+    {
+      return -ETIMEDOUT;
+    }
+    else if (ret != MY_GNSS_SIG)
+    {
+      printf("sigtimedwait error %d\n", ret);
+      return -1;
+    }
+
+    /* Read POS data. */
+    ret = read(fd, &posdat, sizeof(posdat));
+    if (ret < 0)
+    {
+      printf("read error\n");
+      return ret;
+    }
+    else if (ret != sizeof(posdat))
+    {
+      printf("read size error\n");
+      return ERROR;
+    }
+
+  } while (posdat.receiver.pos_fixmode == CXD56_GNSS_PVT_POSFIX_INVALID);
+
+  return OK;
+}
@@ -1,3 +1,7 @@
+#pragma once
+#include <signal.h>
+#include <stdint.h>
+
 #define CONFIG_GNSS_DEVNAME "/dev/gps"
 #define CONFIG_GNSS_ADDON_DEVNAME "/dev/gps2"
 #define GNSS_POLL_FD_NUM 1
@@ -13,6 +17,8 @@ struct gnss_positiondata_s
   double altitude;
   float velocity;
   float direction;
+  uint8_t fixmode; // CXD56_GNSS_PVT_POSFIX_2D or _3D
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC when the fix was notified
 };
 
 void double_to_dmf(double x, struct cxd56_gnss_dms_s *dmf);
@@ -22,5 +28,8 @@ int gnss_setparams(int fd);
 extern void gnss_finalize(int fd, sigset_t *mask);
 extern int gnss_initialize(sigset_t *mask);
 extern int gnss_stop(int fd);
+extern int gnss_resume(int fd);
 extern int gnss_get(int fd, sigset_t *mask, struct gnss_positiondata_s *position_data);
-extern int gnss_first_contact(int fd, sigset_t *mask);
\ No newline at end of file
+extern int gnss_first_contact(int fd, sigset_t *mask);
+extern int gnss_flush(sigset_t *mask);
+extern int gnss_wait_fix(int fd, sigset_t *mask, int timeout_ms);
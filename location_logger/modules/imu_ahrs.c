@@ -0,0 +1,178 @@
+#include <string.h>
+#include <math.h>
+
+#include "imu_ahrs.h"
+
+#define DEG_TO_RAD ((float)M_PI / 180.0f)
+
+/**
+ * @brief level from a sample at about rest, yaw 0
+ */
+
+static void level(imu_ahrs_t *ahrs, const float f[3])
+{
+  float roll = atan2f(-f[1], -f[2]);
+  float pitch = atan2f(f[0], sqrtf(f[1] * f[1] + f[2] * f[2]));
+
+  ahrs->q[0] = cosf(roll * 0.5f) * cosf(pitch * 0.5f);
+  ahrs->q[1] = sinf(roll * 0.5f) * cosf(pitch * 0.5f);
+  ahrs->q[2] = cosf(roll * 0.5f) * sinf(pitch * 0.5f);
+  ahrs->q[3] = -sinf(roll * 0.5f) * sinf(pitch * 0.5f);
+}
+
+/**
+ * @param kp proportional gain, rad/s; 1 / kp is the time constant of the
+ *        tilt correction
+ * @param ki integral gain, 0 for none
+ * @param acc_tol g, see imu_ahrs_t
+ * @param rate_max degree/s, see imu_ahrs_t
+ */
+
+void imu_ahrs_init(imu_ahrs_t *ahrs, float kp, float ki, float acc_tol,
+                   float rate_max)
+{
+  memset(ahrs, 0, sizeof(*ahrs));
+  ahrs->kp = kp;
+  ahrs->ki = ki;
+  ahrs->acc_tol = acc_tol;
+  ahrs->rate_max = rate_max * DEG_TO_RAD;
+  ahrs->q[0] = 1.0f;
+}
+
+/**
+ * @brief integrate one sample; the first one only levels the filter
+ *
+ * @param data bias compensated sample, IMUData axes and units
+ * @param dt s since the previous sample
+ */
+
+void imu_ahrs_update(imu_ahrs_t *ahrs, const IMUData *data, float dt)
+{
+  float *q = ahrs->q;
+  float f[3];
+  float w[3];
+  float v[3];
+  float e[3];
+  float r[4];
+  float norm;
+  float n;
+  int i;
+
+  imu_to_body(data, f, w);
+  norm = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+  if (!ahrs->started)
+  {
+    if (norm > 0.0f)
+    {
+      level(ahrs, f);
+      ahrs->started = true;
+    }
+
+    return;
+  }
+
+  if (fabsf(norm - CONST_G) < ahrs->acc_tol * CONST_G &&
+      w[0] * w[0] + w[1] * w[1] + w[2] * w[2] <
+      ahrs->rate_max * ahrs->rate_max)
+  {
+    /* gravity as the accelerometer would see it at rest: -z of NED in
+     * the body frame, the third row of the rotation matrix negated
+     */
+
+    v[0] = -2.0f * (q[1] * q[3] - q[0] * q[2]);
+    v[1] = -2.0f * (q[2] * q[3] + q[0] * q[1]);
+    v[2] = -(1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]));
+
+    /* e turns v towards the measurement */
+
+    n = 1.0f / norm;
+    e[0] = (f[1] * v[2] - f[2] * v[1]) * n;
+    e[1] = (f[2] * v[0] - f[0] * v[2]) * n;
+    e[2] = (f[0] * v[1] - f[1] * v[0]) * n;
+    for (i = 0; i < 3; i++)
+    {
+      ahrs->integral[i] += ahrs->ki * e[i] * dt;
+      w[i] += ahrs->kp * e[i];
+    }
+  }
+  else
+  {
+    ahrs->gyro_only++;
+  }
+
+  for (i = 0; i < 3; i++)
+  {
+    w[i] = (w[i] + ahrs->integral[i]) * (0.5f * dt);
+  }
+
+  /* q = q + q * (0, w) dt / 2, renormalised */
+
+  r[0] = q[0] - q[1] * w[0] - q[2] * w[1] - q[3] * w[2];
+  r[1] = q[1] + q[0] * w[0] + q[2] * w[2] - q[3] * w[1];
+  r[2] = q[2] + q[0] * w[1] - q[1] * w[2] + q[3] * w[0];
+  r[3] = q[3] + q[0] * w[2] + q[1] * w[1] - q[2] * w[0];
+
+  n = 1.0f / sqrtf(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+  for (i = 0; i < 4; i++)
+  {
+    q[i] = r[i] * n;
+  }
+
+  ahrs->updates++;
+}
+
+/**
+ * @brief attitude, and the linear acceleration of a sample
+ *
+ * @param data sample last given to imu_ahrs_update(), sets the linear
+ *        acceleration and the timestamp
+ * @param patt result [out]
+ * @return bool false before the first sample
+ */
+
+bool imu_ahrs_get(const imu_ahrs_t *ahrs, const IMUData *data,
+                  IMUAttitude *patt)
+{
+  const float *q = ahrs->q;
+  float f[3];
+  float w[3];
+  float r[3][3];
+  int i;
+
+  if (!ahrs->started)
+  {
+    return false;
+  }
+
+  r[0][0] = 1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3]);
+  r[0][1] = 2.0f * (q[1] * q[2] - q[0] * q[3]);
+  r[0][2] = 2.0f * (q[1] * q[3] + q[0] * q[2]);
+  r[1][0] = 2.0f * (q[1] * q[2] + q[0] * q[3]);
+  r[1][1] = 1.0f - 2.0f * (q[1] * q[1] + q[3] * q[3]);
+  r[1][2] = 2.0f * (q[2] * q[3] - q[0] * q[1]);
+  r[2][0] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+  r[2][1] = 2.0f * (q[2] * q[3] + q[0] * q[1]);
+  r[2][2] = 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]);
+
+  memcpy(patt->q, q, sizeof(patt->q));
+  patt->roll = atan2f(r[2][1], r[2][2]) / DEG_TO_RAD;
+  patt->pitch = asinf(fmaxf(-1.0f, fminf(1.0f, -r[2][0]))) / DEG_TO_RAD;
+  patt->yaw = atan2f(r[1][0], r[0][0]) / DEG_TO_RAD;
+  if (patt->yaw < 0.0f)
+  {
+    patt->yaw += 360.0f;
+  }
+
+  /* specific force plus gravity, in the body frame and in NED */
+
+  imu_to_body(data, f, w);
+  for (i = 0; i < 3; i++)
+  {
+    patt->lin_body[i] = f[i] + CONST_G * r[2][i];
+    patt->lin_ned[i] = r[i][0] * f[0] + r[i][1] * f[1] + r[i][2] * f[2];
+  }
+
+  patt->lin_ned[2] += CONST_G;
+  patt->timestamp_ns = data->timestamp_ns;
+  return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bmi270_ctrl.h"
+
+/* Mahony complementary filter: the gyro rates rotate an attitude
+ * quaternion and the angle between the measured and the estimated
+ * gravity direction is fed back into them, proportionally and through an
+ * integral that absorbs residual gyro bias.  In a vehicle the
+ * accelerometer sees gravity plus the acceleration of the ride, so
+ * samples whose |acc| is more than acc_tol g from 1 g (shocks, braking)
+ * or that turn faster than rate_max (the centripetal acceleration of a
+ * curve) are integrated from the gyro alone.  There is no heading
+ * reference, so yaw is relative to the start and drifts with the yaw
+ * rate bias.  IMUData is taken in body axes by imu_to_body().
+ */
+
+typedef struct
+{
+  float kp; // rad/s per unit of gravity direction error
+  float ki; // rad/s^2 per unit
+  float acc_tol; // g, |acc| from 1 g for the accelerometer to be used
+  float rate_max; // rad/s, |gyro| for the accelerometer to be used
+
+  bool started;
+  float q[4]; // w x y z, body to NED
+  float integral[3]; // rad/s, added to the gyro rates
+  uint32_t updates;
+  uint32_t gyro_only; // samples outside acc_tol or rate_max
+} imu_ahrs_t;
+
+void imu_ahrs_init(imu_ahrs_t *ahrs, float kp, float ki, float acc_tol,
+                   float rate_max);
+void imu_ahrs_update(imu_ahrs_t *ahrs, const IMUData *data, float dt);
+bool imu_ahrs_get(const imu_ahrs_t *ahrs, const IMUData *data,
+                  IMUAttitude *patt);
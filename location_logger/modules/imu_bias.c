@@ -0,0 +1,199 @@
+#include <string.h>
+#include <math.h>
+
+#include "imu_bias.h"
+
+/**
+ * @brief empty accumulator
+ */
+
+void imu_welford_reset(imu_welford_t *w)
+{
+  memset(w, 0, sizeof(*w));
+}
+
+/**
+ * @brief add one sample
+ *
+ * @param x one value per axis
+ */
+
+void imu_welford_add(imu_welford_t *w, const float x[IMU_BIAS_AXES])
+{
+  int i;
+  float delta;
+
+  w->n++;
+  for (i = 0; i < IMU_BIAS_AXES; i++)
+  {
+    delta = x[i] - w->mean[i];
+    w->mean[i] += delta / w->n;
+    w->m2[i] += delta * (x[i] - w->mean[i]);
+  }
+}
+
+/**
+ * @brief fold src into dst, Chan's parallel form of the update
+ *
+ * When the sum would exceed max_count samples, dst is first scaled down so
+ * that src keeps its weight and older history fades.
+ *
+ * @param max_count weight limit of dst, 0 for none
+ */
+
+void imu_welford_merge(imu_welford_t *dst, const imu_welford_t *src,
+                       uint32_t max_count)
+{
+  int i;
+  uint32_t n;
+  float scale;
+  float delta;
+
+  if (src->n == 0)
+  {
+    return;
+  }
+
+  if (max_count > src->n && dst->n + src->n > max_count)
+  {
+    scale = (float)(max_count - src->n) / dst->n;
+    for (i = 0; i < IMU_BIAS_AXES; i++)
+    {
+      dst->m2[i] *= scale;
+    }
+
+    dst->n = max_count - src->n;
+  }
+
+  n = dst->n + src->n;
+  for (i = 0; i < IMU_BIAS_AXES; i++)
+  {
+    delta = src->mean[i] - dst->mean[i];
+    dst->mean[i] += delta * src->n / n;
+    dst->m2[i] += src->m2[i] + delta * delta * ((float)dst->n * src->n / n);
+  }
+
+  dst->n = n;
+}
+
+/**
+ * @brief sample variance of one axis
+ *
+ * @return float 0 with fewer than two samples
+ */
+
+float imu_welford_variance(const imu_welford_t *w, int axis)
+{
+  return w->n > 1 ? w->m2[axis] / (w->n - 1) : 0.0f;
+}
+
+/**
+ * @brief start without an estimate
+ *
+ * @param window samples per rest test
+ * @param max_count weight limit of the estimate, in samples
+ * @param limits rest test
+ */
+
+void imu_bias_init(imu_bias_t *bias, int window, uint32_t max_count,
+                   const imu_bias_limits_t *limits)
+{
+  memset(bias, 0, sizeof(*bias));
+  bias->window = window;
+  bias->max_count = max_count;
+  bias->limits = *limits;
+}
+
+/**
+ * @brief add a sample, judging the window when it is complete
+ *
+ * @return bool true when a window at rest changed the estimate
+ */
+
+bool imu_bias_update(imu_bias_t *bias, const IMUData *data)
+{
+  int i;
+  float x[IMU_BIAS_AXES];
+  float limit;
+  float norm;
+  imu_welford_t *w = &bias->win;
+  const imu_bias_limits_t *l = &bias->limits;
+
+  x[0] = data->ax;
+  x[1] = data->ay;
+  x[2] = data->az;
+  x[3] = data->roll;
+  x[4] = data->pitch;
+  x[5] = data->yaw;
+  imu_welford_add(w, x);
+  if ((int)w->n < bias->window)
+  {
+    return false;
+  }
+
+  for (i = 0; i < IMU_BIAS_AXES; i++)
+  {
+    limit = i < 3 ? l->acc_std_max : l->gyr_std_max;
+    if (imu_welford_variance(w, i) > limit * limit ||
+        (i >= 3 && fabsf(w->mean[i]) > l->gyr_mean_max))
+    {
+      break;
+    }
+  }
+
+  norm = sqrtf(w->mean[0] * w->mean[0] + w->mean[1] * w->mean[1] +
+               w->mean[2] * w->mean[2]);
+  if (i < IMU_BIAS_AXES || fabsf(norm - CONST_G) > l->acc_norm_tol)
+  {
+    bias->rejected++;
+    imu_welford_reset(w);
+    return false;
+  }
+
+  imu_welford_merge(&bias->total, w, bias->max_count);
+  bias->last = *w;
+  bias->accepted++;
+  imu_welford_reset(w);
+  return true;
+}
+
+/**
+ * @brief current estimate
+ *
+ * The accel means include gravity; the gyro means are the gyro bias.
+ *
+ * @param mean per axis mean at rest [out]
+ * @param stddev per axis noise at rest [out], may be NULL
+ * @return bool false before the first window at rest
+ */
+
+bool imu_bias_get(const imu_bias_t *bias, IMUData *mean, IMUData *stddev)
+{
+  const imu_welford_t *t = &bias->total;
+
+  if (t->n == 0)
+  {
+    return false;
+  }
+
+  mean->ax = t->mean[0];
+  mean->ay = t->mean[1];
+  mean->az = t->mean[2];
+  mean->roll = t->mean[3];
+  mean->pitch = t->mean[4];
+  mean->yaw = t->mean[5];
+  mean->timestamp_ns = 0;
+
+  if (stddev != NULL)
+  {
+    stddev->ax = sqrtf(imu_welford_variance(t, 0));
+    stddev->ay = sqrtf(imu_welford_variance(t, 1));
+    stddev->az = sqrtf(imu_welford_variance(t, 2));
+    stddev->roll = sqrtf(imu_welford_variance(t, 3));
+    stddev->pitch = sqrtf(imu_welford_variance(t, 4));
+    stddev->yaw = sqrtf(imu_welford_variance(t, 5));
+    stddev->timestamp_ns = 0;
+  }
+
+  return true;
+}
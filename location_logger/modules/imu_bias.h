@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bmi270_ctrl.h"
+
+#define IMU_BIAS_AXES 6 // ax ay az roll pitch yaw, IMUData order
+
+/* Welford running mean and sum of squared deviations, per axis */
+
+typedef struct
+{
+  uint32_t n;
+  float mean[IMU_BIAS_AXES];
+  float m2[IMU_BIAS_AXES];
+} imu_welford_t;
+
+/* When a window of samples counts as at rest */
+
+typedef struct
+{
+  float gyr_std_max; // degree/s, spread of every gyro axis
+  float acc_std_max; // m/s^2, spread of every accel axis
+  float acc_norm_tol; // m/s^2, |mean acc| from CONST_G
+  float gyr_mean_max; // degree/s, mean of every gyro axis, rejects a turn
+} imu_bias_limits_t;
+
+/* Streaming bias estimate.  Samples are collected in windows of `window`
+ * samples and a window at rest is merged into `total`, which keeps at
+ * most `max_count` samples of weight so the estimate follows slow drift.
+ */
+
+typedef struct
+{
+  int window;
+  uint32_t max_count;
+  imu_bias_limits_t limits;
+
+  imu_welford_t win;
+  imu_welford_t total;
+  imu_welford_t last; // last window merged, e.g. for the temperature model
+  uint32_t accepted; // windows merged
+  uint32_t rejected; // windows with motion
+} imu_bias_t;
+
+void imu_welford_reset(imu_welford_t *w);
+void imu_welford_add(imu_welford_t *w, const float x[IMU_BIAS_AXES]);
+void imu_welford_merge(imu_welford_t *dst, const imu_welford_t *src,
+                       uint32_t max_count);
+float imu_welford_variance(const imu_welford_t *w, int axis);
+
+void imu_bias_init(imu_bias_t *bias, int window, uint32_t max_count,
+                   const imu_bias_limits_t *limits);
+bool imu_bias_update(imu_bias_t *bias, const IMUData *data);
+bool imu_bias_get(const imu_bias_t *bias, IMUData *mean, IMUData *stddev);
@@ -0,0 +1,153 @@
+#include <stddef.h>
+#include <math.h>
+
+#include "imu_capture.h"
+
+/**
+ * @brief set up an armed capture over caller supplied storage
+ *
+ * @param buf storage for pre + post entries
+ * @param pre samples kept before the trigger
+ * @param post samples recorded from the trigger on, at least one
+ * @param threshold |acc| that triggers, m/s^2
+ * @return int success == 0
+ */
+
+int imu_capture_init(imu_capture_t *cap, imu_capture_sample_t *buf,
+                     uint32_t pre, uint32_t post, float threshold)
+{
+  if (buf == NULL || post == 0)
+  {
+    return -1;
+  }
+
+  cap->buf = buf;
+  cap->capacity = pre + post;
+  cap->post = post;
+  cap->threshold2 = threshold * threshold;
+  cap->head = 0;
+  cap->filled = 0;
+  cap->remaining = 0;
+  cap->trigger_index = 0;
+  atomic_init(&cap->state, IMU_CAPTURE_ARMED);
+  atomic_init(&cap->triggers, 0);
+  atomic_init(&cap->missed, 0);
+  return 0;
+}
+
+/**
+ * @brief record a sample, producer side
+ *
+ * @param saturation BMI270_SAT_* flags to store with the sample
+ * @return bool true when this sample completed a window
+ */
+
+bool imu_capture_push(imu_capture_t *cap, const IMUData *data,
+                      uint8_t saturation)
+{
+  int state = atomic_load_explicit(&cap->state, memory_order_acquire);
+  bool over = data->ax * data->ax + data->ay * data->ay +
+              data->az * data->az > cap->threshold2;
+  imu_capture_sample_t *s;
+
+  if (state == IMU_CAPTURE_FROZEN)
+  {
+    if (over)
+    {
+      atomic_fetch_add_explicit(&cap->missed, 1, memory_order_relaxed);
+    }
+
+    return false;
+  }
+
+  s = &cap->buf[cap->head];
+  s->data = *data;
+  s->saturation = saturation;
+
+  if (state == IMU_CAPTURE_ARMED && over)
+  {
+    state = IMU_CAPTURE_TRIGGERED;
+    atomic_store_explicit(&cap->state, state, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cap->triggers, 1, memory_order_relaxed);
+    cap->trigger_index = cap->head;
+    cap->remaining = cap->post;
+  }
+
+  cap->head = cap->head + 1 == cap->capacity ? 0 : cap->head + 1;
+  cap->filled++;
+  if (state != IMU_CAPTURE_TRIGGERED || --cap->remaining > 0)
+  {
+    return false;
+  }
+
+  atomic_store_explicit(&cap->state, IMU_CAPTURE_FROZEN,
+                        memory_order_release);
+  return true;
+}
+
+/**
+ * @brief summary of the frozen window, consumer side
+ *
+ * @param event summary [out]
+ * @return bool false while no window is frozen
+ */
+
+bool imu_capture_get(imu_capture_t *cap, imu_capture_event_t *event)
+{
+  const imu_capture_sample_t *s;
+  float a2;
+  float peak2 = 0.0f;
+  uint32_t i;
+
+  if (atomic_load_explicit(&cap->state, memory_order_acquire) !=
+      IMU_CAPTURE_FROZEN)
+  {
+    return false;
+  }
+
+  event->count = cap->filled < cap->capacity ? cap->filled : cap->capacity;
+  event->pre = event->count - cap->post;
+  event->trigger_ns = cap->buf[cap->trigger_index].data.timestamp_ns;
+  event->saturation = 0;
+  for (i = 0; i < event->count; i++)
+  {
+    s = imu_capture_sample(cap, event, i);
+    a2 = s->data.ax * s->data.ax + s->data.ay * s->data.ay +
+         s->data.az * s->data.az;
+    peak2 = a2 > peak2 ? a2 : peak2;
+    event->saturation |= s->saturation;
+  }
+
+  event->peak = sqrtf(peak2);
+  return true;
+}
+
+/**
+ * @brief sample i of the frozen window, oldest first
+ */
+
+const imu_capture_sample_t *imu_capture_sample(const imu_capture_t *cap,
+                                               const imu_capture_event_t *event,
+                                               uint32_t i)
+{
+  uint32_t pos = cap->head + cap->capacity - event->count + i;
+
+  return &cap->buf[pos % cap->capacity];
+}
+
+/**
+ * @brief hand the window back and record a new pre-trigger history
+ */
+
+void imu_capture_release(imu_capture_t *cap)
+{
+  if (atomic_load_explicit(&cap->state, memory_order_acquire) !=
+      IMU_CAPTURE_FROZEN)
+  {
+    return;
+  }
+
+  cap->filled = 0;
+  atomic_store_explicit(&cap->state, IMU_CAPTURE_ARMED,
+                        memory_order_release);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "bmi270_ctrl.h"
+
+/* Capture states, see imu_capture_t */
+
+#define IMU_CAPTURE_ARMED 0     // recording the pre-trigger history
+#define IMU_CAPTURE_TRIGGERED 1 // recording the post-trigger samples
+#define IMU_CAPTURE_FROZEN 2    // window complete, owned by the consumer
+
+typedef struct
+{
+  IMUData data;
+  uint8_t saturation; // BMI270_SAT_* of the drain the sample came from
+} imu_capture_sample_t;
+
+/* Pre/post-trigger capture of a shock.  The producer records every sample
+ * into a circular buffer of pre + post entries.  The first sample whose
+ * |acc| exceeds the threshold starts the post-trigger count; after post
+ * more samples the buffer freezes, holding up to pre samples before the
+ * trigger and post samples from it on.  The consumer reads the frozen
+ * window and re-arms the capture with imu_capture_release(); triggers
+ * while it is frozen are counted as missed.
+ */
+
+typedef struct
+{
+  imu_capture_sample_t *buf;
+  uint32_t capacity;
+  uint32_t post;
+  float threshold2; // (m/s^2)^2, compared with |acc|^2
+
+  uint32_t head; // next slot to write, producer owned
+  uint32_t filled; // samples since the capture was armed
+  uint32_t remaining; // post-trigger samples still to record
+  uint32_t trigger_index; // slot of the trigger sample
+  atomic_int state;
+  atomic_uint triggers;
+  atomic_uint missed;
+} imu_capture_t;
+
+/* Summary of a frozen window */
+
+typedef struct
+{
+  uint32_t count; // samples in the window
+  uint32_t pre; // of which before the trigger
+  uint64_t trigger_ns; // timestamp_ns of the trigger sample
+  float peak; // largest |acc| in the window, m/s^2
+  uint8_t saturation; // BMI270_SAT_* seen in the window
+} imu_capture_event_t;
+
+int imu_capture_init(imu_capture_t *cap, imu_capture_sample_t *buf,
+                     uint32_t pre, uint32_t post, float threshold);
+bool imu_capture_push(imu_capture_t *cap, const IMUData *data,
+                      uint8_t saturation);
+bool imu_capture_get(imu_capture_t *cap, imu_capture_event_t *event);
+const imu_capture_sample_t *imu_capture_sample(const imu_capture_t *cap,
+                                               const imu_capture_event_t *event,
+                                               uint32_t i);
+void imu_capture_release(imu_capture_t *cap);
@@ -0,0 +1,122 @@
+#include <stddef.h>
+
+#include "imu_ring.h"
+
+/**
+ * @brief set up an empty ring over caller supplied storage
+ *
+ * @param buf storage for capacity entries
+ * @param capacity number of entries, a power of two
+ * @param policy IMU_RING_DROP_NEWEST or IMU_RING_OVERWRITE_OLDEST
+ * @return int success == 0
+ */
+
+int imu_ring_init(imu_ring_t *ring, IMUData *buf, uint32_t capacity,
+                  int policy)
+{
+  if (buf == NULL || capacity < 2 || (capacity & (capacity - 1)) != 0)
+  {
+    return -1;
+  }
+
+  ring->buf = buf;
+  ring->mask = capacity - 1;
+  ring->policy = policy;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->dropped, 0);
+  atomic_init(&ring->overwritten, 0);
+  return 0;
+}
+
+/**
+ * @brief append a sample, producer side
+ *
+ * @return bool false when the sample was dropped
+ */
+
+bool imu_ring_push(imu_ring_t *ring, const IMUData *data)
+{
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  if (head - tail > ring->mask)
+  {
+    if (ring->policy != IMU_RING_OVERWRITE_OLDEST)
+    {
+      atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+      return false;
+    }
+
+    /* Reclaim the oldest slot.  If the consumer got there first the ring
+     * is no longer full and the slot is free anyway.
+     */
+
+    if (atomic_compare_exchange_strong_explicit(&ring->tail, &tail, tail + 1,
+                                                memory_order_acq_rel,
+                                                memory_order_acquire))
+    {
+      atomic_fetch_add_explicit(&ring->overwritten, 1,
+                                memory_order_relaxed);
+    }
+  }
+
+  ring->buf[head & ring->mask] = *data;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return true;
+}
+
+/**
+ * @brief take the oldest sample, consumer side
+ *
+ * @return bool false when the ring is empty
+ */
+
+bool imu_ring_pop(imu_ring_t *ring, IMUData *data)
+{
+  unsigned int head;
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  while (1)
+  {
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail)
+    {
+      return false;
+    }
+
+    *data = ring->buf[tail & ring->mask];
+
+    /* Only the producer can move the tail under us, by reclaiming this
+     * slot; the copy may then be torn, so read the next one instead.
+     */
+
+    if (atomic_compare_exchange_strong_explicit(&ring->tail, &tail, tail + 1,
+                                                memory_order_acq_rel,
+                                                memory_order_acquire))
+    {
+      return true;
+    }
+  }
+}
+
+/**
+ * @brief number of queued samples
+ */
+
+uint32_t imu_ring_count(imu_ring_t *ring)
+{
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+  return head - tail;
+}
+
+void imu_ring_get_stats(imu_ring_t *ring, imu_ring_stats_t *stats)
+{
+  stats->count = imu_ring_count(ring);
+  stats->dropped = atomic_load_explicit(&ring->dropped,
+                                        memory_order_relaxed);
+  stats->overwritten = atomic_load_explicit(&ring->overwritten,
+                                            memory_order_relaxed);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "bmi270_ctrl.h"
+
+/* What imu_ring_push() does when the ring is full */
+
+#define IMU_RING_DROP_NEWEST 0     // keep the queued samples, drop the new one
+#define IMU_RING_OVERWRITE_OLDEST 1 // keep the new sample, drop the oldest
+
+/* Single-producer/single-consumer ring of IMUData.  Indices run freely and
+ * are masked on access, so the capacity must be a power of two.  The
+ * producer never waits; in overwrite mode the consumer retries a pop that
+ * raced with the producer reclaiming the oldest slot.
+ */
+
+typedef struct
+{
+  IMUData *buf;
+  uint32_t mask;
+  int policy;
+
+  atomic_uint head;        // next slot to write, producer owned
+  atomic_uint tail;        // next slot to read, consumer owned
+  atomic_uint dropped;     // new samples discarded (DROP_NEWEST)
+  atomic_uint overwritten; // old samples discarded (OVERWRITE_OLDEST)
+} imu_ring_t;
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t dropped;
+  uint32_t overwritten;
+} imu_ring_stats_t;
+
+int imu_ring_init(imu_ring_t *ring, IMUData *buf, uint32_t capacity,
+                  int policy);
+bool imu_ring_push(imu_ring_t *ring, const IMUData *data);
+bool imu_ring_pop(imu_ring_t *ring, IMUData *data);
+uint32_t imu_ring_count(imu_ring_t *ring);
+void imu_ring_get_stats(imu_ring_t *ring, imu_ring_stats_t *stats);
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "imu_tempco.h"
+
+/* Stored image: header, then IMU_TEMPCO_BINS imu_tempco_bin_t */
+
+#define IMU_TEMPCO_MAGIC 0x31435447 // "GTC1"
+#define IMU_TEMPCO_PATH_SIZE 64
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t bins;
+  uint16_t bin_size;
+  float t_min;
+  float bin_c;
+} imu_tempco_header_t;
+
+/**
+ * @brief refit the line through the occupied bins
+ */
+
+static void fit(imu_tempco_t *tc)
+{
+  int i;
+  int k;
+  float lo = 0.0f;
+  float hi = 0.0f;
+  float dt;
+  float stt = 0.0f;
+  float stb[IMU_TEMPCO_AXES] = {0};
+
+  tc->bins = 0;
+  tc->t_ref = 0.0f;
+  memset(tc->offset, 0, sizeof(tc->offset));
+  memset(tc->slope, 0, sizeof(tc->slope));
+  for (k = 0; k < IMU_TEMPCO_BINS; k++)
+  {
+    if (tc->bin[k].count == 0)
+    {
+      continue;
+    }
+
+    lo = tc->bins == 0 ? tc->bin[k].temp_c : lo;
+    hi = tc->bin[k].temp_c;
+    tc->bins++;
+    tc->t_ref += tc->bin[k].temp_c;
+    for (i = 0; i < IMU_TEMPCO_AXES; i++)
+    {
+      tc->offset[i] += tc->bin[k].bias[i];
+    }
+  }
+
+  if (tc->bins == 0)
+  {
+    return;
+  }
+
+  tc->t_ref /= tc->bins;
+  for (i = 0; i < IMU_TEMPCO_AXES; i++)
+  {
+    tc->offset[i] /= tc->bins;
+  }
+
+  if (hi - lo < IMU_TEMPCO_MIN_SPAN_C)
+  {
+    return;
+  }
+
+  for (k = 0; k < IMU_TEMPCO_BINS; k++)
+  {
+    if (tc->bin[k].count == 0)
+    {
+      continue;
+    }
+
+    dt = tc->bin[k].temp_c - tc->t_ref;
+    stt += dt * dt;
+    for (i = 0; i < IMU_TEMPCO_AXES; i++)
+    {
+      stb[i] += dt * (tc->bin[k].bias[i] - tc->offset[i]);
+    }
+  }
+
+  for (i = 0; i < IMU_TEMPCO_AXES; i++)
+  {
+    tc->slope[i] = stb[i] / stt;
+  }
+}
+
+/**
+ * @brief start with no measurements, i.e. no compensation
+ */
+
+void imu_tempco_init(imu_tempco_t *tc)
+{
+  memset(tc, 0, sizeof(*tc));
+}
+
+/**
+ * @brief add a gyro bias measured at rest and refit
+ *
+ * @param temp_c die temperature during the measurement
+ * @param bias mean rate at rest, degree/s
+ * @return bool false when temp_c is outside the bins
+ */
+
+bool imu_tempco_add(imu_tempco_t *tc, float temp_c,
+                    const float bias[IMU_TEMPCO_AXES])
+{
+  int i;
+  int k = (int)floorf((temp_c - IMU_TEMPCO_T_MIN) / IMU_TEMPCO_BIN_C);
+  imu_tempco_bin_t *b;
+
+  if (k < 0 || k >= IMU_TEMPCO_BINS)
+  {
+    return false;
+  }
+
+  b = &tc->bin[k];
+  if (b->count < IMU_TEMPCO_BIN_MAX)
+  {
+    b->count++;
+  }
+
+  b->temp_c += (temp_c - b->temp_c) / b->count;
+  for (i = 0; i < IMU_TEMPCO_AXES; i++)
+  {
+    b->bias[i] += (bias[i] - b->bias[i]) / b->count;
+  }
+
+  fit(tc);
+  tc->changed = true;
+  return true;
+}
+
+/**
+ * @brief modelled gyro bias at a temperature
+ *
+ * @param bias degree/s [out], zero without measurements
+ * @return bool false without measurements
+ */
+
+bool imu_tempco_get(const imu_tempco_t *tc, float temp_c,
+                    float bias[IMU_TEMPCO_AXES])
+{
+  int i;
+  float dt = temp_c - tc->t_ref;
+
+  for (i = 0; i < IMU_TEMPCO_AXES; i++)
+  {
+    bias[i] = tc->offset[i] + tc->slope[i] * dt;
+  }
+
+  return tc->bins > 0;
+}
+
+/**
+ * @brief restore the bins stored by imu_tempco_save()
+ *
+ * @return int success == 0, -1 when there is no usable file; tc is then
+ *         left empty
+ */
+
+int imu_tempco_load(imu_tempco_t *tc, const char *path)
+{
+  int fd;
+  int ok;
+  imu_tempco_header_t h;
+
+  imu_tempco_init(tc);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  ok = read(fd, &h, sizeof(h)) == sizeof(h) &&
+       h.magic == IMU_TEMPCO_MAGIC && h.bins == IMU_TEMPCO_BINS &&
+       h.bin_size == sizeof(imu_tempco_bin_t) &&
+       h.t_min == IMU_TEMPCO_T_MIN && h.bin_c == IMU_TEMPCO_BIN_C &&
+       read(fd, tc->bin, sizeof(tc->bin)) == sizeof(tc->bin);
+  close(fd);
+  if (!ok)
+  {
+    imu_tempco_init(tc);
+    return -1;
+  }
+
+  fit(tc);
+  return 0;
+}
+
+/**
+ * @brief store the bins, replacing the file only once fully written
+ *
+ * @return int success == 0
+ */
+
+int imu_tempco_save(imu_tempco_t *tc, const char *path)
+{
+  int fd;
+  int ok;
+  char tmp[IMU_TEMPCO_PATH_SIZE];
+  imu_tempco_header_t h =
+  {
+    IMU_TEMPCO_MAGIC, IMU_TEMPCO_BINS, sizeof(imu_tempco_bin_t),
+    IMU_TEMPCO_T_MIN, IMU_TEMPCO_BIN_C
+  };
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  ok = write(fd, &h, sizeof(h)) == sizeof(h) &&
+       write(fd, tc->bin, sizeof(tc->bin)) == sizeof(tc->bin);
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmp, path) < 0)
+  {
+    unlink(tmp);
+    return -1;
+  }
+
+  tc->changed = false;
+  return 0;
+}
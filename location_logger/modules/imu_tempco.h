@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IMU_TEMPCO_AXES 3 // roll pitch yaw, degree/s
+#define IMU_TEMPCO_BINS 48
+#define IMU_TEMPCO_T_MIN -30.0f // degC, lower edge of bin 0
+#define IMU_TEMPCO_BIN_C 2.0f // degC per bin, -30 .. 66 degC
+#define IMU_TEMPCO_BIN_MAX 32 // windows per bin mean, older ones fade
+#define IMU_TEMPCO_MIN_SPAN_C 4.0f // spread of the bins before a slope is fitted
+
+/* Gyro bias as a function of die temperature.  Bias measurements at rest
+ * are averaged into temperature bins, so a long stay at one temperature
+ * does not wash out the others, and a line is fitted per axis through the
+ * bin means with every occupied bin weighted alike.  Until the bins span
+ * IMU_TEMPCO_MIN_SPAN_C the model is their mean with no slope.  The bins
+ * are what is stored; the line is refitted on every update and on load.
+ */
+
+typedef struct
+{
+  float temp_c; // mean temperature of the windows
+  float bias[IMU_TEMPCO_AXES]; // degree/s
+  uint16_t count; // windows in the mean, at most IMU_TEMPCO_BIN_MAX
+} imu_tempco_bin_t;
+
+typedef struct
+{
+  imu_tempco_bin_t bin[IMU_TEMPCO_BINS];
+
+  /* fit: bias(t) = offset + slope * (t - t_ref) */
+
+  float t_ref; // degC, mean of the occupied bins
+  float offset[IMU_TEMPCO_AXES];
+  float slope[IMU_TEMPCO_AXES]; // degree/s per K
+  int bins; // occupied
+  bool changed; // since the last imu_tempco_save()
+} imu_tempco_t;
+
+void imu_tempco_init(imu_tempco_t *tc);
+bool imu_tempco_add(imu_tempco_t *tc, float temp_c,
+                    const float bias[IMU_TEMPCO_AXES]);
+bool imu_tempco_get(const imu_tempco_t *tc, float temp_c,
+                    float bias[IMU_TEMPCO_AXES]);
+int imu_tempco_load(imu_tempco_t *tc, const char *path);
+int imu_tempco_save(imu_tempco_t *tc, const char *path);
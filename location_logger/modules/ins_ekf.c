@@ -0,0 +1,653 @@
+#include <string.h>
+#include <math.h>
+
+#include "ins_ekf.h"
+
+#define N INS_EKF_STATES
+#define M INS_EKF_MEAS_MAX
+
+#define WGS84_A 6378137.0
+#define WGS84_E2 6.69437999014e-3
+#define DEG_TO_RAD (M_PI / 180.0)
+
+static void quat_to_dcm(const float q[4], float r[3][3])
+{
+  float w = q[0];
+  float x = q[1];
+  float y = q[2];
+  float z = q[3];
+
+  r[0][0] = 1.0f - 2.0f * (y * y + z * z);
+  r[0][1] = 2.0f * (x * y - w * z);
+  r[0][2] = 2.0f * (x * z + w * y);
+  r[1][0] = 2.0f * (x * y + w * z);
+  r[1][1] = 1.0f - 2.0f * (x * x + z * z);
+  r[1][2] = 2.0f * (y * z - w * x);
+  r[2][0] = 2.0f * (x * z - w * y);
+  r[2][1] = 2.0f * (y * z + w * x);
+  r[2][2] = 1.0f - 2.0f * (x * x + y * y);
+}
+
+static void quat_from_euler(float q[4], float roll, float pitch, float yaw)
+{
+  float cr = cosf(roll * 0.5f);
+  float sr = sinf(roll * 0.5f);
+  float cp = cosf(pitch * 0.5f);
+  float sp = sinf(pitch * 0.5f);
+  float cy = cosf(yaw * 0.5f);
+  float sy = sinf(yaw * 0.5f);
+
+  q[0] = cr * cp * cy + sr * sp * sy;
+  q[1] = sr * cp * cy - cr * sp * sy;
+  q[2] = cr * sp * cy + sr * cp * sy;
+  q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+/**
+ * @brief q = q * exp(th / 2), a rotation by th in the body frame
+ */
+
+static void quat_rotate(float q[4], const float th[3])
+{
+  float a2 = th[0] * th[0] + th[1] * th[1] + th[2] * th[2];
+  float d[4];
+  float r[4];
+  float s;
+  float n;
+
+  /* second order series, exact to float precision for the angles of a
+   * sample period or a correction
+   */
+
+  d[0] = 1.0f - a2 / 8.0f;
+  s = 0.5f - a2 / 48.0f;
+  d[1] = th[0] * s;
+  d[2] = th[1] * s;
+  d[3] = th[2] * s;
+
+  r[0] = q[0] * d[0] - q[1] * d[1] - q[2] * d[2] - q[3] * d[3];
+  r[1] = q[0] * d[1] + q[1] * d[0] + q[2] * d[3] - q[3] * d[2];
+  r[2] = q[0] * d[2] - q[1] * d[3] + q[2] * d[0] + q[3] * d[1];
+  r[3] = q[0] * d[3] + q[1] * d[2] - q[2] * d[1] + q[3] * d[0];
+
+  n = 1.0f / sqrtf(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+  q[0] = r[0] * n;
+  q[1] = r[1] * n;
+  q[2] = r[2] * n;
+  q[3] = r[3] * n;
+}
+
+/**
+ * @brief put the reference point at lat, lon (radians) and alt
+ */
+
+static void set_reference(ins_ekf_t *ekf, double lat, double lon,
+                          double alt)
+{
+  double s = sin(lat);
+  double d = 1.0 - WGS84_E2 * s * s;
+
+  ekf->ref_lat = lat;
+  ekf->ref_lon = lon;
+  ekf->ref_alt = alt;
+  ekf->m_per_rad_n = WGS84_A * (1.0 - WGS84_E2) / (d * sqrt(d)) + alt;
+  ekf->m_per_rad_e = (WGS84_A / sqrt(d) + alt) * cos(lat);
+}
+
+static void fix_to_ned(const ins_ekf_t *ekf, const ins_ekf_fix_t *fix,
+                       float ned[3])
+{
+  double dlon = fix->longitude * DEG_TO_RAD - ekf->ref_lon;
+
+  if (dlon > M_PI)
+  {
+    dlon -= 2.0 * M_PI;
+  }
+  else if (dlon < -M_PI)
+  {
+    dlon += 2.0 * M_PI;
+  }
+
+  ned[0] = (float)((fix->latitude * DEG_TO_RAD - ekf->ref_lat) *
+                   ekf->m_per_rad_n);
+  ned[1] = (float)(dlon * ekf->m_per_rad_e);
+  ned[2] = (float)(ekf->ref_alt - fix->altitude);
+}
+
+/**
+ * @brief move the reference point to the current position
+ */
+
+static void rebase(ins_ekf_t *ekf)
+{
+  if (fabsf(ekf->p[0]) < INS_EKF_REBASE_M &&
+      fabsf(ekf->p[1]) < INS_EKF_REBASE_M)
+  {
+    return;
+  }
+
+  set_reference(ekf, ekf->ref_lat + ekf->p[0] / ekf->m_per_rad_n,
+                ekf->ref_lon + ekf->p[1] / ekf->m_per_rad_e,
+                ekf->ref_alt - ekf->p[2]);
+  memset(ekf->p, 0, sizeof(ekf->p));
+}
+
+/**
+ * @brief out = Phi * in for the transition matrix of a sample period
+ *
+ * Phi is the identity except for the blocks
+ *   p/v = I dt, v/th = a, v/ba = b, th/th = t, th/bg = -I dt
+ * so only those are multiplied.  in(r, c) is in[r * rs + c * cs], which
+ * reads in transposed when rs == 1.
+ */
+
+static void phi_mul(const float a[3][3], const float b[3][3],
+                    const float t[3][3], float dt, const float *in,
+                    int rs, int cs, float out[N][N])
+{
+  int c;
+  int i;
+  const float *col;
+
+#define IN(r) col[(r) * rs]
+
+  for (c = 0; c < N; c++)
+  {
+    col = in + c * cs;
+    for (i = 0; i < 3; i++)
+    {
+      out[INS_EKF_P + i][c] = IN(INS_EKF_P + i) + dt * IN(INS_EKF_V + i);
+      out[INS_EKF_V + i][c] = IN(INS_EKF_V + i) +
+                              a[i][0] * IN(INS_EKF_TH) +
+                              a[i][1] * IN(INS_EKF_TH + 1) +
+                              a[i][2] * IN(INS_EKF_TH + 2) +
+                              b[i][0] * IN(INS_EKF_BA) +
+                              b[i][1] * IN(INS_EKF_BA + 1) +
+                              b[i][2] * IN(INS_EKF_BA + 2);
+      out[INS_EKF_TH + i][c] = t[i][0] * IN(INS_EKF_TH) +
+                               t[i][1] * IN(INS_EKF_TH + 1) +
+                               t[i][2] * IN(INS_EKF_TH + 2) -
+                               dt * IN(INS_EKF_BG + i);
+      out[INS_EKF_BA + i][c] = IN(INS_EKF_BA + i);
+      out[INS_EKF_BG + i][c] = IN(INS_EKF_BG + i);
+    }
+  }
+
+#undef IN
+}
+
+static void symmetrize(float p[N][N])
+{
+  int r;
+  int c;
+  float m;
+
+  for (r = 0; r < N; r++)
+  {
+    for (c = r + 1; c < N; c++)
+    {
+      m = 0.5f * (p[r][c] + p[c][r]);
+      p[r][c] = m;
+      p[c][r] = m;
+    }
+  }
+}
+
+/**
+ * @brief in place lower Cholesky factor of the m x m matrix s
+ *
+ * @return int success == 0, -1 when s is not positive definite
+ */
+
+static int cholesky(float s[M][M], int m)
+{
+  int i;
+  int j;
+  int k;
+  float sum;
+
+  for (j = 0; j < m; j++)
+  {
+    sum = s[j][j];
+    for (k = 0; k < j; k++)
+    {
+      sum -= s[j][k] * s[j][k];
+    }
+
+    if (sum <= 0.0f)
+    {
+      return -1;
+    }
+
+    s[j][j] = sqrtf(sum);
+    for (i = j + 1; i < m; i++)
+    {
+      sum = s[i][j];
+      for (k = 0; k < j; k++)
+      {
+        sum -= s[i][k] * s[j][k];
+      }
+
+      s[i][j] = sum / s[j][j];
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief x = (L L^T)^-1 x
+ */
+
+static void cholesky_solve(const float l[M][M], int m, float x[M])
+{
+  int i;
+  int k;
+
+  for (i = 0; i < m; i++)
+  {
+    for (k = 0; k < i; k++)
+    {
+      x[i] -= l[i][k] * x[k];
+    }
+
+    x[i] /= l[i][i];
+  }
+
+  for (i = m - 1; i >= 0; i--)
+  {
+    for (k = i + 1; k < m; k++)
+    {
+      x[i] -= l[k][i] * x[k];
+    }
+
+    x[i] /= l[i][i];
+  }
+}
+
+/**
+ * @brief restart position and velocity at a fix, keeping attitude and
+ *        biases
+ */
+
+static void reset_position(ins_ekf_t *ekf, const ins_ekf_fix_t *fix)
+{
+  const ins_ekf_config_t *c = &ekf->config;
+  int i;
+  int k;
+
+  set_reference(ekf, fix->latitude * DEG_TO_RAD,
+                fix->longitude * DEG_TO_RAD, fix->altitude);
+  memset(ekf->p, 0, sizeof(ekf->p));
+  ekf->v[0] = fix->vn;
+  ekf->v[1] = fix->ve;
+  ekf->v[2] = 0.0f;
+
+  for (i = INS_EKF_P; i < INS_EKF_TH; i++)
+  {
+    for (k = 0; k < N; k++)
+    {
+      ekf->P[i][k] = 0.0f;
+      ekf->P[k][i] = 0.0f;
+    }
+  }
+
+  ekf->P[0][0] = c->pos_h_std * c->pos_h_std;
+  ekf->P[1][1] = c->pos_h_std * c->pos_h_std;
+  ekf->P[2][2] = c->pos_v_std * c->pos_v_std;
+  for (i = INS_EKF_V; i < INS_EKF_V + 3; i++)
+  {
+    ekf->P[i][i] = c->init_vel_std * c->init_vel_std;
+  }
+}
+
+/**
+ * @brief noise and start uncertainty for a BMI270 in a road vehicle and
+ *        a 1Hz GNSS fix
+ */
+
+void ins_ekf_default_config(ins_ekf_config_t *config)
+{
+  config->acc_noise = 0.05f;
+  config->gyr_noise = 0.002f;
+  config->acc_bias_walk = 0.002f;
+  config->gyr_bias_walk = 2e-5f;
+  config->pos_h_std = 3.0f;
+  config->pos_v_std = 6.0f;
+  config->vel_std = 0.3f;
+  config->gate = 20.0f; // chi-square, 5 degrees of freedom, 99.9%
+  config->init_vel_std = 1.0f;
+  config->init_tilt_std = 0.035f;
+  config->init_acc_bias_std = 0.3f;
+  config->init_gyr_bias_std = 0.01f;
+}
+
+/**
+ * @brief filter waiting for its first fix
+ */
+
+void ins_ekf_init(ins_ekf_t *ekf, const ins_ekf_config_t *config)
+{
+  memset(ekf, 0, sizeof(*ekf));
+  ekf->config = *config;
+  ekf->q[0] = 1.0f;
+}
+
+/**
+ * @brief start at a fix, level from an IMU sample at about rest
+ *
+ * @param data IMU sample, its acceleration gives roll and pitch
+ * @param yaw rad, e.g. course over ground or magnetic heading
+ * @param yaw_std rad, its uncertainty
+ * @return int success == 0
+ */
+
+int ins_ekf_start(ins_ekf_t *ekf, const ins_ekf_fix_t *fix,
+                  const IMUData *data, float yaw, float yaw_std)
+{
+  const ins_ekf_config_t *c = &ekf->config;
+  float f[3];
+  float w[3];
+  int i;
+
+  imu_to_body(data, f, w);
+  if (f[0] == 0.0f && f[1] == 0.0f && f[2] == 0.0f)
+  {
+    return -1;
+  }
+
+  memset(ekf->P, 0, sizeof(ekf->P));
+  memset(ekf->ba, 0, sizeof(ekf->ba));
+  memset(ekf->bg, 0, sizeof(ekf->bg));
+  quat_from_euler(ekf->q, atan2f(-f[1], -f[2]),
+                  atan2f(f[0], sqrtf(f[1] * f[1] + f[2] * f[2])), yaw);
+  reset_position(ekf, fix);
+
+  ekf->P[INS_EKF_TH][INS_EKF_TH] = c->init_tilt_std * c->init_tilt_std;
+  ekf->P[INS_EKF_TH + 1][INS_EKF_TH + 1] =
+    c->init_tilt_std * c->init_tilt_std;
+  ekf->P[INS_EKF_TH + 2][INS_EKF_TH + 2] = yaw_std * yaw_std;
+  for (i = 0; i < 3; i++)
+  {
+    ekf->P[INS_EKF_BA + i][INS_EKF_BA + i] =
+      c->init_acc_bias_std * c->init_acc_bias_std;
+    ekf->P[INS_EKF_BG + i][INS_EKF_BG + i] =
+      c->init_gyr_bias_std * c->init_gyr_bias_std;
+  }
+
+  ekf->rejects_in_row = 0;
+  ekf->started = true;
+  return 0;
+}
+
+/**
+ * @brief propagate by one IMU sample
+ *
+ * @param data bias compensated sample, IMUData axes and units
+ * @param dt s since the previous sample
+ */
+
+void ins_ekf_predict(ins_ekf_t *ekf, const IMUData *data, float dt)
+{
+  const ins_ekf_config_t *c = &ekf->config;
+  float f[3];
+  float w[3];
+  float r[3][3];
+  float acc[3];
+  float th[3];
+  float a[3][3];
+  float b[3][3];
+  float t[3][3];
+  float qv;
+  float qa;
+  float qba;
+  float qbg;
+  int i;
+
+  if (!ekf->started || dt <= 0.0f)
+  {
+    return;
+  }
+
+  imu_to_body(data, f, w);
+  for (i = 0; i < 3; i++)
+  {
+    f[i] -= ekf->ba[i];
+    w[i] -= ekf->bg[i];
+  }
+
+  /* nominal state */
+
+  quat_to_dcm(ekf->q, r);
+  for (i = 0; i < 3; i++)
+  {
+    acc[i] = r[i][0] * f[0] + r[i][1] * f[1] + r[i][2] * f[2];
+  }
+
+  acc[2] += CONST_G;
+  for (i = 0; i < 3; i++)
+  {
+    ekf->p[i] += ekf->v[i] * dt + 0.5f * acc[i] * dt * dt;
+    ekf->v[i] += acc[i] * dt;
+    th[i] = w[i] * dt;
+  }
+
+  quat_rotate(ekf->q, th);
+
+  /* error transition blocks: a = -R [f]x dt, b = -R dt, t = I - [w]x dt */
+
+  for (i = 0; i < 3; i++)
+  {
+    a[i][0] = -dt * (r[i][1] * f[2] - r[i][2] * f[1]);
+    a[i][1] = -dt * (r[i][2] * f[0] - r[i][0] * f[2]);
+    a[i][2] = -dt * (r[i][0] * f[1] - r[i][1] * f[0]);
+    b[i][0] = -dt * r[i][0];
+    b[i][1] = -dt * r[i][1];
+    b[i][2] = -dt * r[i][2];
+  }
+
+  t[0][0] = 1.0f;
+  t[0][1] = w[2] * dt;
+  t[0][2] = -w[1] * dt;
+  t[1][0] = -w[2] * dt;
+  t[1][1] = 1.0f;
+  t[1][2] = w[0] * dt;
+  t[2][0] = w[1] * dt;
+  t[2][1] = -w[0] * dt;
+  t[2][2] = 1.0f;
+
+  /* P = Phi (Phi P)^T + Q, P symmetric */
+
+  phi_mul(a, b, t, dt, (const float *)ekf->P, N, 1, ekf->tmp);
+  phi_mul(a, b, t, dt, (const float *)ekf->tmp, 1, N, ekf->P);
+
+  qv = c->acc_noise * c->acc_noise * dt;
+  qa = c->gyr_noise * c->gyr_noise * dt;
+  qba = c->acc_bias_walk * c->acc_bias_walk * dt;
+  qbg = c->gyr_bias_walk * c->gyr_bias_walk * dt;
+  for (i = 0; i < 3; i++)
+  {
+    ekf->P[INS_EKF_V + i][INS_EKF_V + i] += qv;
+    ekf->P[INS_EKF_TH + i][INS_EKF_TH + i] += qa;
+    ekf->P[INS_EKF_BA + i][INS_EKF_BA + i] += qba;
+    ekf->P[INS_EKF_BG + i][INS_EKF_BG + i] += qbg;
+  }
+
+  symmetrize(ekf->P);
+  rebase(ekf);
+}
+
+/**
+ * @brief correct with a GNSS fix
+ *
+ * The fix must be for the time of the last predicted sample.  A fix whose
+ * innovation fails the chi-square gate is dropped; INS_EKF_MAX_REJECTS in
+ * a row restart position and velocity at the fix.
+ *
+ * @return int 0 applied, 1 rejected, -1 not started
+ */
+
+int ins_ekf_update(ins_ekf_t *ekf, const ins_ekf_fix_t *fix)
+{
+  const ins_ekf_config_t *c = &ekf->config;
+  int idx[M];
+  float z[M];
+  float var[M];
+  float y[M];
+  float u[M];
+  float s[M][M];
+  float hp[M][N];
+  float k[N][M];
+  float dx[N];
+  float ned[3];
+  float x;
+  int m = 0;
+  int i;
+  int j;
+  int n;
+
+  if (!ekf->started)
+  {
+    return -1;
+  }
+
+  fix_to_ned(ekf, fix, ned);
+  for (i = 0; i < 3; i++)
+  {
+    if (i == 2 && !fix->altitude_valid)
+    {
+      continue;
+    }
+
+    idx[m] = INS_EKF_P + i;
+    z[m] = ned[i];
+    var[m] = i < 2 ? c->pos_h_std * c->pos_h_std :
+                     c->pos_v_std * c->pos_v_std;
+    m++;
+  }
+
+  idx[m] = INS_EKF_V;
+  z[m] = fix->vn;
+  var[m++] = c->vel_std * c->vel_std;
+  idx[m] = INS_EKF_V + 1;
+  z[m] = fix->ve;
+  var[m++] = c->vel_std * c->vel_std;
+
+  for (i = 0; i < m; i++)
+  {
+    x = idx[i] < INS_EKF_V ? ekf->p[idx[i] - INS_EKF_P] :
+                             ekf->v[idx[i] - INS_EKF_V];
+    y[i] = z[i] - x;
+    memcpy(hp[i], ekf->P[idx[i]], sizeof(hp[i]));
+    for (j = 0; j < m; j++)
+    {
+      s[i][j] = ekf->P[idx[i]][idx[j]];
+    }
+
+    s[i][i] += var[i];
+  }
+
+  if (cholesky(s, m) < 0)
+  {
+    return 1;
+  }
+
+  /* gate on y^T S^-1 y */
+
+  memcpy(u, y, sizeof(u));
+  cholesky_solve(s, m, u);
+  ekf->nis = 0.0f;
+  for (i = 0; i < m; i++)
+  {
+    ekf->nis += y[i] * u[i];
+  }
+
+  if (c->gate > 0.0f && ekf->nis > c->gate)
+  {
+    ekf->rejects++;
+    if (++ekf->rejects_in_row >= INS_EKF_MAX_REJECTS)
+    {
+      reset_position(ekf, fix);
+      ekf->resets++;
+      ekf->rejects_in_row = 0;
+    }
+
+    return 1;
+  }
+
+  /* K = P H^T S^-1, one row per state; dx = K y, P = P - K H P */
+
+  for (n = 0; n < N; n++)
+  {
+    for (i = 0; i < m; i++)
+    {
+      u[i] = hp[i][n];
+    }
+
+    cholesky_solve(s, m, u);
+    dx[n] = 0.0f;
+    for (i = 0; i < m; i++)
+    {
+      k[n][i] = u[i];
+      dx[n] += u[i] * y[i];
+    }
+  }
+
+  for (n = 0; n < N; n++)
+  {
+    for (j = 0; j < N; j++)
+    {
+      x = 0.0f;
+      for (i = 0; i < m; i++)
+      {
+        x += k[n][i] * hp[i][j];
+      }
+
+      ekf->P[n][j] -= x;
+    }
+  }
+
+  symmetrize(ekf->P);
+
+  /* fold the error into the nominal state */
+
+  for (i = 0; i < 3; i++)
+  {
+    ekf->p[i] += dx[INS_EKF_P + i];
+    ekf->v[i] += dx[INS_EKF_V + i];
+    ekf->ba[i] += dx[INS_EKF_BA + i];
+    ekf->bg[i] += dx[INS_EKF_BG + i];
+  }
+
+  quat_rotate(ekf->q, &dx[INS_EKF_TH]);
+  ekf->updates++;
+  ekf->rejects_in_row = 0;
+  return 0;
+}
+
+/**
+ * @brief current estimate
+ */
+
+void ins_ekf_get(const ins_ekf_t *ekf, ins_ekf_state_t *state)
+{
+  const float *q = ekf->q;
+
+  state->latitude = (ekf->ref_lat + ekf->p[0] / ekf->m_per_rad_n) /
+                    DEG_TO_RAD;
+  state->longitude = (ekf->ref_lon + ekf->p[1] / ekf->m_per_rad_e) /
+                     DEG_TO_RAD;
+  state->altitude = ekf->ref_alt - ekf->p[2];
+  memcpy(state->v, ekf->v, sizeof(state->v));
+  state->roll = atan2f(2.0f * (q[0] * q[1] + q[2] * q[3]),
+                       1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]));
+  state->pitch = asinf(fmaxf(-1.0f, fminf(1.0f,
+                       2.0f * (q[0] * q[2] - q[3] * q[1]))));
+  state->yaw = atan2f(2.0f * (q[0] * q[3] + q[1] * q[2]),
+                      1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3]));
+  memcpy(state->acc_bias, ekf->ba, sizeof(state->acc_bias));
+  memcpy(state->gyr_bias, ekf->bg, sizeof(state->gyr_bias));
+  state->pos_std = sqrtf(ekf->P[0][0] + ekf->P[1][1]);
+  state->vel_std = sqrtf(ekf->P[3][3] + ekf->P[4][4]);
+  state->yaw_std = sqrtf(ekf->P[INS_EKF_TH + 2][INS_EKF_TH + 2]);
+}
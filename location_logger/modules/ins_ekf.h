@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bmi270_ctrl.h"
+
+/* Error state, in this order */
+
+#define INS_EKF_P 0 // position, m, NED from the reference point
+#define INS_EKF_V 3 // velocity, m/s, NED
+#define INS_EKF_TH 6 // attitude, rad, body frame
+#define INS_EKF_BA 9 // accelerometer bias, m/s^2, body frame
+#define INS_EKF_BG 12 // gyroscope bias, rad/s, body frame
+#define INS_EKF_STATES 15
+#define INS_EKF_MEAS_MAX 5 // north, east, down, vnorth, veast
+
+#define INS_EKF_REBASE_M 2000.0f // move the reference point this far out
+#define INS_EKF_MAX_REJECTS 5 // gated fixes in a row before a reset
+
+/* Loosely coupled GNSS/INS error-state Kalman filter.  The nominal state
+ * (position, velocity, attitude quaternion, accelerometer and gyroscope
+ * biases) is propagated with every IMU sample and the 15 element error
+ * state covariance with it; each GNSS fix corrects it through position
+ * and horizontal velocity, the error is folded into the nominal state and
+ * reset.  IMUData is taken in body axes by imu_to_body().  Position is
+ * kept in float32 NED metres from a reference point that follows the
+ * vehicle, so the precision does not depend on where on earth it is.  No heap; all
+ * matrices are fixed size members.
+ */
+
+typedef struct
+{
+  float acc_noise; // m/s^2/sqrt(Hz), incl. vibration
+  float gyr_noise; // rad/s/sqrt(Hz)
+  float acc_bias_walk; // m/s^3/sqrt(Hz)
+  float gyr_bias_walk; // rad/s^2/sqrt(Hz)
+  float pos_h_std; // m, GNSS horizontal position
+  float pos_v_std; // m, GNSS altitude
+  float vel_std; // m/s, GNSS horizontal velocity
+  float gate; // chi-square limit of a fix, 0 for none
+  float init_vel_std; // m/s
+  float init_tilt_std; // rad, roll and pitch from gravity
+  float init_acc_bias_std; // m/s^2
+  float init_gyr_bias_std; // rad/s
+} ins_ekf_config_t;
+
+typedef struct
+{
+  double latitude; // degree
+  double longitude;
+  double altitude; // m
+  float vn; // m/s
+  float ve;
+  bool altitude_valid; // 3D fix
+} ins_ekf_fix_t;
+
+typedef struct
+{
+  double latitude; // degree
+  double longitude;
+  double altitude; // m
+  float v[3]; // m/s, NED
+  float roll; // rad, body to NED
+  float pitch;
+  float yaw; // clockwise from north
+  float acc_bias[3]; // m/s^2, body frame
+  float gyr_bias[3]; // rad/s, body frame
+  float pos_std; // m, horizontal 1 sigma
+  float vel_std; // m/s, horizontal 1 sigma
+  float yaw_std; // rad
+} ins_ekf_state_t;
+
+typedef struct
+{
+  ins_ekf_config_t config;
+  bool started;
+
+  /* reference point of p, radians and m, with its metres per radian */
+
+  double ref_lat;
+  double ref_lon;
+  double ref_alt;
+  double m_per_rad_n;
+  double m_per_rad_e;
+
+  /* nominal state */
+
+  float p[3];
+  float v[3];
+  float q[4]; // w x y z, body to NED
+  float ba[3];
+  float bg[3];
+
+  float P[INS_EKF_STATES][INS_EKF_STATES];
+  float tmp[INS_EKF_STATES][INS_EKF_STATES]; // predict scratch
+
+  uint32_t updates; // fixes applied
+  uint32_t rejects; // fixes gated out
+  uint32_t resets; // position/velocity reset after too many rejects
+  int rejects_in_row;
+  float nis; // normalised innovation squared of the last fix
+} ins_ekf_t;
+
+void ins_ekf_default_config(ins_ekf_config_t *config);
+void ins_ekf_init(ins_ekf_t *ekf, const ins_ekf_config_t *config);
+int ins_ekf_start(ins_ekf_t *ekf, const ins_ekf_fix_t *fix,
+                  const IMUData *data, float yaw, float yaw_std);
+void ins_ekf_predict(ins_ekf_t *ekf, const IMUData *data, float dt);
+int ins_ekf_update(ins_ekf_t *ekf, const ins_ekf_fix_t *fix);
+void ins_ekf_get(const ins_ekf_t *ekf, ins_ekf_state_t *state);